@@ -0,0 +1,317 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <numeric>
+#include <pthread.h>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "rlibv2/core/lib.hh"
+#include "rlibv2/core/qps/abs_recv_allocator.hh"
+#include "rlibv2/core/qps/rc_recv_manager.hh"
+#include "rlibv2/core/rmem/handler.hh"
+#include "rlibv2/core/rmem/mem_allocators.hh"
+#include "rlibv2/core/utils/logging.hh"
+#include "rlibv2/core/utils/timer.hh"
+
+/*!
+  Helpers shared by the benchmark binaries (latency summaries, result files,
+  registered memory, a bump allocator for recv buffers and the client QPs of
+  the servers).
+ */
+
+constexpr const char *kResultsDir = "/hdd2/rdma-libs/results/";
+
+inline long now_nsec() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * A framed record on the wire (the copy and sge send paths of client and server):
+ * this header, then len bytes of payload
+ */
+struct __attribute__((packed)) RecordHeader {
+	rdmaio::u32 seq;
+	rdmaio::u32 len;
+};
+
+/**
+ * Percentiles of a set of latency samples (in nanoseconds)
+ */
+struct LatencySummary {
+	long p50 = 0;
+	long p90 = 0;
+	long p99 = 0;
+	long p999 = 0;
+	long max = 0;
+	double avg = 0;
+
+	static LatencySummary from(std::vector<long> samples) {
+		LatencySummary s;
+		if (samples.empty()) {
+			return s;
+		}
+		std::sort(samples.begin(), samples.end());
+		auto at = [&samples](double q) {
+			return samples[std::min(samples.size() - 1, static_cast<size_t>(q * samples.size()))];
+		};
+		s.p50 = at(0.5);
+		s.p90 = at(0.9);
+		s.p99 = at(0.99);
+		s.p999 = at(0.999);
+		s.max = samples.back();
+		s.avg = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+		return s;
+	}
+
+	static std::string header() {
+		return "avg\tp50\tp90\tp99\tp999\tmax";
+	}
+
+	std::string row() const {
+		std::ostringstream os;
+		os << avg << "\t" << p50 << "\t" << p90 << "\t" << p99 << "\t" << p999 << "\t" << max;
+		return os.str();
+	}
+};
+
+/**
+ * Appends one row to a tab separated result file, writing the header first if the file is new
+ */
+inline void appendResultRow(const std::string& filename, const std::string& header, const std::string& row) {
+	bool exists = std::ifstream(filename).good();
+	std::ofstream outputFile(filename, std::ios::app);
+	if (!outputFile.is_open()) {
+		RDMA_LOG(::rdmaio::ERROR) << "Unable to open file: " << filename;
+		return;
+	}
+	if (!exists) {
+		outputFile << header << std::endl;
+	}
+	outputFile << row << std::endl;
+	RDMA_LOG(::rdmaio::INFO) << "Data written to: " << filename;
+}
+
+/**
+ * Pins the calling thread to one core, returns false if the core cannot be used
+ */
+inline bool pin_to_core(int core) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+/**
+ * Resident set size of this process in KiB (VmRSS of /proc/self/status), 0 if unknown
+ */
+inline long vm_rss_kb() {
+	std::ifstream status("/proc/self/status");
+	std::string line;
+	while (std::getline(status, line)) {
+		if (line.rfind("VmRSS:", 0) == 0) {
+			return std::stol(line.substr(6));
+		}
+	}
+	return 0;
+}
+
+/**
+ * The memory options of a --mem_type (malloc, thp, huge2m or huge1g) and --numa_node pair
+ */
+inline rdmaio::rmem::MemOptions mem_options(const std::string &mem_type, int numa_node) {
+	auto type = rdmaio::rmem::MemOptions::parse_type(mem_type);
+	RDMA_ASSERT(type) << "unknown mem type: " << mem_type;
+	return rdmaio::rmem::MemOptions{.type = type.value(), .numa_node = numa_node};
+}
+
+/**
+ * Registers `mem` of type `mem_type`, logging how long ibv_reg_mr took (also returned in reg_msec)
+ */
+inline rdmaio::Arc<rdmaio::rmem::RegHandler> timed_reg(const rdmaio::Arc<rdmaio::rmem::RMem> &mem,
+	rdmaio::Arc<rdmaio::RNic> &nic, const std::string &mem_type, double *reg_msec = nullptr) {
+	RDMA_ASSERT(mem->valid()) << "failed to allocate " << mem->sz << " bytes of " << mem_type << " memory";
+	rdmaio::Timer t;
+	auto handler = rdmaio::rmem::RegHandler::create(mem, nic).value();
+	double msec = t.passed_msec() / 1000;
+	RDMA_LOG(::rdmaio::INFO) << "registered " << mem->sz << " bytes of " << mem_type << " memory in " << msec << " ms";
+	if (reg_msec) {
+		*reg_msec = msec;
+	}
+	return handler;
+}
+
+/**
+ * Bump allocator over one registered RMem, used to carve recv buffers
+ */
+class SimpleAllocator : public rdmaio::qp::AbsRecvAllocator {
+	rdmaio::rmem::RMem::raw_ptr_t buf = nullptr;
+	rdmaio::usize total_mem = 0;
+	rdmaio::rmem::mr_key_t key;
+
+	public:
+	virtual ~SimpleAllocator() = default;
+	SimpleAllocator(const rdmaio::Arc<rdmaio::rmem::RMem>& mem, rdmaio::rmem::mr_key_t key)
+	  : buf(mem->raw_ptr), total_mem(mem->sz), key(key) {}
+
+	rdmaio::Option<std::pair<rdmaio::rmem::RMem::raw_ptr_t, rdmaio::rmem::mr_key_t>> alloc_one(
+	  const rdmaio::usize &sz) override {
+		if (total_mem < sz) {
+			return {};
+		}
+		auto ret = buf;
+		buf = static_cast<char *>(buf) + sz;
+		total_mem -= sz;
+		return std::make_pair(ret, key);
+	}
+
+	rdmaio::Option<std::pair<rdmaio::rmem::RMem::raw_ptr_t, rdmaio::rmem::RegAttr>> alloc_one_for_remote(
+		const rdmaio::usize & /*sz*/) override {
+		return {};
+	}
+};
+
+// replies are sent unsignaled, with one signaled send per batch to drain the send cq
+constexpr rdmaio::u64 kReplySignalBatch = 32;
+
+/**
+ * Deletes the server side QP `name` (created with `key`) when a client exits, so that the
+ * name can be reused by the next run
+ */
+inline void release_remote_qp(rdmaio::ConnectManager &cm, const std::string &name, rdmaio::u64 key) {
+	cm.delete_remote_rc(name, key);
+}
+
+inline void release_remote_qp(const std::string &addr, const std::string &name, rdmaio::u64 key) {
+	rdmaio::ConnectManager cm(addr);
+	release_remote_qp(cm, name, key);
+}
+
+/**
+ * Re-posts the entry consumed by a recv completion of qp: recvs of one QP complete in order,
+ * so it is the next entry of its ring
+ */
+template <rdmaio::usize R>
+inline void repost_consumed(rdmaio::qp::RC &qp, rdmaio::qp::RecvEntries<R> &entries) {
+	auto res = qp.post_recvs(entries, 1);
+	RDMA_ASSERT(res == rdmaio::IOCode::Ok);
+}
+
+/**
+ * The client QPs a server answers, keyed by qp_num so that a completion of a shared recv cq
+ * finds the QP it came from.
+ * Clients connect with cc_rc_msg as <prefix><id> on one channel. The QPs are reported by the
+ * RecvManager's msg_qp_hooks and the RCtrl's qp_delete_hooks (in the RCtrl daemon), and the
+ * poller applies them in find(), so its lookups take no lock.
+ * A client is made by make(id, qp, entries), which returns {} to refuse it (e.g., id is too
+ * large). It should be created before ctrl.start_daemon(), and outlive the RCtrl.
+ */
+template <typename Client, rdmaio::usize R>
+class ClientTable {
+	public:
+	using make_f = std::function<rdmaio::Option<Client>(int, rdmaio::Arc<rdmaio::qp::RC>,
+		rdmaio::Arc<rdmaio::qp::RecvEntries<R>>)>;
+
+	private:
+	const std::string prefix;
+	const std::string channel;
+	make_f make;
+
+	std::unordered_map<rdmaio::u32, Client> clients;
+	std::unordered_map<std::string, rdmaio::u32> qp_nums;
+
+	// QPs joined (qp != nullptr) or left since the last find()
+	struct Event {
+		std::string name;
+		rdmaio::Arc<rdmaio::qp::RC> qp;
+		rdmaio::Arc<rdmaio::qp::RecvEntries<R>> entries;
+	};
+	std::mutex lock;
+	std::vector<Event> events;
+	std::atomic<bool> has_events{false};
+
+	void push(Event e) {
+		std::lock_guard<std::mutex> guard(lock);
+		events.push_back(std::move(e));
+		has_events.store(true, std::memory_order_release);
+	}
+
+	bool is_client(const std::string &name) const {
+		return name.size() > prefix.size() && name.size() - prefix.size() <= 9 &&
+			name.compare(0, prefix.size(), prefix) == 0 &&
+			std::all_of(name.begin() + prefix.size(), name.end(), [](char c) { return c >= '0' && c <= '9'; });
+	}
+
+	void apply_events() {
+		std::vector<Event> evs;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			evs.swap(events);
+			has_events.store(false, std::memory_order_relaxed);
+		}
+		for (auto &e : evs) {
+			auto it = qp_nums.find(e.name);
+			if (it != qp_nums.end()) {
+				clients.erase(it->second);
+				qp_nums.erase(it);
+			}
+			if (e.qp == nullptr) {
+				continue;
+			}
+			auto c = make(std::stoi(e.name.substr(prefix.size())), e.qp, e.entries);
+			if (!c) {
+				RDMA_LOG(::rdmaio::WARNING) << "refuse client " << e.name;
+				continue;
+			}
+			clients.erase(e.qp->qp->qp_num);
+			clients.emplace(e.qp->qp->qp_num, std::move(c.value()));
+			qp_nums[e.name] = e.qp->qp->qp_num;
+		}
+	}
+
+	public:
+	ClientTable(rdmaio::RCtrl &ctrl, rdmaio::qp::RecvManager<R> &manager, const std::string &prefix,
+		const std::string &channel, make_f make)
+		: prefix(prefix), channel(channel), make(std::move(make)) {
+		manager.msg_qp_hooks.push_back([this](const std::string &name, const std::string &ch,
+			rdmaio::Arc<rdmaio::qp::RC> qp, rdmaio::Arc<rdmaio::qp::RecvEntries<R>> entries) {
+			if (ch == this->channel && is_client(name)) {
+				push(Event{name, qp, entries});
+			}
+		});
+		ctrl.qp_delete_hooks.push_back([this](const std::string &name) {
+			if (is_client(name)) {
+				push(Event{name, nullptr, nullptr});
+			}
+		});
+	}
+
+	ClientTable(const ClientTable &) = delete;
+	ClientTable &operator=(const ClientTable &) = delete;
+
+	/**
+	 * The client of qp_num, nullptr if it is unknown
+	 */
+	Client *find(const rdmaio::u32 &qp_num) {
+		if (unlikely(has_events.load(std::memory_order_acquire))) {
+			apply_events();
+		}
+		auto it = clients.find(qp_num);
+		return it == clients.end() ? nullptr : &it->second;
+	}
+
+	rdmaio::usize size() {
+		if (has_events.load(std::memory_order_acquire)) {
+			apply_events();
+		}
+		return clients.size();
+	}
+};
@@ -0,0 +1,111 @@
+#include <gflags/gflags.h>
+#include <cstring>
+
+#include "rlibv2/core/lib.hh"
+#include "rlibv2/core/qps/chunked_writer.hh"
+#include "rlibv2/core/qps/rc_recv_manager.hh"
+#include "rlibv2/core/qps/recv_cursor.hh"
+
+#include "bench_utils.hh"
+
+DEFINE_int64(port, 8888, "Listener (UDP) port of the in-process RCtrl serving the receiver");
+DEFINE_int64(use_nic_idx, 0, "Which NIC to create QP");
+DEFINE_int64(reg_mem_name, 73, "The name to register the receiver's region (and the NIC) at rctrl");
+DEFINE_string(cq_name, "chunk_channel", "The recv channel of the completion WRITE_WITH_IMMs");
+DEFINE_int64(msg_size, 256 * 1024 * 1024, "Size of each transfer, e.g., a snapshot");
+DEFINE_int64(chunk_size, 1024 * 1024, "Size of each WRITE, msg_size sends the transfer as one WR");
+DEFINE_int32(depth, 8, "Chunks in flight");
+DEFINE_int32(msg_count, 20, "Number of transfers");
+
+using namespace rdmaio;
+using namespace rdmaio::rmem;
+using namespace rdmaio::qp;
+using namespace std;
+
+constexpr usize entry_num = 64;
+// the recvs only carry the immediate, the payload lands in the region
+constexpr usize imm_recv_sz = 64;
+
+int main(int argc, char **argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+	RDMA_ASSERT(FLAGS_chunk_size > 0 && FLAGS_chunk_size <= FLAGS_msg_size && FLAGS_chunk_size <= UINT32_MAX)
+		<< "chunk size should be in [1, min(msg_size, 4 GiB)]";
+
+	auto nic =
+	  RNic::create(RNicInfo::query_dev_names().at(FLAGS_use_nic_idx)).value();
+
+	// 1. the receiver (loopback): the region advertised at its RCtrl, and a recv channel for the immediates
+	RCtrl ctrl(FLAGS_port);
+	RecvManager<entry_num> manager(ctrl);
+	RDMA_ASSERT(ctrl.opened_nics.reg(FLAGS_reg_mem_name, nic));
+	auto region_mr = RegHandler::create(Arc<RMem>(new RMem(FLAGS_msg_size)), nic).value();
+	ctrl.registered_mrs.reg(FLAGS_reg_mem_name, region_mr);
+	auto region = reinterpret_cast<char *>(region_mr->get_reg_attr().value().buf);
+
+	auto recv_cq_res = Impl::create_cq(nic, entry_num);
+	RDMA_ASSERT(recv_cq_res == IOCode::Ok);
+	auto recv_mem = Arc<RMem>(new RMem(entry_num * imm_recv_sz));
+	auto recv_mr = RegHandler::create(recv_mem, nic).value();
+	manager.reg_recv_cqs.create_then_reg(FLAGS_cq_name, std::get<0>(recv_cq_res.desc),
+		std::make_shared<SimpleAllocator>(recv_mem, recv_mr->get_reg_attr().value().key));
+	ctrl.start_daemon();
+
+	// 2. the sender, whose send queue holds all the chunks in flight
+	auto qp_config = QPConfig().set_max_send(std::max<int>(FLAGS_depth, kRcMaxSendSz));
+	auto qp = RC::create(nic, qp_config).value();
+	ConnectManager cm("127.0.0.1:" + std::to_string(FLAGS_port));
+	if (cm.wait_ready(1000000, 4) == IOCode::Timeout) {
+		RDMA_LOG(WARNING) << "connect to the local rctrl timeout!";
+	}
+	auto qp_res = cm.cc_rc_msg("chunk_qp", FLAGS_cq_name, imm_recv_sz, qp, FLAGS_reg_mem_name, QPConfig());
+	RDMA_ASSERT(qp_res == IOCode::Ok) << std::get<0>(qp_res.desc);
+	auto fetch_res = cm.fetch_remote_mr(FLAGS_reg_mem_name);
+	RDMA_ASSERT(fetch_res == IOCode::Ok) << std::get<0>(fetch_res.desc);
+	qp->bind_remote_mr(std::get<1>(fetch_res.desc));
+
+	auto local_mr = RegHandler::create(Arc<RMem>(new RMem(FLAGS_msg_size)), nic).value();
+	auto local = reinterpret_cast<char *>(local_mr->get_reg_attr().value().buf);
+	qp->bind_local_mr(local_mr->get_reg_attr().value());
+	for (i64 i = 0; i < FLAGS_msg_size; ++i) {
+		local[i] = static_cast<char>(i * 31 + 7);
+	}
+
+	auto recv_qp = ctrl.registered_qps.wait_for("chunk_qp").value();
+	auto recv_rs = manager.reg_recv_entries.wait_for("chunk_qp").value();
+	RecvCursor<Dummy, entry_num> cursor(recv_qp, recv_rs);
+
+	// 3. each transfer lasts until the receiver sees its immediate, the payload is then in place
+	ChunkedWriter writer(qp, static_cast<u32>(FLAGS_chunk_size), FLAGS_depth);
+	vector<long> latencies;
+	long begin = now_nsec();
+	for (int i = 1; i <= FLAGS_msg_count; ++i) {
+		long start = now_nsec();
+		auto res = writer.write(local, 0, FLAGS_msg_size, i);
+		RDMA_ASSERT(res == IOCode::Ok) << res.desc;
+
+		while (cursor.poll() == 0) {
+		}
+		auto imm_msg = cursor.cur_msg().value();
+		RDMA_ASSERT(std::get<0>(imm_msg) == static_cast<u32>(i)) << "unexpected imm " << std::get<0>(imm_msg);
+		cursor.next();
+		latencies.push_back(now_nsec() - start);
+
+		if (i == 1) {
+			RDMA_ASSERT(memcmp(local, region, FLAGS_msg_size) == 0) << "the region differs from the payload";
+		}
+	}
+	long nsec = now_nsec() - begin;
+
+	// 4. achieved bandwidth by chunk size and depth
+	double gbps = static_cast<double>(FLAGS_msg_size) * FLAGS_msg_count * 8 / nsec;
+	double chunks_per_poll = static_cast<double>(writer.chunks) / writer.polls;
+	auto summary = LatencySummary::from(latencies);
+	RDMA_LOG(INFO) << FLAGS_msg_size << " B in " << FLAGS_chunk_size << " B chunks x" << FLAGS_depth << ": "
+		<< gbps << " Gbit/s, p50 " << summary.p50 << " ns, " << chunks_per_poll << " chunks per poll";
+	appendResultRow(std::string(kResultsDir) + "chunked_write.txt",
+		"msg_size\tchunk_size\tdepth\tgbps\tchunks_per_poll\t" + LatencySummary::header(),
+		std::to_string(FLAGS_msg_size) + "\t" + std::to_string(FLAGS_chunk_size) + "\t" +
+		std::to_string(FLAGS_depth) + "\t" + std::to_string(gbps) + "\t" +
+		std::to_string(chunks_per_poll) + "\t" + summary.row());
+	return 0;
+}
@@ -10,7 +10,7 @@
 #include "rlibv2/c_wrappers/rdmaio_lib_c.h"
 #include "rlibv2/c_wrappers/rdmaio_rc_c.h"
 #include "rlibv2/c_wrappers/rdmaio_rctrl_c.h"
-#include "rlibv2/c_wrappers/rdmaio_recv_iter_c.h"
+#include "rlibv2/c_wrappers/rdmaio_recv_cursor_c.h"
 #include "rlibv2/c_wrappers/rdmaio_regattr_c.h"
 #include "rlibv2/c_wrappers/rdmaio_result_c.h"
 #include "rlibv2/c_wrappers/rdmaio_rc_recv_manager_c.h"
@@ -31,9 +31,27 @@ int FLAGS_ack_buffer_size = 1024;
 int FLAGS_msg_size = 1024;
 int FLAGS_max_msg_size = 4 * 1024 * 1024;
 int FLAGS_msg_count = 1000;
+char* FLAGS_verb = "send";
+long FLAGS_reg_write_mem_name = 74;
 
 // Placeholder for entry_num (assuming it's a constant)
 const int entry_num = 128;
+// with WRITE_WITH_IMM the payload lands in the remote slot, the recv buffer only carries the immediate
+const int write_imm_recv_sz = 64;
+
+bool use_write_verb() {
+	return strcmp(FLAGS_verb, "write") == 0;
+}
+
+/**
+ * Offset of the slot that message number `counter` is written to in the server's write region.
+ * The server computes the same offset to locate the payload.
+ */
+uint64_t write_slot_offset(int counter) {
+	uint64_t slot_sz = (uint64_t)FLAGS_msg_size + 1;
+	uint64_t num_slots = (uint64_t)FLAGS_buffer_size / slot_sz;
+	return ((uint64_t)(counter - 1) % num_slots) * slot_sz;
+}
 
 char* generateRandomString(size_t numBytes) {
 	const char* charset= "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
@@ -104,8 +122,10 @@ void init_send_queue(rdmaio_nic_t* nic, rdmaio_rc_t** qp_out, rdmaio_reg_handler
 	sleep(1);
 
 	rdmaio_qpconfig_t* qp_config_connect = rdmaio_qpconfig_create_default();
+	// the write verb only needs recv buffers large enough for the immediate
+	int recv_sz = use_write_verb() ? write_imm_recv_sz : FLAGS_max_msg_size;
 	rdmaio_iocode_t qp_res = rdmaio_connect_manager_cc_rc_msg(cm, "client_qp", FLAGS_cq_name,
-																   FLAGS_max_msg_size, qp, FLAGS_reg_mem_name, qp_config_connect);
+																   recv_sz, qp, FLAGS_reg_mem_name, qp_config_connect);
 	if (qp_res != RDMAIO_OK) {
 		fprintf(stderr, "Failed to connect RC QP: %d\n", qp_res);
 		rdmaio_connect_manager_destroy(cm);
@@ -115,9 +135,10 @@ void init_send_queue(rdmaio_nic_t* nic, rdmaio_rc_t** qp_out, rdmaio_reg_handler
 		return;
 	}
 
-	// 3. fetch the remote MR for usage
+	// 3. fetch the remote MR for usage (the write region when writing with imm)
 	rdmaio_regattr_t remote_attr;
-	rdmaio_iocode_t fetch_res = rdmaio_connect_manager_fetch_remote_mr(cm, FLAGS_reg_mem_name, &remote_attr);
+	long remote_mr_name = use_write_verb() ? FLAGS_reg_write_mem_name : FLAGS_reg_mem_name;
+	rdmaio_iocode_t fetch_res = rdmaio_connect_manager_fetch_remote_mr(cm, remote_mr_name, &remote_attr);
 	if (fetch_res != RDMAIO_OK) {
 		fprintf(stderr, "Failed to fetch remote MR: %d\n", fetch_res);
 		rdmaio_connect_manager_destroy(cm);
@@ -314,11 +335,10 @@ void init_recv_queue(rdmaio_rctrl_t* ctrl, rdmaio_nic_t* nic, rdmaio_recv_manage
  * @param msg Test data to be written to remote memory
  * @param imm_counter_val Message number
  * @param arr Array to store time taken
- * @param recv_qp Receive RDMA Queue Pair
- * @param recv_rs Received entries
+ * @param recv_cursor Receive cursor of the ack QP
  */
 void publish_messages_and_receive_ack(rdmaio_rc_t* qp, rdmaio_reg_handler_t* local_mr, const char* msg, int imm_counter_val,
-	long *arr, rdmaio_qp_t* recv_qp, recv_entries_handle_t* recv_rs) {
+	long *arr, rdmaio_recv_cursor_t* recv_cursor) {
 	static size_t current_offset = 0;
 	static char *base_buf = NULL;
 	static size_t total_buffer_size = 0;
@@ -349,7 +369,7 @@ void publish_messages_and_receive_ack(rdmaio_rc_t* qp, rdmaio_reg_handler_t* loc
 	clock_gettime(CLOCK_MONOTONIC_RAW, &start);
 
 	rdmaio_reqdesc_t send_desc;
-	send_desc.op = IBV_WR_SEND_WITH_IMM;
+	send_desc.op = use_write_verb() ? IBV_WR_RDMA_WRITE_WITH_IMM : IBV_WR_SEND_WITH_IMM;
 	send_desc.flags = IBV_SEND_SIGNALED;
 	send_desc.len = msg_len_with_null;
 	send_desc.wr_id = 0;
@@ -357,7 +377,7 @@ void publish_messages_and_receive_ack(rdmaio_rc_t* qp, rdmaio_reg_handler_t* loc
 	rdmaio_regattr_t attr = rdmaio_reg_handler_get_attr(local_mr);
 	rdmaio_reqpayload_t send_payload;
 	send_payload.local_addr = (uintptr_t)new_buf;
-	send_payload.remote_addr = 0;
+	send_payload.remote_addr = use_write_verb() ? write_slot_offset(imm_counter_val) : 0;
 	send_payload.imm_data = imm_counter_val;
 
 	char error_msg[256];
@@ -380,27 +400,22 @@ void publish_messages_and_receive_ack(rdmaio_rc_t* qp, rdmaio_reg_handler_t* loc
 
 	bool ack = false;
 	while (!ack) {
-		rdmaio_recv_iter_t* iter = rdmaio_recv_iter_create(recv_qp, recv_rs);
-		if (!iter) {
-			fprintf(stderr, "Error creating recv iterator.\n");
-			break;
-		}
-		while (rdmaio_recv_iter_has_msgs(iter)) {
+		rdmaio_recv_cursor_poll(recv_cursor);
+		while (rdmaio_recv_cursor_has_msgs(recv_cursor)) {
 			ack = true;
 			clock_gettime(CLOCK_MONOTONIC_RAW, &after_ack);
 			uint32_t imm_msg;
 			uintptr_t buf_addr;
-			if (rdmaio_recv_iter_cur_msg(iter, &imm_msg, &buf_addr)) {
+			if (rdmaio_recv_cursor_cur_msg(recv_cursor, &imm_msg, &buf_addr)) {
 				if (imm_msg != imm_counter_val) {
 					fprintf(stderr, "Acknowledgement message count mismatch: sent %d, received %u\n", imm_counter_val, imm_msg);
 				}
 			} else {
-				fprintf(stderr, "Error getting current message from iterator.\n");
+				fprintf(stderr, "Error getting current message from cursor.\n");
 			}
-			rdmaio_recv_iter_next(iter);
+			rdmaio_recv_cursor_next(recv_cursor);
 			break; // Assuming only one ack per message
 		}
-		rdmaio_recv_iter_destroy(iter);
 	}
 
 	long before_wait_nsec = (before_wait.tv_sec - start.tv_sec) * 1000000000LL + (before_wait.tv_nsec - start.tv_nsec);
@@ -446,7 +461,8 @@ void send_reset(rdmaio_rc_t* qp, rdmaio_reg_handler_t* local_mr) {
 void writeResultsToFile(long** times, int num_msgs, int num_bytes) {
 	// Construct the output file name
 	char filename[256]; // Assuming a reasonable maximum filename length
-	snprintf(filename, sizeof(filename), "/hdd2/rdma-libs/results/rdma_send_recv_c_%d.txt", num_bytes);
+	snprintf(filename, sizeof(filename), "/hdd2/rdma-libs/results/rdma_send_recv_c_%s%d.txt",
+		use_write_verb() ? "write_imm_" : "", num_bytes);
 
 	// Open the file for writing
 	FILE* outputFile = fopen(filename, "w");
@@ -513,6 +529,8 @@ void print_usage(const char *program_name) {
 	fprintf(stderr, "  --msg_size <int>      Size of each message to send (default: %d)\n", FLAGS_msg_size);
 	fprintf(stderr, "  --max_msg_size <int>  Maximum message size (default: %d)\n", FLAGS_max_msg_size);
 	fprintf(stderr, "  --msg_count <int>     Number of messages to send (default: %d)\n", FLAGS_msg_count);
+	fprintf(stderr, "  --verb <send|write>   Data path verb: SEND_WITH_IMM or WRITE_WITH_IMM (default: %s)\n", FLAGS_verb);
+	fprintf(stderr, "  --reg_write_mem_name <int> The server MR that receives WRITE_WITH_IMM payloads (default: %ld)\n", FLAGS_reg_write_mem_name);
 	fprintf(stderr, "  --help                Print this usage information\n");
 }
 
@@ -532,11 +550,13 @@ int main(int argc, char **argv) {
 		{"msg_size", required_argument, 0, 's'},
 		{"max_msg_size", required_argument, 0, 'x'},
 		{"msg_count", required_argument, 0, 'o'},
+		{"verb", required_argument, 0, 'v'},
+		{"reg_write_mem_name", required_argument, 0, 'w'},
 		{"help", no_argument, 0, 'h'},
 		{NULL, 0, NULL, 0}
 	};
 
-	while ((option = getopt_long(argc, argv, "a:p:n:m:k:c:d:b:e:s:x:o:h", long_options, &long_index)) != -1) {
+	while ((option = getopt_long(argc, argv, "a:p:n:m:k:c:d:b:e:s:x:o:v:w:h", long_options, &long_index)) != -1) {
 		long temp_long;
 		switch (option) {
 			case 'a':
@@ -600,6 +620,16 @@ int main(int argc, char **argv) {
 				}
 				FLAGS_msg_count = (int)temp_long;
 				break;
+			case 'v':
+				if (strcmp(optarg, "send") != 0 && strcmp(optarg, "write") != 0) {
+					fprintf(stderr, "Error: --verb must be either send or write.\n");
+					return 1;
+				}
+				FLAGS_verb = optarg;
+				break;
+			case 'w':
+				FLAGS_reg_write_mem_name = strtol(optarg, NULL, 10);
+				break;
 			case 'h':
 				print_usage(argv[0]);
 				return 0;
@@ -683,6 +713,12 @@ int main(int argc, char **argv) {
 	recv_entries_handle_t* recv_rs = NULL;
 	init_recv_queue(ctrl, nic, manager, &recv_qp, &recv_rs);
 	printf("rc client ready to receive acknowledgements from the server!\n");
+	// one cursor for the whole run: consumed recvs are re-posted in batches
+	rdmaio_recv_cursor_t* recv_cursor = rdmaio_recv_cursor_create(recv_qp, recv_rs, 0);
+	if (!recv_cursor) {
+		fprintf(stderr, "Error creating recv cursor.\n");
+		return 1;
+	}
 
 	int num_bytes = FLAGS_msg_size;
 	int message_count = 0;
@@ -699,7 +735,7 @@ int main(int argc, char **argv) {
 	/* warm up run here */
 	for (int i = 0, idx = 0; i < warm_up_msgs; ++i, idx = (idx + 1) % saved_msgs_count) {
 		long arr[3]; // we don't care about the returned values in warm up.
-		publish_messages_and_receive_ack(qp, local_mr, saved_msgs[idx], ++message_count, arr, recv_qp, recv_rs);
+		publish_messages_and_receive_ack(qp, local_mr, saved_msgs[idx], ++message_count, arr, recv_cursor);
 		// No allocation or freeing inside the warm-up loop
 	}
 
@@ -714,7 +750,7 @@ int main(int argc, char **argv) {
 		long *arr = (long*)malloc(sizeof(long) * 3);
 		times[i] = arr;
 		char* msg = generateRandomString(num_bytes); // Generate new random string for test
-		publish_messages_and_receive_ack(qp, local_mr, msg, ++message_count, arr, recv_qp, recv_rs);
+		publish_messages_and_receive_ack(qp, local_mr, msg, ++message_count, arr, recv_cursor);
 		free(msg); // Free the allocated string
 	}
 
@@ -734,6 +770,7 @@ int main(int argc, char **argv) {
 		free(saved_msgs[i]);
 	}
 
+	rdmaio_recv_cursor_destroy(recv_cursor);
 	rnic_destroy(nic);
 	recv_manager_destroy(manager);
 	rctrl_destroy(ctrl);
@@ -1,13 +1,20 @@
 #include <gflags/gflags.h>
+#include <sys/resource.h>
 #include "rlibv2/core/lib.hh"
 #include "rlibv2/core/qps/rc_recv_manager.hh"
-#include "rlibv2/core/qps/recv_iter.hh"
+#include "rlibv2/core/qps/recv_cursor.hh"
+#include "rlibv2/core/qps/op.hh"
+#include "rlibv2/core/qps/comp_channel.hh"
+#include "rlibv2/core/qps/size_class_allocator.hh"
+#include "rlibv2/core/rmem/mem_allocators.hh"
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <random>
 #include <chrono>
 
+#include "bench_utils.hh"
+
 DEFINE_string(addr, "192.168.252.211:8888", "Server IP address");
 DEFINE_int64(port, 8888, "Client listener (UDP) port.");
 DEFINE_int64(use_nic_idx, 0, "The nic to connect QP to");
@@ -20,6 +27,17 @@ DEFINE_int32(ack_buffer_size, 1024, "Buffer for ack messages");
 DEFINE_int32(msg_size, 1024, "Size of each message to send");
 DEFINE_int32(max_msg_size, 4*1024*1024, "Maximum memory size");
 DEFINE_int32(msg_count, 1000, "Number of messages to send");
+DEFINE_string(verb, "send", "Data path verb: send (SEND_WITH_IMM into posted recv buffers) or write (WRITE_WITH_IMM into a remote-offset slot)");
+DEFINE_int64(reg_write_mem_name, 74, "The name of the server MR that receives WRITE_WITH_IMM payloads");
+DEFINE_string(wait_mode, "poll", "How to wait for completions: poll (busy polling), event (sleep on a completion channel) or adaptive (spin for spin_usec, then sleep)");
+DEFINE_double(spin_usec, 20, "Spin budget of the adaptive wait mode, in microseconds");
+DEFINE_bool(split_slots, false, "Send messages up to small_slot_size on the main QP and larger ones on a second QP with few big recv slots");
+DEFINE_int32(small_slot_size, 4096, "Recv slot size of the main QP when splitting slots");
+DEFINE_int32(large_recv_entries, 8, "Number of max_msg_size recv slots the server posts for the large-message QP");
+DEFINE_string(send_path, "plain", "How the send verb frames messages: plain (the payload only), copy (a record header and the payload staged into one buffer) or sge (the header from a header pool and the payload in place, as two sges)");
+DEFINE_string(mem_type, "malloc", "Memory backing the large send buffer: malloc, thp (transparent huge pages), huge2m or huge1g (hugetlbfs)");
+DEFINE_int32(numa_node, -1, "NUMA node to bind the send buffer to, -1 for no binding");
+DEFINE_int32(path_mtu, 0, "Path MTU in bytes (256 to 4096) forced on the data QPs, 0 to use the smaller active MTU of the two ports");
 
 using namespace rdmaio;
 using namespace rdmaio::rmem;
@@ -27,35 +45,120 @@ using namespace rdmaio::qp;
 using namespace std;
 
 constexpr usize entry_num = 256;
+// with WRITE_WITH_IMM the payload lands in the remote slot, the recv buffer only carries the immediate
+constexpr usize write_imm_recv_sz = 64;
 
-class SimpleAllocator : public AbsRecvAllocator {
-	RMem::raw_ptr_t buf = nullptr;
-	usize total_mem = 0;
-	mr_key_t key;
+// headers of the sge path are taken round-robin from a small registered pool
+constexpr usize header_pool_sz = 64;
 
-public:
-	virtual ~SimpleAllocator() = default;
-	SimpleAllocator(const Arc<RMem>& mem, mr_key_t key)
-	  : buf(mem->raw_ptr), total_mem(mem->sz), key(key) {
-		RDMA_LOG(4) << "simple allocator use key: " << key;
-	}
+bool use_write_verb() {
+	return FLAGS_verb == "write";
+}
 
-	Option<std::pair<rmem::RMem::raw_ptr_t, rmem::mr_key_t>> alloc_one(
-	  const usize &sz) override {
-		if (total_mem < sz) {
-			return {};
+bool use_framing() {
+	return FLAGS_send_path != "plain";
+}
+
+/**
+ * Bytes on the wire for a payload of `len` bytes
+ */
+usize wire_len(usize len) {
+	return use_framing() ? len + sizeof(RecordHeader) : len;
+}
+
+/**
+ * The registered buffers of the framed send paths
+ */
+struct Framing {
+	Arc<RegHandler> headers_mr;
+	RecordHeader *headers = nullptr;
+	u32 headers_lkey = 0;
+	u32 next_header = 0;
+
+	Arc<RegHandler> staging_mr;
+	char *staging = nullptr;
+
+	void init(Arc<RNic> &nic) {
+		headers_mr = RegHandler::create(Arc<RMem>(new RMem(header_pool_sz * sizeof(RecordHeader))), nic).value();
+		headers = reinterpret_cast<RecordHeader *>(headers_mr->get_reg_attr().value().buf);
+		headers_lkey = headers_mr->get_reg_attr().value().lkey;
+		if (FLAGS_send_path == "copy") {
+			staging_mr = RegHandler::create(Arc<RMem>(new RMem(wire_len(FLAGS_max_msg_size))), nic).value();
+			staging = reinterpret_cast<char *>(staging_mr->get_reg_attr().value().buf);
 		}
-		auto ret = buf;
-		buf = static_cast<char *>(buf) + sz;
-		total_mem -= sz;
-		return std::make_pair(ret, key);
 	}
+};
+
+Framing framing;
 
-	Option<std::pair<rmem::RMem::raw_ptr_t, rmem::RegAttr>> alloc_one_for_remote(
-		const usize &sz) override {
-		return {};
+/**
+ * Applies --path_mtu to the config of a data QP (both the local and the server one)
+ */
+QPConfig with_path_mtu(QPConfig config) {
+	switch (FLAGS_path_mtu) {
+	case 0:
+		break;
+	case 256:
+		config.set_path_mtu(IBV_MTU_256);
+		break;
+	case 512:
+		config.set_path_mtu(IBV_MTU_512);
+		break;
+	case 1024:
+		config.set_path_mtu(IBV_MTU_1024);
+		break;
+	case 2048:
+		config.set_path_mtu(IBV_MTU_2048);
+		break;
+	case 4096:
+		config.set_path_mtu(IBV_MTU_4096);
+		break;
+	default:
+		RDMA_ASSERT(false) << "unsupported path mtu: " << FLAGS_path_mtu;
 	}
-};
+	return config;
+}
+
+/**
+ * The config of the data QPs, the sge path gathers two buffers per send
+ */
+QPConfig data_qp_config() {
+	QPConfig config;
+	if (FLAGS_send_path == "sge") {
+		config.set_max_send_sge(2);
+	}
+	return with_path_mtu(config);
+}
+
+/**
+ * Offset of the slot that message number `counter` is written to in the server's write region.
+ * The server computes the same offset to locate the payload.
+ */
+u64 write_slot_offset(u32 counter) {
+	const u64 slot_sz = FLAGS_msg_size + 1;
+	const u64 num_slots = FLAGS_buffer_size / slot_sz;
+	return ((counter - 1) % num_slots) * slot_sz;
+}
+
+/**
+ * How long an idle recv cq is polled before sleeping on the completion channel
+ */
+double spin_budget_usec() {
+	if (FLAGS_wait_mode == "poll") {
+		return Timer::no_timeout();
+	}
+	return FLAGS_wait_mode == "event" ? 0 : FLAGS_spin_usec;
+}
+
+/**
+ * User plus system CPU time of this process, in seconds
+ */
+double cpu_seconds() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+		(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
 
 std::string generateRandomString(size_t numBytes) {
     const char charset[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
@@ -74,33 +177,43 @@ std::string generateRandomString(size_t numBytes) {
     return result;
 }
 
+// time ibv_reg_mr took for the local send buffer, reported with the results
+double local_reg_msec = 0;
+
 /**
  * Initializes the RDMA setup for use
  * @return pair containing the local QP and the remote memory buffer
  */
 pair<Arc<RC>, Arc<RegHandler>> init_send_queue(Arc<RNic> &nic) {
     // 1. create the local QP to send
-    auto qp = RC::create(nic, QPConfig()).value();
+    auto qp = RC::create(nic, data_qp_config()).value();
 
     ConnectManager cm(FLAGS_addr);
-    if (cm.wait_ready(100000, 4) ==
-        IOCode::Timeout) {  // wait 1 second for server to ready, retry 2 times
+    // the server answers once its channels and MRs are registered, retry for up to 5 seconds
+    if (cm.wait_ready(100000, 50) == IOCode::Timeout) {
             RDMA_LOG(WARNING) << "connect to the " << FLAGS_addr << " timeout!";
 	}
 
-    sleep(1);
     // 2. create the remote QP and connect
-    auto qp_res = cm.cc_rc_msg("client_qp", FLAGS_cq_name,
-    	FLAGS_max_msg_size, qp, FLAGS_reg_mem_name, QPConfig());
+    // (the write verb only needs recv buffers large enough for the immediate,
+    // and with split slots large messages go to their own QP)
+    usize recv_sz = wire_len(FLAGS_max_msg_size);
+    if (use_write_verb()) {
+    	recv_sz = write_imm_recv_sz;
+    } else if (FLAGS_split_slots) {
+    	recv_sz = FLAGS_small_slot_size;
+    }
+    auto qp_res = cm.cc_rc_msg("client_qp", FLAGS_cq_name, recv_sz, qp, FLAGS_reg_mem_name, with_path_mtu(QPConfig()));
     RDMA_ASSERT(qp_res == IOCode::Ok) << std::get<0>(qp_res.desc);
 
-    // 3. fetch the remote MR for usage
-    auto fetch_res = cm.fetch_remote_mr(FLAGS_reg_mem_name);
+    // 3. fetch the remote MR for usage (the write region when writing with imm)
+    auto fetch_res = cm.fetch_remote_mr(use_write_verb() ? FLAGS_reg_write_mem_name : FLAGS_reg_mem_name);
     RDMA_ASSERT(fetch_res == IOCode::Ok) << std::get<0>(fetch_res.desc);
     rmem::RegAttr remote_attr = std::get<1>(fetch_res.desc);
 
     // 4. register a local buffer for sending messages
-    auto local_mr = RegHandler::create(Arc<RMem>(new RMem(FLAGS_buffer_size)), nic).value();
+    auto local_mr = timed_reg(alloc_rmem(FLAGS_buffer_size, mem_options(FLAGS_mem_type, FLAGS_numa_node)), nic,
+        FLAGS_mem_type, &local_reg_msec);
 
 
     qp->bind_remote_mr(remote_attr);
@@ -109,19 +222,42 @@ pair<Arc<RC>, Arc<RegHandler>> init_send_queue(Arc<RNic> &nic) {
 	return make_pair(qp, local_mr);
 }
 
+/**
+ * Creates the QP for messages larger than a small slot. The server posts only
+ * large_recv_entries slots of max_msg_size for it, instead of one per recv entry.
+ * @return the QP, sharing the local and remote MRs of `small_qp`
+ */
+Arc<RC> init_large_send_queue(Arc<RNic> &nic, const Arc<RC> &small_qp) {
+	auto qp = RC::create(nic, data_qp_config()).value();
+
+	ConnectManager cm(FLAGS_addr);
+	auto qp_res = cm.cc_rc_msg("client_qp_large", FLAGS_cq_name + "_large", wire_len(FLAGS_max_msg_size), qp,
+		FLAGS_reg_mem_name, with_path_mtu(QPConfig()), 1000000, FLAGS_large_recv_entries);
+	RDMA_ASSERT(qp_res == IOCode::Ok) << std::get<0>(qp_res.desc);
+
+	qp->bind_remote_mr(small_qp->remote_mr.value());
+	qp->bind_local_mr(small_qp->local_mr.value());
+	return qp;
+}
+
 
-pair<shared_ptr<Dummy>, shared_ptr<RecvEntries<entry_num>>> init_recv_queue(RCtrl &ctrl, Arc<RNic> &nic, RecvManager<entry_num> &manager) {
-	// 1. create receive cq
-	auto recv_cq_res = ::rdmaio::qp::Impl::create_cq(nic, entry_num);
+/**
+ * Registers the ack channel and starts the RCtrl, before connecting to the server,
+ * so the server can connect back as soon as it sees our QP
+ */
+void init_recv_queue(RCtrl &ctrl, Arc<RNic> &nic, RecvManager<entry_num> &manager,
+	const Arc<CompChannel> &channel) {
+	// 1. create receive cq (reporting to the completion channel, if any)
+	auto recv_cq_res = channel ? channel->create_cq(nic, entry_num) : ::rdmaio::qp::Impl::create_cq(nic, entry_num);
 	RDMA_ASSERT(recv_cq_res == IOCode::Ok);
 	auto recv_cq = std::get<0>(recv_cq_res.desc);
 
-	// 2. prepare the message buffer with allocator
-	auto mem =
-	  Arc<RMem>(new RMem(static_cast<const rdmaio::u64>(FLAGS_ack_buffer_size)));
-	auto handler = RegHandler::create(mem, nic).value();
-	auto alloc = std::make_shared<SimpleAllocator>(
-	  mem, handler->get_reg_attr().value().key);
+	// 2. prepare the allocator of the ack slots, acks only carry the immediate so one
+	// small chunk covers all of them
+	auto alloc = SizeClassAllocator::create(nic, SizeClassAllocator::kMinClassSz,
+		SizeClassAllocator::kMinClassSz * entry_num).value();
+	// the server still fetches an MR under this name
+	auto handler = RegHandler::create(Arc<RMem>(new RMem(static_cast<const rdmaio::u64>(FLAGS_ack_buffer_size))), nic).value();
 
 	// 3. register receive cq
 	manager.reg_recv_cqs.create_then_reg(FLAGS_ack_cq_name, recv_cq, alloc);
@@ -129,31 +265,57 @@ pair<shared_ptr<Dummy>, shared_ptr<RecvEntries<entry_num>>> init_recv_queue(RCtr
 	ctrl.registered_mrs.reg(FLAGS_reg_ack_mem_name, handler);
 
 	ctrl.start_daemon();
+}
+
+/**
+ * Waits until the server has connected its ack QP, which wakes up as soon as the
+ * RCtrl registers it
+ */
+pair<shared_ptr<Dummy>, shared_ptr<RecvEntries<entry_num>>> wait_ack_qp(RCtrl &ctrl, RecvManager<entry_num> &manager) {
 	Option<Arc<Dummy>> recv_qp_opt;
+	for (int ctx = 1; !(recv_qp_opt = ctrl.registered_qps.wait_for("server_qp", 1000000)); ++ctx) {
+		RDMA_LOG(INFO) << "Server QP not yet registered. Waiting count " << ctx;
+	}
+
+	// the entries are registered once the QP is connected
 	Option<Arc<RecvEntries<entry_num>>> recv_rs_opt;
-	int ctx = 0;
+	for (int ctx = 1; !(recv_rs_opt = manager.reg_recv_entries.wait_for("server_qp", 1000000)); ++ctx) {
+		RDMA_LOG(INFO) << "Serv Recv entries not yet registered. Waiting count " << ctx;
+	}
 
-	do {
-		recv_qp_opt = ctrl.registered_qps.query("server_qp");
-		if (!recv_qp_opt.has_value()) {
-			RDMA_LOG(INFO) << "Server QP not yet registered. Retrying count " << ++ctx;
-			sleep(1);
-		}
-	} while (!recv_qp_opt.has_value());
-
-	ctx = 0;
-	do {
-		recv_rs_opt = manager.reg_recv_entries.query("server_qp");
-		if (!recv_rs_opt.has_value()) {
-			RDMA_LOG(INFO) << "Serv Recv entries not yet registered. Retrying count " << ++ctx;
-			sleep(1);
-		}
-	} while (!recv_rs_opt.has_value());
+	return make_pair(recv_qp_opt.value(), recv_rs_opt.value());
+}
 
-	auto recv_qp = ctrl.registered_qps.query("server_qp").value();
-	auto recv_rs = manager.reg_recv_entries.query("server_qp").value();
+/**
+ * Sends one framed record of the payload at `payload`, which is inside the QP's local MR (the log).
+ * copy stages the header and the payload into one registered buffer and sends it as one sge;
+ * sge sends a header from the pool and the payload in place, without copying it.
+ */
+Result<std::string> send_framed(const Arc<RC> &qp, char *payload, u32 len, u32 seq) {
+	if (FLAGS_send_path == "copy") {
+		auto header = reinterpret_cast<RecordHeader *>(framing.staging);
+		header->seq = seq;
+		header->len = len;
+		memcpy(framing.staging + sizeof(RecordHeader), payload, len);
+		return qp->send_normal(
+			{.op = IBV_WR_SEND_WITH_IMM,
+			 .flags = IBV_SEND_SIGNALED,
+			 .len = static_cast<u32>(wire_len(len)),
+			 .wr_id = 0},
+			{.local_addr = reinterpret_cast<RMem::raw_ptr_t>(framing.staging),
+			 .remote_addr = 0,
+			 .imm_data = seq},
+			framing.staging_mr->get_reg_attr().value(), qp->remote_mr.value());
+	}
 
-	return make_pair(recv_qp, recv_rs);
+	auto header = framing.headers + (framing.next_header++ % header_pool_sz);
+	header->seq = seq;
+	header->len = len;
+	Op<2> op;
+	op.set_op(IBV_WR_SEND_WITH_IMM).set_imm(seq);
+	op.set_payload(header, sizeof(RecordHeader), framing.headers_lkey, 0);
+	op.set_payload(payload, len, qp->local_mr.value().lkey, 1);
+	return op.execute(qp, IBV_SEND_SIGNALED);
 }
 
 /**
@@ -165,7 +327,7 @@ pair<shared_ptr<Dummy>, shared_ptr<RecvEntries<entry_num>>> init_recv_queue(RCtr
  * @return Time taken to perform the write
  */
 void publish_messages_and_receive_ack(const Arc<RC> &qp, const Arc<RegHandler> &local_mr, const string &msg, u32 imm_counter_val,
-	long *arr, shared_ptr<Dummy> &recv_qp, shared_ptr<RecvEntries<entry_num>> &recv_rs) {
+	long *arr, RecvCursor<Dummy, entry_num> &recv_cursor, AdaptiveWait &recv_waiter) {
 	static size_t current_offset = 0;
 	static char *base_buf = nullptr;
 	static size_t total_buffer_size = 0;
@@ -190,13 +352,13 @@ void publish_messages_and_receive_ack(const Arc<RC> &qp, const Arc<RegHandler> &
 	memcpy(new_buf, msg.data(), msg.size());
 
 	auto start = std::chrono::high_resolution_clock::now();
-	auto res_s = qp->send_normal(
-		{.op = IBV_WR_SEND_WITH_IMM,
+	auto res_s = use_framing() ? send_framed(qp, new_buf, msg.size() + 1, imm_counter_val) : qp->send_normal(
+		{.op = use_write_verb() ? IBV_WR_RDMA_WRITE_WITH_IMM : IBV_WR_SEND_WITH_IMM,
 		 .flags = IBV_SEND_SIGNALED,
 		 .len = (u32) msg.size() + 1,
 		 .wr_id = 0},
 		{.local_addr = reinterpret_cast<RMem::raw_ptr_t>(new_buf),
-		 .remote_addr = 0,
+		 .remote_addr = use_write_verb() ? write_slot_offset(imm_counter_val) : 0,
 		 .imm_data = imm_counter_val});
 
 	RDMA_ASSERT(res_s == IOCode::Ok);
@@ -208,12 +370,17 @@ void publish_messages_and_receive_ack(const Arc<RC> &qp, const Arc<RegHandler> &
 	chrono::time_point<chrono::system_clock, chrono::system_clock::duration> after_ack;
 	// receive acknowledgement from server
 	bool ack = false;
+	recv_waiter.reset();
 	while (!ack) {
+		if (recv_cursor.poll() == 0) {
+			recv_waiter.idle();
+			continue;
+		}
 		// for loop is actually not needed, loop will only run once!
-		for (RecvIter<Dummy, entry_num> iter(recv_qp, recv_rs); iter.has_msgs(); iter.next()) {
+		for (; recv_cursor.has_msgs(); recv_cursor.next()) {
 			ack = true;
 			after_ack = std::chrono::high_resolution_clock::now();
-			auto imm_msg = iter.cur_msg().value();
+			auto imm_msg = recv_cursor.cur_msg().value();
 			u32 num_msg = std::get<0>(imm_msg);
 			u32 *count = &num_msg;
 			RDMA_ASSERT(*count == imm_counter_val);
@@ -262,7 +429,26 @@ void send_reset(const Arc<RC> &qp, const Arc<RegHandler> &local_mr) {
 
 void writeResultsToFile(const std::vector<long*>& times, int msg_size) {
 	// Construct the output file name
-	std::string filename = "/hdd2/rdma-libs/results/rdma_send_recv_" + std::to_string(msg_size) + ".txt";
+	std::string prefix = use_write_verb() ? "rdma_send_recv_write_imm_" : "rdma_send_recv_";
+	if (FLAGS_split_slots) {
+		prefix += "split_";
+	}
+	if (use_framing()) {
+		prefix += FLAGS_send_path + "_";
+	}
+	if (FLAGS_mem_type != "malloc") {
+		prefix += FLAGS_mem_type + "_";
+	}
+	if (FLAGS_numa_node >= 0) {
+		prefix += "numa" + std::to_string(FLAGS_numa_node) + "_";
+	}
+	if (FLAGS_wait_mode != "poll") {
+		prefix += FLAGS_wait_mode + "_";
+	}
+	if (FLAGS_path_mtu != 0) {
+		prefix += "mtu" + std::to_string(FLAGS_path_mtu) + "_";
+	}
+	std::string filename = "/hdd2/rdma-libs/results/" + prefix + std::to_string(msg_size) + ".txt";
 	std::ofstream outputFile(filename);
 
 	// Check if the file was opened successfully
@@ -283,8 +469,47 @@ void writeResultsToFile(const std::vector<long*>& times, int msg_size) {
 	}
 }
 
+/**
+ * Appends the average rtt and the client CPU cost of one run to the wait mode summary
+ */
+void writeWaitSummary(const std::vector<long*>& times, int msg_size, double cpu_per_msg, u64 blocks) {
+	double rtt_sum = 0;
+	for (const long* arr : times) {
+		rtt_sum += arr[2];
+	}
+	std::ostringstream row;
+	row << FLAGS_verb << "\t" << FLAGS_wait_mode << "\t" << spin_budget_usec() << "\t" << msg_size << "\t"
+		<< rtt_sum / times.size() << "\t" << cpu_per_msg << "\t" << blocks;
+	appendResultRow(std::string(kResultsDir) + "rdma_send_recv_wait_modes.txt",
+		"verb\twait mode\tspin usec\tmsg size\tavg rtt\tcpu sec per msg\tsleeps", row.str());
+	RDMA_LOG(INFO) << "wait mode " << FLAGS_wait_mode << ": " << cpu_per_msg << " CPU-seconds/msg";
+}
+
+/**
+ * Appends the registration time of the send buffer and the average rtt of one run to the memory type summary
+ */
+void writeMemSummary(const std::vector<long*>& times, int msg_size) {
+	double rtt_sum = 0;
+	for (const long* arr : times) {
+		rtt_sum += arr[2];
+	}
+	std::ostringstream row;
+	row << FLAGS_verb << "\t" << FLAGS_mem_type << "\t" << FLAGS_numa_node << "\t" << FLAGS_buffer_size << "\t"
+		<< local_reg_msec << "\t" << msg_size << "\t" << rtt_sum / times.size();
+	appendResultRow(std::string(kResultsDir) + "rdma_send_recv_mem_types.txt",
+		"verb\tmem type\tnuma node\tbuffer size\treg msec\tmsg size\tavg rtt", row.str());
+}
+
 int main(int argc, char **argv) {
 	gflags::ParseCommandLineFlags(&argc, &argv, true);
+	RDMA_ASSERT(FLAGS_verb == "send" || FLAGS_verb == "write") << "unknown verb: " << FLAGS_verb;
+	RDMA_ASSERT(FLAGS_wait_mode == "poll" || FLAGS_wait_mode == "event" || FLAGS_wait_mode == "adaptive")
+		<< "unknown wait mode: " << FLAGS_wait_mode;
+	RDMA_ASSERT(MemOptions::parse_type(FLAGS_mem_type)) << "unknown mem type: " << FLAGS_mem_type;
+	RDMA_ASSERT(!FLAGS_split_slots || !use_write_verb()) << "split slots only apply to the send verb";
+	RDMA_ASSERT(FLAGS_send_path == "plain" || FLAGS_send_path == "copy" || FLAGS_send_path == "sge")
+		<< "unknown send path: " << FLAGS_send_path;
+	RDMA_ASSERT(!use_framing() || !use_write_verb()) << "framed send paths only apply to the send verb";
 
 	RCtrl ctrl(FLAGS_port);
 	RecvManager<entry_num> manager(ctrl);
@@ -293,10 +518,32 @@ int main(int argc, char **argv) {
 	RDMA_ASSERT(ctrl.opened_nics.reg(FLAGS_reg_mem_name, nic));
 	RDMA_ASSERT(ctrl.opened_nics.reg(FLAGS_reg_ack_mem_name, nic));
 
+	Arc<CompChannel> channel;
+	if (FLAGS_wait_mode != "poll") {
+		channel = CompChannel::create(nic).value();
+	}
+	init_recv_queue(ctrl, nic, manager, channel);
+
 	auto [qp, local_mr] = init_send_queue(nic);
-	RDMA_LOG(INFO) << "rc client ready to send message to the server!";
+	if (use_framing()) {
+		framing.init(nic);
+	}
+	// messages that do not fit a small slot (with their trailing null) use the large QP,
+	// control messages always use the main one
+	Arc<RC> data_qp = qp;
+	if (FLAGS_split_slots) {
+		auto large_qp = init_large_send_queue(nic, qp);
+		if (wire_len(FLAGS_msg_size + 1) > static_cast<usize>(FLAGS_small_slot_size)) {
+			data_qp = large_qp;
+		}
+	}
+	RDMA_LOG(INFO) << "rc client ready to send message to the server! (port active mtu "
+		<< (nic->active_mtu ? 128 << nic->active_mtu.value() : 0) << ", path mtu flag " << FLAGS_path_mtu << ")";
 
-	auto [recv_qp, recv_rs] = init_recv_queue(ctrl, nic, manager);
+	auto [recv_qp, recv_rs] = wait_ack_qp(ctrl, manager);
+	AdaptiveWait recv_waiter(channel, recv_qp->recv_cq, spin_budget_usec());
+	// one cursor for the whole run: consumed recvs are re-posted in batches
+	RecvCursor<Dummy, entry_num> recv_cursor(recv_qp, recv_rs);
 	RDMA_LOG(INFO) << "rc client ready to receive acknowledgements from the server!";
 
 	int num_bytes = FLAGS_msg_size;
@@ -316,7 +563,7 @@ int main(int argc, char **argv) {
 		long arr[3]; // we don't care about the returned values in warm up.
 
 		string msg = saved_msgs[idx];
-		publish_messages_and_receive_ack(qp, local_mr, msg, ++message_count, arr, recv_qp, recv_rs);
+		publish_messages_and_receive_ack(data_qp, local_mr, msg, ++message_count, arr, recv_cursor, recv_waiter);
 		// ignore these times
 	}
 
@@ -326,17 +573,22 @@ int main(int argc, char **argv) {
 	int num_msgs = FLAGS_msg_count;
 	vector<long *> times(num_msgs);
 	message_count = 0;
+	double cpu_begin = cpu_seconds();
 	RDMA_LOG(INFO) << "Sending " << num_msgs << " messages of size " << num_bytes << " for test.";
 	for (int i = 0, idx = 0; i < num_msgs; ++i, idx = (idx + 1) % saved_msgs_count) {
 		long *arr = new long[3];
 
 		string msg = saved_msgs[idx];
-		publish_messages_and_receive_ack(qp, local_mr, msg, ++message_count, arr, recv_qp, recv_rs);
+		publish_messages_and_receive_ack(data_qp, local_mr, msg, ++message_count, arr, recv_cursor, recv_waiter);
 		times[i] = arr;
 	}
 
+	double cpu_per_msg = (cpu_seconds() - cpu_begin) / num_msgs;
+
 	RDMA_LOG(INFO) << "Number of messages: " << message_count;
 	writeResultsToFile(times, num_bytes);
+	writeWaitSummary(times, num_bytes, cpu_per_msg, recv_waiter.blocks);
+	writeMemSummary(times, num_bytes);
 
 	RDMA_LOG(INFO) << "Sending terminate signal to server";
 	send_termination(qp, local_mr);
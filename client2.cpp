@@ -24,11 +24,9 @@ int main(int argc, char **argv) {
 	auto qp = RC::create(nic, QPConfig()).value();
 
 	ConnectManager cm(FLAGS_addr);
-	if (cm.wait_ready(100000, 4) == IOCode::Timeout) // wait 1 second for server to ready, retry 2 times
+	if (cm.wait_ready(100000, 50) == IOCode::Timeout) // retry for up to 5 seconds until the server is ready
 		RDMA_LOG(4) << "connect to the " << FLAGS_addr << " timeout!";
 
-	sleep(10);
-
 	// 2. create the remote QP and connect
 	auto qp_res = cm.cc_rc_msg("client_qp", FLAGS_cq_name, 4096, qp, FLAGS_use_nic_idx, QPConfig());
 	RDMA_ASSERT(qp_res == IOCode::Ok) << std::get<0>(qp_res.desc);
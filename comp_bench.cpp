@@ -0,0 +1,177 @@
+#include <gflags/gflags.h>
+#include <time.h>
+#include <vector>
+
+#include "rlibv2/core/lib.hh"
+#include "rlibv2/core/qps/comp_dispatcher.hh"
+
+#include "bench_utils.hh"
+
+DEFINE_int64(port, 8888, "Listener (UDP) port of the in-process RCtrl serving the target QP and MR");
+DEFINE_int64(use_nic_idx, 0, "Which NIC to create QP");
+DEFINE_int64(reg_mem_name, 73, "The name to register the target MR (and the NIC) at rctrl");
+DEFINE_string(mode, "batch", "single: poll_rc_comp one wc per call; batch: CompDispatcher");
+DEFINE_string(op, "read", "One-sided op to issue: read or write");
+DEFINE_int32(msg_size, 64, "Size of each op");
+DEFINE_int32(depth, 64, "Signaled ops in flight");
+DEFINE_int64(op_count, 1000000, "Number of ops to complete");
+
+using namespace rdmaio;
+using namespace rdmaio::rmem;
+using namespace rdmaio::qp;
+using namespace std;
+
+const usize kBatch = 64;
+
+long thread_cpu_nsec() {
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/**
+ * The state shared by the in-flight ops: each one reads (writes) its own slot of
+ * msg_size bytes, and is re-posted on the same slot once it completes.
+ */
+struct Window {
+	Arc<RC> qp;
+	char *local;
+	i64 issued = 0;
+	i64 done = 0;
+	i64 polls = 0;
+
+	RC::ReqDesc desc(u64 wr_id) const {
+		return {.op = FLAGS_op == "write" ? IBV_WR_RDMA_WRITE : IBV_WR_RDMA_READ,
+			.flags = IBV_SEND_SIGNALED,
+			.len = static_cast<u32>(FLAGS_msg_size),
+			.wr_id = wr_id};
+	}
+
+	RC::ReqPayload payload(u64 slot) const {
+		return {.local_addr = reinterpret_cast<RMem::raw_ptr_t>(local + slot * FLAGS_msg_size),
+			.remote_addr = slot * FLAGS_msg_size,
+			.imm_data = 0};
+	}
+};
+
+/**
+ * Baseline: one wc per poll, the slot is carried in the user wr_id
+ */
+void run_single(Window &w) {
+	for (u64 s = 0; s < static_cast<u64>(FLAGS_depth); ++s, ++w.issued) {
+		auto res = w.qp->send_normal(w.desc(s), w.payload(s));
+		RDMA_ASSERT(res == IOCode::Ok) << res.desc;
+	}
+	while (w.done < FLAGS_op_count) {
+		w.polls += 1;
+		auto res = w.qp->poll_rc_comp();
+		if (!res) {
+			continue;
+		}
+		auto [slot, wc] = res.value();
+		RDMA_ASSERT(wc.status == IBV_WC_SUCCESS) << Dummy::wc_status(wc);
+		w.done += 1;
+		if (w.issued < FLAGS_op_count) {
+			auto res_s = w.qp->send_normal(w.desc(slot), w.payload(slot));
+			RDMA_ASSERT(res_s == IOCode::Ok) << res_s.desc;
+			w.issued += 1;
+		}
+	}
+}
+
+struct SlotCtx {
+	Window *w;
+	CompDispatcher<kBatch> *d;
+	u64 slot;
+};
+
+void repost(SlotCtx *c);
+
+void on_done(void *ctx, const ibv_wc &wc) {
+	auto c = static_cast<SlotCtx *>(ctx);
+	RDMA_ASSERT(wc.status == IBV_WC_SUCCESS) << Dummy::wc_status(wc);
+	c->w->done += 1;
+	if (c->w->issued < FLAGS_op_count) {
+		repost(c);
+	}
+}
+
+void repost(SlotCtx *c) {
+	auto res = c->d->post(*c->w->qp, c->w->desc(0), c->w->payload(c->slot), on_done, c);
+	RDMA_ASSERT(res == IOCode::Ok) << res.desc;
+	c->w->issued += 1;
+}
+
+/**
+ * Batched: up to kBatch wcs per poll, dispatched to the slots' continuations
+ */
+void run_batch(Window &w) {
+	CompDispatcher<kBatch> d(FLAGS_depth);
+	vector<SlotCtx> ctxs(FLAGS_depth);
+	for (int s = 0; s < FLAGS_depth; ++s) {
+		ctxs[s] = {.w = &w, .d = &d, .slot = static_cast<u64>(s)};
+		repost(&ctxs[s]);
+	}
+	while (w.done < FLAGS_op_count) {
+		w.polls += 1;
+		d.poll(*w.qp);
+	}
+}
+
+int main(int argc, char **argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+	auto nic =
+	  RNic::create(RNicInfo::query_dev_names().at(FLAGS_use_nic_idx)).value();
+	const usize region_sz = static_cast<usize>(FLAGS_depth) * FLAGS_msg_size;
+
+	// 1. the target of the ops, served by an in-process RCtrl (loopback)
+	RCtrl ctrl(FLAGS_port);
+	RDMA_ASSERT(ctrl.opened_nics.reg(FLAGS_reg_mem_name, nic));
+	auto target_mr = RegHandler::create(Arc<RMem>(new RMem(region_sz)), nic).value();
+	ctrl.registered_mrs.reg(FLAGS_reg_mem_name, target_mr);
+	ctrl.start_daemon();
+
+	// the send queue should hold all the ops in flight
+	auto qp_config = QPConfig().set_max_send(std::max<int>(FLAGS_depth, kRcMaxSendSz));
+	auto qp = RC::create(nic, qp_config).value();
+	ConnectManager cm("127.0.0.1:" + std::to_string(FLAGS_port));
+	if (cm.wait_ready(1000000, 4) == IOCode::Timeout) {
+		RDMA_LOG(WARNING) << "connect to the local rctrl timeout!";
+	}
+	auto qp_res = cm.cc_rc("comp_bench_qp", qp, FLAGS_reg_mem_name, qp_config);
+	RDMA_ASSERT(qp_res == IOCode::Ok) << std::get<0>(qp_res.desc);
+	auto fetch_res = cm.fetch_remote_mr(FLAGS_reg_mem_name);
+	RDMA_ASSERT(fetch_res == IOCode::Ok) << std::get<0>(fetch_res.desc);
+	qp->bind_remote_mr(std::get<1>(fetch_res.desc));
+
+	auto local_mr = RegHandler::create(Arc<RMem>(new RMem(region_sz)), nic).value();
+	auto local_attr = local_mr->get_reg_attr().value();
+	qp->bind_local_mr(local_attr);
+
+	// 2. keep depth ops in flight until op_count of them complete
+	Window w = {.qp = qp, .local = reinterpret_cast<char *>(local_attr.buf)};
+	long begin = now_nsec();
+	long cpu_begin = thread_cpu_nsec();
+	if (FLAGS_mode == "single") {
+		run_single(w);
+	} else {
+		run_batch(w);
+	}
+	long cpu_nsec = thread_cpu_nsec() - cpu_begin;
+	long nsec = now_nsec() - begin;
+
+	// 3. the CPU cost of a completion covers polling, dispatching and re-posting
+	double mops = w.done * 1000.0 / nsec;
+	double cpu_per_op = static_cast<double>(cpu_nsec) / w.done;
+	double wcs_per_poll = static_cast<double>(w.done) / w.polls;
+	RDMA_LOG(INFO) << FLAGS_mode << " " << FLAGS_op << " x" << FLAGS_depth << ": " << mops
+		<< " Mops/s, " << cpu_per_op << " CPU ns per op, " << wcs_per_poll << " wcs per poll";
+	appendResultRow(std::string(kResultsDir) + "comp_dispatch.txt",
+		"mode\top\tmsg_size\tdepth\tops\tmops\tcpu_ns_per_op\twcs_per_poll",
+		FLAGS_mode + "\t" + FLAGS_op + "\t" + std::to_string(FLAGS_msg_size) + "\t" +
+		std::to_string(FLAGS_depth) + "\t" + std::to_string(w.done) + "\t" +
+		std::to_string(mops) + "\t" + std::to_string(cpu_per_op) + "\t" +
+		std::to_string(wcs_per_poll));
+	return 0;
+}
@@ -0,0 +1,166 @@
+#include <gflags/gflags.h>
+#include <vector>
+
+#include "rlibv2/core/lib.hh"
+#include "rlibv2/core/coro/scheduler.hh"
+#include "rlibv2/core/qps/size_class_allocator.hh"
+
+#include "bench_utils.hh"
+#include "coro_pingpong.hh"
+
+DEFINE_string(addr, "192.168.252.212:8888", "Coro server address");
+DEFINE_int64(use_nic_idx, 0, "Which NIC to create QP");
+DEFINE_int32(gid_idx, 0, "GID index of the NIC (RoCE v2 GIDs are often 1 or 3)");
+DEFINE_int64(reg_mem_name, 73, "The name of the NIC registered at the server");
+DEFINE_string(cq_name, "coro_channel", "The recv channel the server registered");
+DEFINE_int32(client_id, 0, "Id of the client QP, for running several clients against one server");
+DEFINE_string(mode, "coro", "coro (one coroutine per stream) or loop (a hand-written state machine over the streams)");
+DEFINE_int32(streams, 1, "Ping-pong streams sharing the QP and the polling thread");
+DEFINE_int32(msg_size, 1024, "Size of each message");
+DEFINE_int32(msgs_per_stream, 100000, "Number of measured round trips of each stream");
+DEFINE_int32(warmup, 1000, "Round trips of each stream before the measured ones");
+
+using namespace rdmaio;
+using namespace rdmaio::rmem;
+using namespace rdmaio::qp;
+using namespace rdmaio::coro;
+using namespace std;
+
+constexpr usize ack_recv_sz = 64;
+
+/**
+ * One ping-pong stream: send a message tagged with the stream id, wait for its ack
+ */
+Task<> stream(AsyncQP &qp, AsyncRecv<RC, coro_entry_num> &acks, u32 id, char *buf, vector<long> &latencies) {
+	for (int i = 0; i < FLAGS_warmup + FLAGS_msgs_per_stream; ++i) {
+		long begin = now_nsec();
+		auto res = co_await qp.send(buf, FLAGS_msg_size, id);
+		RDMA_ASSERT(res == IOCode::Ok) << res.desc;
+		auto ack = co_await acks.next(id);
+		RDMA_ASSERT(ack.ok()) << "recv ack error: " << ack.status;
+		if (i >= FLAGS_warmup) {
+			latencies.push_back(now_nsec() - begin);
+		}
+	}
+}
+
+void run_coro(Arc<RC> &qp, Arc<RecvEntries<coro_entry_num>> &entries, char *bufs, vector<long> &latencies) {
+	Scheduler s;
+	AsyncQP aqp(qp, s);
+	AsyncRecv<RC, coro_entry_num> acks(qp, entries, s);
+	for (int i = 0; i < FLAGS_streams; ++i) {
+		s.spawn(stream(aqp, acks, i, bufs + i * FLAGS_msg_size, latencies));
+	}
+	s.run();
+}
+
+/**
+ * The same streams as run_coro, as a hand-written state machine: every ack re-arms the
+ * stream it belongs to
+ */
+void run_loop(Arc<RC> &qp, Arc<RecvEntries<coro_entry_num>> &entries, char *bufs, vector<long> &latencies) {
+	struct StreamState {
+		int round = 0;
+		long begin = 0;
+	};
+	vector<StreamState> states(FLAGS_streams);
+	auto send = [&](u32 id) {
+		states[id].begin = now_nsec();
+		auto res = qp->send_normal(
+			{.op = IBV_WR_SEND_WITH_IMM, .flags = IBV_SEND_SIGNALED, .len = static_cast<u32>(FLAGS_msg_size), .wr_id = 0},
+			{.local_addr = bufs + id * FLAGS_msg_size, .remote_addr = 0, .imm_data = id});
+		RDMA_ASSERT(res == IOCode::Ok) << res.desc;
+	};
+
+	for (int i = 0; i < FLAGS_streams; ++i) {
+		send(i);
+	}
+	RecvCursor<RC, coro_entry_num> cursor(qp, entries);
+	int finished = 0;
+	while (finished < FLAGS_streams) {
+		while (auto comp = qp->poll_rc_comp()) {
+			RDMA_ASSERT(std::get<1>(comp.value()).status == IBV_WC_SUCCESS)
+				<< Dummy::wc_status(std::get<1>(comp.value()));
+		}
+		for (cursor.poll(); cursor.has_msgs(); cursor.next()) {
+			auto &wc = cursor.cur_wc();
+			RDMA_ASSERT(wc.status == IBV_WC_SUCCESS) << Dummy::wc_status(wc);
+			auto &st = states[wc.imm_data];
+			if (st.round >= FLAGS_warmup) {
+				latencies.push_back(now_nsec() - st.begin);
+			}
+			st.round += 1;
+			if (st.round < FLAGS_warmup + FLAGS_msgs_per_stream) {
+				send(wc.imm_data);
+			} else {
+				finished += 1;
+			}
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+	RDMA_ASSERT(FLAGS_mode == "coro" || FLAGS_mode == "loop") << "unknown mode: " << FLAGS_mode;
+	// each stream has one signaled send and one ack in flight
+	RDMA_ASSERT(FLAGS_streams > 0 && FLAGS_streams <= static_cast<int>(coro_entry_num) / 2)
+		<< "streams should be in [1, " << coro_entry_num / 2 << "]";
+
+	auto nic =
+	  RNic::create(RNicInfo::query_dev_names().at(FLAGS_use_nic_idx), FLAGS_gid_idx).value();
+
+	auto recv_cq_res = ::rdmaio::qp::Impl::create_cq(nic, coro_entry_num);
+	RDMA_ASSERT(recv_cq_res == IOCode::Ok);
+	auto qp = RC::create(nic, QPConfig(), std::get<0>(recv_cq_res.desc)).value();
+
+	ConnectManager cm(FLAGS_addr);
+	if (cm.wait_ready(1000000, 4) == IOCode::Timeout) {
+		RDMA_LOG(WARNING) << "connect to the " << FLAGS_addr << " timeout!";
+	}
+	auto name = coro_qp_name(FLAGS_client_id);
+	auto qp_res = cm.cc_rc_msg(name, FLAGS_cq_name, FLAGS_msg_size, qp, FLAGS_reg_mem_name, QPConfig());
+	RDMA_ASSERT(qp_res == IOCode::Ok) << std::get<0>(qp_res.desc);
+
+	// one send buffer per stream
+	auto send_mr = RegHandler::create(Arc<RMem>(new RMem(FLAGS_streams * FLAGS_msg_size)), nic).value();
+	auto send_attr = send_mr->get_reg_attr().value();
+	memset(reinterpret_cast<char *>(send_attr.buf), 'x', FLAGS_streams * FLAGS_msg_size);
+	qp->bind_local_mr(send_attr);
+	qp->bind_remote_mr(send_attr);
+
+	Arc<AbsRecvAllocator> alloc = SizeClassAllocator::create(nic).value();
+	auto entries = RecvEntriesFactoryv2<coro_entry_num>::create(alloc, ack_recv_sz).value();
+	auto res = qp->post_recvs(*entries, coro_entry_num);
+	RDMA_ASSERT(res == IOCode::Ok);
+
+	vector<long> latencies;
+	latencies.reserve(FLAGS_streams * FLAGS_msgs_per_stream);
+	auto bufs = reinterpret_cast<char *>(send_attr.buf);
+	long begin = now_nsec();
+	if (FLAGS_mode == "coro") {
+		run_coro(qp, entries, bufs, latencies);
+	} else {
+		run_loop(qp, entries, bufs, latencies);
+	}
+	long elapsed = now_nsec() - begin;
+
+	// the warmup rounds are part of the elapsed time, so they are counted as well
+	double msgs_per_sec = static_cast<double>(FLAGS_streams) * (FLAGS_warmup + FLAGS_msgs_per_stream) / elapsed * 1e9;
+	auto summary = LatencySummary::from(latencies);
+	RDMA_LOG(INFO) << FLAGS_mode << ", " << FLAGS_streams << " streams, " << FLAGS_msg_size << " B: " << msgs_per_sec
+		<< " msgs/s, p50 " << summary.p50 << " ns, p99 " << summary.p99 << " ns";
+	appendResultRow(std::string(kResultsDir) + "coro_pingpong.txt",
+		"mode\tstreams\tmsg_size\tmsgs_per_sec\t" + LatencySummary::header(),
+		FLAGS_mode + "\t" + std::to_string(FLAGS_streams) + "\t" + std::to_string(FLAGS_msg_size) + "\t" +
+		std::to_string(msgs_per_sec) + "\t" + summary.row());
+
+	// stop the server side coroutine, then release the QP so that the name can be reused
+	auto res_s = qp->send_normal(
+		{.op = IBV_WR_SEND_WITH_IMM, .flags = IBV_SEND_SIGNALED, .len = 0, .wr_id = 0},
+		{.local_addr = bufs, .remote_addr = 0, .imm_data = kCoroStopImm});
+	RDMA_ASSERT(res_s == IOCode::Ok) << res_s.desc;
+	auto res_p = qp->wait_rc_comp();
+	RDMA_ASSERT(res_p == IOCode::Ok);
+	cm.delete_remote_rc(name, std::get<1>(qp_res.desc));
+	return 0;
+}
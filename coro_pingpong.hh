@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+#include "rlibv2/core/common.hh"
+
+/*!
+  Names and constants shared by coro_server and coro_client.
+  A client runs several ping-pong streams over one QP: stream i sends a message
+  with imm_data i and waits for the server's (empty) ack carrying the same imm.
+ */
+
+// sent by a client after its last stream finishes, the server then drops the QP
+constexpr rdmaio::u32 kCoroStopImm = 0xffffffff;
+
+// recv entries of each QP (on both sides), which bounds the streams per QP
+constexpr rdmaio::usize coro_entry_num = 128;
+
+inline std::string coro_qp_name(int client_id) {
+	return "coro_qp_" + std::to_string(client_id);
+}
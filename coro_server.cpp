@@ -0,0 +1,166 @@
+#include <gflags/gflags.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "rlibv2/core/lib.hh"
+#include "rlibv2/core/coro/scheduler.hh"
+#include "rlibv2/core/qps/rc_recv_manager.hh"
+#include "rlibv2/core/qps/size_class_allocator.hh"
+
+#include "bench_utils.hh"
+#include "coro_pingpong.hh"
+
+DEFINE_int64(port, 8888, "Server listener (UDP) port.");
+DEFINE_int64(use_nic_idx, 0, "Which NIC to create QP");
+DEFINE_int32(gid_idx, 0, "GID index of the NIC (RoCE v2 GIDs are often 1 or 3)");
+DEFINE_int64(reg_mem_name, 73, "The name to register the NIC at rctrl");
+DEFINE_string(cq_name, "coro_channel", "The recv channel the clients connect to");
+DEFINE_int64(max_msg_size, 4 * 1024 * 1024, "Largest message a client may send");
+DEFINE_string(mode, "coro", "coro (one coroutine per client QP) or loop (a hand-written polling loop)");
+
+using namespace rdmaio;
+using namespace rdmaio::rmem;
+using namespace rdmaio::qp;
+using namespace rdmaio::coro;
+using namespace std;
+
+// acks are sent unsignaled, with one signaled (and awaited) ack per batch to drain the send cq
+constexpr u64 signal_batch = 32;
+
+struct Conn {
+	Arc<RC> qp;
+	Arc<RecvEntries<coro_entry_num>> entries;
+};
+
+// QPs handed over from the RCtrl daemon
+std::mutex joined_lock;
+vector<Conn> joined;
+
+vector<Conn> take_joined() {
+	vector<Conn> ret;
+	std::lock_guard<std::mutex> guard(joined_lock);
+	ret.swap(joined);
+	return ret;
+}
+
+const RC::ReqDesc ack_desc = {.op = IBV_WR_SEND_WITH_IMM, .flags = 0, .len = 0, .wr_id = 0};
+
+/**
+ * Acks every message of one client QP until the client stops
+ */
+Task<> serve_conn(Scheduler &s, Conn conn, u64 &served) {
+	AsyncQP qp(conn.qp, s);
+	AsyncRecv<RC, coro_entry_num> ch(conn.qp, conn.entries, s);
+	u64 acks = 0;
+	while (true) {
+		auto msg = co_await ch.next();
+		if (!msg.ok() || msg.imm == kCoroStopImm) {
+			break;
+		}
+		acks += 1;
+		if (acks % signal_batch == 0) {
+			auto res = co_await qp.op(ack_desc, {.local_addr = nullptr, .remote_addr = 0, .imm_data = msg.imm});
+			RDMA_ASSERT(res == IOCode::Ok) << res.desc;
+		} else {
+			auto res = qp.post(ack_desc, {.local_addr = nullptr, .remote_addr = 0, .imm_data = msg.imm});
+			RDMA_ASSERT(res == IOCode::Ok) << res.desc;
+		}
+		served += 1;
+	}
+}
+
+struct LoopConn {
+	Conn conn;
+	unique_ptr<RecvCursor<RC, coro_entry_num>> cursor;
+	u64 acks = 0;
+};
+
+/**
+ * The same server as serve_conn, written as a polling loop over all the client QPs
+ * \ret false once the client stops
+ */
+bool poll_conn(LoopConn &c, u64 &served) {
+	for (c.cursor->poll(); c.cursor->has_msgs(); c.cursor->next()) {
+		auto &wc = c.cursor->cur_wc();
+		if (wc.status != IBV_WC_SUCCESS || wc.imm_data == kCoroStopImm) {
+			return false;
+		}
+		c.acks += 1;
+		bool signaled = c.acks % signal_batch == 0;
+		auto desc = ack_desc;
+		desc.flags = signaled ? IBV_SEND_SIGNALED : 0;
+		auto res = c.conn.qp->send_normal(desc, {.local_addr = nullptr, .remote_addr = 0, .imm_data = wc.imm_data});
+		RDMA_ASSERT(res == IOCode::Ok) << res.desc;
+		if (signaled) {
+			auto res_p = c.conn.qp->wait_rc_comp();
+			RDMA_ASSERT(res_p == IOCode::Ok);
+		}
+		served += 1;
+	}
+	return true;
+}
+
+int main(int argc, char **argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+	RDMA_ASSERT(FLAGS_mode == "coro" || FLAGS_mode == "loop") << "unknown mode: " << FLAGS_mode;
+
+	RCtrl ctrl(FLAGS_port);
+	RecvManager<coro_entry_num> manager(ctrl);
+	auto nic =
+	  RNic::create(RNicInfo::query_dev_names().at(FLAGS_use_nic_idx), FLAGS_gid_idx).value();
+	RDMA_ASSERT(ctrl.opened_nics.reg(FLAGS_reg_mem_name, nic));
+
+	// the channel has no shared cq: each client QP gets a recv cq of its own, since serve_conn
+	// and poll_conn poll the recv cq of one QP
+	auto alloc = SizeClassAllocator::create(nic, FLAGS_max_msg_size).value();
+	manager.reg_recv_cqs.create_then_reg(FLAGS_cq_name, static_cast<ibv_cq *>(nullptr), alloc);
+
+	// the acks carry no payload, so every QP sends from this one MR
+	auto ack_mr = RegHandler::create(Arc<RMem>(new RMem(64)), nic).value();
+	auto ack_attr = ack_mr->get_reg_attr().value();
+	manager.msg_qp_hooks.push_back(
+		[ack_attr](const string &, const string &, Arc<RC> qp, Arc<RecvEntries<coro_entry_num>> entries) {
+			qp->bind_local_mr(ack_attr);
+			qp->bind_remote_mr(ack_attr);
+			std::lock_guard<std::mutex> guard(joined_lock);
+			joined.push_back({qp, entries});
+		});
+	ctrl.start_daemon();
+	RDMA_LOG(INFO) << "coro server ready (" << FLAGS_mode << " mode)";
+
+	u64 served = 0, last = 0;
+	Timer report_timer;
+	Scheduler s;
+	vector<LoopConn> loop_conns;
+	while (true) {
+		for (auto &c : take_joined()) {
+			if (FLAGS_mode == "coro") {
+				s.spawn(serve_conn(s, c, served));
+			} else {
+				auto cursor = make_unique<RecvCursor<RC, coro_entry_num>>(c.qp, c.entries);
+				loop_conns.push_back({c, std::move(cursor)});
+			}
+		}
+
+		if (FLAGS_mode == "coro") {
+			s.poll();
+		} else {
+			for (usize i = 0; i < loop_conns.size();) {
+				if (poll_conn(loop_conns[i], served)) {
+					i += 1;
+				} else {
+					loop_conns.erase(loop_conns.begin() + i);
+				}
+			}
+		}
+
+		if (report_timer.passed_sec() >= 1) {
+			usize conns = FLAGS_mode == "coro" ? s.num_running() : loop_conns.size();
+			RDMA_LOG(INFO) << served - last << " msgs/s from " << conns << " QPs";
+			last = served;
+			report_timer.reset();
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,344 @@
+#include <gflags/gflags.h>
+#include <functional>
+#include <vector>
+
+#include "rlibv2/core/async_cm.hh"
+#include "rlibv2/core/lib.hh"
+#include "rlibv2/core/qps/rc_recv_manager.hh"
+#include "rlibv2/core/qps/size_class_allocator.hh"
+#include "rlibv2/core/rmem/mem_allocators.hh"
+
+#include "bench_utils.hh"
+
+DEFINE_int64(port, 8888, "Listener (UDP) port of the in-process RCtrl used for the handshakes");
+DEFINE_int64(use_nic_idx, 0, "Which NIC to benchmark");
+DEFINE_int32(gid_idx, 0, "GID index of the NIC (soft-RoCE usually needs the RoCE v2 GID, e.g., 1)");
+DEFINE_int64(reg_mem_name, 73, "The name to register the NIC at rctrl");
+DEFINE_int32(iters, 100, "Number of measured iterations of each operation");
+DEFINE_int64(max_reg_size, 1024 * 1024 * 1024, "Largest region registered (sizes go up by 4x from 4 KiB)");
+DEFINE_int32(reg_iters, 10, "Iterations for regions of 64 MiB or more, which take long to register");
+DEFINE_string(mem_types, "malloc,thp,huge2m,huge1g", "Comma separated page types to register, types without memory are skipped");
+DEFINE_string(ops, "nic,reg,rc,handshake,bulk,multi,pool", "Comma separated operations to measure");
+DEFINE_string(bulk_sizes, "1,8,64", "Comma separated numbers of QPs set up at once by the bulk op");
+DEFINE_int32(servers, 4, "Number of in-process RCtrls (on the ports after port) the multi op connects to");
+DEFINE_int32(pool_size, 16, "QPs kept pre-created by the RCtrl of the pool op");
+
+using namespace rdmaio;
+using namespace rdmaio::rmem;
+using namespace rdmaio::qp;
+using namespace std;
+
+constexpr usize entry_num = 128;
+constexpr const char *kChannel = "ctrl_channel";
+
+vector<string> split(const string &s) {
+	vector<string> ret;
+	std::stringstream ss(s);
+	for (string item; std::getline(ss, item, ',');) {
+		ret.push_back(item);
+	}
+	return ret;
+}
+
+bool enabled(const string &op) {
+	auto ops = split(FLAGS_ops);
+	return std::find(ops.begin(), ops.end(), op) != ops.end();
+}
+
+void report(const string &op, const string &param, const vector<long> &latencies) {
+	auto summary = LatencySummary::from(latencies);
+	RDMA_LOG(INFO) << op << " " << param << ": avg " << summary.avg / 1000 << " us, p50 " << summary.p50 / 1000
+		<< " us, p99 " << summary.p99 / 1000 << " us";
+	appendResultRow(std::string(kResultsDir) + "ctrl_bench.txt", "op\tparam\titers\t" + LatencySummary::header(),
+		op + "\t" + param + "\t" + std::to_string(latencies.size()) + "\t" + summary.row());
+}
+
+/**
+ * Opening a device: context, PD and port queries
+ */
+void bench_nic_create(const DevIdx &dev) {
+	vector<long> latencies;
+	for (int i = 0; i < FLAGS_iters; ++i) {
+		long begin = now_nsec();
+		auto nic = RNic::create(dev, FLAGS_gid_idx);
+		latencies.push_back(now_nsec() - begin);
+		RDMA_ASSERT(nic) << "failed to open the nic";
+	}
+	report("nic_create", "-", latencies);
+}
+
+/**
+ * ibv_reg_mr and ibv_dereg_mr against region size and page type. The memory is touched
+ * beforehand, so page faults are not counted as registration time.
+ */
+void bench_reg(Arc<RNic> &nic) {
+	for (auto &name : split(FLAGS_mem_types)) {
+		auto type = MemOptions::parse_type(name);
+		RDMA_ASSERT(type) << "unknown mem type: " << name;
+		MemOptions opts{.type = type.value()};
+
+		for (u64 sz = 4096; sz <= static_cast<u64>(FLAGS_max_reg_size); sz *= 4) {
+			if (sz < opts.page_sz()) {
+				continue;
+			}
+			auto mem = alloc_rmem(sz, opts);
+			if (!mem->valid()) {
+				RDMA_LOG(WARNING) << "no " << name << " memory for " << sz << " bytes, skipped";
+				break;
+			}
+			memset(mem->raw_ptr, 0, mem->sz);
+
+			int iters = sz >= 64 * 1024 * 1024 ? FLAGS_reg_iters : FLAGS_iters;
+			vector<long> reg, dereg;
+			for (int i = 0; i < iters; ++i) {
+				long begin = now_nsec();
+				auto mr = RegHandler::create(mem, nic);
+				reg.push_back(now_nsec() - begin);
+				RDMA_ASSERT(mr) << "failed to register " << sz << " bytes";
+
+				begin = now_nsec();
+				mr = {};
+				dereg.push_back(now_nsec() - begin);
+			}
+			report("reg_mr", name + "/" + std::to_string(sz), reg);
+			report("dereg_mr", name + "/" + std::to_string(sz), dereg);
+		}
+	}
+}
+
+/**
+ * Creating two RC QPs and connecting them to each other, without any network round trip
+ */
+void bench_rc_create_connect(Arc<RNic> &nic) {
+	vector<long> create, connect;
+	for (int i = 0; i < FLAGS_iters; ++i) {
+		long begin = now_nsec();
+		auto a = RC::create(nic, QPConfig()).value();
+		auto b = RC::create(nic, QPConfig()).value();
+		create.push_back((now_nsec() - begin) / 2);
+
+		begin = now_nsec();
+		auto res_a = a->connect(b->my_attr());
+		auto res_b = b->connect(a->my_attr());
+		connect.push_back((now_nsec() - begin) / 2);
+		RDMA_ASSERT(res_a == IOCode::Ok && res_b == IOCode::Ok) << res_a.desc << " " << res_b.desc;
+	}
+	report("rc_create", "-", create);
+	report("rc_connect", "-", connect);
+}
+
+/**
+ * Full handshakes with an RCtrl (here over loopback UDP): creating the local QP,
+ * cc_rc / cc_rc_msg and, for reuse of the names, delete_remote_rc.
+ * before_iter runs (untimed) before each iteration, e.g., to let a QP pool refill.
+ */
+void bench_handshake(Arc<RNic> &nic, i64 port, const string &variant = "",
+	const std::function<void()> &before_iter = [] {}) {
+	ConnectManager cm("127.0.0.1:" + std::to_string(port));
+	if (cm.wait_ready(1000000, 4) == IOCode::Timeout) {
+		RDMA_LOG(WARNING) << "connect to the local rctrl timeout!";
+	}
+
+	vector<long> cc_rc, cc_rc_msg, del;
+	for (int i = 0; i < FLAGS_iters; ++i) {
+		before_iter();
+		auto name = "ctrl_qp_" + std::to_string(i);
+
+		long begin = now_nsec();
+		auto qp = RC::create(nic, QPConfig()).value();
+		auto res = cm.cc_rc(name, qp, FLAGS_reg_mem_name, QPConfig());
+		cc_rc.push_back(now_nsec() - begin);
+		RDMA_ASSERT(res == IOCode::Ok) << std::get<0>(res.desc);
+
+		begin = now_nsec();
+		auto del_res = cm.delete_remote_rc(name, std::get<1>(res.desc));
+		del.push_back(now_nsec() - begin);
+		RDMA_ASSERT(del_res == IOCode::Ok) << del_res.desc;
+
+		begin = now_nsec();
+		auto msg_qp = RC::create(nic, QPConfig()).value();
+		res = cm.cc_rc_msg(name, kChannel, 64, msg_qp, FLAGS_reg_mem_name, QPConfig());
+		cc_rc_msg.push_back(now_nsec() - begin);
+		RDMA_ASSERT(res == IOCode::Ok) << std::get<0>(res.desc);
+		cm.delete_remote_rc(name, std::get<1>(res.desc));
+	}
+	report("cc_rc" + variant, "-", cc_rc);
+	report("cc_rc_msg" + variant, std::to_string(entry_num) + " recvs", cc_rc_msg);
+	report("delete_remote_rc" + variant, "-", del);
+}
+
+void delete_remote_qps(ConnectManager &cm, const string &prefix, const vector<u64> &keys) {
+	for (usize j = 0; j < keys.size(); ++j) {
+		auto res = cm.delete_remote_rc(prefix + std::to_string(j), keys[j]);
+		RDMA_ASSERT(res == IOCode::Ok) << res.desc;
+	}
+}
+
+/**
+ * Setting up n QPs at once (e.g., to stripe over QPs, or one per thread): one cc_rc_msg
+ * round trip per QP, against cc_rc_msg_bulk (one round trip per proto::kMaxBulkRC QPs).
+ * The local QPs are created beforehand, so only the handshakes are timed.
+ */
+void bench_bulk_handshake(Arc<RNic> &nic) {
+	ConnectManager cm("127.0.0.1:" + std::to_string(FLAGS_port));
+	if (cm.wait_ready(1000000, 4) == IOCode::Timeout) {
+		RDMA_LOG(WARNING) << "connect to the local rctrl timeout!";
+	}
+	const string prefix = "bulk_qp_";
+
+	for (auto &size : split(FLAGS_bulk_sizes)) {
+		usize n = std::stoul(size);
+		vector<long> per_qp, bulk;
+		for (int i = 0; i < FLAGS_iters; ++i) {
+			vector<Arc<RC>> qps;
+			for (usize j = 0; j < n; ++j) {
+				qps.push_back(RC::create(nic, QPConfig()).value());
+			}
+			vector<u64> keys;
+			long begin = now_nsec();
+			for (usize j = 0; j < n; ++j) {
+				auto res = cm.cc_rc_msg(prefix + std::to_string(j), kChannel, 64, qps[j], FLAGS_reg_mem_name, QPConfig());
+				RDMA_ASSERT(res == IOCode::Ok) << std::get<0>(res.desc);
+				keys.push_back(std::get<1>(res.desc));
+			}
+			per_qp.push_back(now_nsec() - begin);
+			delete_remote_qps(cm, prefix, keys);
+
+			// a connected QP cannot be connected again, so the bulk path gets new ones
+			qps.clear();
+			for (usize j = 0; j < n; ++j) {
+				qps.push_back(RC::create(nic, QPConfig()).value());
+			}
+			begin = now_nsec();
+			auto res = cm.cc_rc_msg_bulk(prefix, kChannel, 64, qps, FLAGS_reg_mem_name, QPConfig());
+			bulk.push_back(now_nsec() - begin);
+			RDMA_ASSERT(res == IOCode::Ok) << std::get<0>(res.desc);
+			delete_remote_qps(cm, prefix, std::get<1>(res.desc));
+		}
+		report("cc_rc_msg_per_qp", std::to_string(n) + " qps", per_qp);
+		report("cc_rc_msg_bulk", std::to_string(n) + " qps", bulk);
+	}
+}
+
+/**
+ * Connecting to several servers (e.g., the replicas, at startup): wait_ready and cc_rc with
+ * each server in turn with ConnectManager, against all of them in flight with AsyncConnectManager.
+ * The servers are in-process RCtrls over loopback, so this is a lower bound of the gain.
+ */
+void bench_multi_server(Arc<RNic> &nic, vector<string> &addrs) {
+	vector<long> serial, async;
+	for (int i = 0; i < FLAGS_iters; ++i) {
+		auto name = "multi_qp_" + std::to_string(i);
+		vector<Arc<RC>> qps;
+		for (usize j = 0; j < addrs.size(); ++j) {
+			qps.push_back(RC::create(nic, QPConfig()).value());
+		}
+		vector<u64> keys(addrs.size());
+		long begin = now_nsec();
+		for (usize j = 0; j < addrs.size(); ++j) {
+			ConnectManager cm(addrs[j]);
+			RDMA_ASSERT(cm.wait_ready(1000000, 4) == IOCode::Ok);
+			auto res = cm.cc_rc(name, qps[j], FLAGS_reg_mem_name, QPConfig());
+			RDMA_ASSERT(res == IOCode::Ok) << std::get<0>(res.desc);
+			keys[j] = std::get<1>(res.desc);
+		}
+		serial.push_back(now_nsec() - begin);
+		for (usize j = 0; j < addrs.size(); ++j) {
+			ConnectManager(addrs[j]).delete_remote_rc(name, keys[j]);
+		}
+
+		qps.clear();
+		for (usize j = 0; j < addrs.size(); ++j) {
+			qps.push_back(RC::create(nic, QPConfig()).value());
+		}
+		begin = now_nsec();
+		AsyncConnectManager acm;
+		for (usize j = 0; j < addrs.size(); ++j) {
+			auto peer = acm.add_peer(addrs[j]).value();
+			acm.wait_ready(peer, [&, peer](const Result<std::string> &ready) {
+				RDMA_ASSERT(ready == IOCode::Ok) << ready.desc;
+				acm.cc_rc(peer, name, qps[peer], FLAGS_reg_mem_name, QPConfig(),
+					[&, peer](const Result<AsyncConnectManager::cc_rc_ret_t> &res) {
+						RDMA_ASSERT(res == IOCode::Ok) << std::get<0>(res.desc);
+						keys[peer] = std::get<1>(res.desc);
+					});
+			});
+		}
+		RDMA_ASSERT(acm.run() == IOCode::Ok);
+		async.push_back(now_nsec() - begin);
+		for (usize j = 0; j < addrs.size(); ++j) {
+			ConnectManager(addrs[j]).delete_remote_rc(name, keys[j]);
+		}
+	}
+	report("connect_serial", std::to_string(addrs.size()) + " servers", serial);
+	report("connect_async", std::to_string(addrs.size()) + " servers", async);
+}
+
+int main(int argc, char **argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+	auto dev = RNicInfo::query_dev_names().at(FLAGS_use_nic_idx);
+	auto nic = RNic::create(dev, FLAGS_gid_idx).value();
+
+	if (enabled("nic")) {
+		bench_nic_create(dev);
+	}
+	if (enabled("reg")) {
+		bench_reg(nic);
+	}
+	if (enabled("rc")) {
+		bench_rc_create_connect(nic);
+	}
+	if (enabled("handshake") || enabled("bulk")) {
+		RCtrl ctrl(FLAGS_port);
+		RecvManager<entry_num> manager(ctrl);
+		RDMA_ASSERT(ctrl.opened_nics.reg(FLAGS_reg_mem_name, nic));
+		auto alloc = SizeClassAllocator::create(nic, SizeClassAllocator::kMinClassSz).value();
+		auto recv_cq_res = ::rdmaio::qp::Impl::create_cq(nic, entry_num);
+		RDMA_ASSERT(recv_cq_res == IOCode::Ok);
+		manager.reg_recv_cqs.create_then_reg(kChannel, std::get<0>(recv_cq_res.desc), alloc);
+		ctrl.start_daemon();
+
+		if (enabled("handshake")) {
+			bench_handshake(nic, FLAGS_port);
+		}
+		if (enabled("bulk")) {
+			bench_bulk_handshake(nic);
+		}
+	}
+	if (enabled("multi")) {
+		vector<unique_ptr<RCtrl>> ctrls;
+		vector<string> addrs;
+		for (int i = 0; i < FLAGS_servers; ++i) {
+			auto port = FLAGS_port + 1 + i;
+			ctrls.emplace_back(new RCtrl(port));
+			RDMA_ASSERT(ctrls.back()->opened_nics.reg(FLAGS_reg_mem_name, nic));
+			ctrls.back()->start_daemon();
+			addrs.push_back("127.0.0.1:" + std::to_string(port));
+		}
+		bench_multi_server(nic, addrs);
+	}
+	if (enabled("pool")) {
+		// the same handshakes as the handshake op, against an RCtrl (on a port of its own) keeping
+		// QPs pre-created; the pools refill between iterations, so each handshake takes a warm QP
+		auto port = FLAGS_port + FLAGS_servers + 1;
+		RCtrl ctrl(port);
+		RecvManager<entry_num> manager(ctrl);
+		RDMA_ASSERT(ctrl.opened_nics.reg(FLAGS_reg_mem_name, nic));
+		auto alloc = SizeClassAllocator::create(nic, SizeClassAllocator::kMinClassSz).value();
+		auto recv_cq_res = ::rdmaio::qp::Impl::create_cq(nic, entry_num);
+		RDMA_ASSERT(recv_cq_res == IOCode::Ok);
+		manager.reg_recv_cqs.create_then_reg(kChannel, std::get<0>(recv_cq_res.desc), alloc);
+		auto rc_pool = ctrl.warm_rc_pool(FLAGS_reg_mem_name, QPConfig(), FLAGS_pool_size).value();
+		auto msg_pool = manager.warm_msg_pool(kChannel, FLAGS_reg_mem_name, QPConfig(), 64, FLAGS_pool_size).value();
+		ctrl.start_daemon();
+
+		bench_handshake(nic, port, "_pooled", [&] {
+			rc_pool->wait_full();
+			msg_pool->wait_full();
+		});
+		RDMA_LOG(INFO) << "pool hits: rc " << rc_pool->hits() << "/" << rc_pool->hits() + rc_pool->misses()
+			<< ", msg " << msg_pool->hits() << "/" << msg_pool->hits() + msg_pool->misses();
+	}
+	return 0;
+}
@@ -0,0 +1,129 @@
+#include <gflags/gflags.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "rlibv2/core/lib.hh"
+
+#include "bench_utils.hh"
+
+DEFINE_int64(port, 8888, "Listener (UDP) port of the in-process RCtrl");
+DEFINE_int64(use_nic_idx, 0, "Which NIC to create QP");
+DEFINE_int64(reg_nic_name, 73, "The name to register the NIC at rctrl");
+DEFINE_int32(workers, 1, "Daemon threads of the RCtrl");
+DEFINE_int32(clients, 200, "Clients connecting at once, one thread each");
+DEFINE_int32(qps_per_client, 4, "RC QPs each client creates");
+DEFINE_int32(max_retries, 8, "Attempts of a timed out create before counting it as failed");
+DEFINE_int64(timeout_usec, 1000000, "Reply timeout of one create");
+
+using namespace rdmaio;
+using namespace rdmaio::qp;
+using namespace std;
+
+/**
+ * The QPs created by one client, so they are deleted after the measurement
+ */
+struct ClientResult {
+	vector<pair<string, u64>> created;
+	vector<long> latencies;
+	u64 retries = 0;
+	u64 failed = 0;
+};
+
+/**
+ * One producer re-connecting after a failover: once the storm starts, it creates
+ * its QPs back to back, retrying the ones whose reply is lost.
+ */
+void client_main(int id, Arc<RNic> nic, atomic<int> &ready, atomic<bool> &go, ClientResult &res) {
+	ConnectManager cm("127.0.0.1:" + std::to_string(FLAGS_port));
+	// the local QPs are created before the storm, only the control plane is measured
+	vector<Arc<RC>> qps;
+	for (int i = 0; i < FLAGS_qps_per_client; ++i) {
+		qps.push_back(RC::create(nic, QPConfig()).value());
+	}
+	ready.fetch_add(1);
+	while (!go.load()) {
+	}
+
+	for (int i = 0; i < FLAGS_qps_per_client; ++i) {
+		long begin = now_nsec();
+		for (int attempt = 0; attempt < FLAGS_max_retries; ++attempt) {
+			// a lost reply may still have created the QP, so a retry uses a new name
+			string name = "storm_" + std::to_string(id) + "_" + std::to_string(i) + "_" + std::to_string(attempt);
+			auto qp_res = cm.cc_rc(name, qps[i], FLAGS_reg_nic_name, QPConfig(), FLAGS_timeout_usec);
+			if (qp_res == IOCode::Ok) {
+				res.created.push_back({name, std::get<1>(qp_res.desc)});
+				res.latencies.push_back(now_nsec() - begin);
+				break;
+			}
+			res.retries += 1;
+			if (attempt + 1 == FLAGS_max_retries) {
+				RDMA_LOG(WARNING) << "client " << id << " failed to create " << name << ": "
+					<< std::get<0>(qp_res.desc);
+				res.failed += 1;
+			}
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+	auto nic =
+	  RNic::create(RNicInfo::query_dev_names().at(FLAGS_use_nic_idx)).value();
+
+	RCtrl ctrl(FLAGS_port, "localhost", FLAGS_workers);
+	RDMA_ASSERT(ctrl.opened_nics.reg(FLAGS_reg_nic_name, nic));
+	ctrl.start_daemon();
+
+	// 1. all the clients get ready, then start at once
+	atomic<int> ready(0);
+	atomic<bool> go(false);
+	vector<ClientResult> results(FLAGS_clients);
+	vector<thread> threads;
+	for (int i = 0; i < FLAGS_clients; ++i) {
+		threads.emplace_back(client_main, i, nic, std::ref(ready), std::ref(go), std::ref(results[i]));
+	}
+	while (ready.load() < FLAGS_clients) {
+		std::this_thread::yield();
+	}
+
+	long begin = now_nsec();
+	go.store(true);
+	for (auto &t : threads) {
+		t.join();
+	}
+	long nsec = now_nsec() - begin;
+
+	// 2. QPs established per second over the whole storm, and the per-QP latency
+	vector<long> latencies;
+	u64 created = 0, retries = 0, failed = 0;
+	for (auto &r : results) {
+		latencies.insert(latencies.end(), r.latencies.begin(), r.latencies.end());
+		created += r.created.size();
+		retries += r.retries;
+		failed += r.failed;
+	}
+	double qps_per_sec = created * 1e9 / nsec;
+	auto summary = LatencySummary::from(latencies);
+	RDMA_LOG(INFO) << FLAGS_workers << " workers, " << FLAGS_clients << " clients: " << created
+		<< " QPs in " << nsec / 1000000 << " ms (" << qps_per_sec << " QPs/s), p50 "
+		<< summary.p50 << " ns, p99 " << summary.p99 << " ns, " << retries << " retries, "
+		<< failed << " failed";
+	appendResultRow(std::string(kResultsDir) + "ctrl_storm.txt",
+		"workers\tclients\tqps_per_client\tcreated\tqps_per_sec\tretries\tfailed\t" + LatencySummary::header(),
+		std::to_string(FLAGS_workers) + "\t" + std::to_string(FLAGS_clients) + "\t" +
+		std::to_string(FLAGS_qps_per_client) + "\t" + std::to_string(created) + "\t" +
+		std::to_string(qps_per_sec) + "\t" + std::to_string(retries) + "\t" +
+		std::to_string(failed) + "\t" + summary.row());
+
+	// 3. release the QPs created at the RCtrl
+	ConnectManager cm("127.0.0.1:" + std::to_string(FLAGS_port));
+	for (auto &r : results) {
+		for (auto &c : r.created) {
+			cm.delete_remote_rc(c.first, c.second);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,123 @@
+#include <gflags/gflags.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "rlibv2/core/utils/abs_factory.hh"
+
+#include "bench_utils.hh"
+
+DEFINE_int32(threads, 8, "Threads looking up entries at once, like the pollers of a multi-tenant server");
+DEFINE_int32(entries, 1024, "Entries registered before the measurement");
+DEFINE_int64(lookups, 1000000, "Lookups of each thread");
+DEFINE_bool(writer, true, "Whether a thread keeps registering and deregistering entries meanwhile");
+
+using namespace rdmaio;
+using namespace std;
+
+/**
+ * The registry as it was before: a std::map guarded by one mutex
+ */
+class LockedFactory {
+	std::map<u64, Arc<u64>> store;
+	std::mutex lock;
+
+public:
+	void reg(const u64 &k, Arc<u64> v) {
+		std::lock_guard<std::mutex> guard(lock);
+		store.insert(std::make_pair(k, v));
+	}
+
+	void dereg(const u64 &k) {
+		std::lock_guard<std::mutex> guard(lock);
+		store.erase(k);
+	}
+
+	Option<Arc<u64>> query(const u64 &k) {
+		std::lock_guard<std::mutex> guard(lock);
+		auto it = store.find(k);
+		if (it == store.end())
+			return {};
+		return it->second;
+	}
+};
+
+template <typename F>
+void run(const std::string &mode, F &factory) {
+	for (int i = 0; i < FLAGS_entries; ++i) {
+		factory.reg(i, Arc<u64>(new u64(i)));
+	}
+
+	// the writer churns keys above the looked up ones, so every lookup hits
+	atomic<bool> done(false);
+	u64 updates = 0;
+	thread writer([&]() {
+		u64 k = FLAGS_entries;
+		while (FLAGS_writer && !done.load()) {
+			factory.reg(k, Arc<u64>(new u64(k)));
+			factory.dereg(k);
+			updates += 1;
+			k += 1;
+		}
+	});
+
+	vector<thread> threads;
+	long begin = now_nsec();
+	for (int t = 0; t < FLAGS_threads; ++t) {
+		threads.emplace_back([&factory, t]() {
+			u64 sum = 0;
+			for (i64 i = 0; i < FLAGS_lookups; ++i) {
+				auto v = factory.query((t + i) % FLAGS_entries);
+				RDMA_ASSERT(v);
+				sum += *v.value();
+			}
+			RDMA_ASSERT(sum > 0);
+		});
+	}
+	for (auto &t : threads) {
+		t.join();
+	}
+	long nsec = now_nsec() - begin;
+	done.store(true);
+	writer.join();
+
+	double lookups_per_sec = static_cast<double>(FLAGS_threads) * FLAGS_lookups * 1e9 / nsec;
+	RDMA_LOG(INFO) << mode << ": " << FLAGS_threads << " threads, " << lookups_per_sec
+		<< " lookups/s, " << updates << " updates";
+	appendResultRow(std::string(kResultsDir) + "factory_bench.txt",
+		"mode\tthreads\tentries\twriter\tlookups_per_sec\tupdates",
+		mode + "\t" + std::to_string(FLAGS_threads) + "\t" + std::to_string(FLAGS_entries) + "\t" +
+		std::to_string(FLAGS_writer) + "\t" + std::to_string(lookups_per_sec) + "\t" +
+		std::to_string(updates));
+}
+
+/**
+ * Adapts Factory to the calls of run(), which forget the authentication keys
+ */
+struct RCUFactory {
+	Factory<u64, u64> f;
+	std::map<u64, u64> keys;
+
+	void reg(const u64 &k, Arc<u64> v) { keys[k] = f.reg(k, v).value(); }
+	void dereg(const u64 &k) {
+		f.dereg(k, keys[k]);
+		keys.erase(k);
+	}
+	Option<Arc<u64>> query(const u64 &k) { return f.query(k); }
+};
+
+int main(int argc, char **argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+	{
+		LockedFactory locked;
+		run("mutex_map", locked);
+	}
+	{
+		RCUFactory rcu;
+		run("rcu_factory", rcu);
+	}
+	return 0;
+}
@@ -0,0 +1,272 @@
+#include <gflags/gflags.h>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "rlibv2/core/lib.hh"
+#include "rlibv2/core/qps/doorbell_helper.hh"
+#include "rlibv2/core/qps/recv_iter.hh"
+
+#include "bench_utils.hh"
+#include "kv_table.hh"
+
+DEFINE_string(addr, "192.168.252.212:8888", "KV server address");
+DEFINE_int64(use_nic_idx, 0, "Which NIC to create QP");
+DEFINE_int64(reg_mem_name, 73, "The name of the hash table MR (and the NIC) registered at the server");
+DEFINE_string(cq_name, "kv_channel", "The receive cq the server registered for lookup RPCs");
+DEFINE_string(mode, "read", "How to look up keys: read (one-sided RDMA READ) or rpc (SEND/RECV served by the server)");
+DEFINE_int64(num_keys, 1 << 19, "Keys are drawn uniformly from 1..num_keys (must match the server)");
+DEFINE_int32(batch, 1, "Keys per multi-get (at most 16)");
+DEFINE_int32(threads, 1, "Number of client threads, each owning one QP");
+DEFINE_int32(thread_offset, 0, "Index of the first QP name, for running several client processes against one server");
+DEFINE_int32(ops_per_thread, 100000, "Number of multi-gets each thread issues");
+DEFINE_int32(warmup_ops, 1000, "Number of multi-gets each thread issues before measuring");
+
+using namespace rdmaio;
+using namespace rdmaio::rmem;
+using namespace rdmaio::qp;
+using namespace std;
+
+constexpr usize entry_num = 16;
+
+struct ThreadResult {
+	vector<long> latencies;
+	u64 lookups = 0;
+	u64 reads = 0;
+	u64 misses = 0;
+};
+
+class KVClient {
+	Arc<RC> qp;
+	Arc<RegHandler> local_mr;
+	Arc<RegHandler> recv_mr;
+	Arc<RecvEntries<entry_num>> entries;
+	RegAttr table_attr;
+	u64 num_buckets = 0;
+	KVSlot *slots = nullptr;
+	KVRpcReq *req = nullptr;
+	u32 lkey = 0;
+	u32 req_id = 0;
+	DoorbellHelper<kNMaxDoorbell> doorbell;
+
+	public:
+	u64 reads = 0;
+	u64 misses = 0;
+
+	KVClient(Arc<RNic> &nic, int idx) : doorbell(IBV_WR_RDMA_READ) {
+		// 1. a dedicated recv cq so that rpc replies do not mix with send completions
+		auto recv_cq_res = ::rdmaio::qp::Impl::create_cq(nic, entry_num);
+		RDMA_ASSERT(recv_cq_res == IOCode::Ok);
+		qp = RC::create(nic, QPConfig(), std::get<0>(recv_cq_res.desc)).value();
+
+		ConnectManager cm(FLAGS_addr);
+		if (cm.wait_ready(1000000, 4) == IOCode::Timeout) {
+			RDMA_LOG(WARNING) << "connect to the " << FLAGS_addr << " timeout!";
+		}
+
+		// 2. create the remote QP and connect
+		auto qp_res = cm.cc_rc_msg("kv_qp_" + std::to_string(idx), FLAGS_cq_name,
+			sizeof(KVRpcReq), qp, FLAGS_reg_mem_name, QPConfig());
+		RDMA_ASSERT(qp_res == IOCode::Ok) << std::get<0>(qp_res.desc);
+
+		// 3. fetch the table MR, its size tells the number of buckets
+		auto fetch_res = cm.fetch_remote_mr(FLAGS_reg_mem_name);
+		RDMA_ASSERT(fetch_res == IOCode::Ok) << std::get<0>(fetch_res.desc);
+		table_attr = std::get<1>(fetch_res.desc);
+		num_buckets = table_attr.sz / sizeof(KVSlot);
+
+		// 4. local memory: the READ destinations followed by the rpc request
+		auto mem = Arc<RMem>(new RMem(kKVRpcReplySz + sizeof(KVRpcReq), kv_aligned_alloc));
+		local_mr = RegHandler::create(mem, nic).value();
+		auto local_attr = local_mr->get_reg_attr().value();
+		slots = reinterpret_cast<KVSlot *>(local_attr.buf);
+		lkey = local_attr.lkey;
+		req = reinterpret_cast<KVRpcReq *>(local_attr.buf + kKVRpcReplySz);
+		qp->bind_remote_mr(table_attr);
+		qp->bind_local_mr(local_attr);
+
+		auto recv_mem = Arc<RMem>(new RMem(kKVRpcReplySz * entry_num));
+		recv_mr = RegHandler::create(recv_mem, nic).value();
+		Arc<AbsRecvAllocator> alloc =
+			std::make_shared<SimpleAllocator>(recv_mem, recv_mr->get_reg_attr().value().key);
+		entries = RecvEntriesFactoryv2<entry_num>::create(alloc, kKVRpcReplySz).value();
+		auto res = qp->post_recvs(*entries, entry_num);
+		RDMA_ASSERT(res == IOCode::Ok);
+	}
+
+	/**
+	 * One-sided multi-get: one doorbell of READs for the first candidate buckets,
+	 * then one more for the keys that were found in neither
+	 */
+	void get_read(const u64 *keys, int n) {
+		int pending[kKVMaxBatch];
+		int num_pending = n;
+		for (int i = 0; i < n; ++i) {
+			pending[i] = i;
+		}
+
+		for (int c = 0; c < kKVChoices && num_pending > 0; ++c) {
+			for (int p = 0; p < num_pending; ++p) {
+				int i = pending[p];
+				doorbell.next();
+				doorbell.cur_sge() = {.addr = reinterpret_cast<u64>(slots + i),
+				                      .length = sizeof(KVSlot),
+				                      .lkey = lkey};
+				doorbell.cur_wr().send_flags = 0;
+				doorbell.cur_wr().wr.rdma.remote_addr =
+					table_attr.buf + kv_bucket(keys[i], c, num_buckets) * sizeof(KVSlot);
+				doorbell.cur_wr().wr.rdma.rkey = table_attr.key;
+			}
+			// only the last READ is signaled, it completes after all the previous ones
+			doorbell.cur_wr().send_flags = IBV_SEND_SIGNALED;
+			doorbell.cur_wr().wr_id = qp->encode_my_wr(0, doorbell.size());
+			doorbell.freeze();
+			ibv_send_wr *bad_sr;
+			auto res_s = qp->send(*doorbell.first_wr_ptr(), doorbell.size(), &bad_sr);
+			RDMA_ASSERT(res_s == IOCode::Ok) << strerror(res_s.desc);
+			qp->out_signaled += 1;
+			reads += doorbell.size();
+			doorbell.clear();
+
+			auto res_p = qp->wait_rc_comp();
+			RDMA_ASSERT(res_p == IOCode::Ok);
+
+			int still_pending = 0;
+			for (int p = 0; p < num_pending; ++p) {
+				if (!kv_check_slot(slots[pending[p]], keys[pending[p]])) {
+					pending[still_pending++] = pending[p];
+				}
+			}
+			num_pending = still_pending;
+		}
+		misses += num_pending;
+	}
+
+	/**
+	 * Two-sided multi-get: the keys go in one SEND, the server thread replies with the slots
+	 */
+	void get_rpc(const u64 *keys, int n) {
+		// 0 is never used as request id
+		req_id = req_id + 1 == 0 ? 1 : req_id + 1;
+		req->num = n;
+		memcpy(req->keys, keys, n * sizeof(u64));
+		auto res_s = qp->send_normal(
+			{.op = IBV_WR_SEND_WITH_IMM,
+			 .flags = IBV_SEND_SIGNALED,
+			 .len = static_cast<u32>(sizeof(u64) * (n + 1)),
+			 .wr_id = 0},
+			{.local_addr = reinterpret_cast<RMem::raw_ptr_t>(req),
+			 .remote_addr = 0,
+			 .imm_data = req_id});
+		RDMA_ASSERT(res_s == IOCode::Ok) << res_s.desc;
+
+		bool replied = false;
+		while (!replied) {
+			for (RecvIter<RC, entry_num> iter(qp, entries); iter.has_msgs(); iter.next()) {
+				auto imm_msg = iter.cur_msg().value();
+				RDMA_ASSERT(std::get<0>(imm_msg) == req_id) << "unexpected reply " << std::get<0>(imm_msg);
+				auto reply = static_cast<const KVSlot *>(std::get<1>(imm_msg));
+				for (int i = 0; i < n; ++i) {
+					misses += kv_check_slot(reply[i], keys[i]) ? 0 : 1;
+				}
+				replied = true;
+			}
+		}
+		auto res_p = qp->wait_rc_comp();
+		RDMA_ASSERT(res_p == IOCode::Ok);
+	}
+
+	void get(const u64 *keys, int n) {
+		if (FLAGS_mode == "read") {
+			get_read(keys, n);
+		} else {
+			get_rpc(keys, n);
+		}
+	}
+};
+
+int main(int argc, char **argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+	RDMA_ASSERT(FLAGS_mode == "read" || FLAGS_mode == "rpc") << "unknown mode: " << FLAGS_mode;
+	RDMA_ASSERT(FLAGS_batch > 0 && FLAGS_batch <= kKVMaxBatch) << "batch must be in [1," << kKVMaxBatch << "]";
+
+	auto nic =
+	  RNic::create(RNicInfo::query_dev_names().at(FLAGS_use_nic_idx)).value();
+
+	vector<ThreadResult> results(FLAGS_threads);
+	std::atomic<int> ready(0);
+	std::atomic<bool> start(false);
+	vector<std::thread> workers;
+
+	for (int t = 0; t < FLAGS_threads; ++t) {
+		workers.emplace_back([&, t]() {
+			KVClient client(nic, FLAGS_thread_offset + t);
+			std::mt19937_64 rng(t + 1);
+			std::uniform_int_distribution<u64> key_dist(1, FLAGS_num_keys);
+			u64 keys[kKVMaxBatch];
+			auto next_keys = [&]() {
+				for (int i = 0; i < FLAGS_batch; ++i) {
+					keys[i] = key_dist(rng);
+				}
+			};
+
+			for (int i = 0; i < FLAGS_warmup_ops; ++i) {
+				next_keys();
+				client.get(keys, FLAGS_batch);
+			}
+			client.reads = 0;
+			client.misses = 0;
+
+			auto &res = results[t];
+			res.latencies.reserve(FLAGS_ops_per_thread);
+
+			ready.fetch_add(1);
+			while (!start.load()) {
+			}
+
+			for (int i = 0; i < FLAGS_ops_per_thread; ++i) {
+				next_keys();
+				long before = now_nsec();
+				client.get(keys, FLAGS_batch);
+				res.latencies.push_back(now_nsec() - before);
+			}
+			res.lookups = static_cast<u64>(FLAGS_ops_per_thread) * FLAGS_batch;
+			res.reads = client.reads;
+			res.misses = client.misses;
+		});
+	}
+
+	while (ready.load() != FLAGS_threads) {
+	}
+	long begin = now_nsec();
+	start.store(true);
+	for (auto &w : workers) {
+		w.join();
+	}
+	long elapsed = now_nsec() - begin;
+
+	vector<long> latencies;
+	u64 lookups = 0, reads = 0, misses = 0;
+	for (auto &r : results) {
+		latencies.insert(latencies.end(), r.latencies.begin(), r.latencies.end());
+		lookups += r.lookups;
+		reads += r.reads;
+		misses += r.misses;
+	}
+	RDMA_VERIFY(WARNING, misses == 0) << misses << " lookups missed";
+
+	double lookups_per_sec = static_cast<double>(lookups) / elapsed * 1e9;
+	double reads_per_lookup = static_cast<double>(reads) / lookups;
+	auto summary = LatencySummary::from(latencies);
+	RDMA_LOG(INFO) << FLAGS_mode << " lookups, " << FLAGS_threads << " threads, batch " << FLAGS_batch << ": "
+		<< lookups_per_sec << " lookups/s, " << reads_per_lookup << " READs/lookup, p50 " << summary.p50
+		<< " ns, p99 " << summary.p99 << " ns";
+
+	appendResultRow(std::string(kResultsDir) + "kv_" + FLAGS_mode + ".txt",
+		"threads\tbatch\tlookups_per_sec\treads_per_lookup\t" + LatencySummary::header(),
+		std::to_string(FLAGS_threads) + "\t" + std::to_string(FLAGS_batch) + "\t" +
+		std::to_string(lookups_per_sec) + "\t" + std::to_string(reads_per_lookup) + "\t" + summary.row());
+
+	return 0;
+}
@@ -0,0 +1,155 @@
+#include <gflags/gflags.h>
+
+#include "rlibv2/core/lib.hh"
+#include "rlibv2/core/qps/rc_recv_manager.hh"
+
+#include "bench_utils.hh"
+#include "kv_table.hh"
+
+DEFINE_int64(port, 8888, "Server listener (UDP) port.");
+DEFINE_int64(use_nic_idx, 0, "Which NIC to create QP");
+DEFINE_int64(reg_mem_name, 73, "The name to register the hash table MR (and the NIC) at rctrl.");
+DEFINE_string(cq_name, "kv_channel", "The name to register the receive cq for lookup RPCs");
+DEFINE_int64(num_buckets, 1 << 20, "Number of cache-line slots in the hash table");
+DEFINE_int64(num_keys, 1 << 19, "Keys 1..num_keys are loaded into the table");
+DEFINE_int32(max_clients, 256, "Maximum number of client QPs (kv_qp_0 .. kv_qp_{max_clients-1})");
+
+using namespace rdmaio;
+using namespace rdmaio::rmem;
+using namespace rdmaio::qp;
+using namespace std;
+
+constexpr usize entry_num = 64;
+constexpr usize req_sz = sizeof(KVRpcReq);
+constexpr usize recv_cq_depth = 4096;
+
+struct ClientQP {
+	Arc<RC> qp;
+	Arc<RecvEntries<entry_num>> entries;
+	KVSlot *reply_buf;
+	u64 replies = 0;
+};
+
+/**
+ * Loads keys 1..num_keys, each into the first free of its candidate buckets
+ */
+void load_table(KVSlot *table) {
+	memset(table, 0, FLAGS_num_buckets * sizeof(KVSlot));
+	u64 dropped = 0;
+	for (u64 key = 1; key <= static_cast<u64>(FLAGS_num_keys); ++key) {
+		bool placed = false;
+		for (int c = 0; c < kKVChoices && !placed; ++c) {
+			auto &slot = table[kv_bucket(key, c, FLAGS_num_buckets)];
+			if (slot.key == 0) {
+				kv_fill_slot(slot, key);
+				placed = true;
+			}
+		}
+		dropped += placed ? 0 : 1;
+	}
+	RDMA_LOG(INFO) << "loaded " << FLAGS_num_keys - dropped << " keys into " << FLAGS_num_buckets
+		<< " buckets (" << dropped << " dropped on collision)";
+}
+
+const KVSlot *lookup(const KVSlot *table, u64 key) {
+	for (int c = 0; c < kKVChoices; ++c) {
+		const auto &slot = table[kv_bucket(key, c, FLAGS_num_buckets)];
+		if (slot.key == key) {
+			return &slot;
+		}
+	}
+	return nullptr;
+}
+
+int main(int argc, char **argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+	RCtrl ctrl(FLAGS_port);
+	RecvManager<entry_num> manager(ctrl);
+	auto nic =
+	  RNic::create(RNicInfo::query_dev_names().at(FLAGS_use_nic_idx)).value();
+	RDMA_ASSERT(ctrl.opened_nics.reg(FLAGS_reg_mem_name, nic));
+
+	// 1. the hash table, read directly by the one-sided clients
+	auto table_mem = Arc<RMem>(new RMem(FLAGS_num_buckets * sizeof(KVSlot), kv_aligned_alloc));
+	RDMA_ASSERT(table_mem->valid());
+	auto table = static_cast<KVSlot *>(table_mem->raw_ptr);
+	load_table(table);
+	auto table_mr = RegHandler::create(table_mem, nic).value();
+	ctrl.registered_mrs.reg(FLAGS_reg_mem_name, table_mr);
+
+	// 2. the recv channel and reply buffers used by the RPC lookups
+	auto recv_cq_res = ::rdmaio::qp::Impl::create_cq(nic, recv_cq_depth);
+	RDMA_ASSERT(recv_cq_res == IOCode::Ok);
+	auto recv_cq = std::get<0>(recv_cq_res.desc);
+
+	auto recv_mem = Arc<RMem>(new RMem(FLAGS_max_clients * entry_num * req_sz));
+	auto recv_mr = RegHandler::create(recv_mem, nic).value();
+	auto alloc = std::make_shared<SimpleAllocator>(recv_mem, recv_mr->get_reg_attr().value().key);
+	manager.reg_recv_cqs.create_then_reg(FLAGS_cq_name, recv_cq, alloc);
+
+	auto reply_mem = Arc<RMem>(new RMem(FLAGS_max_clients * kKVRpcReplySz, kv_aligned_alloc));
+	auto reply_mr = RegHandler::create(reply_mem, nic).value();
+	auto reply_attr = reply_mr->get_reg_attr().value();
+
+	auto reply_base = reinterpret_cast<KVSlot *>(reply_attr.buf);
+	ClientTable<ClientQP, entry_num> clients(ctrl, manager, "kv_qp_", FLAGS_cq_name,
+		[reply_base](int id, Arc<RC> qp, Arc<RecvEntries<entry_num>> entries) -> Option<ClientQP> {
+			if (id >= FLAGS_max_clients) {
+				return {};
+			}
+			RDMA_LOG(INFO) << "kv server serves kv_qp_" << id << " (qpn " << qp->qp->qp_num << ")";
+			return ClientQP{qp, entries, reply_base + id * kKVMaxBatch};
+		});
+
+	ctrl.start_daemon();
+	RDMA_LOG(INFO) << "kv server ready: table MR " << FLAGS_reg_mem_name << ", rpc channel " << FLAGS_cq_name;
+
+	ibv_wc wcs[entry_num];
+
+	while (true) {
+		int n = ibv_poll_cq(recv_cq, entry_num, wcs);
+		RDMA_ASSERT(n >= 0) << "poll recv cq error";
+
+		for (int i = 0; i < n; ++i) {
+			RDMA_ASSERT(wcs[i].status == IBV_WC_SUCCESS) << Dummy::wc_status(wcs[i]);
+
+			auto client_p = clients.find(wcs[i].qp_num);
+			RDMA_ASSERT(client_p != nullptr) << "unknown qp: " << wcs[i].qp_num;
+			auto &client = *client_p;
+
+			// serve the multi-get from the local table
+			auto req = reinterpret_cast<const KVRpcReq *>(wcs[i].wr_id);
+			RDMA_ASSERT(req->num > 0 && req->num <= kKVMaxBatch) << "bad request size " << req->num;
+			for (u64 k = 0; k < req->num; ++k) {
+				auto slot = lookup(table, req->keys[k]);
+				if (slot != nullptr) {
+					client.reply_buf[k] = *slot;
+				} else {
+					client.reply_buf[k].key = 0;
+				}
+			}
+
+			client.replies += 1;
+			bool signaled = client.replies % kReplySignalBatch == 0;
+			auto res_s = client.qp->send_normal(
+				{.op = IBV_WR_SEND_WITH_IMM,
+				 .flags = signaled ? IBV_SEND_SIGNALED : 0,
+				 .len = static_cast<u32>(req->num * sizeof(KVSlot)),
+				 .wr_id = 0},
+				{.local_addr = reinterpret_cast<RMem::raw_ptr_t>(client.reply_buf),
+				 .remote_addr = 0,
+				 .imm_data = wcs[i].imm_data},
+				reply_attr, reply_attr);
+			RDMA_ASSERT(res_s == IOCode::Ok) << res_s.desc;
+			if (signaled) {
+				auto res_p = client.qp->wait_rc_comp();
+				RDMA_ASSERT(res_p == IOCode::Ok);
+			}
+
+			repost_consumed(*client.qp, *client.entries);
+		}
+	}
+
+	return 0;
+}
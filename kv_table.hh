@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdlib>
+
+#include "rlibv2/core/common.hh"
+
+/*!
+  Layout of the remote hash table used by kv_server and kv_client.
+  The table is an array of cache-line sized slots; a key lives in one of two
+  candidate buckets, so a one-sided lookup takes one or two RDMA READs.
+ */
+
+constexpr rdmaio::usize kKVSlotSz = 64;
+constexpr int kKVChoices = 2;
+
+struct alignas(kKVSlotSz) KVSlot {
+	// 0 marks an empty slot
+	rdmaio::u64 key;
+	char value[kKVSlotSz - sizeof(rdmaio::u64)];
+};
+static_assert(sizeof(KVSlot) == kKVSlotSz, "a slot must fill exactly one cache line");
+
+inline rdmaio::u64 kv_hash(rdmaio::u64 key, rdmaio::u64 seed) {
+	// splitmix64 finalizer
+	rdmaio::u64 z = key + seed * 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/**
+ * Bucket index of the `choice`-th candidate slot of `key`
+ */
+inline rdmaio::u64 kv_bucket(rdmaio::u64 key, int choice, rdmaio::u64 num_buckets) {
+	return kv_hash(key, choice + 1) % num_buckets;
+}
+
+/**
+ * The value stored with `key`, derived from the key so clients can check what they read
+ */
+inline char kv_value_byte(rdmaio::u64 key, rdmaio::usize i) {
+	return static_cast<char>((key + i) & 0xff);
+}
+
+inline void kv_fill_slot(KVSlot &slot, rdmaio::u64 key) {
+	slot.key = key;
+	for (rdmaio::usize i = 0; i < sizeof(slot.value); ++i) {
+		slot.value[i] = kv_value_byte(key, i);
+	}
+}
+
+inline bool kv_check_slot(const KVSlot &slot, rdmaio::u64 key) {
+	return slot.key == key && slot.value[0] == kv_value_byte(key, 0) &&
+		slot.value[sizeof(slot.value) - 1] == kv_value_byte(key, sizeof(slot.value) - 1);
+}
+
+/**
+ * Cache-line aligned allocation for the table (RMem defaults to malloc)
+ */
+inline void *kv_aligned_alloc(rdmaio::u64 sz) {
+	return aligned_alloc(kKVSlotSz, (sz + kKVSlotSz - 1) / kKVSlotSz * kKVSlotSz);
+}
+
+// at most this many keys per multi-get, matching the doorbell limit of the one-sided path
+constexpr int kKVMaxBatch = 16;
+
+/**
+ * Request of the two-sided lookup; the reply is `num` KVSlots (key 0 on a miss)
+ */
+struct KVRpcReq {
+	rdmaio::u64 num;
+	rdmaio::u64 keys[kKVMaxBatch];
+};
+
+constexpr rdmaio::usize kKVRpcReplySz = kKVMaxBatch * kKVSlotSz;
@@ -0,0 +1,249 @@
+#include <gflags/gflags.h>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "rlibv2/core/lib.hh"
+#include "rlibv2/core/qps/op.hh"
+
+#include "bench_utils.hh"
+
+DEFINE_string(addr, "192.168.252.212:8888", "Lock server address");
+DEFINE_int64(use_nic_idx, 0, "Which NIC to create QP");
+DEFINE_int64(reg_mem_name, 73, "The name of the lock table MR (and the NIC) registered at the server");
+DEFINE_string(lock_mode, "contended", "contended: all threads compete for num_locks shared locks; uncontended: each thread (of each client_id) owns a lock");
+DEFINE_int64(num_locks, 1, "Number of shared locks threads pick from in contended mode");
+DEFINE_int32(threads, 1, "Number of client threads, each owning one QP");
+DEFINE_int32(client_id, 0, "Id of this client process, part of every lease word");
+DEFINE_int32(duration_sec, 10, "How long each thread keeps acquiring locks");
+DEFINE_int32(hold_usec, 1, "How long a lock is held before it is released");
+DEFINE_int32(lease_usec, 10000, "A lock observed unchanged for longer than this is considered expired and may be taken over");
+DEFINE_int32(min_backoff_nsec, 500, "Initial backoff after a failed CAS");
+DEFINE_int32(max_backoff_nsec, 64000, "Upper bound of the exponential backoff");
+
+using namespace rdmaio;
+using namespace rdmaio::rmem;
+using namespace rdmaio::qp;
+using namespace std;
+
+constexpr usize lock_stride = 64;
+
+struct ThreadResult {
+	vector<long> latencies;
+	u64 acquisitions = 0;
+	u64 attempts = 0;
+	u64 takeovers = 0;
+	u64 lost_leases = 0;
+};
+
+/**
+ * A lease word identifies the holder (client, thread) and the acquisition,
+ * so a stale holder can tell its lease was taken over
+ */
+u64 lease_word(u32 thread_id, u32 epoch) {
+	u64 owner = (static_cast<u64>(FLAGS_client_id) << 16) | thread_id;
+	return (owner + 1) << 32 | epoch;
+}
+
+class LockClient {
+	Arc<RC> qp;
+	Arc<RegHandler> local_mr;
+	RegAttr table_attr;
+	u64 *result = nullptr;
+	u32 lkey = 0;
+
+	std::string name;
+	u64 remote_key = 0;
+
+	public:
+	LockClient(Arc<RNic> &nic, int idx) : name("lock_qp_" + std::to_string(FLAGS_client_id) + "_" + std::to_string(idx)) {
+		qp = RC::create(nic, QPConfig()).value();
+
+		ConnectManager cm(FLAGS_addr);
+		if (cm.wait_ready(1000000, 4) == IOCode::Timeout) {
+			RDMA_LOG(WARNING) << "connect to the " << FLAGS_addr << " timeout!";
+		}
+
+		// one-sided only, so a plain RC without recv entries is enough
+		auto qp_res = cm.cc_rc(name, qp, FLAGS_reg_mem_name, QPConfig());
+		RDMA_ASSERT(qp_res == IOCode::Ok) << std::get<0>(qp_res.desc);
+		remote_key = std::get<1>(qp_res.desc);
+
+		auto fetch_res = cm.fetch_remote_mr(FLAGS_reg_mem_name);
+		RDMA_ASSERT(fetch_res == IOCode::Ok) << std::get<0>(fetch_res.desc);
+		table_attr = std::get<1>(fetch_res.desc);
+
+		local_mr = RegHandler::create(Arc<RMem>(new RMem(sizeof(u64))), nic).value();
+		auto local_attr = local_mr->get_reg_attr().value();
+		result = reinterpret_cast<u64 *>(local_attr.buf);
+		lkey = local_attr.lkey;
+		qp->bind_remote_mr(table_attr);
+		qp->bind_local_mr(local_attr);
+	}
+
+	~LockClient() {
+		release_remote_qp(FLAGS_addr, name, remote_key);
+	}
+
+	u64 num_locks() const {
+		return table_attr.sz / lock_stride;
+	}
+
+	u64 *lock_addr(u64 lock) const {
+		return reinterpret_cast<u64 *>(table_attr.buf + lock * lock_stride);
+	}
+
+	/**
+	 * CAS the lock word from `expected` to `desired`, returns the previous value
+	 */
+	u64 cas(u64 lock, u64 expected, u64 desired) {
+		Op<> op;
+		op.set_atomic_rbuf(lock_addr(lock), table_attr.key).set_cas(expected, desired);
+		op.set_payload(result, sizeof(u64), lkey);
+		auto res_s = op.execute(qp, IBV_SEND_SIGNALED);
+		RDMA_ASSERT(res_s == IOCode::Ok) << res_s.desc;
+		auto res_p = qp->wait_rc_comp();
+		RDMA_ASSERT(res_p == IOCode::Ok);
+		return *result;
+	}
+
+	/**
+	 * Read-only lease check: one RDMA READ of the lock word
+	 */
+	u64 read(u64 lock) {
+		Op<> op;
+		op.set_rdma_rbuf(lock_addr(lock), table_attr.key).set_read();
+		op.set_payload(result, sizeof(u64), lkey);
+		auto res_s = op.execute(qp, IBV_SEND_SIGNALED);
+		RDMA_ASSERT(res_s == IOCode::Ok) << res_s.desc;
+		auto res_p = qp->wait_rc_comp();
+		RDMA_ASSERT(res_p == IOCode::Ok);
+		return *result;
+	}
+};
+
+void spin_nsec(long nsec) {
+	long until = now_nsec() + nsec;
+	while (now_nsec() < until) {
+	}
+}
+
+int main(int argc, char **argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+	RDMA_ASSERT(FLAGS_lock_mode == "contended" || FLAGS_lock_mode == "uncontended")
+		<< "unknown lock mode: " << FLAGS_lock_mode;
+	const bool contended = FLAGS_lock_mode == "contended";
+
+	auto nic =
+	  RNic::create(RNicInfo::query_dev_names().at(FLAGS_use_nic_idx)).value();
+
+	vector<ThreadResult> results(FLAGS_threads);
+	std::atomic<int> ready(0);
+	std::atomic<bool> start(false);
+	vector<std::thread> workers;
+
+	for (int t = 0; t < FLAGS_threads; ++t) {
+		workers.emplace_back([&, t]() {
+			LockClient client(nic, t);
+			std::mt19937_64 rng(FLAGS_client_id * 1000 + t + 1);
+			std::uniform_int_distribution<u64> lock_dist(0, FLAGS_num_locks - 1);
+			auto &res = results[t];
+			u32 epoch = 0;
+			RDMA_ASSERT(static_cast<u64>(FLAGS_num_locks + (FLAGS_client_id + 1) * FLAGS_threads) <= client.num_locks())
+				<< "the server table has only " << client.num_locks() << " locks";
+
+			ready.fetch_add(1);
+			while (!start.load()) {
+			}
+
+			long end = now_nsec() + FLAGS_duration_sec * 1000000000L;
+			while (now_nsec() < end) {
+				// uncontended threads (of all the clients) use disjoint locks placed after the shared ones
+				u64 lock = contended ? lock_dist(rng) : FLAGS_num_locks + FLAGS_client_id * FLAGS_threads + t;
+				u64 mine = lease_word(t, ++epoch);
+
+				// 1. acquire with exponential backoff, taking over leases that stopped changing
+				long begin = now_nsec();
+				long backoff = FLAGS_min_backoff_nsec;
+				u64 expected = 0;
+				u64 observed = 0;
+				long observed_since = begin;
+				while (true) {
+					res.attempts += 1;
+					u64 prev = client.cas(lock, expected, mine);
+					if (prev == expected) {
+						res.takeovers += expected != 0 ? 1 : 0;
+						break;
+					}
+					long now = now_nsec();
+					if (prev != observed) {
+						observed = prev;
+						observed_since = now;
+					}
+					// only a lease held unchanged past its expiry may be taken over
+					expected = now - observed_since > FLAGS_lease_usec * 1000L ? observed : 0;
+					std::uniform_int_distribution<long> jitter(backoff / 2, backoff);
+					spin_nsec(jitter(rng));
+					backoff = std::min<long>(backoff * 2, FLAGS_max_backoff_nsec);
+				}
+				res.latencies.push_back(now_nsec() - begin);
+				res.acquisitions += 1;
+
+				// 2. critical section, validating the lease before acting on it
+				spin_nsec(FLAGS_hold_usec * 1000L);
+				if (client.read(lock) != mine) {
+					res.lost_leases += 1;
+					continue;
+				}
+
+				// 3. release, unless the lease has been taken over meanwhile
+				if (client.cas(lock, mine, 0) != mine) {
+					res.lost_leases += 1;
+				}
+			}
+		});
+	}
+
+	while (ready.load() != FLAGS_threads) {
+	}
+	long begin = now_nsec();
+	start.store(true);
+	for (auto &w : workers) {
+		w.join();
+	}
+	long elapsed = now_nsec() - begin;
+
+	vector<long> latencies;
+	u64 acquisitions = 0, attempts = 0, takeovers = 0, lost_leases = 0;
+	double sum = 0, sum_sq = 0;
+	for (auto &r : results) {
+		latencies.insert(latencies.end(), r.latencies.begin(), r.latencies.end());
+		acquisitions += r.acquisitions;
+		attempts += r.attempts;
+		takeovers += r.takeovers;
+		lost_leases += r.lost_leases;
+		sum += r.acquisitions;
+		sum_sq += static_cast<double>(r.acquisitions) * r.acquisitions;
+	}
+
+	// Jain's fairness index over the per-thread acquisition counts (1 is perfectly fair)
+	double fairness = sum_sq == 0 ? 0 : sum * sum / (FLAGS_threads * sum_sq);
+	double acquisitions_per_sec = static_cast<double>(acquisitions) / elapsed * 1e9;
+	double attempts_per_acquire = acquisitions == 0 ? 0 : static_cast<double>(attempts) / acquisitions;
+	auto summary = LatencySummary::from(latencies);
+	RDMA_LOG(INFO) << FLAGS_lock_mode << " locks, " << FLAGS_threads << " threads: "
+		<< acquisitions_per_sec << " acquisitions/s, " << attempts_per_acquire << " CAS/acquire, fairness "
+		<< fairness << ", p50 " << summary.p50 << " ns, p99 " << summary.p99 << " ns, "
+		<< takeovers << " takeovers, " << lost_leases << " lost leases";
+
+	appendResultRow(std::string(kResultsDir) + "lock_" + FLAGS_lock_mode + ".txt",
+		"threads\tnum_locks\tacquisitions_per_sec\tattempts_per_acquire\tfairness\ttakeovers\tlost_leases\t" +
+			LatencySummary::header(),
+		std::to_string(FLAGS_threads) + "\t" + std::to_string(FLAGS_num_locks) + "\t" +
+			std::to_string(acquisitions_per_sec) + "\t" + std::to_string(attempts_per_acquire) + "\t" +
+			std::to_string(fairness) + "\t" + std::to_string(takeovers) + "\t" + std::to_string(lost_leases) + "\t" +
+			summary.row());
+
+	return 0;
+}
@@ -0,0 +1,47 @@
+#include <gflags/gflags.h>
+
+#include "rlibv2/core/lib.hh"
+
+DEFINE_int64(port, 8888, "Server listener (UDP) port.");
+DEFINE_int64(use_nic_idx, 0, "Which NIC to create QP");
+DEFINE_int64(reg_mem_name, 73, "The name to register the lock table MR (and the NIC) at rctrl.");
+DEFINE_int64(num_locks, 1024, "Number of lock words in the table");
+
+using namespace rdmaio;
+using namespace rdmaio::rmem;
+
+// every lock word sits on its own cache line so that locks do not share NIC atomic units
+constexpr usize lock_stride = 64;
+
+int main(int argc, char **argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+	RCtrl ctrl(FLAGS_port);
+	auto nic =
+	  RNic::create(RNicInfo::query_dev_names().at(FLAGS_use_nic_idx)).value();
+	RDMA_ASSERT(ctrl.opened_nics.reg(FLAGS_reg_mem_name, nic));
+
+	// the lock table: 0 means free, otherwise the holder's lease word
+	auto mem = Arc<RMem>(new RMem(FLAGS_num_locks * lock_stride, [](u64 sz) -> RMem::raw_ptr_t {
+		return aligned_alloc(lock_stride, sz);
+	}));
+	RDMA_ASSERT(mem->valid());
+	memset(mem->raw_ptr, 0, mem->sz);
+	RDMA_ASSERT(ctrl.registered_mrs.create_then_reg(FLAGS_reg_mem_name, mem, nic));
+
+	ctrl.start_daemon();
+	RDMA_LOG(INFO) << "lock server ready: " << FLAGS_num_locks << " locks in MR " << FLAGS_reg_mem_name;
+
+	// the server CPU is not involved in locking, clients use RDMA atomics on the table
+	auto table = static_cast<volatile u64 *>(mem->raw_ptr);
+	while (true) {
+		sleep(1);
+		u64 held = 0;
+		for (i64 i = 0; i < FLAGS_num_locks; ++i) {
+			held += table[i * (lock_stride / sizeof(u64))] != 0 ? 1 : 0;
+		}
+		RDMA_LOG(INFO) << "locks held: " << held;
+	}
+
+	return 0;
+}
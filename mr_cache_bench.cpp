@@ -0,0 +1,144 @@
+#include <gflags/gflags.h>
+#include <vector>
+
+#include "rlibv2/core/lib.hh"
+#include "rlibv2/core/rmem/mr_cache.hh"
+
+#include "bench_utils.hh"
+
+DEFINE_int64(port, 8888, "Listener (UDP) port of the in-process RCtrl serving the target QP and MR");
+DEFINE_int64(use_nic_idx, 0, "Which NIC to create QP");
+DEFINE_int64(reg_mem_name, 73, "The name to register the target MR (and the NIC) at rctrl");
+DEFINE_int32(msg_size, 4096, "Size of each WRITE");
+DEFINE_int32(num_bufs, 64, "Number of application buffers the sends rotate over");
+DEFINE_int32(msg_count, 10000, "Number of WRITEs of each mode");
+DEFINE_int64(max_pinned_bytes, 1024 * 1024 * 1024, "Eviction threshold of the MR cache");
+
+using namespace rdmaio;
+using namespace rdmaio::rmem;
+using namespace rdmaio::qp;
+using namespace std;
+
+/**
+ * Posts one signaled WRITE of `buf` and waits for its completion.
+ * The buffer is either pinned by an MR cache, or inside the QP's bound local MR.
+ */
+void write_and_wait(const Arc<RC> &qp, char *buf, const MRCache::Pin *pin = nullptr) {
+	RC::ReqDesc desc = {.op = IBV_WR_RDMA_WRITE,
+		.flags = IBV_SEND_SIGNALED,
+		.len = static_cast<u32>(FLAGS_msg_size),
+		.wr_id = 0};
+	RC::ReqPayload payload = {.local_addr = reinterpret_cast<RMem::raw_ptr_t>(buf),
+		.remote_addr = 0,
+		.imm_data = 0};
+	auto res_s = pin ? qp->send_normal(desc, payload, *pin) : qp->send_normal(desc, payload);
+	RDMA_ASSERT(res_s == IOCode::Ok) << res_s.desc;
+	auto res_p = qp->wait_rc_comp();
+	RDMA_ASSERT(res_p == IOCode::Ok) << std::get<0>(res_p.desc);
+}
+
+void report(const std::string &mode, const vector<long> &latencies, const MRCache &cache) {
+	auto summary = LatencySummary::from(latencies);
+	RDMA_LOG(INFO) << mode << ": p50 " << summary.p50 << " ns, p99 " << summary.p99 << " ns ("
+		<< cache.hits << " hits, " << cache.misses << " misses, " << cache.evictions << " evictions)";
+	appendResultRow(std::string(kResultsDir) + "mr_cache.txt",
+		"mode\tmsg_size\tnum_bufs\thits\tmisses\t" + LatencySummary::header(),
+		mode + "\t" + std::to_string(FLAGS_msg_size) + "\t" + std::to_string(FLAGS_num_bufs) + "\t" +
+		std::to_string(cache.hits) + "\t" + std::to_string(cache.misses) + "\t" + summary.row());
+}
+
+int main(int argc, char **argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+	auto nic =
+	  RNic::create(RNicInfo::query_dev_names().at(FLAGS_use_nic_idx)).value();
+
+	// 1. the target of the WRITEs, served by an in-process RCtrl (loopback)
+	RCtrl ctrl(FLAGS_port);
+	RDMA_ASSERT(ctrl.opened_nics.reg(FLAGS_reg_mem_name, nic));
+	auto target_mr = RegHandler::create(Arc<RMem>(new RMem(FLAGS_msg_size)), nic).value();
+	ctrl.registered_mrs.reg(FLAGS_reg_mem_name, target_mr);
+	ctrl.start_daemon();
+
+	auto qp = RC::create(nic, QPConfig()).value();
+	ConnectManager cm("127.0.0.1:" + std::to_string(FLAGS_port));
+	if (cm.wait_ready(1000000, 4) == IOCode::Timeout) {
+		RDMA_LOG(WARNING) << "connect to the local rctrl timeout!";
+	}
+	auto qp_res = cm.cc_rc("mr_cache_qp", qp, FLAGS_reg_mem_name, QPConfig());
+	RDMA_ASSERT(qp_res == IOCode::Ok) << std::get<0>(qp_res.desc);
+	auto fetch_res = cm.fetch_remote_mr(FLAGS_reg_mem_name);
+	RDMA_ASSERT(fetch_res == IOCode::Ok) << std::get<0>(fetch_res.desc);
+	qp->bind_remote_mr(std::get<1>(fetch_res.desc));
+
+	// 2. unregistered application buffers, page aligned so each one is its own registration
+	const usize buf_sz = (FLAGS_msg_size + 4095) / 4096 * 4096;
+	vector<char *> bufs(FLAGS_num_bufs);
+	for (auto &b : bufs) {
+		b = static_cast<char *>(aligned_alloc(4096, buf_sz));
+		memset(b, 'x', FLAGS_msg_size);
+	}
+
+	vector<long> latencies;
+	latencies.reserve(FLAGS_msg_count);
+
+	// 3. baseline: copy into a pre-registered staging buffer, then WRITE
+	{
+		auto staging_mr = RegHandler::create(Arc<RMem>(new RMem(FLAGS_msg_size)), nic).value();
+		auto staging_attr = staging_mr->get_reg_attr().value();
+		char *staging = reinterpret_cast<char *>(staging_attr.buf);
+		qp->bind_local_mr(staging_attr);
+		auto cache = MRCache::create(nic).value(); // only for the (empty) statistics
+		for (int i = 0; i < FLAGS_msg_count; ++i) {
+			long begin = now_nsec();
+			memcpy(staging, bufs[i % FLAGS_num_bufs], FLAGS_msg_size);
+			write_and_wait(qp, staging);
+			latencies.push_back(now_nsec() - begin);
+		}
+		report("staging_copy", latencies, *cache);
+	}
+
+	// 4. cold cache: every send registers its buffer, which is dropped afterwards
+	{
+		latencies.clear();
+		auto cache = MRCache::create(nic, FLAGS_max_pinned_bytes).value();
+		for (int i = 0; i < FLAGS_msg_count; ++i) {
+			char *buf = bufs[i % FLAGS_num_bufs];
+			long begin = now_nsec();
+			{
+				auto pin = cache->pin(buf, FLAGS_msg_size).value();
+				write_and_wait(qp, buf, &pin);
+			}
+			latencies.push_back(now_nsec() - begin);
+			cache->invalidate(buf, FLAGS_msg_size);
+		}
+		report("cache_cold", latencies, *cache);
+	}
+
+	// 5. hot cache: the buffers are registered once, then every send hits
+	{
+		latencies.clear();
+		auto cache = MRCache::create(nic, FLAGS_max_pinned_bytes).value();
+		for (auto b : bufs) {
+			cache->pin(b, FLAGS_msg_size);
+		}
+		cache->hits = cache->misses = 0;
+		for (int i = 0; i < FLAGS_msg_count; ++i) {
+			char *buf = bufs[i % FLAGS_num_bufs];
+			long begin = now_nsec();
+			{
+				auto pin = cache->pin(buf, FLAGS_msg_size).value();
+				write_and_wait(qp, buf, &pin);
+			}
+			latencies.push_back(now_nsec() - begin);
+		}
+		report("cache_hot", latencies, *cache);
+		RDMA_LOG(INFO) << "hot cache pinned " << cache->pinned_bytes() << " bytes in "
+			<< cache->num_entries() << " registrations";
+	}
+
+	for (auto b : bufs) {
+		free(b);
+	}
+	return 0;
+}
@@ -0,0 +1,173 @@
+#include <gflags/gflags.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "rlibv2/core/lib.hh"
+#include "rlibv2/core/qps/recv_iter.hh"
+
+#include "bench_utils.hh"
+
+DEFINE_string(addr, "192.168.252.212:8888", "Multi-client server address");
+DEFINE_int64(use_nic_idx, 0, "Which NIC to create QP");
+DEFINE_int64(reg_mem_name, 73, "The name of the NIC registered at the server");
+DEFINE_string(cq_name, "mc_channel", "Prefix of the server's receive channels");
+DEFINE_int32(pollers, 1, "Number of server pollers (must match the server); producer i uses channel i % pollers");
+DEFINE_int32(producers, 1, "Number of producer threads in this process, each owning one QP");
+DEFINE_int32(producer_offset, 0, "Index of the first QP name, for running several client processes against one server");
+DEFINE_int32(msg_size, 1024, "Size of each replicated message");
+DEFINE_int32(window, 16, "Messages a producer may have in flight before it waits for acks");
+DEFINE_int32(msgs_per_producer, 100000, "Number of messages each producer replicates");
+
+using namespace rdmaio;
+using namespace rdmaio::rmem;
+using namespace rdmaio::qp;
+using namespace std;
+
+constexpr usize entry_num = 256;
+constexpr usize ack_recv_sz = 64;
+// sends are signaled once per batch so the send queue is drained without waiting on every message
+constexpr u64 signal_batch = 16;
+
+struct ProducerResult {
+	vector<long> latencies;
+	u64 acked = 0;
+};
+
+class Producer {
+	Arc<RC> qp;
+	Arc<RegHandler> local_mr;
+	Arc<RegHandler> recv_mr;
+	Arc<RecvEntries<entry_num>> entries;
+	std::string name;
+	u64 key = 0;
+
+	public:
+	Producer(Arc<RNic> &nic, int idx) : name("mc_qp_" + std::to_string(idx)) {
+		// acks arrive on a dedicated recv cq
+		auto recv_cq_res = ::rdmaio::qp::Impl::create_cq(nic, entry_num);
+		RDMA_ASSERT(recv_cq_res == IOCode::Ok);
+		qp = RC::create(nic, QPConfig(), std::get<0>(recv_cq_res.desc)).value();
+
+		ConnectManager cm(FLAGS_addr);
+		if (cm.wait_ready(1000000, 4) == IOCode::Timeout) {
+			RDMA_LOG(WARNING) << "connect to the " << FLAGS_addr << " timeout!";
+		}
+		auto channel = FLAGS_cq_name + "_" + std::to_string(idx % FLAGS_pollers);
+		auto qp_res = cm.cc_rc_msg(name, channel, FLAGS_msg_size, qp, FLAGS_reg_mem_name, QPConfig());
+		RDMA_ASSERT(qp_res == IOCode::Ok) << std::get<0>(qp_res.desc);
+		key = std::get<1>(qp_res.desc);
+
+		local_mr = RegHandler::create(Arc<RMem>(new RMem(FLAGS_msg_size)), nic).value();
+		auto local_attr = local_mr->get_reg_attr().value();
+		memset(reinterpret_cast<char *>(local_attr.buf), 'x', FLAGS_msg_size);
+		qp->bind_local_mr(local_attr);
+		qp->bind_remote_mr(local_attr);
+
+		auto recv_mem = Arc<RMem>(new RMem(ack_recv_sz * entry_num));
+		recv_mr = RegHandler::create(recv_mem, nic).value();
+		Arc<AbsRecvAllocator> alloc =
+			std::make_shared<SimpleAllocator>(recv_mem, recv_mr->get_reg_attr().value().key);
+		entries = RecvEntriesFactoryv2<entry_num>::create(alloc, ack_recv_sz).value();
+		auto res = qp->post_recvs(*entries, entry_num);
+		RDMA_ASSERT(res == IOCode::Ok);
+	}
+
+	~Producer() {
+		release_remote_qp(FLAGS_addr, name, key);
+	}
+
+	/**
+	 * Replicate `num` messages keeping up to `window` of them unacknowledged,
+	 * recording the send-to-ack latency of each
+	 */
+	void run(u32 num, ProducerResult &res) {
+		vector<long> sent_at(num + 1);
+		u32 sent = 0;
+		u32 acked = 0;
+		while (acked < num) {
+			while (sent < num && sent - acked < static_cast<u32>(FLAGS_window)) {
+				sent += 1;
+				bool signaled = sent % signal_batch == 0;
+				sent_at[sent] = now_nsec();
+				auto res_s = qp->send_normal(
+					{.op = IBV_WR_SEND_WITH_IMM,
+					 .flags = signaled ? IBV_SEND_SIGNALED : 0,
+					 .len = static_cast<u32>(FLAGS_msg_size),
+					 .wr_id = 0},
+					{.local_addr = reinterpret_cast<RMem::raw_ptr_t>(local_mr->get_reg_attr().value().buf),
+					 .remote_addr = 0,
+					 .imm_data = sent});
+				RDMA_ASSERT(res_s == IOCode::Ok) << res_s.desc;
+			}
+			// reap send completions without blocking, the acks pace the producer
+			for (auto comp = qp->poll_rc_comp(); comp; comp = qp->poll_rc_comp()) {
+				RDMA_ASSERT(std::get<1>(comp.value()).status == IBV_WC_SUCCESS)
+					<< Dummy::wc_status(std::get<1>(comp.value()));
+			}
+
+			for (RecvIter<RC, entry_num> iter(qp, entries); iter.has_msgs(); iter.next()) {
+				u32 seq = std::get<0>(iter.cur_msg().value());
+				RDMA_ASSERT(seq == acked + 1) << "out of order ack " << seq << ", expected " << acked + 1;
+				acked = seq;
+				res.latencies.push_back(now_nsec() - sent_at[seq]);
+			}
+		}
+		res.acked = acked;
+	}
+};
+
+int main(int argc, char **argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+	RDMA_ASSERT(FLAGS_window > 0 && FLAGS_window + signal_batch <= 128)
+		<< "window must fit in the send queue together with one signal batch";
+
+	auto nic =
+	  RNic::create(RNicInfo::query_dev_names().at(FLAGS_use_nic_idx)).value();
+
+	vector<ProducerResult> results(FLAGS_producers);
+	std::atomic<int> ready(0);
+	std::atomic<bool> start(false);
+	vector<std::thread> workers;
+
+	for (int t = 0; t < FLAGS_producers; ++t) {
+		workers.emplace_back([&, t]() {
+			Producer producer(nic, FLAGS_producer_offset + t);
+			results[t].latencies.reserve(FLAGS_msgs_per_producer);
+
+			ready.fetch_add(1);
+			while (!start.load()) {
+			}
+			producer.run(FLAGS_msgs_per_producer, results[t]);
+		});
+	}
+
+	while (ready.load() != FLAGS_producers) {
+	}
+	long begin = now_nsec();
+	start.store(true);
+	for (auto &w : workers) {
+		w.join();
+	}
+	long elapsed = now_nsec() - begin;
+
+	vector<long> latencies;
+	u64 acked = 0;
+	for (auto &r : results) {
+		latencies.insert(latencies.end(), r.latencies.begin(), r.latencies.end());
+		acked += r.acked;
+	}
+	double msgs_per_sec = static_cast<double>(acked) / elapsed * 1e9;
+	auto summary = LatencySummary::from(latencies);
+	RDMA_LOG(INFO) << FLAGS_producers << " producers, " << FLAGS_pollers << " server pollers, window "
+		<< FLAGS_window << ": " << msgs_per_sec << " acked msgs/s, p50 " << summary.p50 << " ns, p99 "
+		<< summary.p99 << " ns";
+
+	appendResultRow(std::string(kResultsDir) + "multi_client.txt",
+		"producers\tpollers\tmsg_size\twindow\tmsgs_per_sec\t" + LatencySummary::header(),
+		std::to_string(FLAGS_producers) + "\t" + std::to_string(FLAGS_pollers) + "\t" +
+		std::to_string(FLAGS_msg_size) + "\t" + std::to_string(FLAGS_window) + "\t" +
+		std::to_string(msgs_per_sec) + "\t" + summary.row());
+
+	return 0;
+}
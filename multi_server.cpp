@@ -0,0 +1,150 @@
+#include <gflags/gflags.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "rlibv2/core/lib.hh"
+#include "rlibv2/core/qps/rc_recv_manager.hh"
+
+#include "bench_utils.hh"
+
+DEFINE_int64(port, 8888, "Server listener (UDP) port.");
+DEFINE_int64(use_nic_idx, 0, "Which NIC to create QP");
+DEFINE_int64(reg_mem_name, 73, "The name to register the NIC at rctrl.");
+DEFINE_string(cq_name, "mc_channel", "Prefix of the receive channels, poller p registers <cq_name>_<p>");
+DEFINE_int32(pollers, 1, "Number of poller threads, each owning one recv cq");
+DEFINE_int32(first_core, 0, "Poller p is pinned to core first_core + p");
+DEFINE_int32(max_clients, 256, "Maximum number of client QPs (mc_qp_0 .. mc_qp_{max_clients-1})");
+DEFINE_int64(max_msg_size, 1024, "Size of every recv buffer");
+
+using namespace rdmaio;
+using namespace rdmaio::rmem;
+using namespace rdmaio::qp;
+using namespace std;
+
+constexpr usize entry_num = 256;
+constexpr usize recv_cq_depth = 8192;
+constexpr usize poll_batch = 64;
+
+struct ClientQP {
+	Arc<RC> qp;
+	Arc<RecvEntries<entry_num>> entries;
+	u64 acks = 0;
+};
+
+/**
+ * One poller serves the clients whose QPs were created on its channel:
+ * client i uses channel i % pollers, see multi_client
+ */
+class Poller {
+	const int id;
+	ibv_cq *recv_cq = nullptr;
+	Arc<RegHandler> recv_mr;
+	Arc<RegHandler> ack_mr;
+	ClientTable<ClientQP, entry_num> clients;
+
+	public:
+	std::atomic<u64> msgs{0};
+
+	Poller(RCtrl &ctrl, RecvManager<entry_num> &manager, Arc<RNic> &nic, int id)
+		: id(id),
+		  clients(ctrl, manager, "mc_qp_", FLAGS_cq_name + "_" + std::to_string(id),
+			  [id](int client, Arc<RC> qp, Arc<RecvEntries<entry_num>> entries) -> Option<ClientQP> {
+				  if (client >= FLAGS_max_clients) {
+					  return {};
+				  }
+				  RDMA_LOG(INFO) << "poller " << id << " serves mc_qp_" << client << " (qpn " << qp->qp->qp_num << ")";
+				  return ClientQP{qp, entries};
+			  }) {
+		auto recv_cq_res = ::rdmaio::qp::Impl::create_cq(nic, recv_cq_depth);
+		RDMA_ASSERT(recv_cq_res == IOCode::Ok);
+		recv_cq = std::get<0>(recv_cq_res.desc);
+
+		// enough recv buffers for this poller's share of the clients
+		u64 clients_per_poller = (FLAGS_max_clients + FLAGS_pollers - 1) / FLAGS_pollers;
+		auto recv_mem = Arc<RMem>(new RMem(clients_per_poller * entry_num * FLAGS_max_msg_size));
+		recv_mr = RegHandler::create(recv_mem, nic).value();
+		auto alloc = std::make_shared<SimpleAllocator>(recv_mem, recv_mr->get_reg_attr().value().key);
+		manager.reg_recv_cqs.create_then_reg(FLAGS_cq_name + "_" + std::to_string(id), recv_cq, alloc);
+
+		ack_mr = RegHandler::create(Arc<RMem>(new RMem(64)), nic).value();
+	}
+
+	void run() {
+		RDMA_VERIFY(WARNING, pin_to_core(FLAGS_first_core + id)) << "failed to pin poller " << id;
+		auto ack_attr = ack_mr->get_reg_attr().value();
+		ibv_wc wcs[poll_batch];
+
+		while (true) {
+			int n = ibv_poll_cq(recv_cq, poll_batch, wcs);
+			RDMA_ASSERT(n >= 0) << "poll recv cq error";
+
+			for (int i = 0; i < n; ++i) {
+				RDMA_ASSERT(wcs[i].status == IBV_WC_SUCCESS) << Dummy::wc_status(wcs[i]);
+
+				auto client_p = clients.find(wcs[i].qp_num);
+				RDMA_ASSERT(client_p != nullptr) << "unknown qp: " << wcs[i].qp_num;
+				auto &client = *client_p;
+
+				// ack with the producer's sequence number on the same QP
+				client.acks += 1;
+				bool signaled = client.acks % kReplySignalBatch == 0;
+				auto res_s = client.qp->send_normal(
+					{.op = IBV_WR_SEND_WITH_IMM,
+					 .flags = signaled ? IBV_SEND_SIGNALED : 0,
+					 .len = 0,
+					 .wr_id = 0},
+					{.local_addr = reinterpret_cast<RMem::raw_ptr_t>(ack_attr.buf),
+					 .remote_addr = 0,
+					 .imm_data = wcs[i].imm_data},
+					ack_attr, ack_attr);
+				RDMA_ASSERT(res_s == IOCode::Ok) << res_s.desc;
+				if (signaled) {
+					auto res_p = client.qp->wait_rc_comp();
+					RDMA_ASSERT(res_p == IOCode::Ok);
+				}
+
+				repost_consumed(*client.qp, *client.entries);
+			}
+			msgs.fetch_add(n, std::memory_order_relaxed);
+		}
+	}
+};
+
+int main(int argc, char **argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+	RDMA_ASSERT(FLAGS_pollers > 0) << "at least one poller is needed";
+
+	RCtrl ctrl(FLAGS_port);
+	RecvManager<entry_num> manager(ctrl);
+	auto nic =
+	  RNic::create(RNicInfo::query_dev_names().at(FLAGS_use_nic_idx)).value();
+	RDMA_ASSERT(ctrl.opened_nics.reg(FLAGS_reg_mem_name, nic));
+
+	vector<unique_ptr<Poller>> pollers;
+	for (int p = 0; p < FLAGS_pollers; ++p) {
+		pollers.emplace_back(new Poller(ctrl, manager, nic, p));
+	}
+
+	ctrl.start_daemon();
+	vector<std::thread> threads;
+	for (auto &p : pollers) {
+		threads.emplace_back([&p]() { p->run(); });
+	}
+	RDMA_LOG(INFO) << "multi-client server ready: " << FLAGS_pollers << " pollers from core " << FLAGS_first_core;
+
+	// per-poller message rates, to see when one core stops keeping up
+	vector<u64> last(FLAGS_pollers, 0);
+	while (true) {
+		sleep(1);
+		std::ostringstream os;
+		for (int p = 0; p < FLAGS_pollers; ++p) {
+			u64 cur = pollers[p]->msgs.load(std::memory_order_relaxed);
+			os << " " << cur - last[p];
+			last[p] = cur;
+		}
+		RDMA_LOG(INFO) << "msgs/s per poller:" << os.str();
+	}
+
+	return 0;
+}
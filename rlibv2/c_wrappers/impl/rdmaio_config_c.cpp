@@ -27,6 +27,7 @@ extern "C" {
 			config->max_recv_size = kRcMaxRecvSz; // Using the C++ default
 			config->qkey = kDefaultQKey;
 			config->dc_key = kDcKey;
+			config->path_mtu = 0;
 		}
 		return config;
 	}
@@ -58,6 +58,8 @@ rdmaio_iocode_t rdmaio_connect_manager_cc_rc_msg(rdmaio_connect_manager_t* cm,
                  .set_max_recv(config->max_recv_size)
                  .set_qkey(config->qkey)
                  .set_dc_key(config->dc_key);
+        if (config->path_mtu != 0)
+            qp_config.set_path_mtu(static_cast<ibv_mtu>(config->path_mtu));
     }
 
 	auto result = static_cast<ConnectManager*>(cm->cm)->cc_rc_msg(qp_name, channel_name, max_msg_size, rc_to_pass, remote_nic_id, qp_config);
@@ -30,6 +30,8 @@ rdmaio_rc_t* rdmaio_rc_create(rdmaio_nic_t* nic, const rdmaio_qpconfig_t* config
     qp_config.set_max_recv(config->max_recv_size);
     qp_config.set_qkey(config->qkey);
     qp_config.set_dc_key(config->dc_key);
+    if (config->path_mtu != 0)
+        qp_config.set_path_mtu(static_cast<ibv_mtu>(config->path_mtu));
 
     Arc<RNic>* arc_nic_ptr = static_cast<Arc<RNic>*>(nic->nic);
     if (arc_nic_ptr) {
@@ -68,6 +70,7 @@ void rdmaio_rc_my_attr(const rdmaio_rc_t* rc, rdmaio_qpattr_t* out_attr) {
         out_attr->port_id = qp_attr.port_id;
         out_attr->qpn = qp_attr.qpn;
         out_attr->qkey = qp_attr.qkey;
+        out_attr->mtu = qp_attr.mtu;
     }
 }
 
@@ -83,6 +86,7 @@ int rdmaio_rc_connect(rdmaio_rc_t* rc, const rdmaio_qpattr_t* attr, char* out_er
         qp_attr.port_id = attr->port_id;
         qp_attr.qpn = attr->qpn;
         qp_attr.qkey = attr->qkey;
+        qp_attr.mtu = attr->mtu;
         auto result = (*arc_rc_ptr)->connect(qp_attr);
         if (result == IOCode::Ok) {
             return 0; // Success
@@ -0,0 +1,70 @@
+#include "../rdmaio_recv_cursor_c.h"
+#include "../../core/qps/recv_cursor.hh"
+#include "../../core/qps/mod.hh" // Include for Dummy
+
+using namespace rdmaio;
+using namespace rdmaio::qp;
+
+constexpr size_t entry_num = 256;
+
+// The C handle is the cursor itself, so creating one costs a single allocation
+struct rdmaio_recv_cursor_t {
+    RecvCursor<Dummy, entry_num> cursor;
+
+    rdmaio_recv_cursor_t(Arc<Dummy>& qp, Arc<RecvEntries<entry_num>>& entries, size_t repost_threshold)
+        : cursor(qp, entries, repost_threshold) {}
+};
+
+extern "C" {
+
+rdmaio_recv_cursor_t* rdmaio_recv_cursor_create(rdmaio_qp_t* qp_ptr, recv_entries_handle_t* recv_entries_handle,
+                                                size_t repost_threshold) {
+    if (!qp_ptr || !recv_entries_handle || !qp_ptr->internal || !recv_entries_handle->internal_ptr) return nullptr;
+
+    // rdmaio_qp_t::internal holds an Arc<Dummy>*
+    Arc<Dummy>& qp_arc = *static_cast<Arc<Dummy>*>(qp_ptr->internal);
+    // recv_entries_handle->internal_ptr holds an Arc<RecvEntries<entry_num>>*
+    Arc<RecvEntries<entry_num>>& entries_arc =
+        *static_cast<Arc<RecvEntries<entry_num>>*>(recv_entries_handle->internal_ptr);
+
+    return new rdmaio_recv_cursor_t(qp_arc, entries_arc, repost_threshold == 0 ? entry_num / 8 : repost_threshold);
+}
+
+int rdmaio_recv_cursor_poll(rdmaio_recv_cursor_t* cursor) {
+    return cursor ? cursor->cursor.poll() : 0;
+}
+
+bool rdmaio_recv_cursor_has_msgs(const rdmaio_recv_cursor_t* cursor) {
+    return cursor && cursor->cursor.has_msgs();
+}
+
+bool rdmaio_recv_cursor_cur_msg(const rdmaio_recv_cursor_t* cursor, uint32_t* out_imm_data, uintptr_t* out_buf_addr) {
+    if (!cursor) return false;
+    auto msg_opt = cursor->cursor.cur_msg();
+    if (!msg_opt.has_value()) return false;
+    if (out_imm_data) {
+        *out_imm_data = msg_opt.value().first;
+    }
+    if (out_buf_addr) {
+        *out_buf_addr = reinterpret_cast<uintptr_t>(msg_opt.value().second);
+    }
+    return true;
+}
+
+void rdmaio_recv_cursor_next(rdmaio_recv_cursor_t* cursor) {
+    if (cursor) {
+        cursor->cursor.next();
+    }
+}
+
+void rdmaio_recv_cursor_flush(rdmaio_recv_cursor_t* cursor) {
+    if (cursor) {
+        cursor->cursor.flush();
+    }
+}
+
+void rdmaio_recv_cursor_destroy(rdmaio_recv_cursor_t* cursor) {
+    delete cursor;
+}
+
+} // extern "C"
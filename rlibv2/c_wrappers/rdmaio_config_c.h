@@ -18,6 +18,7 @@ typedef struct rdmaio_qpconfig_t {
 	int max_recv_size;
 	int qkey;
 	int dc_key;
+	int path_mtu; // an ibv_mtu overriding the negotiated one, 0 to negotiate
 } rdmaio_qpconfig_t;
 
 /*!
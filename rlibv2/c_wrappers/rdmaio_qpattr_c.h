@@ -16,6 +16,7 @@ typedef struct rdmaio_qpattr_t {
 	uint64_t port_id;
 	uint64_t qpn;
 	uint64_t qkey;
+	uint8_t mtu; // active MTU of the port (an ibv_mtu), 0 if unknown
 } rdmaio_qpattr_t;
 
 #ifdef __cplusplus
@@ -0,0 +1,78 @@
+// rdmaio_recv_cursor_c.h
+#ifndef RDMAIO_RECV_CURSOR_C_H
+#define RDMAIO_RECV_CURSOR_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <infiniband/verbs.h>
+#include "rdmaio_qp_c.h"
+#include "rdmaio_rc_recv_manager_c.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /*!
+   * @brief Opaque long-lived receive cursor (see core/qps/recv_cursor.hh).
+   * Unlike rdmaio_recv_iter_t, one cursor is created per QP and reused for
+   * every poll; consumed receive buffers are re-posted in batches.
+   */
+  typedef struct rdmaio_recv_cursor_t rdmaio_recv_cursor_t;
+
+  /*!
+   * @brief Creates a receive cursor for a given QP.
+   * @param qp A pointer to the wrapped QP object (rdmaio_qp_t*).
+   * @param recv_entries_handle A pointer to the wrapped RecvEntries object.
+   * @param repost_threshold Number of consumed buffers re-posted together, 0 for the default.
+   * @return A pointer to the created cursor, or NULL on failure.
+   */
+  rdmaio_recv_cursor_t* rdmaio_recv_cursor_create(rdmaio_qp_t* qp, recv_entries_handle_t* recv_entries_handle,
+                                                  size_t repost_threshold);
+
+  /*!
+   * @brief Polls a batch of completions if all the previous messages have been consumed.
+   * @param cursor The cursor.
+   * @return The number of messages not yet consumed.
+   */
+  int rdmaio_recv_cursor_poll(rdmaio_recv_cursor_t* cursor);
+
+  /*!
+   * @brief Checks if there are more polled messages.
+   * @param cursor The cursor.
+   * @return True if there are more messages, false otherwise.
+   */
+  bool rdmaio_recv_cursor_has_msgs(const rdmaio_recv_cursor_t* cursor);
+
+  /*!
+   * @brief Gets the current message.
+   * @param cursor The cursor.
+   * @param out_imm_data Pointer to store the immediate data of the message. Can be NULL.
+   * @param out_buf_addr Pointer to store the buffer address of the message. Can be NULL.
+   * @return True if a message was available, false otherwise.
+   */
+  bool rdmaio_recv_cursor_cur_msg(const rdmaio_recv_cursor_t* cursor, uint32_t* out_imm_data, uintptr_t* out_buf_addr);
+
+  /*!
+   * @brief Finishes the current message; its buffer is re-posted once the threshold is reached.
+   * @param cursor The cursor.
+   */
+  void rdmaio_recv_cursor_next(rdmaio_recv_cursor_t* cursor);
+
+  /*!
+   * @brief Re-posts all the consumed receive buffers.
+   * @param cursor The cursor.
+   */
+  void rdmaio_recv_cursor_flush(rdmaio_recv_cursor_t* cursor);
+
+  /*!
+   * @brief Re-posts the consumed buffers and destroys the cursor.
+   * @param cursor The cursor to destroy.
+   */
+  void rdmaio_recv_cursor_destroy(rdmaio_recv_cursor_t* cursor);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // RDMAIO_RECV_CURSOR_C_H
@@ -0,0 +1,270 @@
+#pragma once
+
+#include "./lib.hh"
+
+#include "./bootstrap/async_srpc.hh"
+
+namespace rdmaio {
+
+/*!
+  The non-blocking version of ConnectManager, for connecting to many servers
+  (e.g., all the replicas at startup) at once: the handshakes to all the
+  servers are in flight together, so the setup takes about one round trip to
+  the slowest server, instead of the sum of them.
+  Each call completes through its callback, called by poll() (or run()) with
+  the same result as the ConnectManager call of the same name. Lost requests
+  and replies are retransmitted, see ASRpc.
+
+  Example:
+  `
+  AsyncConnectManager cm;
+  for (auto &addr : replicas) {
+    auto peer = cm.add_peer(addr).value();
+    cm.wait_ready(peer, [&, peer](const Result<std::string> &res) {
+      cm.cc_rc("qp", qps[peer], nic_id, QPConfig(),
+               [&](const Result<AsyncConnectManager::cc_rc_ret_t> &res) {
+                 ...
+               });
+    });
+  }
+  cm.run(); // returns once all the callbacks are called
+  `
+  \note: it is not thread-safe, and the callbacks run in the thread calling
+  poll()
+ */
+class AsyncConnectManager {
+  Arc<ASRpc> rpc;
+
+  const std::string err_name_to_long = "Name to long";
+  const std::string err_decode_reply = "Decode reply error";
+  const std::string err_not_found = "attribute not found";
+  const std::string err_unknown_status = "Unknown status code";
+
+public:
+  using peer_t = ASRpc::peer_t;
+  template <typename T> using cb_f = std::function<void(const Result<T> &)>;
+
+  using cc_rc_ret_t = ConnectManager::cc_rc_ret_t;
+  using mr_res_t = ConnectManager::mr_res_t;
+  using qp_attr_ret_t = ConnectManager::qp_attr_ret_t;
+
+  AsyncConnectManager() : rpc(ASRpc::create().value()) {}
+
+  /*!
+    Add a server to connect to, the address is in the format (ip:port)
+   */
+  Option<peer_t> add_peer(const std::string &addr) {
+    return rpc->add_peer(addr);
+  }
+
+  ASRpc &transport() { return *rpc; }
+
+  usize pending() const { return rpc->pending(); }
+
+  /*!
+    Complete the calls whose reply has arrived, see ASRpc::poll
+   */
+  usize poll(const double &timeout_usec = 0) { return rpc->poll(timeout_usec); }
+
+  /*!
+    Poll until all the calls (including the ones issued by the callbacks)
+    have completed, or timeout_usec passed
+    \ret Ok, or Timeout if some calls are still pending
+   */
+  Result<> run(const double &timeout_usec = ::rdmaio::Timer::no_timeout()) {
+    Timer t;
+    while (pending() > 0) {
+      if (t.passed_msec() >= timeout_usec)
+        return ::rdmaio::Timeout();
+      poll(1000);
+    }
+    return ::rdmaio::Ok();
+  }
+
+  /*!
+    Complete once the server answers a heartbeat. Since the heartbeat is
+    retransmitted until timeout_usec, it also waits for a server which is
+    not started yet.
+   */
+  void wait_ready(const peer_t &peer, cb_f<std::string> cb,
+                  const double &timeout_usec = 1000000) {
+    rpc->call(
+        peer, proto::RCtrlBinderIdType::HeartBeat, ByteBuffer(1, '0'),
+        [cb](const Result<ByteBuffer> &res) {
+          cb(::rdmaio::transfer(res, std::string(res.desc)));
+        },
+        timeout_usec);
+  }
+
+  void cc_rc(const peer_t &peer, const std::string &name,
+             const Arc<::rdmaio::qp::RC> rc, const ::rdmaio::nic_id_t &nic_id,
+             const ::rdmaio::qp::QPConfig &config, cb_f<cc_rc_ret_t> cb,
+             const double &timeout_usec = 1000000) {
+    if (unlikely(name.size() > ::rdmaio::qp::kMaxQPNameLen)) {
+      cb(::rdmaio::Err(std::make_pair(err_name_to_long, static_cast<u64>(0))));
+      return;
+    }
+    proto::RCReq req = {};
+    memcpy(req.name, name.data(), name.size());
+    req.whether_create = 1;
+    req.whether_recv = 0;
+    req.nic_id = nic_id;
+    req.config = config;
+    req.attr = rc->my_attr();
+    call_rc(peer, proto::CreateRC, req, rc, std::move(cb), timeout_usec);
+  }
+
+  /*!
+    Create and connect a remote QP on the recv channel *channel_name*,
+    see ConnectManager::cc_rc_msg
+   */
+  void cc_rc_msg(const peer_t &peer, const std::string &qp_name,
+                 const std::string &channel_name, const usize &msg_sz,
+                 const Arc<::rdmaio::qp::RC> rc,
+                 const ::rdmaio::nic_id_t &nic_id,
+                 const ::rdmaio::qp::QPConfig &config, cb_f<cc_rc_ret_t> cb,
+                 const double &timeout_usec = 1000000,
+                 const usize &recv_entries = 0) {
+    if (unlikely(qp_name.size() > ::rdmaio::qp::kMaxQPNameLen ||
+                 channel_name.size() > ::rdmaio::qp::kMaxQPNameLen)) {
+      cb(::rdmaio::Err(std::make_pair(err_name_to_long, static_cast<u64>(0))));
+      return;
+    }
+    proto::RCReq req = {};
+    memcpy(req.name, qp_name.data(), qp_name.size());
+    memcpy(req.name_recv, channel_name.data(), channel_name.size());
+    req.whether_create = 1;
+    req.whether_recv = 1;
+    req.nic_id = nic_id;
+    req.config = config;
+    req.attr = rc->my_attr();
+    req.max_recv_sz = msg_sz;
+    req.recv_entries = recv_entries;
+    call_rc(peer, proto::CreateRCM, req, rc, std::move(cb), timeout_usec);
+  }
+
+  void fetch_remote_mr(const peer_t &peer, const rmem::register_id_t &id,
+                       cb_f<mr_res_t> cb,
+                       const double &timeout_usec = 1000000) {
+    rpc->call(
+        peer, proto::FetchMr,
+        ::rdmaio::Marshal::dump<proto::MRReq>({.id = id}),
+        [this, cb](const Result<ByteBuffer> &res) {
+          if (res != IOCode::Ok) {
+            cb(::rdmaio::transfer(
+                res, std::make_pair(std::string(res.desc), rmem::RegAttr())));
+            return;
+          }
+          auto mr_reply = ::rdmaio::Marshal::dedump<proto::MRReply>(res.desc);
+          if (!mr_reply) {
+            cb(::rdmaio::Err(std::make_pair(err_decode_reply, rmem::RegAttr())));
+            return;
+          }
+          switch (mr_reply.value().status) {
+          case proto::CallbackStatus::Ok:
+            cb(::rdmaio::Ok(
+                std::make_pair(std::string(""), mr_reply.value().attr)));
+            break;
+          case proto::CallbackStatus::NotFound:
+            cb(::rdmaio::NotReady(
+                std::make_pair(std::string(""), rmem::RegAttr())));
+            break;
+          default:
+            cb(::rdmaio::Err(
+                std::make_pair(err_unknown_status, rmem::RegAttr())));
+          }
+        },
+        timeout_usec);
+  }
+
+  void fetch_qp_attr(const peer_t &peer, const std::string &name,
+                     cb_f<qp_attr_ret_t> cb,
+                     const double &timeout_usec = 1000000) {
+    if (unlikely(name.size() > ::rdmaio::qp::kMaxQPNameLen)) {
+      cb(::rdmaio::Err(std::make_pair(err_name_to_long, ::rdmaio::qp::QPAttr())));
+      return;
+    }
+    auto req = proto::QPReq();
+    memcpy(req.name, name.data(), name.size());
+    rpc->call(
+        peer, proto::RCtrlBinderIdType::FetchQPAttr,
+        ::rdmaio::Marshal::dump<proto::QPReq>(req),
+        [this, cb](const Result<ByteBuffer> &res) {
+          if (res != IOCode::Ok) {
+            cb(::rdmaio::transfer(
+                res, std::make_pair(std::string(res.desc), ::rdmaio::qp::QPAttr())));
+            return;
+          }
+          auto qp_reply = ::rdmaio::Marshal::dedump<proto::RCReply>(res.desc);
+          if (!qp_reply) {
+            cb(::rdmaio::Err(
+                std::make_pair(err_decode_reply, ::rdmaio::qp::QPAttr())));
+            return;
+          }
+          switch (qp_reply.value().status) {
+          case proto::CallbackStatus::Ok:
+            cb(::rdmaio::Ok(
+                std::make_pair(std::string(""), qp_reply.value().attr)));
+            break;
+          case proto::CallbackStatus::NotFound:
+            cb(::rdmaio::NotReady(
+                std::make_pair(err_not_found, ::rdmaio::qp::QPAttr())));
+            break;
+          default:
+            cb(::rdmaio::Err(
+                std::make_pair(err_unknown_status, ::rdmaio::qp::QPAttr())));
+          }
+        },
+        timeout_usec);
+  }
+
+private:
+  /*!
+    Send a create request, and connect rc with the created remote QP
+   */
+  void call_rc(const peer_t &peer, const rpc_id_t &id, const proto::RCReq &req,
+               const Arc<::rdmaio::qp::RC> rc, cb_f<cc_rc_ret_t> cb,
+               const double &timeout_usec) {
+    rpc->call(
+        peer, id, ::rdmaio::Marshal::dump<proto::RCReq>(req),
+        [this, rc, cb](const Result<ByteBuffer> &res) {
+          u64 temp_key = 0;
+          if (res != IOCode::Ok) {
+            cb(::rdmaio::transfer(
+                res, std::make_pair(std::string(res.desc), temp_key)));
+            return;
+          }
+          auto qp_reply = ::rdmaio::Marshal::dedump<proto::RCReply>(res.desc);
+          if (!qp_reply) {
+            cb(::rdmaio::Err(std::make_pair(err_decode_reply, temp_key)));
+            return;
+          }
+          switch (qp_reply.value().status) {
+          case proto::CallbackStatus::Ok: {
+            auto ret = rc->connect(qp_reply.value().attr);
+            if (ret != IOCode::Ok) {
+              cb(::rdmaio::Err(std::make_pair(ret.desc, temp_key)));
+              return;
+            }
+            u64 key = qp_reply.value().key;
+            cb(::rdmaio::Ok(std::make_pair(std::string(""), key)));
+            break;
+          }
+          case proto::CallbackStatus::ConnectErr:
+            cb(::rdmaio::Err(
+                std::make_pair(std::string("Remote connect error"), temp_key)));
+            break;
+          case proto::CallbackStatus::WrongArg:
+            cb(::rdmaio::Err(std::make_pair(
+                std::string("Wrong arguments, possible the QP has exsists"),
+                temp_key)));
+            break;
+          default:
+            cb(::rdmaio::Err(std::make_pair(err_unknown_status, temp_key)));
+          }
+        },
+        timeout_usec);
+  }
+};
+
+} // namespace rdmaio
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <poll.h>
+
+#include <cmath>
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "./srpc.hh"
+
+namespace rdmaio {
+
+namespace bootstrap {
+
+/*!
+  A non-blocking SRpc to many servers over one UDP socket.
+  A call is sent right away, and its callback is called (exactly once) by
+  poll() with the reply, or with Timeout once its deadline passes.
+  A call whose reply does not arrive within the RTO of its server is
+  retransmitted with a doubled RTO. The RTO follows the measured round trips
+  (RFC 6298, without samples of retransmitted calls), so a lost datagram is
+  resent after a few round trips instead of after the whole call timeout.
+  The server answers a retransmitted call from its ReplyCache, so calls like
+  CreateRC are not executed twice.
+
+  Example:
+  `
+  auto rpc = ASRpc::create().value();
+  auto peer = rpc->add_peer("192.168.0.1:8888").value();
+  rpc->call(peer, proto::FetchMr, param,
+            [](const Result<ByteBuffer> &reply) { ... });
+  while (rpc->pending() > 0)
+    rpc->poll(1000);
+  `
+  \note: it is not thread-safe
+ */
+class ASRpc : public AbsChannel {
+public:
+  using reply_cb_f = std::function<void(const Result<ByteBuffer> &)>;
+  using peer_t = usize;
+
+  static constexpr double kInitRTOUsec = 20000;
+  static constexpr double kMinRTOUsec = 1000;
+  static constexpr double kMaxRTOUsec = 200000;
+
+  // replies which match no pending call, e.g., the duplicated ones
+  u64 stale_replies = 0;
+  u64 retransmits = 0;
+
+private:
+  struct Peer {
+    sockaddr_in addr;
+    // smoothed round trip and its variance, < 0 before the first sample
+    double srtt = -1;
+    double rttvar = 0;
+    double rto = kInitRTOUsec;
+  };
+
+  struct Call {
+    peer_t peer;
+    ByteBuffer msg;
+    double sent_at;
+    double rto;
+    double resend_at;
+    double deadline;
+    bool retransmitted;
+    reply_cb_f cb;
+  };
+
+  std::vector<Peer> peers;
+  // pending calls by checksum
+  std::map<u64, Call> calls;
+  u64 checksum = SRpc::invalid_checksum + 1;
+  ByteBuffer recv_buf;
+  Timer clock;
+
+  ASRpc() : AbsChannel(socket(AF_INET, SOCK_DGRAM, 0)), recv_buf(kMaxMsgSz, '\0') {
+    if (valid())
+      fcntl(this->sock_fd, F_SETFL, O_NONBLOCK);
+  }
+
+public:
+  static Option<Arc<ASRpc>> create() {
+    auto rpc = Arc<ASRpc>(new ASRpc());
+    if (rpc->valid())
+      return rpc;
+    return {};
+  }
+
+  /*!
+    Add a server, the address is in the format (ip:port)
+   */
+  Option<peer_t> add_peer(const std::string &addr) {
+    auto host_port = IPNameHelper::parse_addr(addr);
+    if (!host_port)
+      return {};
+    auto ip_res = IPNameHelper::host2ip(std::get<0>(host_port.value()));
+    if (ip_res != IOCode::Ok)
+      return {};
+    Peer p;
+    p.addr = {};
+    p.addr.sin_family = AF_INET;
+    p.addr.sin_port = htons(std::get<1>(host_port.value()));
+    p.addr.sin_addr.s_addr = inet_addr(ip_res.desc.c_str());
+    peers.push_back(p);
+    return peers.size() - 1;
+  }
+
+  usize pending() const { return calls.size(); }
+
+  // the current RTO of a server
+  double rto(const peer_t &peer) const { return peers.at(peer).rto; }
+
+  /*!
+    Send an RPC with id "id" to peer. cb is called once, by poll(), or here
+    if the call cannot be sent.
+    \param timeout_usec: when the call fails with Timeout, retransmissions
+    included
+   */
+  void call(const peer_t &peer, const rpc_id_t &id,
+            const ByteBuffer &parameter, reply_cb_f cb,
+            const double &timeout_usec = 1000000) {
+    if (unlikely(peer >= peers.size())) {
+      cb(::rdmaio::Err(ByteBuffer("unknown peer")));
+      return;
+    }
+    auto mmsg_o = SRpc::MMsg::create_exact(sizeof(SRpcHeader) + parameter.size());
+    if (unlikely(!mmsg_o)) {
+      cb(::rdmaio::Err(ByteBuffer("Msg too large!, only kMaxMsgSz supported")));
+      return;
+    }
+    auto &mmsg = mmsg_o.value();
+    RDMA_ASSERT(mmsg.append(::rdmaio::Marshal::dump<SRpcHeader>(
+        {.id = id, .checksum = checksum})));
+    RDMA_ASSERT(mmsg.append(parameter));
+
+    auto now = clock.passed_msec();
+    auto rto = peers[peer].rto;
+    Call c = {.peer = peer,
+              .msg = *mmsg.buf,
+              .sent_at = now,
+              .rto = rto,
+              .resend_at = now + rto,
+              .deadline = now + timeout_usec,
+              .retransmitted = false,
+              .cb = std::move(cb)};
+    auto res = raw_send(c.msg, peers[peer].addr);
+    if (unlikely(res != IOCode::Ok && errno != EAGAIN)) {
+      c.cb(::rdmaio::Err(ByteBuffer(res.desc)));
+      return;
+    }
+    // a send dropped for EAGAIN is retransmitted as a lost one
+    calls.insert(std::make_pair(checksum, std::move(c)));
+    checksum += 1;
+  }
+
+  /*!
+    Receive the replies (waiting at most timeout_usec if there is none),
+    call their callbacks, and retransmit (or time out) the overdue calls.
+    \ret the number of callbacks called
+   */
+  usize poll(const double &timeout_usec = 0) {
+    usize done = 0;
+    if (calls.empty())
+      return done;
+
+    // wait no longer than the next retransmission
+    auto now = clock.passed_msec();
+    auto wait_usec = timeout_usec;
+    for (auto &c : calls)
+      wait_usec = std::min(wait_usec, std::max(0.0, c.second.resend_at - now));
+    if (wait_usec > 0) {
+      pollfd pfd = {.fd = this->sock_fd, .events = POLLIN, .revents = 0};
+      ::poll(&pfd, 1, static_cast<int>(std::ceil(wait_usec / 1000)));
+    }
+
+    while (true) {
+      sockaddr_in from;
+      socklen_t len = sizeof(from);
+      auto n = recvfrom(this->sock_fd, &recv_buf[0], recv_buf.size(), 0,
+                        reinterpret_cast<sockaddr *>(&from), &len);
+      if (n < 0)
+        break;
+      done += on_reply(ByteBuffer(recv_buf.data(), n), from);
+    }
+
+    now = clock.passed_msec();
+    for (auto it = calls.begin(); it != calls.end();) {
+      auto &c = it->second;
+      if (now >= c.deadline) {
+        auto cb = std::move(c.cb);
+        it = calls.erase(it);
+        cb(::rdmaio::Timeout(ByteBuffer("")));
+        done += 1;
+        continue;
+      }
+      if (now >= c.resend_at) {
+        raw_send(c.msg, peers[c.peer].addr);
+        c.retransmitted = true;
+        c.rto = std::min(c.rto * 2, kMaxRTOUsec);
+        c.resend_at = now + c.rto;
+        peers[c.peer].rto = std::max(peers[c.peer].rto, c.rto);
+        retransmits += 1;
+      }
+      ++it;
+    }
+    return done;
+  }
+
+private:
+  usize on_reply(ByteBuffer &&msg, const sockaddr_in &from) {
+    Option<SReplyHeader> header = {};
+    Option<ByteBuffer> payload = {};
+    auto decoded = MultiMsg<kMaxMsgSz>::create_from(msg);
+    if (decoded) {
+      auto h = decoded.value().query_one(0);
+      if (h)
+        header = ::rdmaio::Marshal::dedump<SReplyHeader>(h.value());
+      payload = decoded.value().query_one(1);
+    }
+    if (!header) {
+      stale_replies += 1;
+      return 0;
+    }
+
+    auto it = calls.find(header.value().checksum);
+    if (it == calls.end() ||
+        peers[it->second.peer].addr.sin_addr.s_addr != from.sin_addr.s_addr ||
+        peers[it->second.peer].addr.sin_port != from.sin_port) {
+      stale_replies += 1;
+      return 0;
+    }
+    auto c = std::move(it->second);
+    calls.erase(it);
+    if (!c.retransmitted)
+      sample_rtt(peers[c.peer], clock.passed_msec() - c.sent_at);
+
+    switch (header.value().callstatus) {
+    case CallStatus::Ok:
+      c.cb(::rdmaio::Ok(payload ? payload.value() : ByteBuffer("")));
+      break;
+    case CallStatus::Nop:
+      c.cb(::rdmaio::Err(ByteBuffer("Not ready")));
+      break;
+    default:
+      c.cb(::rdmaio::Err(ByteBuffer("unknown error")));
+    }
+    return 1;
+  }
+
+  static void sample_rtt(Peer &p, const double &rtt) {
+    if (p.srtt < 0) {
+      p.srtt = rtt;
+      p.rttvar = rtt / 2;
+    } else {
+      p.rttvar = 0.75 * p.rttvar + 0.25 * std::abs(p.srtt - rtt);
+      p.srtt = 0.875 * p.srtt + 0.125 * rtt;
+    }
+    p.rto = std::min(std::max(p.srtt + 4 * p.rttvar, kMinRTOUsec), kMaxRTOUsec);
+  }
+};
+
+} // namespace bootstrap
+
+} // namespace rdmaio
@@ -2,8 +2,12 @@
 
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <sys/epoll.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <vector>
+
 #include "../common.hh"
 
 #include "../utils/ipname.hh"
@@ -327,6 +331,187 @@ public:
   };
 }; // namespace bootstrap
 
+/*!
+  A UDP-based channel for a server thread receiving msgs in batches: it waits
+  on the socket with epoll, receives up to *batch* msgs with one recvmmsg, and
+  sends the replies queued for them with one sendmmsg.
+  With reuse_port, several channels (e.g., one per thread) bind to the same
+  port, and the kernel spreads the clients over them; the msgs of one client
+  always go to the same channel.
+  To use:
+  `
+  auto ch = BatchRecvChannel::create(port).value();
+  auto n = ch->recv_batch(1000);
+  for (usize i = 0; i < n; ++i)
+    ch->reply(i, handle(ch->msg(i)));
+  ch->flush_replies();
+  `
+ */
+class BatchRecvChannel : public AbsChannel {
+public:
+  // socket recv buffer, so that a burst of requests (e.g., all the clients
+  // re-connecting at once) is queued instead of dropped
+  static constexpr int kRcvBufSz = 4 * 1024 * 1024;
+
+private:
+  int epoll_fd = -1;
+
+  std::vector<ByteBuffer> bufs;
+  std::vector<sockaddr_in> addrs;
+  std::vector<iovec> iovs;
+  std::vector<mmsghdr> hdrs;
+
+  // the replies queued since the last flush
+  std::vector<ByteBuffer> replies;
+  std::vector<iovec> reply_iovs;
+  std::vector<mmsghdr> reply_hdrs;
+  usize num_replies = 0;
+
+  BatchRecvChannel(int port, const std::string &host, const usize &batch,
+                   bool reuse_port)
+      : AbsChannel(socket(AF_INET, SOCK_DGRAM, 0)),
+        bufs(batch, ByteBuffer(kMaxMsgSz, '\0')), addrs(batch), iovs(batch),
+        hdrs(batch), replies(batch), reply_iovs(batch), reply_hdrs(batch) {
+    if (!valid())
+      return;
+    fcntl(this->sock_fd, F_SETFL, O_NONBLOCK);
+
+    int one = 1;
+    if (reuse_port &&
+        setsockopt(this->sock_fd, SOL_SOCKET, SO_REUSEPORT, &one,
+                   sizeof(one))) {
+      RDMA_LOG(4) << "set SO_REUSEPORT error: " << strerror(errno);
+      close_channel();
+      return;
+    }
+    // the kernel caps it at net.core.rmem_max, which is fine
+    setsockopt(this->sock_fd, SOL_SOCKET, SO_RCVBUF, &kRcvBufSz,
+               sizeof(kRcvBufSz));
+
+    sockaddr_in my_addr = {};
+    my_addr.sin_family = AF_INET;
+    my_addr.sin_port = htons(port);
+    my_addr.sin_addr.s_addr =
+        host == "localhost" ? INADDR_ANY : inet_addr(host.c_str());
+    if (bind(this->sock_fd, (const struct sockaddr *)&my_addr,
+             sizeof(my_addr))) {
+      RDMA_LOG(4) << "bind to port: " << port
+                  << " error with error: " << strerror(errno);
+      close_channel();
+      return;
+    }
+
+    epoll_fd = epoll_create1(0);
+    epoll_event ev = {.events = EPOLLIN, .data = {.fd = this->sock_fd}};
+    if (epoll_fd < 0 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, this->sock_fd, &ev)) {
+      RDMA_LOG(4) << "create epoll error: " << strerror(errno);
+      close_channel();
+    }
+  }
+
+  void prepare_recv(const usize &i) {
+    iovs[i] = {.iov_base = &bufs[i][0], .iov_len = bufs[i].size()};
+    memset(&hdrs[i], 0, sizeof(mmsghdr));
+    hdrs[i].msg_hdr.msg_name = &addrs[i];
+    hdrs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    hdrs[i].msg_hdr.msg_iov = &iovs[i];
+    hdrs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  int try_recv_batch() {
+    for (usize i = 0; i < hdrs.size(); ++i)
+      prepare_recv(i);
+    return recvmmsg(this->sock_fd, hdrs.data(), hdrs.size(), MSG_DONTWAIT,
+                    nullptr);
+  }
+
+public:
+  static Option<Arc<BatchRecvChannel>> create(int port,
+                                              const std::string &h = "localhost",
+                                              const usize &batch = 32,
+                                              bool reuse_port = false) {
+    auto rc = Arc<BatchRecvChannel>(
+        new BatchRecvChannel(port, h, batch, reuse_port));
+    if (rc->valid())
+      return rc;
+    return {};
+  }
+
+  ~BatchRecvChannel() {
+    if (epoll_fd >= 0)
+      close(epoll_fd);
+  }
+
+  /*!
+    Recv up to *batch* msgs, waiting at most timeout_usec if none is queued.
+    The msgs (and the queued replies) of the last batch are dropped.
+    \ret the number of msgs received
+   */
+  usize recv_batch(const double &timeout_usec = 1000) {
+    num_replies = 0;
+    // under load, msgs are queued already, so skip the wait
+    auto n = try_recv_batch();
+    if (n > 0)
+      return n;
+
+    epoll_event ev;
+    auto ready = epoll_wait(epoll_fd, &ev, 1,
+                            std::max(1, static_cast<int>(timeout_usec / 1000)));
+    if (ready <= 0)
+      return 0;
+    n = try_recv_batch();
+    return n > 0 ? n : 0;
+  }
+
+  /*!
+    The i-th msg of the last batch, the buffer is kMaxMsgSz bytes
+   */
+  ByteBuffer &msg(const usize &i) { return bufs[i]; }
+
+  usize msg_len(const usize &i) const { return hdrs[i].msg_len; }
+
+  // the sender of the i-th msg of the last batch
+  const sockaddr_in &msg_addr(const usize &i) const { return addrs[i]; }
+
+  /*!
+    Queue the reply to the i-th msg, sent by flush_replies()
+   */
+  void reply(const usize &i, ByteBuffer &&buf) {
+    auto &r = replies[num_replies];
+    r = std::move(buf);
+    reply_iovs[num_replies] = {.iov_base = &r[0], .iov_len = r.size()};
+    auto &h = reply_hdrs[num_replies];
+    memset(&h, 0, sizeof(mmsghdr));
+    h.msg_hdr.msg_name = &addrs[i];
+    h.msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    h.msg_hdr.msg_iov = &reply_iovs[num_replies];
+    h.msg_hdr.msg_iovlen = 1;
+    num_replies += 1;
+  }
+
+  /*!
+    Send all the queued replies
+    \ret the number of replies sent
+   */
+  usize flush_replies() {
+    usize sent = 0;
+    while (sent < num_replies) {
+      auto n = sendmmsg(this->sock_fd, &reply_hdrs[sent], num_replies - sent,
+                        MSG_CONFIRM);
+      if (n <= 0) {
+        if (errno == EAGAIN || errno == EINTR)
+          continue;
+        RDMA_LOG(4) << "send replies error: " << strerror(errno);
+        break;
+      }
+      sent += n;
+    }
+    num_replies = 0;
+    return sent;
+  }
+};
+
 } // namespace bootstrap
 
 } // namespace rdmaio
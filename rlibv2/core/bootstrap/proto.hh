@@ -20,6 +20,8 @@ enum RCtrlBinderIdType : rpc_id_t {
   DeleteRC,
   FetchQPAttr,  // fetch a created QP's attr. useful for UD QP
   FetchDCAttr,  // fetch a DC attr. used for DCT
+  CreateRCBulk,  // create many RCs for connect in one call
+  CreateRCMBulk, // create many RCs which use message in one call
   Reserved,
 };
 
@@ -72,6 +74,8 @@ struct __attribute__((packed)) RCReq {
   ::rdmaio::qp::QPAttr attr; // the attr used for connect
 
   u64 max_recv_sz = 4096;
+  // #recv buffers of max_recv_sz posted for the QP, 0: one per recv entry
+  u32 recv_entries = 0;
 };
 
 struct __attribute__((packed)) RCReply {
@@ -80,6 +84,41 @@ struct __attribute__((packed)) RCReply {
   u64 key;
 };
 
+/*!
+  Req/Reply for creating many RC QPs in one call.
+  QP i is named "<prefix><base + i>", and all of them are created with the
+  same parameters, so only the attr used to connect each one is sent.
+  The request is followed by *num* QPAttr, and the reply by *num* RCBulkEntry
+  in the same order. The QPs are created all or nothing.
+ */
+struct __attribute__((packed)) RCBulkReq {
+  char prefix[::rdmaio::qp::kMaxQPNameLen + 1];
+  char name_recv[::rdmaio::qp::kMaxQPNameLen + 1];
+
+  u32 base = 0;
+  u16 num = 0;
+
+  ::rdmaio::nic_id_t nic_id;
+  ::rdmaio::qp::QPConfig config;
+
+  u64 max_recv_sz = 4096;
+  u32 recv_entries = 0;
+};
+
+struct __attribute__((packed)) RCBulkReply {
+  CallbackStatus status;
+  u16 num = 0;
+};
+
+struct __attribute__((packed)) RCBulkEntry {
+  ::rdmaio::qp::QPAttr attr;
+  u64 key;
+};
+
+// QPs of one bulk call, so that its request and reply each fit in one SRpc
+// msg (checked in ./srpc.hh). larger bulks are split into several calls.
+const usize kMaxBulkRC = 58;
+
 struct __attribute__((packed)) DCReply {
   CallbackStatus status;
   ::rdmaio::qp::DCAttr attr;
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <deque>
 #include <mutex>   // lock
+#include <unordered_map>
 #include <utility> // std::pair
+#include <vector>
 
 #include "./channel.hh"
 #include "./multi_msg.hh"
@@ -35,6 +38,15 @@ struct __attribute__((packed)) SReplyHeader {
   u8 dummy = 0;
 };
 
+static_assert(sizeof(MsgsHeader) + sizeof(SRpcHeader) + sizeof(RCBulkReq) +
+                      kMaxBulkRC * sizeof(::rdmaio::qp::QPAttr) <=
+                  kMaxMsgSz,
+              "a bulk RC request does not fit in one msg");
+static_assert(sizeof(MsgsHeader) + sizeof(SReplyHeader) + sizeof(RCBulkReply) +
+                      kMaxBulkRC * sizeof(RCBulkEntry) <=
+                  kMaxMsgSz,
+              "a bulk RC reply does not fit in one msg");
+
 /*!
   A simple RPC used for establish connection for RDMA.
  */
@@ -106,7 +118,9 @@ public:
           default:
             return ::rdmaio::Err(ByteBuffer("unknown error"));
           }
-        } else
+        } else if (header.checksum < checksum)
+          goto retry; // a late reply of a call we have sent again
+        else
           return ::rdmaio::Err(ByteBuffer("Fatal checksum error"));
       } catch (std::exception &e) {
 
@@ -119,6 +133,78 @@ public:
   }
 };
 
+/*!
+  The replies recently sent by a server worker, so that a retransmitted
+  request (e.g., by an ASRpc whose reply is lost) gets the same reply instead
+  of being handled twice, which is not idempotent for calls like CreateRC.
+  A request is identified by its sender and its bytes, which carry the
+  sender's checksum. Entries are dropped after kTTLUsec, or when more than
+  kCapacity are kept.
+  \note: it is not thread-safe, each worker owns one; the msgs of one client
+  always go to the same worker.
+ */
+class ReplyCache {
+public:
+  static constexpr usize kCapacity = 4096;
+  static constexpr double kTTLUsec = 2000000;
+
+private:
+  struct Entry {
+    ByteBuffer reply;
+    double at_usec;
+  };
+  std::unordered_map<std::string, Entry> entries;
+  // keys in insertion order, for eviction
+  std::deque<std::string> order;
+  Timer clock;
+
+  static std::string key_of(const sockaddr_in &from, const ByteBuffer &msg,
+                            const usize &len) {
+    std::string key(reinterpret_cast<const char *>(&from.sin_addr),
+                    sizeof(from.sin_addr));
+    key.append(reinterpret_cast<const char *>(&from.sin_port),
+               sizeof(from.sin_port));
+    key.append(msg.data(), len);
+    return key;
+  }
+
+  void evict(const double &now) {
+    while (!order.empty()) {
+      auto it = entries.find(order.front());
+      if (order.size() <= kCapacity && it != entries.end() &&
+          now - it->second.at_usec < kTTLUsec)
+        break;
+      if (it != entries.end())
+        entries.erase(it);
+      order.pop_front();
+    }
+  }
+
+public:
+  /*!
+    The reply sent to the same request from the same sender, if any
+   */
+  Option<ByteBuffer> query(const sockaddr_in &from, const ByteBuffer &msg,
+                           const usize &len) {
+    evict(clock.passed_msec());
+    auto it = entries.find(key_of(from, msg, len));
+    if (it == entries.end())
+      return {};
+    return it->second.reply;
+  }
+
+  void put(const sockaddr_in &from, const ByteBuffer &msg, const usize &len,
+           const ByteBuffer &reply) {
+    auto key = key_of(from, msg, len);
+    auto res = entries.insert(
+        std::make_pair(key, Entry{.reply = reply, .at_usec = clock.passed_msec()}));
+    if (res.second)
+      order.push_back(std::move(key));
+  }
+
+  usize size() const { return entries.size(); }
+};
+
 class SRpcHandler;
 class RPCFactory {
   friend class SRpcHandler;
@@ -158,92 +244,126 @@ private:
   }
 };
 
+/*!
+  The server end of SRpc, served by one or more worker threads.
+  Each worker owns a BatchRecvChannel on the same port (SO_REUSEPORT if there
+  are several), so the requests of different clients are handled in parallel,
+  while the requests of one client are handled in order by one worker.
+  \note: with more than one worker, the registered handlers may run
+  concurrently. register them before serving.
+ */
 class SRpcHandler {
-  Arc<RecvChannel> channel;
+  std::vector<Arc<BatchRecvChannel>> channels;
+  // one per worker
+  std::vector<ReplyCache> caches;
   RPCFactory factory;
 
 public:
-  explicit SRpcHandler(const usize &port, const std::string &h = "localhost")
-      : channel(RecvChannel::create(port, h).value()) {}
+  // requests received by a worker with one recvmmsg
+  static constexpr usize kRecvBatch = 32;
+
+  explicit SRpcHandler(const usize &port, const std::string &h = "localhost",
+                       const usize &workers = 1)
+      : caches(workers) {
+    RDMA_ASSERT(workers > 0);
+    for (usize i = 0; i < workers; ++i)
+      channels.push_back(
+          BatchRecvChannel::create(port, h, kRecvBatch, workers > 1).value());
+  }
 
   bool register_handler(rpc_id_t id, RPCFactory::req_handler_f val) {
     return factory.register_handler(id, val);
   }
 
+  usize num_workers() const { return channels.size(); }
+
   /*!
-    Run a event loop to call received RPC calls
-    \ret: number of PRCs served
+    Decode one request, call its handler and encode the reply
    */
-  usize run_one_event_loop() {
-    usize count = 0;
-    for (channel->start(1000000); channel->has_msg(); channel->next(), count += 1) {
-
-      auto &msg = channel->cur();
-
-      u64 checksum = SRpc::invalid_checksum;
+  ByteBuffer handle(ByteBuffer &msg) {
+    u64 checksum = SRpc::invalid_checksum;
+    try {
+      MultiMsg<kMaxMsgSz> segmeneted_msg;
+      SRpcHeader header;
       try {
-        MultiMsg<kMaxMsgSz> segmeneted_msg;
-        SRpcHeader header;
-        try {
-          // create from move the cur_msg to a MuiltiMsg
-          segmeneted_msg = MultiMsg<kMaxMsgSz>::create_from(msg).value();
-
-          // query the RPC call id
-          header = ::rdmaio::Marshal::dedump<SRpcHeader>(
-                       segmeneted_msg.query_one(0).value())
-                       .value();
-
-          checksum = header.checksum;
-        } catch (std::exception &e) {
-          // some error happens, which is fatal because we cannot decode the
-          // checksum
-
-          MultiMsg<kMaxMsgSz> coded_reply =
-            MultiMsg<kMaxMsgSz>::create_exact(sizeof(SReplyHeader)).value();
-
-          coded_reply.append(::rdmaio::Marshal::dump<SReplyHeader>(
-              {.callstatus = CallStatus::FatalErr,
-               .checksum = checksum,
-               .dummy = 0}));
-          channel->reply_cur(*coded_reply.buf);
+        // create from move the cur_msg to a MuiltiMsg
+        segmeneted_msg = MultiMsg<kMaxMsgSz>::create_from(msg).value();
 
-          continue;
-        }
-
-        // really handles the request
-        rpc_id_t id = header.id;
-
-        ByteBuffer parameter = segmeneted_msg.query_one(1).value();
+        // query the RPC call id
+        header = ::rdmaio::Marshal::dedump<SRpcHeader>(
+                     segmeneted_msg.query_one(0).value())
+                     .value();
 
-        // call the RPC
-        ByteBuffer reply = factory.call_one(id, parameter);
+        checksum = header.checksum;
+      } catch (std::exception &e) {
+        // some error happens, which is fatal because we cannot decode the
+        // checksum
 
         MultiMsg<kMaxMsgSz> coded_reply =
-            MultiMsg<kMaxMsgSz>::create_exact(sizeof(SReplyHeader) +
-                                              reply.size())
-                .value();
+            MultiMsg<kMaxMsgSz>::create_exact(sizeof(SReplyHeader)).value();
+
         coded_reply.append(::rdmaio::Marshal::dump<SReplyHeader>(
-            {.callstatus = CallStatus::Ok,
+            {.callstatus = CallStatus::FatalErr,
              .checksum = checksum,
-             .dummy = (id == RCtrlBinderIdType::HeartBeat)
-                          ? static_cast<u8>(1)
-                          : static_cast<u8>(0)}));
-        coded_reply.append(reply);
-
-        // send the reply to the client
-        channel->reply_cur(*coded_reply.buf);
+             .dummy = 0}));
+        return std::move(*coded_reply.buf);
+      }
 
-      } catch (std::exception &e) {
-        MultiMsg<kMaxMsgSz> coded_reply =
+      // really handles the request
+      rpc_id_t id = header.id;
+
+      ByteBuffer parameter = segmeneted_msg.query_one(1).value();
+
+      // call the RPC
+      ByteBuffer reply = factory.call_one(id, parameter);
+
+      MultiMsg<kMaxMsgSz> coded_reply =
+          MultiMsg<kMaxMsgSz>::create_exact(sizeof(SReplyHeader) +
+                                            reply.size())
+              .value();
+      coded_reply.append(::rdmaio::Marshal::dump<SReplyHeader>(
+          {.callstatus = CallStatus::Ok,
+           .checksum = checksum,
+           .dummy = (id == RCtrlBinderIdType::HeartBeat)
+                        ? static_cast<u8>(1)
+                        : static_cast<u8>(0)}));
+      coded_reply.append(reply);
+      return std::move(*coded_reply.buf);
+
+    } catch (std::exception &e) {
+      MultiMsg<kMaxMsgSz> coded_reply =
           MultiMsg<kMaxMsgSz>::create_exact(sizeof(SReplyHeader)).value();
 
-        // some error happens
-        coded_reply.append(::rdmaio::Marshal::dump<SReplyHeader>(
-            {.callstatus = CallStatus::Nop, .checksum = checksum}));
-        channel->reply_cur(*coded_reply.buf);
-      }
+      // some error happens
+      coded_reply.append(::rdmaio::Marshal::dump<SReplyHeader>(
+          {.callstatus = CallStatus::Nop, .checksum = checksum}));
+      return std::move(*coded_reply.buf);
     }
+  }
 
+  /*!
+    Run a event loop of the worker: wait (at most 1 second) for a batch of
+    RPC calls, serve them and send the replies in one batch.
+    A retransmitted call is answered from the worker's ReplyCache.
+    \ret: number of PRCs served
+   */
+  usize run_one_event_loop(const usize &worker = 0) {
+    auto &channel = *channels.at(worker);
+    auto &cache = caches.at(worker);
+    auto count = channel.recv_batch(1000000);
+    for (usize i = 0; i < count; ++i) {
+      auto &msg = channel.msg(i);
+      auto len = channel.msg_len(i);
+      auto cached = cache.query(channel.msg_addr(i), msg, len);
+      if (cached) {
+        channel.reply(i, std::move(cached.value()));
+        continue;
+      }
+      auto reply = handle(msg);
+      cache.put(channel.msg_addr(i), msg, len, reply);
+      channel.reply(i, std::move(reply));
+    }
+    channel.flush_replies();
     return count;
   }
 };
@@ -0,0 +1,426 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "../qps/rc.hh"
+#include "../qps/recv_cursor.hh"
+
+#include "./task.hh"
+
+namespace rdmaio {
+
+namespace coro {
+
+using namespace qp;
+using namespace rmem;
+
+/*!
+  Something the scheduler polls for completions, e.g., an AsyncRecv
+ */
+class Pollable {
+public:
+  /*!
+    Poll completions and resume the coroutines waiting on them
+    \ret the number of coroutines resumed
+   */
+  virtual usize progress() = 0;
+  virtual ~Pollable() = default;
+};
+
+/*!
+  Scheduler runs the coroutines of one thread: it resumes the spawned tasks,
+  and polls the send cqs of the watched QPs and the watched AsyncRecvs to
+  resume the coroutines awaiting their completions.
+  It is not thread-safe, each polling thread owns one.
+
+  Example:
+  `
+  Scheduler s;
+  AsyncQP qp(rc, s);
+  AsyncRecv<RC, 128> ch(rc, entries, s);
+  for (int i = 0; i < streams; ++i)
+    s.spawn(stream(qp, ch, i)); // Task<> stream(AsyncQP &, AsyncRecv<..> &, int)
+  s.run(); // returns once all the streams return
+  `
+ */
+class Scheduler {
+  std::deque<std::coroutine_handle<>> ready;
+  std::vector<Arc<RC>> qps;
+  std::vector<Pollable *> pollables;
+  // detached tasks not finished
+  usize running = 0;
+
+public:
+  // send completions polled per QP in one round (one ibv_poll_cq)
+  static const usize kSendPollBatch = 16;
+
+private:
+  ibv_wc wcs[kSendPollBatch];
+
+public:
+
+  Scheduler() = default;
+  Scheduler(const Scheduler &) = delete;
+  Scheduler &operator=(const Scheduler &) = delete;
+
+  ~Scheduler() {
+    // tasks never started are not owned by anyone else
+    for (auto h : ready)
+      h.destroy();
+  }
+
+  /*!
+    Run a task detached, it starts at the next poll() and its frame is freed
+    when it returns
+   */
+  void spawn(Task<> t) {
+    auto h = t.release();
+    h.promise().detached_counter = &running;
+    running += 1;
+    ready.push_back(h);
+  }
+
+  /*!
+    Resume h at the next poll()
+   */
+  void schedule(std::coroutine_handle<> h) { ready.push_back(h); }
+
+  /*!
+    watch / unwatch may be called by a coroutine resumed in poll(), e.g.,
+    when it returns and frees the channel it owns. Unwatched entries are
+    cleared in place, and removed at the next poll().
+   */
+  void watch(const Arc<RC> &qp) {
+    if (std::find(qps.begin(), qps.end(), qp) == qps.end())
+      qps.push_back(qp);
+  }
+
+  void unwatch(const Arc<RC> &qp) {
+    std::replace(qps.begin(), qps.end(), qp, Arc<RC>(nullptr));
+  }
+
+  void watch(Pollable *p) { pollables.push_back(p); }
+
+  void unwatch(Pollable *p) {
+    std::replace(pollables.begin(), pollables.end(), p,
+                 static_cast<Pollable *>(nullptr));
+  }
+
+  usize num_running() const { return running; }
+
+  /*!
+    One round: resume the ready coroutines, then poll the completions
+    \ret the number of coroutines resumed
+   */
+  usize poll();
+
+  /*!
+    Poll until all the spawned tasks return
+   */
+  void run() {
+    while (running > 0)
+      poll();
+  }
+};
+
+/*!
+  co_await on an RDMA op: the op is posted signaled, with the awaiter as its
+  wr_id, and the coroutine is resumed by the scheduler with the op's wc.
+  \note: RC keeps 48 bits of a wr_id, enough for user-space addresses
+ */
+class OpAwaiter {
+  friend class Scheduler;
+
+  RC *qp;
+  RC::ReqDesc desc;
+  RC::ReqPayload payload;
+  RegAttr local;
+  RegAttr remote;
+
+  std::coroutine_handle<> h;
+  ibv_wc wc;
+  Option<std::string> post_err;
+
+public:
+  OpAwaiter(RC *qp, const RC::ReqDesc &desc, const RC::ReqPayload &payload,
+            const RegAttr &local, const RegAttr &remote)
+      : qp(qp), desc(desc), payload(payload), local(local), remote(remote) {}
+
+  bool await_ready() const noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<> awaiter) {
+    h = awaiter;
+    desc.flags |= IBV_SEND_SIGNALED;
+    desc.wr_id = reinterpret_cast<u64>(this);
+    auto res = qp->send_normal(desc, payload, local, remote);
+    if (unlikely(res != IOCode::Ok)) {
+      post_err = res.desc;
+      return false; // resume right away with the error
+    }
+    return true;
+  }
+
+  /*!
+    \ret Ok(wc), or Err(wc status / post error)
+   */
+  Result<std::string> await_resume() const {
+    if (unlikely(post_err))
+      return ::rdmaio::Err(post_err.value());
+    if (unlikely(wc.status != IBV_WC_SUCCESS))
+      return ::rdmaio::Err(Dummy::wc_status(wc));
+    return ::rdmaio::Ok(std::string(""));
+  }
+};
+
+/*!
+  An RC QP whose ops can be awaited in the coroutines of a scheduler.
+  The default local/remote MRs of the QP (bind_local_mr / bind_remote_mr) are
+  used if not given.
+
+  Example:
+  `
+  AsyncQP qp(rc, s);
+  auto res = co_await qp.write(buf, 0, sizeof(u64));
+  auto res = co_await qp.send(buf, len, imm);
+  `
+ */
+class AsyncQP {
+  Scheduler &s;
+  Arc<RC> qp;
+
+public:
+  AsyncQP(Arc<RC> qp, Scheduler &s) : s(s), qp(qp) { s.watch(this->qp); }
+
+  AsyncQP(const AsyncQP &) = delete;
+  AsyncQP &operator=(const AsyncQP &) = delete;
+
+  ~AsyncQP() { s.unwatch(qp); }
+
+  OpAwaiter op(const RC::ReqDesc &desc, const RC::ReqPayload &payload,
+               const RegAttr &local, const RegAttr &remote) {
+    return OpAwaiter(qp.get(), desc, payload, local, remote);
+  }
+
+  OpAwaiter op(const RC::ReqDesc &desc, const RC::ReqPayload &payload) {
+    return op(desc, payload, qp->local_mr.value(), qp->remote_mr.value());
+  }
+
+  OpAwaiter write(RMem::raw_ptr_t local_addr, const u64 &remote_off,
+                  const u32 &len) {
+    return op({.op = IBV_WR_RDMA_WRITE, .flags = 0, .len = len, .wr_id = 0},
+              {.local_addr = local_addr, .remote_addr = remote_off,
+               .imm_data = 0});
+  }
+
+  OpAwaiter read(RMem::raw_ptr_t local_addr, const u64 &remote_off,
+                 const u32 &len) {
+    return op({.op = IBV_WR_RDMA_READ, .flags = 0, .len = len, .wr_id = 0},
+              {.local_addr = local_addr, .remote_addr = remote_off,
+               .imm_data = 0});
+  }
+
+  OpAwaiter send(RMem::raw_ptr_t local_addr, const u32 &len,
+                 const u32 &imm) {
+    return op(
+        {.op = IBV_WR_SEND_WITH_IMM, .flags = 0, .len = len, .wr_id = 0},
+        {.local_addr = local_addr, .remote_addr = 0, .imm_data = imm});
+  }
+
+  /*!
+    Post an unsignaled op without waiting, e.g., the requests between two
+    awaited ones
+   */
+  Result<std::string> post(const RC::ReqDesc &desc,
+                           const RC::ReqPayload &payload) {
+    auto d = desc;
+    d.flags &= ~IBV_SEND_SIGNALED;
+    return qp->send_normal(d, payload);
+  }
+
+  Arc<RC> &raw() { return qp; }
+};
+
+inline usize Scheduler::poll() {
+  qps.erase(std::remove(qps.begin(), qps.end(), nullptr), qps.end());
+  pollables.erase(std::remove(pollables.begin(), pollables.end(), nullptr),
+                  pollables.end());
+
+  usize resumed = 0;
+  for (usize n = ready.size(); n > 0; --n) {
+    auto h = ready.front();
+    ready.pop_front();
+    h.resume();
+    resumed += 1;
+  }
+
+  // by index, since a resumed coroutine may watch more
+  for (usize q = 0; q < qps.size(); ++q) {
+    // keep the QP alive, even if the coroutine owning it returns
+    auto qp = qps[q];
+    if (qp == nullptr)
+      continue;
+    auto n = qp->poll_rc_comps(wcs, kSendPollBatch);
+    for (int i = 0; i < n; ++i) {
+      if (unlikely(wcs[i].wr_id == 0)) {
+        // an unsignaled op only completes on errors
+        RDMA_LOG(4) << "un-awaited op error: " << Dummy::wc_status(wcs[i]);
+        continue;
+      }
+      auto aw = reinterpret_cast<OpAwaiter *>(wcs[i].wr_id);
+      aw->wc = wcs[i];
+      aw->h.resume();
+      resumed += 1;
+    }
+  }
+
+  for (usize i = 0; i < pollables.size(); ++i) {
+    if (pollables[i] != nullptr)
+      resumed += pollables[i]->progress();
+  }
+  return resumed;
+}
+
+struct RecvMsg {
+  u32 imm = 0;
+  RMem::raw_ptr_t buf = nullptr;
+  u32 len = 0;
+  ibv_wc_status status = IBV_WC_SUCCESS;
+
+  bool ok() const { return status == IBV_WC_SUCCESS; }
+};
+
+/*!
+  The recv side of a QP (a RecvCursor over its entries) for coroutines:
+  `co_await ch.next()` returns the next message, and `co_await ch.next(imm)`
+  the next one whose imm_data is imm (e.g., the id of a request stream).
+  Messages are handed out in arrival order: one without a waiter blocks the
+  ones behind it until it is taken.
+  The buffer of a message is valid until the coroutine suspends again.
+ */
+template <typename QP, usize N> class AsyncRecv : public Pollable {
+public:
+  class NextAwaiter {
+    friend class AsyncRecv;
+    AsyncRecv *ch;
+    Option<u32> key;
+    RecvMsg msg;
+    std::coroutine_handle<> h;
+
+  public:
+    NextAwaiter(AsyncRecv *ch, const Option<u32> &key) : ch(ch), key(key) {}
+
+    bool await_ready() {
+      auto m = ch->take(key);
+      if (m)
+        msg = m.value();
+      return m.has_value();
+    }
+
+    void await_suspend(std::coroutine_handle<> awaiter) {
+      h = awaiter;
+      if (key)
+        ch->keyed[key.value()] = this;
+      else
+        ch->any.push_back(this);
+    }
+
+    RecvMsg await_resume() const { return msg; }
+  };
+
+private:
+  Scheduler &s;
+  Arc<QP> qp;
+  Arc<RecvEntries<N>> entries;
+  RecvCursor<QP, N> cursor;
+
+  // the current message is handed out, and is consumed on the next touch
+  bool taken = false;
+
+  // set by progress(), so that it stops if a resumed coroutine frees this
+  bool *alive = nullptr;
+
+  std::deque<NextAwaiter *> any;
+  std::unordered_map<u32, NextAwaiter *> keyed;
+
+  RecvMsg cur_msg() const {
+    auto &wc = cursor.cur_wc();
+    return {.imm = wc.imm_data,
+            .buf = reinterpret_cast<RMem::raw_ptr_t>(wc.wr_id),
+            .len = wc.byte_len,
+            .status = wc.status};
+  }
+
+  bool has_msg() {
+    if (taken) {
+      cursor.next();
+      taken = false;
+    }
+    return cursor.has_msgs() || cursor.poll() > 0;
+  }
+
+  Option<RecvMsg> take(const Option<u32> &key) {
+    if (!has_msg())
+      return {};
+    if (key && cursor.cur_wc().imm_data != key.value())
+      return {};
+    taken = true;
+    return cur_msg();
+  }
+
+public:
+  AsyncRecv(Arc<QP> qp, Arc<RecvEntries<N>> entries, Scheduler &s,
+              const usize &repost_threshold = N / 8)
+      : s(s), qp(qp), entries(entries),
+        cursor(this->qp, this->entries, repost_threshold) {
+    s.watch(this);
+  }
+
+  AsyncRecv(const AsyncRecv &) = delete;
+  AsyncRecv &operator=(const AsyncRecv &) = delete;
+
+  ~AsyncRecv() {
+    s.unwatch(this);
+    if (alive != nullptr)
+      *alive = false;
+  }
+
+  NextAwaiter next() { return NextAwaiter(this, {}); }
+  NextAwaiter next(const u32 &imm) { return NextAwaiter(this, imm); }
+
+  usize progress() override {
+    usize resumed = 0;
+    bool is_alive = true;
+    alive = &is_alive;
+    while (has_msg()) {
+      NextAwaiter *w = nullptr;
+      if (!keyed.empty()) {
+        auto it = keyed.find(cursor.cur_wc().imm_data);
+        if (it != keyed.end()) {
+          w = it->second;
+          keyed.erase(it);
+        }
+      }
+      if (w == nullptr && !any.empty()) {
+        w = any.front();
+        any.pop_front();
+      }
+      if (w == nullptr)
+        break; // its waiter has not arrived yet
+      w->msg = cur_msg();
+      taken = true;
+      w->h.resume();
+      resumed += 1;
+      if (!is_alive)
+        return resumed;
+    }
+    alive = nullptr;
+    return resumed;
+  }
+};
+
+} // namespace coro
+
+} // namespace rdmaio
@@ -0,0 +1,136 @@
+#pragma once
+
+#if __cplusplus < 202002L
+#error "rlibv2/core/coro needs C++20, build with -DRLIB_ENABLE_CORO=ON"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+#include "../common.hh"
+
+namespace rdmaio {
+
+namespace coro {
+
+template <typename T = void> class Task;
+
+namespace detail {
+
+struct PromiseBase {
+  // resumed when the task finishes, if it is awaited
+  std::coroutine_handle<> continuation = nullptr;
+  // decremented when a detached (spawned) task finishes, which then frees
+  // its own frame
+  usize *detached_counter = nullptr;
+
+  struct FinalAwaiter {
+    bool await_ready() const noexcept { return false; }
+
+    template <typename P>
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<P> h) noexcept {
+      auto &p = h.promise();
+      if (p.continuation)
+        return p.continuation;
+      if (p.detached_counter != nullptr) {
+        *p.detached_counter -= 1;
+        h.destroy();
+      }
+      return std::noop_coroutine();
+    }
+
+    void await_resume() const noexcept {}
+  };
+
+  std::suspend_always initial_suspend() const noexcept { return {}; }
+  FinalAwaiter final_suspend() const noexcept { return {}; }
+
+  // errors are reported with Result, an escaped exception is a bug
+  void unhandled_exception() const noexcept { std::terminate(); }
+};
+
+template <typename T> struct Promise : public PromiseBase {
+  Option<T> value;
+
+  Task<T> get_return_object();
+  void return_value(T v) { value = std::move(v); }
+};
+
+template <> struct Promise<void> : public PromiseBase {
+  Task<void> get_return_object();
+  void return_void() const noexcept {}
+};
+
+} // namespace detail
+
+/*!
+  A lazily started coroutine returning T.
+  A task starts when it is awaited by another coroutine, which resumes once
+  the task returns, or when it is spawned on a Scheduler (see scheduler.hh).
+
+  Example:
+  `
+  Task<u64> read_counter(AsyncQP &qp, u64 *buf) {
+    auto res = co_await qp.read(buf, 0, sizeof(u64));
+    co_return *buf;
+  }
+
+  Task<> client(AsyncQP &qp, u64 *buf) {
+    auto v = co_await read_counter(qp, buf);
+  }
+  `
+ */
+template <typename T> class Task {
+public:
+  using promise_type = detail::Promise<T>;
+  using handle_t = std::coroutine_handle<promise_type>;
+
+private:
+  handle_t h = nullptr;
+
+public:
+  explicit Task(handle_t h) : h(h) {}
+  Task(Task &&o) noexcept : h(std::exchange(o.h, nullptr)) {}
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+
+  ~Task() {
+    if (h)
+      h.destroy();
+  }
+
+  /*!
+    Hand over the coroutine, e.g., to a scheduler which runs it detached
+   */
+  handle_t release() { return std::exchange(h, nullptr); }
+
+  bool await_ready() const noexcept { return !h || h.done(); }
+
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) {
+    h.promise().continuation = awaiter;
+    return h;
+  }
+
+  T await_resume() {
+    if constexpr (!std::is_void_v<T>)
+      return std::move(h.promise().value.value());
+  }
+};
+
+namespace detail {
+
+template <typename T> inline Task<T> Promise<T>::get_return_object() {
+  return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() {
+  return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+} // namespace detail
+
+} // namespace coro
+
+} // namespace rdmaio
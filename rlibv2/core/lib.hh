@@ -117,7 +117,7 @@ public:
       } catch (std::exception &e) {
       }
     }
-    ::rdmaio::Err(std::string("fatal error"));
+    return ::rdmaio::Err(std::string("fatal error"));
   }
 
   /*!
@@ -197,13 +197,19 @@ public:
     return ::rdmaio::Err(std::make_pair(err_str, temp_key));
   }
 
+  /*!
+    Create and connect a remote QP on the recv channel *channel_name*.
+    The remote posts *recv_entries* buffers of msg_sz for the QP
+    (0: one for each of its recv entries).
+   */
   Result<cc_rc_ret_t> cc_rc_msg(const std::string &qp_name,
                                 const std::string &channel_name,
                                 const usize &msg_sz,
                                 const Arc<::rdmaio::qp::RC> rc,
                                 const ::rdmaio::nic_id_t &nic_id,
                                 const ::rdmaio::qp::QPConfig &config,
-                                const double &timeout_usec = 1000000) {
+                                const double &timeout_usec = 1000000,
+                                const usize &recv_entries = 0) {
 
     auto err_str = std::string("unknown error");
     u64 temp_key = 0;
@@ -225,6 +231,7 @@ public:
       req.config = config;
       req.attr = rc->my_attr();
       req.max_recv_sz = msg_sz;
+      req.recv_entries = recv_entries;
 
       auto res = rpc.call(proto::CreateRCM,
                           ::rdmaio::Marshal::dump<proto::RCReq>(req));
@@ -271,6 +278,54 @@ public:
     return ::rdmaio::Err(std::make_pair(err_str, temp_key));
   }
 
+  /*!
+    Create and connect the remote QPs of *qps* in bulk: qps[i] is connected
+    with the remote QP "<prefix><i>", created as cc_rc() does.
+    It takes one round trip per proto::kMaxBulkRC QPs, instead of one per QP.
+    A round whose reply is lost is sent again while the server's ReplyCache
+    keeps its reply, so its remote QPs are neither created twice nor left
+    without keys.
+    If a round fails, the remote QPs created by the previous rounds are
+    deleted, and the local QPs should be dropped.
+    \ret the keys of the remote QPs, e.g., for delete_remote_rc
+   */
+  using cc_rc_bulk_ret_t = std::pair<std::string, std::vector<u64>>;
+  Result<cc_rc_bulk_ret_t>
+  cc_rc_bulk(const std::string &prefix,
+             const std::vector<Arc<::rdmaio::qp::RC>> &qps,
+             const ::rdmaio::nic_id_t &nic_id,
+             const ::rdmaio::qp::QPConfig &config,
+             const double &timeout_usec = 1000000) {
+    proto::RCBulkReq req = {};
+    req.nic_id = nic_id;
+    req.config = config;
+    return cc_bulk(proto::CreateRCBulk, prefix, req, qps, timeout_usec);
+  }
+
+  /*!
+    The bulk version of cc_rc_msg(): qps[i] is connected with the remote QP
+    "<prefix><i>" on the recv channel *channel_name*.
+   */
+  Result<cc_rc_bulk_ret_t>
+  cc_rc_msg_bulk(const std::string &prefix, const std::string &channel_name,
+                 const usize &msg_sz,
+                 const std::vector<Arc<::rdmaio::qp::RC>> &qps,
+                 const ::rdmaio::nic_id_t &nic_id,
+                 const ::rdmaio::qp::QPConfig &config,
+                 const double &timeout_usec = 1000000,
+                 const usize &recv_entries = 0) {
+    if (unlikely(channel_name.size() > ::rdmaio::qp::kMaxQPNameLen))
+      return ::rdmaio::Err(
+          std::make_pair(err_name_to_long, std::vector<u64>()));
+    proto::RCBulkReq req = {};
+    memcpy(req.name_recv, channel_name.data(), channel_name.size());
+    req.nic_id = nic_id;
+    req.config = config;
+    req.max_recv_sz = msg_sz;
+    req.recv_entries = recv_entries;
+    return cc_bulk(proto::CreateRCMBulk, prefix, req, qps, timeout_usec);
+  }
+
   /*!
     Fetch remote MR identified with "id" at remote machine of this
     connection manager, store the result in the "attr".
@@ -407,6 +462,78 @@ public:
   ErrCase:
     return ::rdmaio::Err(std::make_pair(err_str, ::rdmaio::qp::DCAttr()));
   }
+
+private:
+  Result<cc_rc_bulk_ret_t>
+  cc_bulk(const proto::rpc_id_t &id, const std::string &prefix,
+          proto::RCBulkReq req, const std::vector<Arc<::rdmaio::qp::RC>> &qps,
+          const double &timeout_usec) {
+    std::vector<u64> keys;
+    auto fail = [&](const std::string &err) {
+      // release the remote QPs created by the previous rounds
+      for (usize i = 0; i < keys.size(); ++i)
+        delete_remote_rc(prefix + std::to_string(i), keys[i], timeout_usec);
+      return ::rdmaio::Err(std::make_pair(err, std::vector<u64>()));
+    };
+
+    if (unlikely(prefix.size() + std::to_string(qps.size()).size() >
+                 ::rdmaio::qp::kMaxQPNameLen))
+      return fail(err_name_to_long);
+    memcpy(req.prefix, prefix.data(), prefix.size());
+
+    for (usize base = 0; base < qps.size(); base += proto::kMaxBulkRC) {
+      req.base = base;
+      req.num = std::min<usize>(qps.size() - base, proto::kMaxBulkRC);
+      auto param = ::rdmaio::Marshal::dump<proto::RCBulkReq>(req);
+      for (usize i = base; i < base + req.num; ++i)
+        param.append(
+            ::rdmaio::Marshal::dump<::rdmaio::qp::QPAttr>(qps[i]->my_attr()));
+
+      auto res = rpc.call(id, param);
+      if (unlikely(res != IOCode::Ok))
+        return fail(res.desc);
+      // the same request (and checksum) is answered from the ReplyCache, so
+      // only resend it while the cached reply surely lives
+      const double wait_usec =
+          std::min(timeout_usec, ReplyCache::kTTLUsec / 4);
+      Timer t;
+      auto res_reply = rpc.receive_reply(wait_usec);
+      while (res_reply == IOCode::Timeout && t.passed_msec() < timeout_usec) {
+        if (t.passed_msec() + wait_usec < ReplyCache::kTTLUsec) {
+          res = rpc.call(id, param);
+          if (unlikely(res != IOCode::Ok))
+            return fail(res.desc);
+        }
+        res_reply = rpc.receive_reply(wait_usec);
+      }
+      if (res_reply != IOCode::Ok)
+        return fail(res_reply.desc);
+
+      auto &reply = res_reply.desc;
+      auto header_o = ::rdmaio::Marshal::dedump<proto::RCBulkReply>(reply);
+      if (!header_o)
+        return fail(err_decode_reply);
+      if (header_o.value().status != proto::CallbackStatus::Ok)
+        return fail("Wrong arguments, possible the QP has exsists");
+      if (header_o.value().num != req.num ||
+          reply.size() < sizeof(proto::RCBulkReply) +
+                             req.num * sizeof(proto::RCBulkEntry))
+        return fail(err_decode_reply);
+
+      std::vector<proto::RCBulkEntry> entries(req.num);
+      memcpy(entries.data(), reply.data() + sizeof(proto::RCBulkReply),
+             req.num * sizeof(proto::RCBulkEntry));
+      // all of them are created, so keep their keys before connecting
+      for (auto &e : entries)
+        keys.push_back(e.key);
+      for (usize i = 0; i < req.num; ++i) {
+        auto ret = qps[base + i]->connect(entries[i].attr);
+        if (ret != IOCode::Ok)
+          return fail(ret.desc);
+      }
+    }
+    return ::rdmaio::Ok(std::make_pair(std::string(""), std::move(keys)));
+  }
 };
 
 // a helper for hide wait_ready process
@@ -30,6 +30,9 @@ public:
   */
   const Option<RAddress> addr;
   const Option<u64> lid;
+  // the MTU the port is running with, e.g., IBV_MTU_4096 on most RoCE/IB
+  // fabrics
+  const Option<ibv_mtu> active_mtu;
 
   static Option<Arc<RNic>> create(const DevIdx &idx, u8 gid = 0) {
     auto res = std::make_shared<RNic>(idx,gid);
@@ -46,7 +49,7 @@ public:
    */
   RNic(const DevIdx &idx, u8 gid = 0)
       : id(idx), ctx(open_device(idx)), pd(alloc_pd()), lid(fetch_lid(idx)),
-        addr(query_addr(gid)) {
+        addr(query_addr(gid)), active_mtu(fetch_mtu(idx)) {
     //
   }
 
@@ -138,6 +141,18 @@ private:
     }
   }
 
+  Option<ibv_mtu> fetch_mtu(const DevIdx &idx) {
+    if (!valid()) {
+      return {};
+    } else {
+      ibv_port_attr port_attr;
+      auto rc = ibv_query_port(ctx, idx.port_id, &port_attr);
+      if (rc == 0)
+        return Option<ibv_mtu>(port_attr.active_mtu);
+      return {};
+    }
+  }
+
   Option<RAddress> query_addr(u8 gid_index = 0) const {
 
     if (!valid())
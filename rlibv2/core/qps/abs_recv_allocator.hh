@@ -1,5 +1,7 @@
 #pragma once
 
+#include <limits>
+
 #include "../rmem/handler.hh"
 
 namespace rdmaio {
@@ -20,6 +22,22 @@ public:
    */
   virtual Option<std::pair<rmem::RMem::raw_ptr_t, rmem::RegAttr>>
   alloc_one_for_remote(const usize &sz) = 0;
+
+  /*!
+    return a buffer got from alloc_one, so that it can be reused.
+    allocators that never free (e.g., bump allocators) can ignore it.
+   */
+  virtual void dealloc_one(rmem::RMem::raw_ptr_t /*buf*/) {}
+
+  /*!
+    the largest buffer alloc_one can return, if known, so that a channel
+    can refuse messages larger than it up front
+   */
+  virtual usize max_alloc_sz() const {
+    return std::numeric_limits<usize>::max();
+  }
+
+  virtual ~AbsRecvAllocator() = default;
 };
 
 } // namespace qp
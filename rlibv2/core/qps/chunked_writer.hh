@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "./doorbell_helper.hh"
+#include "./rc.hh"
+
+namespace rdmaio {
+
+namespace qp {
+
+/*!
+  Transfer a payload larger than one WR (e.g., a snapshot of hundreds of MiB)
+  as a pipeline of RDMA WRITEs of chunk_sz each, with up to depth chunks in
+  flight. The chunks land in place in a region the receiver advertised (e.g.,
+  an MR registered at its RCtrl), so the receiver reads the payload there
+  without reassembling it.
+  The last chunk is a WRITE_WITH_IMM carrying imm: since an RC QP places its
+  WRITEs in order, the receiver's one recv completion (with imm) means the
+  whole payload is in place.
+
+  Each chunk is signaled, and the chunks freed by one poll are refilled with
+  one chained ibv_post_send (of at most kNMaxDoorbell WRs).
+  It is not thread-safe, and the QP should not have other signaled ops in
+  flight during a write().
+
+  Example:
+  `
+  ChunkedWriter w(qp, 1 << 20, 8); // 1 MiB chunks, 8 in flight
+  // write len bytes from the QP's local MR to offset 0 of its remote MR
+  auto res = w.write(local_buf, 0, len, seq);
+
+  // at the receiver
+  for (cursor.poll(); cursor.has_msgs(); cursor.next()) {
+    auto imm_msg = cursor.cur_msg().value(); // the imm is seq, the payload
+                                             // is at offset 0 of the region
+  }
+  `
+ */
+class ChunkedWriter {
+  Arc<RC> qp;
+  const u32 chunk_sz;
+  const usize depth;
+
+  ibv_send_wr wrs[kNMaxDoorbell];
+  ibv_sge sges[kNMaxDoorbell];
+  std::vector<ibv_wc> wcs;
+
+public:
+  // chunks written, and the polls of the send cq to complete them
+  u64 chunks = 0;
+  u64 polls = 0;
+
+  /*!
+    \param depth: the chunks in flight, at most the send queue size of qp
+   */
+  ChunkedWriter(Arc<RC> qp, const u32 &chunk_sz, const usize &depth)
+      : qp(std::move(qp)), chunk_sz(chunk_sz), depth(depth), wcs(depth) {
+    RDMA_ASSERT(chunk_sz > 0) << "invalid chunk size";
+    RDMA_ASSERT(depth > 0 &&
+                depth <= static_cast<usize>(this->qp->max_send_sz()))
+        << "invalid depth: " << depth << ", the send queue holds "
+        << this->qp->max_send_sz();
+  }
+
+  ChunkedWriter(const ChunkedWriter &) = delete;
+  ChunkedWriter &operator=(const ChunkedWriter &) = delete;
+
+  /*!
+    Write len bytes at local (in local_mr) to remote_off of remote_mr, and
+    return once all the chunks have completed.
+    \note: timeout is measured in microseconds
+    \ret
+    - Ok
+    - Err: the payload exceeds remote_mr (nothing is posted), or a chunk
+      failed to post or complete; the chunks in flight are drained before
+      returning
+    - Timeout: some chunks have not completed
+   */
+  Result<std::string> write(char *local, const RegAttr &local_mr,
+                            const u64 &remote_off, const RegAttr &remote_mr,
+                            const u64 &len, const u32 &imm,
+                            const double &timeout_usec =
+                                ::rdmaio::Timer::no_timeout()) {
+    if (unlikely(remote_off > remote_mr.sz ||
+                 len > remote_mr.sz - remote_off))
+      return ::rdmaio::Err(std::string("payload exceeds the remote MR"));
+
+    // an empty payload still sends the WRITE_WITH_IMM
+    u64 n = std::max<u64>(1, (len + chunk_sz - 1) / chunk_sz);
+    u64 posted = 0;
+    u64 done = 0;
+    Option<std::string> err = {};
+    Timer t;
+
+    while (done < n) {
+      usize batch = static_cast<usize>(std::min<u64>(
+          {n - posted, depth - (posted - done), kNMaxDoorbell}));
+      if (batch > 0) {
+        for (usize i = 0; i < batch; ++i) {
+          u64 idx = posted + i;
+          u64 off = idx * chunk_sz;
+          sges[i] = {.addr = reinterpret_cast<u64>(local + off),
+                     .length = static_cast<u32>(std::min<u64>(chunk_sz, len - off)),
+                     .lkey = local_mr.lkey};
+          auto &wr = wrs[i];
+          wr.wr_id = qp->encode_my_wr(idx, 1);
+          wr.opcode = idx + 1 == n ? IBV_WR_RDMA_WRITE_WITH_IMM
+                                   : IBV_WR_RDMA_WRITE;
+          wr.num_sge = 1;
+          wr.sg_list = &sges[i];
+          wr.send_flags = IBV_SEND_SIGNALED;
+          wr.imm_data = imm;
+          wr.wr.rdma.remote_addr = remote_mr.buf + remote_off + off;
+          wr.wr.rdma.rkey = remote_mr.key;
+          wr.next = i + 1 < batch ? &wrs[i + 1] : nullptr;
+        }
+        ibv_send_wr *bad_wr = nullptr;
+        // it returns the error code, errno may not be set
+        auto rc = ibv_post_send(qp->qp, wrs, &bad_wr);
+        if (unlikely(rc != 0)) {
+          // the WRs before bad_wr are posted
+          batch = bad_wr != nullptr ? bad_wr - wrs : 0;
+          err = std::string(strerror(rc));
+          n = posted + batch;
+        }
+        qp->out_signaled += batch;
+        posted += batch;
+      }
+
+      polls += 1;
+      auto m = qp->poll_rc_comps(wcs.data(), static_cast<int>(wcs.size()));
+      if (unlikely(m < 0))
+        return ::rdmaio::Err(std::string("poll send cq error"));
+      for (int i = 0; i < m; ++i) {
+        if (unlikely(wcs[i].status != IBV_WC_SUCCESS && !err)) {
+          // the later chunks are flushed with errors
+          err = Dummy::wc_status(wcs[i]);
+          n = posted;
+        }
+      }
+      done += m;
+
+      if (m == 0 && t.passed_msec() >= timeout_usec)
+        return ::rdmaio::Timeout(std::string("chunks in flight: ") +
+                                 std::to_string(posted - done));
+    }
+    chunks += n;
+    if (err)
+      return ::rdmaio::Err(err.value());
+    return ::rdmaio::Ok(std::string(""));
+  }
+
+  /*!
+    The version of write() with the default local/remote MRs of the QP
+   */
+  Result<std::string> write(char *local, const u64 &remote_off,
+                            const u64 &len, const u32 &imm,
+                            const double &timeout_usec =
+                                ::rdmaio::Timer::no_timeout()) {
+    return write(local, qp->local_mr.value(), remote_off, qp->remote_mr.value(),
+                 len, imm, timeout_usec);
+  }
+};
+
+} // namespace qp
+
+} // namespace rdmaio
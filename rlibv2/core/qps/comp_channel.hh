@@ -0,0 +1,178 @@
+#pragma once
+
+#include <fcntl.h>
+#include <poll.h>
+#include <vector>
+
+#include "../utils/timer.hh"
+#include "./impl.hh"
+
+namespace rdmaio {
+
+namespace qp {
+
+/*!
+  A completion channel, so a thread can sleep until one of its CQs has a
+  completion instead of busy polling.
+  The channel's fd() is non-blocking, and can be added to an epoll set.
+
+  Example:
+  `
+  auto channel = CompChannel::create(nic).value();
+  auto cq = std::get<0>(channel->create_cq(nic, 128).desc);
+  AdaptiveWait waiter(channel, cq, 10); // spin 10us before sleeping
+  while (true) {
+    int n = ibv_poll_cq(cq, ...);
+    if (n == 0) { waiter.idle(); continue; }
+    waiter.reset();
+    // handle the completions
+  }
+  `
+ */
+class CompChannel {
+  ibv_comp_channel *channel = nullptr;
+
+  explicit CompChannel(Arc<RNic> nic) {
+    channel = ibv_create_comp_channel(nic->get_ctx());
+    if (channel == nullptr) {
+      RDMA_LOG(4) << "create comp channel error: " << strerror(errno);
+      return;
+    }
+    auto flags = fcntl(channel->fd, F_GETFL);
+    if (fcntl(channel->fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+      RDMA_LOG(4) << "set comp channel non-blocking error: " << strerror(errno);
+    }
+  }
+
+public:
+  static Option<Arc<CompChannel>> create(Arc<RNic> nic) {
+    auto res = Arc<CompChannel>(new CompChannel(nic));
+    if (res->valid())
+      return res;
+    return {};
+  }
+
+  ~CompChannel() {
+    if (channel != nullptr) {
+      auto rc = ibv_destroy_comp_channel(channel);
+      RDMA_VERIFY(WARNING, rc == 0)
+          << "Failed to destroy comp channel " << strerror(errno);
+    }
+  }
+
+  bool valid() const { return channel != nullptr; }
+
+  int fd() const { return channel->fd; }
+
+  ibv_comp_channel *raw() const { return channel; }
+
+  /*!
+    Create a CQ which reports to this channel.
+    \note: the CQ must be destroyed before the channel
+   */
+  Impl::CreateCQRes_t create_cq(Arc<RNic> nic, int cq_sz) {
+    return Impl::create_cq(nic, cq_sz, nullptr, channel);
+  }
+
+  /*!
+    Request an event for the next completion of the cq.
+    The cq must be polled once more after arming it, otherwise a completion
+    that arrived before the request may never be reported.
+   */
+  static Result<> arm(ibv_cq *cq) {
+    if (ibv_req_notify_cq(cq, 0) != 0)
+      return ::rdmaio::Err();
+    return ::rdmaio::Ok();
+  }
+
+  /*!
+    Sleep until an armed cq of this channel has an event.
+    \note timeout is measured in milliseconds, -1 waits forever
+    \ret
+    - Ok: the cq which has the event (it must be armed again)
+    - Timeout: no event
+    - Err: errno
+   */
+  Result<ibv_cq *> wait_event(const int &timeout_ms = -1) {
+    ibv_cq *cq = nullptr;
+    void *ctx = nullptr;
+    while (ibv_get_cq_event(channel, &cq, &ctx) != 0) {
+      if (errno != EAGAIN)
+        return ::rdmaio::Err(cq);
+      struct pollfd pfd = {.fd = channel->fd, .events = POLLIN, .revents = 0};
+      auto rc = poll(&pfd, 1, timeout_ms);
+      if (rc == 0)
+        return ::rdmaio::Timeout(cq);
+      if (rc < 0 && errno != EINTR)
+        return ::rdmaio::Err(cq);
+    }
+    ibv_ack_cq_events(cq, 1);
+    return ::rdmaio::Ok(cq);
+  }
+};
+
+/*!
+  Spin-then-block waiting on cqs of one channel: the caller keeps polling the
+  cqs itself,
+  and calls idle() whenever a poll returns nothing. After spin_usec of idle
+  polls, the cq is armed and the next idle() sleeps on the channel.
+  A spin_usec of Timer::no_timeout() never sleeps (busy polling), and 0
+  sleeps as soon as the cq is empty.
+ */
+class AdaptiveWait {
+  Arc<CompChannel> channel;
+  std::vector<ibv_cq *> cqs;
+  double spin_usec = 0;
+
+  Timer idle_timer;
+  bool idling = false;
+  bool armed = false;
+
+public:
+  // number of times the waiter went to sleep
+  u64 blocks = 0;
+
+  AdaptiveWait(Arc<CompChannel> channel, ibv_cq *cq, const double &spin_usec)
+      : AdaptiveWait(channel, std::vector<ibv_cq *>{cq}, spin_usec) {}
+
+  AdaptiveWait(Arc<CompChannel> channel, const std::vector<ibv_cq *> &cqs,
+               const double &spin_usec)
+      : channel(channel), cqs(cqs), spin_usec(spin_usec) {}
+
+  /*!
+    The last poll found completions: start spinning again
+   */
+  inline void reset() { idling = false; }
+
+  /*!
+    The last poll found nothing
+   */
+  void idle() {
+    if (!idling) {
+      idling = true;
+      idle_timer.reset();
+      return;
+    }
+    if (idle_timer.passed_msec() < spin_usec)
+      return;
+
+    if (!armed) {
+      // arm, then let the caller poll once more before sleeping
+      for (auto cq : cqs) {
+        auto res = CompChannel::arm(cq);
+        RDMA_ASSERT(res == IOCode::Ok) << "arm cq error: " << strerror(errno);
+      }
+      armed = true;
+      return;
+    }
+
+    auto res = channel->wait_event();
+    RDMA_ASSERT(res == IOCode::Ok) << "wait cq event error: " << strerror(errno);
+    armed = false;
+    blocks += 1;
+  }
+};
+
+} // namespace qp
+
+} // namespace rdmaio
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <vector>
+
+#include "./rc.hh"
+
+namespace rdmaio {
+
+namespace qp {
+
+/*!
+  A completion dispatcher for many outstanding one-sided ops per thread.
+  Each signaled op registers a continuation (a function and its context) in a
+  preallocated slab, and is posted with the slot's token as its wr_id.
+  poll() drains up to N completions of a QP with one ibv_poll_cq, retires the
+  QP's progress once for all of them (RC::poll_rc_comps), then calls the
+  continuation of each.
+
+  A token is the slot index plus a generation, so a stale or corrupted wr_id
+  is detected instead of resuming the wrong op. The token is never 0, which
+  is what an unsignaled op completing with an error carries.
+  It is not thread-safe, each polling thread owns one, and it may serve
+  several QPs.
+
+  Example:
+  `
+  CompDispatcher<64> d(256);
+  auto res = d.post(*qp, {.op = IBV_WR_RDMA_READ, .flags = 0, .len = 64,
+                          .wr_id = 0},
+                    {.local_addr = buf, .remote_addr = off, .imm_data = 0},
+                    [](void *ctx, const ibv_wc &wc) { ... }, ctx);
+  while (d.pending() > 0)
+    d.poll(*qp);
+
+  // or with an Op, using a token registered beforehand
+  auto token = d.reg(on_done, ctx).value();
+  op.execute(qp, IBV_SEND_SIGNALED, token);
+  `
+ */
+template <usize N = 64> class CompDispatcher {
+public:
+  // (the registered context, the op's wc, whose wr_id is the token)
+  using comp_fn = void (*)(void *, const ibv_wc &);
+
+  // a token is (generation << kSlotBits | slot), within the 48-bit user wr
+  static const u32 kSlotBits = 24;
+  static const u32 kGenBits = 48 - kSlotBits;
+
+private:
+  struct Slot {
+    comp_fn fn = nullptr;
+    void *ctx = nullptr;
+    u64 gen = 1;
+  };
+
+  std::vector<Slot> slab;
+  std::vector<u32> free_slots;
+  ibv_wc wcs[N];
+
+public:
+  // completions whose wr_id matches no registered slot
+  u64 unknown = 0;
+
+  /*!
+    Preallocate *capacity* continuations, i.e., the most signaled ops in
+    flight over all the QPs polled by this dispatcher
+   */
+  explicit CompDispatcher(const usize &capacity) : slab(capacity) {
+    RDMA_ASSERT(capacity > 0 && capacity <= bitmask<u64>(kSlotBits))
+        << "invalid capacity: " << capacity;
+    free_slots.reserve(capacity);
+    for (usize i = 0; i < capacity; ++i)
+      free_slots.push_back(capacity - 1 - i);
+  }
+
+  CompDispatcher(const CompDispatcher &) = delete;
+  CompDispatcher &operator=(const CompDispatcher &) = delete;
+
+  /*!
+    Register a continuation, to be called once by poll() when the op posted
+    with the returned token completes.
+    \ret the token, or {} if all the slots are in use
+   */
+  Option<u64> reg(comp_fn fn, void *ctx) {
+    if (unlikely(free_slots.empty()))
+      return {};
+    auto idx = free_slots.back();
+    free_slots.pop_back();
+    auto &s = slab[idx];
+    s.fn = fn;
+    s.ctx = ctx;
+    return (s.gen << kSlotBits) | idx;
+  }
+
+  /*!
+    Release the slot of a token whose op failed to post
+   */
+  void cancel(const u64 &token) {
+    auto s = lookup(token);
+    if (s != nullptr)
+      release(s);
+  }
+
+  /*!
+    Post a signaled op whose completion calls fn(ctx, wc).
+    \ret
+    - Ok
+    - NotReady: no free slot, poll() and retry
+    - Err: the post failed, fn is not called
+   */
+  Result<std::string> post(RC &qp, const RC::ReqDesc &desc,
+                           const RC::ReqPayload &payload,
+                           const RegAttr &local, const RegAttr &remote,
+                           comp_fn fn, void *ctx) {
+    auto token = reg(fn, ctx);
+    if (unlikely(!token))
+      return ::rdmaio::NotReady(std::string("no free slot"));
+    auto d = desc;
+    d.flags |= IBV_SEND_SIGNALED;
+    d.wr_id = token.value();
+    auto res = qp.send_normal(d, payload, local, remote);
+    if (unlikely(res != IOCode::Ok))
+      cancel(token.value());
+    return res;
+  }
+
+  /*!
+    The version of post() with the default local/remote MRs of the QP
+   */
+  Result<std::string> post(RC &qp, const RC::ReqDesc &desc,
+                           const RC::ReqPayload &payload, comp_fn fn,
+                           void *ctx) {
+    return post(qp, desc, payload, qp.local_mr.value(), qp.remote_mr.value(),
+                fn, ctx);
+  }
+
+  /*!
+    Drain up to N completions of qp, and call their continuations.
+    A continuation may post (and register) more ops.
+    \ret the number of continuations called
+   */
+  usize poll(RC &qp) {
+    auto n = qp.poll_rc_comps(wcs, N);
+    if (unlikely(n < 0)) {
+      RDMA_LOG(4) << "poll send cq error";
+      return 0;
+    }
+    usize called = 0;
+    for (int i = 0; i < n; ++i) {
+      auto s = lookup(wcs[i].wr_id);
+      if (unlikely(s == nullptr)) {
+        // e.g., an unsignaled op completing with an error
+        RDMA_LOG(4) << "completion of an unknown op " << wcs[i].wr_id << ": "
+                    << Dummy::wc_status(wcs[i]);
+        unknown += 1;
+        continue;
+      }
+      auto fn = s->fn;
+      auto ctx = s->ctx;
+      // release first, so the continuation can reuse the slot
+      release(s);
+      fn(ctx, wcs[i]);
+      called += 1;
+    }
+    return called;
+  }
+
+  // signaled ops registered but not completed
+  usize pending() const { return slab.size() - free_slots.size(); }
+
+private:
+  Slot *lookup(const u64 &token) {
+    auto idx = token & bitmask<u64>(kSlotBits);
+    if (unlikely(idx >= slab.size()))
+      return nullptr;
+    auto &s = slab[idx];
+    if (unlikely(s.fn == nullptr || s.gen != (token >> kSlotBits)))
+      return nullptr;
+    return &s;
+  }
+
+  void release(Slot *s) {
+    s->fn = nullptr;
+    s->ctx = nullptr;
+    // skip 0, so that a token is never 0
+    s->gen = (s->gen + 1) & bitmask<u64>(kGenBits);
+    if (s->gen == 0)
+      s->gen = 1;
+    free_slots.push_back(static_cast<u32>(s - slab.data()));
+  }
+};
+
+} // namespace qp
+
+} // namespace rdmaio
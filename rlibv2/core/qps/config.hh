@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstring>
 #include <string>
 
 #include "../common.hh"
@@ -13,6 +14,8 @@ const u32 kDefaultPSN = 3185;
 const u32 kRcMaxSendSz = 128;
 const u32 kRcMaxRecvSz = 2048;
 const u32 kDcKey = 1024;
+// the path MTU if neither end knows its port's MTU
+const ibv_mtu kDefaultMTU = IBV_MTU_1024;
 
 class RC;
 class UD;
@@ -64,6 +67,37 @@ public:
     return max_recv_size;
   }
 
+  /*!
+    The scatter/gather entries a send (recv) request may carry, e.g., 2 for
+    sending a header and a payload from different buffers without copying.
+    \note: the NIC may refuse a QP with more sges than it supports
+   */
+  QPConfig &set_max_send_sge(int num) {
+    max_send_sge = num;
+    return *this;
+  }
+
+  int max_send_sges() const { return max_send_sge; }
+
+  QPConfig &set_max_recv_sge(int num) {
+    max_recv_sge = num;
+    return *this;
+  }
+
+  int max_recv_sges() const { return max_recv_sge; }
+
+  /*!
+    Connect with this path MTU, instead of the smaller active MTU of the two
+    ports, e.g., when a switch on the path supports less than the ports.
+   */
+  QPConfig &set_path_mtu(ibv_mtu mtu) {
+    path_mtu = mtu;
+    return *this;
+  }
+
+  // 0 if the MTU is negotiated
+  int path_mtu_override() const { return path_mtu; }
+
   QPConfig &add_access_write() {
     access_flags |= IBV_ACCESS_REMOTE_WRITE;
     return *this;
@@ -89,6 +123,11 @@ public:
     return *this;
   }
 
+  // e.g., whether a pre-created QP can serve a request of this config
+  bool operator==(const QPConfig &o) const {
+    return memcmp(this, &o, sizeof(QPConfig)) == 0;
+  }
+
   bool allow_remote_read() const {
     return (access_flags & IBV_ACCESS_REMOTE_READ) != 0;
   }
@@ -116,6 +155,9 @@ private:
   int timeout = 20;
   int max_send_size = kRcMaxSendSz;
   int max_recv_size = kRcMaxRecvSz;
+  int max_send_sge = 1;
+  int max_recv_sge = 1;
+  int path_mtu = 0;
 
   int qkey = kDefaultQKey;
 
@@ -53,8 +53,13 @@ public:
     this->srq = std::get<0>(srq_res.desc);
 
     // 3. create dct
+    // DC has no handshake, so the initiators and targets use the MTU of their
+    // own port, which is the same on one fabric
     const int dc_key = my_config.dc_key;
-    auto dct_res = Impl::create_dct(nic, tmp_cq, this->srq, dc_key);
+    auto dct_res = Impl::create_dct(
+      nic, tmp_cq, this->srq, dc_key,
+      Impl::path_mtu(my_config,
+                     nic->active_mtu ? nic->active_mtu.value() : 0));
     if (dct_res != IOCode::Ok) {
       RDMA_LOG(4) << "Error on creating DCT: " << std::get<1>(res.desc);
       return;
@@ -117,7 +122,10 @@ public:
     this->qp = std::get<0>(res_qp.desc);
 
     // 3. bring status to rtr and rts
-    if (!bring_dc_to_init(qp) || !bring_dc_to_rtr(qp) || !bring_dc_to_rts(qp)) {
+    auto mtu = Impl::path_mtu(
+      my_config, nic->active_mtu ? nic->active_mtu.value() : 0);
+    if (!bring_dc_to_init(qp) || !bring_dc_to_rtr(qp, mtu) ||
+        !bring_dc_to_rts(qp)) {
       RDMA_ASSERT(false);
     }
   }
@@ -129,7 +137,8 @@ public:
              .psn = static_cast<u64>(my_config.rq_psn),
              .port_id = static_cast<u64>(nic->id.port_id),
              .qpn = static_cast<u64>(qp->qp_num),
-             .qkey = static_cast<u64>(0) };
+             .qkey = static_cast<u64>(0),
+             .mtu = static_cast<u8>(nic->active_mtu ? nic->active_mtu.value() : 0) };
   }
   static Option<Arc<DC>> create(Arc<RNic> nic, const QPConfig& config)
   {
@@ -224,11 +233,11 @@ public:
     return ibv_exp_modify_qp(qp, &qp_attr, flags) == 0;
   }
 
-  static bool bring_dc_to_rtr(ibv_qp* qp)
+  static bool bring_dc_to_rtr(ibv_qp* qp, ibv_mtu mtu = kDefaultMTU)
   {
     struct ibv_exp_qp_attr qp_attr = {};
     qp_attr.qp_state = IBV_QPS_RTR;
-    qp_attr.path_mtu = IBV_MTU_1024;
+    qp_attr.path_mtu = mtu;
     qp_attr.ah_attr.is_global = 0;
     qp_attr.ah_attr.port_num = 1;
     qp_attr.ah_attr.sl = 0;
@@ -44,11 +44,27 @@ public:
     return Ok(std::string(""));
   }
 
+  /*!
+    The path MTU of a QP: the override in config if any, otherwise the smaller
+    active MTU of the two ports (an unknown one, i.e., 0, is ignored).
+   */
+  static ibv_mtu path_mtu(const QPConfig &config, const u8 &local_mtu,
+                          const u8 &remote_mtu = 0) {
+    if (config.path_mtu != 0)
+      return static_cast<ibv_mtu>(config.path_mtu);
+    if (local_mtu == 0 && remote_mtu == 0)
+      return kDefaultMTU;
+    if (local_mtu == 0 || remote_mtu == 0)
+      return static_cast<ibv_mtu>(std::max(local_mtu, remote_mtu));
+    return static_cast<ibv_mtu>(std::min(local_mtu, remote_mtu));
+  }
+
   static Result<std::string> bring_rc_to_rcv(ibv_qp *qp, const QPConfig &config,
-                                             const QPAttr &attr, int port_id) {
+                                             const QPAttr &attr, int port_id,
+                                             const u8 &local_mtu = 0) {
     struct ibv_qp_attr qp_attr = {};
     qp_attr.qp_state = IBV_QPS_RTR;
-    qp_attr.path_mtu = IBV_MTU_1024;
+    qp_attr.path_mtu = path_mtu(config, local_mtu, attr.mtu);
     qp_attr.dest_qp_num = attr.qpn;
     qp_attr.rq_psn = config.rq_psn; // should this match the sender's psn ?
     qp_attr.max_dest_rd_atomic = config.max_dest_rd_atomic;
@@ -116,7 +132,8 @@ public:
   static CreateQPRes_t create_qp(Arc<RNic> nic, ibv_qp_type type,
                                  const QPConfig &config,
                                  ibv_cq *cq, // send cq
-                                 ibv_cq *recv_cq = nullptr) {
+                                 ibv_cq *recv_cq = nullptr,
+                                 ibv_srq *srq = nullptr) {
 
     if (cq == nullptr) {
       return Err(std::make_pair<ibv_qp *, std::string>(nullptr,
@@ -131,13 +148,15 @@ public:
 
     qp_init_attr.send_cq = cq;
     qp_init_attr.recv_cq = recv_cq;
+    // with an srq, max_recv_wr is ignored and recvs come from the srq
+    qp_init_attr.srq = srq;
     qp_init_attr.qp_type = type;
     qp_init_attr.sq_sig_all = 0;
 
     qp_init_attr.cap.max_send_wr = config.max_send_sz();
     qp_init_attr.cap.max_recv_wr = config.max_recv_sz();
-    qp_init_attr.cap.max_send_sge = 1;
-    qp_init_attr.cap.max_recv_sge = 1;
+    qp_init_attr.cap.max_send_sge = config.max_send_sges();
+    qp_init_attr.cap.max_recv_sge = config.max_recv_sges();
     qp_init_attr.cap.max_inline_data = kMaxInlinSz;
 
     auto qp = ibv_create_qp(nic->get_pd(), &qp_init_attr);
@@ -165,7 +184,7 @@ public:
   using CreateDCTRes_t = Result<std::pair<ibv_exp_dct *, std::string>>;
   static CreateDCTRes_t create_dct(Arc<RNic> nic,
                                    ibv_cq *cq, ibv_srq *srq,
-                                   int dc_key)
+                                   int dc_key, ibv_mtu mtu = kDefaultMTU)
   {
     if (cq == nullptr) {
       return Err(std::make_pair<ibv_exp_dct *, std::string>(nullptr,
@@ -188,7 +207,7 @@ public:
     dctattr.min_rnr_timer = 2;
     dctattr.tclass = 0;
     dctattr.flow_label = 0;
-    dctattr.mtu = IBV_MTU_1024;
+    dctattr.mtu = mtu;
     dctattr.pkey_index = 0;
     dctattr.hop_limit = 1;
     dctattr.create_flags = 0;
@@ -216,7 +235,7 @@ public:
     qp_init_attr.send_cq = cq;
     qp_init_attr.recv_cq = recv_cq;
     qp_init_attr.cap.max_send_wr = config.max_send_sz();
-    qp_init_attr.cap.max_send_sge = 1;
+    qp_init_attr.cap.max_send_sge = config.max_send_sges();
     qp_init_attr.cap.max_inline_data = kMaxInlinSz;
     qp_init_attr.qp_type = IBV_EXP_QPT_DC_INI;
     qp_init_attr.pd = nic->get_pd();
@@ -49,6 +49,9 @@ struct __attribute__((packed)) QPAttr {
   u64 port_id;
   u64 qpn;
   u64 qkey;
+  // active MTU of the port (an ibv_mtu), 0 if unknown.
+  // the two ends of an RC connect with the smaller one
+  u8 mtu;
 };
 
 class Dummy {
@@ -57,6 +60,14 @@ public:
   struct ibv_cq *cq = nullptr;
   struct ibv_cq *recv_cq = nullptr;
 
+  // if set, recvs are posted to this (shared) srq instead of the QP.
+  // the srq is owned by whom created it, e.g., the RecvManager
+  struct ibv_srq *srq = nullptr;
+
+  // the recv_cq is shared by other QPs (e.g., a RecvManager channel),
+  // so it is not destroyed with this QP
+  bool shared_recv_cq = false;
+
   // #of outsignaled RDMA requests
   usize out_signaled = 0;
 
@@ -78,7 +89,7 @@ public:
       cq = nullptr;
     }
 
-    if (recv_cq) {
+    if (recv_cq && !shared_recv_cq) {
       int res = ibv_destroy_cq(recv_cq);
       RDMA_VERIFY(WARNING, res == 0)
         << "Failed to destroy recv_cq " << strerror(errno);
@@ -159,7 +170,8 @@ public:
   }
 
   /*!
-  Post *num* recv entries to the QP, start at entries.header
+  Post *num* recv entries to the QP (or its srq, if any), start at
+  entries.header
 
   \ret
   - Err: errono
@@ -167,6 +179,16 @@ public:
  */
   template <usize entries>
   Result<int> post_recvs(RecvEntries<entries> &r, int num) {
+    return post_recvs_to(this->qp, this->srq, r, num);
+  }
+
+  /*!
+    Post *num* recv entries with one chained post, to the srq if it is not
+    null, otherwise to the qp.
+   */
+  template <usize entries>
+  static Result<int> post_recvs_to(ibv_qp *qp, ibv_srq *srq,
+                                   RecvEntries<entries> &r, int num) {
 
     auto tail = r.header + num - 1;
     if (tail >= entries)
@@ -175,7 +197,8 @@ public:
 
     // really post the recvs
     struct ibv_recv_wr *bad_rr;
-    auto rc = ibv_post_recv(this->qp, r.header_ptr(), &bad_rr);
+    auto rc = srq != nullptr ? ibv_post_srq_recv(srq, r.header_ptr(), &bad_rr)
+                             : ibv_post_recv(qp, r.header_ptr(), &bad_rr);
 
     if (rc != 0)
       return Err(errno);
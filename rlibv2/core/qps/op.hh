@@ -146,6 +146,16 @@ public:
     return true;
   }
 
+  /*!
+    Use an application buffer pinned by an MRCache as the payload.
+    \note: the pin should be kept until the op completes.
+   */
+  template <typename T>
+  inline bool set_payload(const T *addr, const u32 &length,
+                          const MRCache::Pin &pin, const u32 index = 0) {
+    return set_payload(addr, length, pin.lkey(), index);
+  }
+
   inline auto execute_batch(const Arc<RC> &qp) -> Result<std::string> {
     // to avoid performance overhead of Arc, we first extract QP's raw pointer
     // out
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../rmem/handler.hh"
+#include "../rmem/mr_cache.hh"
 
 #include "./mod.hh"
 #include "./impl.hh"
@@ -65,7 +66,19 @@ public:
      }
   */
 private:
-  RC(Arc<RNic> nic, const QPConfig &config,ibv_cq *recv_cq = nullptr) : Dummy(nic), my_config(config) {
+  RC(Arc<RNic> nic, const QPConfig &config, ibv_cq *recv_cq = nullptr,
+     ibv_srq *srq = nullptr, bool shared_recv_cq = false)
+      : Dummy(nic), my_config(config) {
+    // FIXME: we donot sanity check the the incoming recv_cq
+    // The choice is that the recv cq could be shared among other QPs
+    // shall we replace this with smart pointers ?
+    // it is taken before anything may fail, so that a failed QP only destroys
+    // the recv cq it owns
+    this->recv_cq = recv_cq;
+    this->shared_recv_cq = shared_recv_cq;
+    // the srq (if any) is shared, so it is not destroyed with this QP
+    this->srq = srq;
+
     /*
       It takes 3 steps to create an RC QP during the initialization
       according to the RDMA programming mannal.
@@ -81,14 +94,9 @@ private:
     }
     this->cq = std::get<0>(res.desc);
 
-    // FIXME: we donot sanity check the the incoming recv_cq
-    // The choice is that the recv cq could be shared among other QPs
-    // shall we replace this with smart pointers ?
-    this->recv_cq = recv_cq;
-
     // 2 qp
-    auto res_qp =
-        Impl::create_qp(nic, IBV_QPT_RC, my_config, this->cq, this->recv_cq);
+    auto res_qp = Impl::create_qp(nic, IBV_QPT_RC, my_config, this->cq,
+                                  this->recv_cq, this->srq);
     if (res_qp != IOCode::Ok) {
       RDMA_LOG(4) << "Error on creating QP: " << std::get<1>(res.desc);
       return;
@@ -104,10 +112,17 @@ private:
   }
 
 public:
+  /*!
+    \param shared_recv_cq: recv_cq is shared with other QPs (e.g., the cq of a
+    RecvManager channel or srq), so it is not destroyed with this QP, even if
+    the creation fails; otherwise the QP takes it
+   */
   static Option<Arc<RC>> create(Arc<RNic> nic,
                                 const QPConfig &config = QPConfig(),
-                                ibv_cq *recv_cq = nullptr) {
-    auto res = Arc<RC>(new RC(nic, config,recv_cq));
+                                ibv_cq *recv_cq = nullptr,
+                                ibv_srq *srq = nullptr,
+                                bool shared_recv_cq = false) {
+    auto res = Arc<RC>(new RC(nic, config, recv_cq, srq, shared_recv_cq));
     if (res->valid()) {
       return Option<Arc<RC>>(std::move(res));
     }
@@ -124,7 +139,8 @@ public:
             .psn = static_cast<u64>(my_config.rq_psn),
             .port_id = static_cast<u64>(nic->id.port_id),
             .qpn = static_cast<u64>(qp->qp_num),
-            .qkey = static_cast<u64>(0)};
+            .qkey = static_cast<u64>(0),
+            .mtu = static_cast<u8>(nic->active_mtu ? nic->active_mtu.value() : 0)};
   }
 
   Result<> my_status() const { return status; }
@@ -154,8 +170,9 @@ public:
         {
           // first bring QP to ready to recv. note we bring it to ready to init
           // during class's construction.
-          auto res =
-              Impl::bring_rc_to_rcv(qp, my_config, attr, my_attr().port_id);
+          auto me = my_attr();
+          auto res = Impl::bring_rc_to_rcv(qp, my_config, attr, me.port_id,
+                                           me.mtu);
           if (res.code != IOCode::Ok)
             return res;
           // then we bring it to ready to send.
@@ -201,6 +218,17 @@ public:
     return send_normal(desc, payload, local_mr.value(), remote_mr.value());
   }
 
+  /*!
+    the version of send_normal from an application buffer pinned by an
+    MRCache, to the default remote MR binded to this QP.
+    \note: the pin should be kept until the request completes.
+   */
+  Result<std::string> send_normal(const ReqDesc &desc,
+                                  const ReqPayload &payload,
+                                  const MRCache::Pin &local) {
+    return send_normal(desc, payload, local.attr(), remote_mr.value());
+  }
+
   u64 encode_my_wr(const u64 &wr, int forward_num) {
     return (static_cast<u64>(wr) << Progress::num_progress_bits) |
            static_cast<u64>(progress.forward(forward_num));
@@ -260,6 +288,25 @@ public:
     return std::make_pair(user_wr, wc);
   }
 
+  /*!
+    The batched version of poll_rc_comp: poll up to *num* completions with one
+    ibv_poll_cq. Since the completions of a QP are in order, the progress is
+    retired once with the watermark of the last one.
+    The wr_id of each polled wc is replaced by its user wr.
+    \ret the number of wcs polled, or a negative value on poll errors
+   */
+  int poll_rc_comps(ibv_wc *wcs, const int &num) {
+    auto n = ibv_poll_cq(cq, num, wcs);
+    if (n <= 0)
+      return n;
+    out_signaled -= n;
+    progress.done(wcs[n - 1].wr_id &
+                  bitmask<u64>(Progress::num_progress_bits));
+    for (int i = 0; i < n; ++i)
+      wcs[i].wr_id >>= Progress::num_progress_bits;
+    return n;
+  }
+
   Result<std::pair<u64, ibv_wc>>
   wait_rc_comp(const double &timeout = ::rdmaio::Timer::no_timeout()) {
     Timer t;
@@ -1,14 +1,22 @@
 #pragma once
 
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
 #include "../rctrl.hh"
 
 #include "./recv_helper.hh"
+#include "./warm_pool.hh"
 
 namespace rdmaio {
 
 namespace qp {
 /*!
-  Common structure shared by a recv endpoint
+  Common structure shared by a recv endpoint.
+  The QPs of the endpoint complete their recvs on cq; if cq is null, each QP
+  gets a recv cq of its own instead, e.g., so that every QP can be polled by a
+  different coroutine.
  */
 struct RecvCommon {
   ibv_cq *cq;
@@ -22,6 +30,87 @@ struct RecvCommon {
   }
 };
 
+/*!
+  A recv endpoint whose QPs share one SRQ, so the server pins R recv buffers
+  in total instead of R per connected QP.
+  The QPs consume the SRQ concurrently, so the consumed entries need not be the
+  next ones of the ring: re-post them by their completions with repost(). The
+  cq should be polled by one thread.
+ */
+template <usize R> struct RecvSRQ {
+  ibv_cq *cq = nullptr;
+  ibv_srq *srq = nullptr;
+  usize max_recv_sz = 0;
+  Arc<RecvEntries<R>> entries;
+
+private:
+  // wr_id (the buffer address) -> index of the entry
+  std::unordered_map<u64, usize> index_of;
+  std::vector<ibv_recv_wr> repost_wrs;
+
+public:
+
+  /*!
+    Create an SRQ of R entries, each of max_recv_sz bytes from alloc, and post
+    all of them.
+   */
+  static Option<Arc<RecvSRQ>> create(Arc<RNic> nic, ibv_cq *cq,
+                                     Arc<AbsRecvAllocator> alloc,
+                                     const usize &max_recv_sz) {
+    auto res = Impl::create_srq(nic, R, 1);
+    if (res != IOCode::Ok) {
+      RDMA_LOG(4) << "create srq error: " << std::get<1>(res.desc);
+      return {};
+    }
+
+    Arc<RecvSRQ> ret(new RecvSRQ);
+    ret->cq = cq;
+    ret->srq = std::get<0>(res.desc);
+    ret->max_recv_sz = max_recv_sz;
+    auto entries = RecvEntriesFactoryv2<R>::create(alloc, max_recv_sz);
+    if (!entries)
+      return {};
+    ret->entries = entries.value();
+    for (usize i = 0; i < R; ++i)
+      ret->index_of[ret->entries->wr_ptr(i)->wr_id] = i;
+    if (Dummy::post_recvs_to(nullptr, ret->srq, *(ret->entries), R) !=
+        IOCode::Ok) {
+      return {};
+    }
+    return ret;
+  }
+
+  /*!
+    Re-post the entries consumed by the (successful) recv completions
+    wcs[0..n), with one chained post.
+   */
+  Result<int> repost(const ibv_wc *wcs, const int &n) {
+    if (n <= 0)
+      return ::rdmaio::Ok(0);
+    if (repost_wrs.size() < static_cast<usize>(n))
+      repost_wrs.resize(n);
+    for (int i = 0; i < n; ++i) {
+      auto it = index_of.find(wcs[i].wr_id);
+      RDMA_ASSERT(it != index_of.end())
+          << "not a recv of this srq: " << wcs[i].wr_id;
+      repost_wrs[i] = *entries->wr_ptr(it->second);
+      repost_wrs[i].next = i + 1 < n ? &repost_wrs[i + 1] : nullptr;
+    }
+    struct ibv_recv_wr *bad_rr;
+    if (ibv_post_srq_recv(srq, repost_wrs.data(), &bad_rr) != 0)
+      return ::rdmaio::Err(errno);
+    return ::rdmaio::Ok(0);
+  }
+
+  ~RecvSRQ() {
+    if (srq != nullptr) {
+      auto rc = ibv_destroy_srq(srq);
+      RDMA_VERIFY(WARNING, rc == 0)
+          << "Failed to destroy srq " << strerror(errno);
+    }
+  }
+};
+
 /*!
   T: reserved
   R: recv cq depth for a QP
@@ -33,15 +122,157 @@ public:
   Factory<std::string, RecvCommon> reg_recv_cqs;
   Factory<std::string, RecvEntries<R>> reg_recv_entries;
 
+  /*!
+    Recv endpoints backed by an SRQ. QPs created on such an endpoint share the
+    SRQ's entries, so nothing is added to reg_recv_entries for them.
+   */
+  Factory<std::string, RecvSRQ<R>> reg_recv_srqs;
+
   /*!
     we assume RCtrl is a global static variable which never freed.
    */
   RCtrl *rctrl_p = nullptr;
 
+  /*!
+    keys of the entries registered by msg_rc_handler, so they can be released
+    when their QP is deleted.
+    entries_lock guards them and the allocation (and the freeing, by whichever
+    thread drops the entries last) of the entries, since the RCtrl may serve
+    requests with several daemon threads, and the allocators are not required
+    to be thread-safe.
+   */
+  std::map<std::string, u64> entries_keys;
+  Arc<std::mutex> entries_lock = std::make_shared<std::mutex>();
+
+  /*!
+    Called with (qp name, channel name, QP, recv entries) once a QP created by
+    msg_rc_handler is connected and its recvs are posted, e.g., to hand the QP
+    to the thread polling the channel. QPs on an SRQ endpoint are not reported.
+    \note: hooks run in the RCtrl daemon threads (concurrently if it has
+    several workers), add them before start_daemon()
+   */
+  using msg_qp_hook_f =
+      std::function<void(const std::string &, const std::string &, Arc<RC>,
+                         Arc<RecvEntries<R>>)>;
+  std::vector<msg_qp_hook_f> msg_qp_hooks;
+
+  // a pre-created QP on a recv channel, with its recvs posted
+  struct WarmMsgQP {
+    Arc<RC> rc;
+    Arc<RecvEntries<R>> entries;
+  };
+  using msg_pool_t = WarmPool<WarmMsgQP>;
+
+private:
+  struct MsgPool {
+    std::string channel;
+    nic_id_t nic_id;
+    QPConfig config;
+    usize max_recv_sz;
+    usize num_bufs;
+    Arc<msg_pool_t> pool;
+  };
+  std::vector<MsgPool> msg_pools;
+
+public:
   explicit RecvManager(RCtrl &ctr) : rctrl_p(&ctr) {
     RDMA_ASSERT(ctr.rpc.register_handler(
         proto::CreateRCM,
         std::bind(&RecvManager::msg_rc_handler, this, std::placeholders::_1)));
+    RDMA_ASSERT(ctr.rpc.register_handler(
+        proto::CreateRCMBulk, [this](const ByteBuffer &b) {
+          return rctrl_p->rc_bulk_handler(
+              b, [this](const proto::RCReq &req) { return create_msg_rc(req); });
+        }));
+    ctr.qp_delete_hooks.push_back(
+        [this](const std::string &name) { this->release_entries(name); });
+  }
+
+  /*!
+    Deregister the recv entries of a deleted QP. Their buffers go back to the
+    channel's allocator once no one else holds the entries.
+   */
+  void release_entries(const std::string &name) {
+    // freeing the entries takes the lock, so the last reference is dropped
+    // after it is released
+    Option<Arc<RecvEntries<R>>> entries = {};
+    std::lock_guard<std::mutex> guard(*entries_lock);
+    auto it = entries_keys.find(name);
+    if (it == entries_keys.end())
+      return;
+    entries = reg_recv_entries.query(name);
+    reg_recv_entries.dereg(name, it->second);
+    entries_keys.erase(it);
+  }
+
+  /*!
+    The number of recv buffers for a QP requesting *requested* of them:
+    the largest divisor of R not above it, so the ring of R entries wraps at a
+    buffer boundary.
+   */
+  static usize recv_bufs_of(const usize &requested) {
+    if (requested == 0 || requested >= R)
+      return R;
+    usize n = requested;
+    while (R % n != 0)
+      n -= 1;
+    return n;
+  }
+
+  /*!
+    Keep *num* QPs of *config* on the recv channel *channel* created, in INIT
+    and with their recvs (of max_recv_sz bytes, as many as a client asking
+    for recv_entries gets) posted. A CreateRCM (or CreateRCMBulk) on the
+    channel with the same NIC and config, and whose messages fit, takes one
+    instead of creating the QP and allocating its recv buffers.
+    QPs on an SRQ endpoint are not pooled.
+    \note: call it after the channel is registered, and before the RCtrl's
+    start_daemon()
+    \ret the pool, e.g., for its hit counters; {} if the channel's allocator
+    cannot hold messages of max_recv_sz
+   */
+  Option<Arc<msg_pool_t>> warm_msg_pool(const std::string &channel,
+                                        const nic_id_t &nic_id,
+                                        const QPConfig &config,
+                                        const usize &max_recv_sz,
+                                        const usize &num,
+                                        const usize &recv_entries = 0) {
+    auto nic = rctrl_p->opened_nics.query(nic_id);
+    auto recv_c = reg_recv_cqs.query(channel);
+    if (!nic || !recv_c)
+      return {};
+    auto n = nic.value();
+    auto common = recv_c.value();
+    if (max_recv_sz > common->allocator->max_alloc_sz())
+      return {};
+    auto num_bufs = recv_bufs_of(recv_entries);
+    auto pool = std::make_shared<msg_pool_t>(
+        [this, n, common, config, max_recv_sz,
+         num_bufs]() -> Option<WarmMsgQP> {
+          auto rc_o = create_rc_on(n, config, common->cq);
+          if (!rc_o)
+            return {};
+          auto rc = rc_o.value();
+          Option<Arc<RecvEntries<R>>> entries = {};
+          {
+            std::lock_guard<std::mutex> guard(*entries_lock);
+            entries = RecvEntriesFactoryv2<R>::create(
+                common->allocator, max_recv_sz, num_bufs, entries_lock);
+          }
+          // recvs can be posted once the QP is in INIT
+          if (!entries ||
+              rc->post_recvs(*entries.value(), num_bufs) != IOCode::Ok)
+            return {};
+          return WarmMsgQP{.rc = rc, .entries = entries.value()};
+        },
+        num);
+    msg_pools.push_back({.channel = channel,
+                         .nic_id = nic_id,
+                         .config = config,
+                         .max_recv_sz = max_recv_sz,
+                         .num_bufs = num_bufs,
+                         .pool = pool});
+    return pool;
   }
 
   /*!
@@ -65,46 +296,10 @@ public:
       // 1. check whether we need to create the QP
       u64 key = 0;
       if (rc_req.whether_create == 1) {
-        // 1.0 find the Nic to create this QP
-        auto nic = rctrl_p->opened_nics.query(rc_req.nic_id);
-        if (!nic)
-          goto WA; // failed to find Nic
-
-        // 1.0 check whether we are able to use the registered recv_cq
-        ibv_cq *recv_cq = nullptr;
-        if (rc_req.whether_recv == 1) {
-          auto recv_c_res = reg_recv_cqs.query(rc_req.name_recv);
-          if (!recv_c_res)
-            recv_cq = nullptr;
-          else
-            recv_cq = recv_c_res.value()->cq;
-        }
-
-        // 1.1 try to create and register this QP
-        auto rc = qp::RC::create(nic.value(), rc_req.config, recv_cq).value();
-        auto rc_status = rctrl_p->registered_qps.reg(rc_req.name, rc);
-
-        if (!rc_status) {
-          // clean up
+        auto res = create_msg_rc(rc_req);
+        if (!res)
           goto WA;
-        }
-
-        // 1.2 finally we connect the QP
-        if (rc->connect(rc_req.attr) != IOCode::Ok) {
-          // in connect error
-          rctrl_p->registered_qps.dereg(rc_req.name, rc_status.value());
-          goto WA;
-        }
-        key = rc_status.value();
-
-        // 1.3 this QP is done, alloc the recv; entries
-        auto recv_c_res = reg_recv_cqs.query(rc_req.name_recv); // must exsist, because we have checked in step 1.0
-        auto recv_entries = RecvEntriesFactoryv2<R>::create(recv_c_res.value()->allocator, rc_req.max_recv_sz);
-        RDMA_ASSERT(reg_recv_entries.reg(rc_req.name, recv_entries));
-
-        // 1.4 we post_recvs
-        auto res = rc->post_recvs(*recv_entries, R);
-        RDMA_ASSERT(res == IOCode::Ok); // FIXME: now assert false if failed
+        key = std::get<1>(res.value());
       }
 
       // 2. fetch the QP result
@@ -114,9 +309,145 @@ public:
   WA: // wrong arg
     return ::rdmaio::Marshal::dump<proto::RCReply>(
         {.status = proto::CallbackStatus::WrongArg});
-  Err:
-    return ::rdmaio::Marshal::dump<proto::RCReply>(
-        {.status = proto::CallbackStatus::ConnectErr});
+  }
+
+  /*!
+    Create, register and connect the QP of a CreateRCM request, then post its
+    recvs and run the msg_qp_hooks.
+    \ret the QP and its key
+   */
+  Option<RCtrl::create_rc_ret_t> create_msg_rc(const proto::RCReq &rc_req) {
+    // 1.0 find the Nic to create this QP
+    auto nic = rctrl_p->opened_nics.query(rc_req.nic_id);
+    if (!nic)
+      return {}; // failed to find Nic
+
+    // 1.0 check whether we are able to use the registered recv_cq
+    ibv_cq *recv_cq = nullptr;
+    Option<Arc<RecvSRQ<R>>> recv_srq = {};
+    Option<Arc<RecvCommon>> recv_c = {};
+    if (rc_req.whether_recv == 1) {
+      recv_c = reg_recv_cqs.query(rc_req.name_recv);
+      recv_srq = reg_recv_srqs.query(rc_req.name_recv);
+      if (recv_srq) {
+        // the shared buffers must be able to hold the client's messages
+        if (rc_req.max_recv_sz > recv_srq.value()->max_recv_sz)
+          return {};
+        recv_cq = recv_srq.value()->cq;
+      } else if (!recv_c)
+        recv_cq = nullptr;
+      else
+        recv_cq = recv_c.value()->cq;
+    }
+
+    // 1.1 take a pre-created QP, or try to create one, and register it
+    auto warm = take_warm(rc_req, recv_srq.has_value());
+    Option<Arc<RC>> rc_o = {};
+    if (warm)
+      rc_o = warm.value().rc;
+    else if (recv_srq)
+      rc_o = qp::RC::create(nic.value(), rc_req.config, recv_cq,
+                            recv_srq.value()->srq, true);
+    else if (recv_c)
+      rc_o = create_rc_on(nic.value(), rc_req.config, recv_cq);
+    else
+      rc_o = qp::RC::create(nic.value(), rc_req.config);
+    if (!rc_o)
+      return {};
+    auto rc = rc_o.value();
+    auto rc_status = rctrl_p->registered_qps.reg(rc_req.name, rc);
+
+    if (!rc_status) {
+      // clean up
+      return {};
+    }
+
+    // 1.2 finally we connect the QP
+    if (rc->connect(rc_req.attr) != IOCode::Ok) {
+      // in connect error
+      rctrl_p->registered_qps.dereg(rc_req.name, rc_status.value());
+      return {};
+    }
+    auto key = rc_status.value();
+
+    // 1.3 this QP is done, alloc the recv; entries
+    if (recv_srq) {
+      // the srq's entries have been posted at its creation
+      return std::make_pair(rc, key);
+    }
+    auto recv_c_res = reg_recv_cqs.query(rc_req.name_recv);
+    if (!recv_c_res) {
+      // no such recv channel, the QP could not receive anything
+      rctrl_p->registered_qps.dereg(rc_req.name, key);
+      return {};
+    }
+    auto num_bufs = recv_bufs_of(rc_req.recv_entries);
+    Arc<RecvEntries<R>> recv_entries;
+    {
+      std::lock_guard<std::mutex> guard(*entries_lock);
+      // a pre-created QP has its entries allocated (and posted) already
+      auto entries_o = warm ? Option<Arc<RecvEntries<R>>>(warm.value().entries)
+                            : RecvEntriesFactoryv2<R>::create(
+                                  recv_c_res.value()->allocator,
+                                  rc_req.max_recv_sz, num_bufs, entries_lock);
+      if (entries_o) {
+        recv_entries = entries_o.value();
+        auto entries_key = reg_recv_entries.reg(rc_req.name, recv_entries);
+        RDMA_ASSERT(entries_key);
+        entries_keys[rc_req.name] = entries_key.value();
+      }
+    }
+    if (!recv_entries) {
+      // e.g., the channel's allocator cannot hold messages of max_recv_sz
+      rctrl_p->registered_qps.dereg(rc_req.name, key);
+      return {};
+    }
+
+    // 1.4 we post_recvs
+    if (!warm) {
+      auto res = rc->post_recvs(*recv_entries, num_bufs);
+      RDMA_ASSERT(res == IOCode::Ok); // FIXME: now assert false if failed
+    }
+
+    for (auto &hook : msg_qp_hooks)
+      hook(std::string(rc_req.name), std::string(rc_req.name_recv), rc,
+           recv_entries);
+    return std::make_pair(rc, key);
+  }
+
+private:
+  /*!
+    Create an RC whose recvs complete on the channel's cq, or (if it is null)
+    on a cq of R entries which is destroyed with the QP.
+   */
+  static Option<Arc<RC>> create_rc_on(Arc<RNic> nic, const QPConfig &config,
+                                      ibv_cq *cq) {
+    const bool own = cq == nullptr;
+    if (own) {
+      auto res = Impl::create_cq(nic, R);
+      if (res != IOCode::Ok) {
+        RDMA_LOG(4) << "create recv cq error: " << std::get<1>(res.desc);
+        return {};
+      }
+      cq = std::get<0>(res.desc);
+    }
+    // a failed RC destroys the cq only if it is its own
+    return RC::create(nic, config, cq, nullptr, !own);
+  }
+
+  /*!
+    Take a pre-created QP for the request, if one of the pools serves it
+   */
+  Option<WarmMsgQP> take_warm(const proto::RCReq &rc_req, bool on_srq) {
+    if (rc_req.whether_recv != 1 || on_srq)
+      return {};
+    for (auto &p : msg_pools) {
+      if (p.channel == rc_req.name_recv && p.nic_id == rc_req.nic_id &&
+          p.config == rc_req.config && rc_req.max_recv_sz <= p.max_recv_sz &&
+          recv_bufs_of(rc_req.recv_entries) == p.num_bufs)
+        return p.pool->take();
+    }
+    return {};
   }
 };
 
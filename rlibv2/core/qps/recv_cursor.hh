@@ -0,0 +1,110 @@
+#pragma once
+
+#include "./recv_helper.hh"
+
+namespace rdmaio {
+
+namespace qp {
+
+/*!
+  RecvCursor is a long-lived alternative of RecvIter.
+  RecvIter reposts every consumed entry when it is destroyed, so a loop which
+  creates one iterator per poll pays one ibv_post_recv per poll.
+  The cursor instead keeps the consumed entries, and reposts them with one
+  chained post once *repost_threshold* of them are pending, i.e., when the
+  posted recvs fall to the low-watermark (es - repost_threshold).
+
+  \note: the cursor uses the wcs of the entries, so the entries should not be
+  used by a RecvIter at the same time.
+  \note: we donot store the smart pointer for the performance reason
+
+  Example:
+  `
+  RecvCursor<RC, 256> cursor(qp, entries, 32);
+  while (running) {
+    for (cursor.poll(); cursor.has_msgs(); cursor.next()) {
+      auto imm_data, msg_buf = cursor.cur_msg(); // relax some syntax
+      // do with imm_data and msg_buf
+    }
+  }
+  `
+ */
+template <typename QP, usize es> class RecvCursor {
+  QP *qp = nullptr;
+  RecvEntries<es> *entries = nullptr;
+  usize repost_threshold = 1;
+
+  int idx = 0;
+  int total_msgs = 0;
+
+  // consumed entries which have not been re-posted
+  usize pending_repost = 0;
+
+public:
+  RecvCursor(Arc<QP> &qp, Arc<RecvEntries<es>> &e,
+             const usize &repost_threshold = es / 8)
+      : qp(qp.get()), entries(e.get()),
+        repost_threshold(std::max<usize>(1,
+                                         std::min(repost_threshold, es))) {}
+
+  RecvCursor(const RecvCursor &) = delete;
+  RecvCursor &operator=(const RecvCursor &) = delete;
+
+  /*!
+    Poll a batch of completions, if all the previous ones have been consumed.
+    \ret the number of messages not yet consumed
+   */
+  int poll() {
+    if (idx < total_msgs)
+      return total_msgs - idx;
+    idx = 0;
+    total_msgs = ibv_poll_cq(qp->recv_cq, es, entries->wcs);
+    if (unlikely(total_msgs < 0)) {
+      RDMA_LOG(4) << "poll recv cq error";
+      total_msgs = 0;
+    }
+    return total_msgs;
+  }
+
+  inline bool has_msgs() const { return idx < total_msgs; }
+
+  /*!
+    \ret (imm_data, recv_buffer)
+    */
+  Option<std::pair<u32, rmem::RMem::raw_ptr_t>> cur_msg() const {
+    if (has_msgs()) {
+      auto buf = reinterpret_cast<rmem::RMem::raw_ptr_t>(entries->wcs[idx].wr_id);
+      return std::make_pair(entries->wcs[idx].imm_data, buf);
+    }
+    return {};
+  }
+
+  const ibv_wc &cur_wc() const { return entries->wcs[idx]; }
+
+  /*!
+    Finish the current message, its buffer may be re-posted from now on
+   */
+  inline void next() {
+    idx += 1;
+    pending_repost += 1;
+    if (pending_repost >= repost_threshold)
+      this->flush();
+  }
+
+  /*!
+    Re-post all the consumed entries with one chained post
+   */
+  void flush() {
+    if (pending_repost == 0)
+      return;
+    auto res = qp->post_recvs(*entries, pending_repost);
+    if (unlikely(res != IOCode::Ok))
+      RDMA_LOG(4) << "post recv error: " << strerror(res.desc);
+    pending_repost = 0;
+  }
+
+  ~RecvCursor() { this->flush(); }
+};
+
+} // namespace qp
+} // namespace rdmaio
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <mutex>
+
 #include "./abs_recv_allocator.hh"
 
 namespace rdmaio {
@@ -70,32 +72,64 @@ public:
 
 /*!
   This version only uses one template: N
+
+  Only *num_bufs* buffers are allocated, entry i uses the buffer (i % num_bufs),
+  so at most num_bufs entries should be posted at a time.
+  The buffers are returned to the allocator when the entries are freed, with
+  alloc_lock (if any) held, since the last holder of the entries may be any
+  thread.
+  The buffers are allocated with the caller's locking (e.g., with alloc_lock
+  held), and if one cannot be allocated, the ones taken are returned the same
+  way and {} is returned.
  */
 template <usize N> class RecvEntriesFactoryv2 {
 public:
-  static Arc<RecvEntries<N>> create(Arc<AbsRecvAllocator> &alloc_p,
-                                    const usize &msg_sz) {
-
-    Arc<RecvEntries<N>> ret(new RecvEntries<N>);
-
+  static Option<Arc<RecvEntries<N>>> create(Arc<AbsRecvAllocator> &alloc_p,
+                                            const usize &msg_sz,
+                                            const usize &num_bufs = N,
+                                            Arc<std::mutex> alloc_lock = nullptr) {
+    // the ring of N entries must wrap at a buffer boundary
+    RDMA_ASSERT(num_bufs > 0 && num_bufs <= N && N % num_bufs == 0)
+        << "invalid number of recv buffers: " << num_bufs;
+
+    std::unique_ptr<RecvEntries<N>> e(new RecvEntries<N>());
     for (uint i = 0; i < N; ++i) {
-      auto recv_buf = alloc_p->alloc_one(msg_sz).value();
-
-      struct ibv_sge sge = {
-          .addr = reinterpret_cast<uintptr_t>(std::get<0>(recv_buf)),
-          .length = static_cast<u32>(msg_sz),
-          .lkey = std::get<1>(recv_buf)};
+      struct ibv_sge sge = e->sges[i % num_bufs];
+      if (i < num_bufs) {
+        auto recv_buf = alloc_p->alloc_one(msg_sz);
+        if (!recv_buf) {
+          for (uint j = 0; j < i; ++j)
+            alloc_p->dealloc_one(
+                reinterpret_cast<rmem::RMem::raw_ptr_t>(e->rs[j].wr_id));
+          return {};
+        }
+        sge = {.addr = reinterpret_cast<uintptr_t>(
+                   std::get<0>(recv_buf.value())),
+               .length = static_cast<u32>(msg_sz),
+               .lkey = std::get<1>(recv_buf.value())};
+      }
 
       { // unsafe code
-        ret->rs[i].wr_id = sge.addr;
-        ret->rs[i].sg_list = &(ret->sges[i]);
-        ret->rs[i].num_sge = 1;
-        ret->rs[i].next = (i < N - 1) ? (&(ret->rs[i + 1])) : (&(ret->rs[0]));
+        e->rs[i].wr_id = sge.addr;
+        e->rs[i].sg_list = &(e->sges[i]);
+        e->rs[i].num_sge = 1;
+        e->rs[i].next = (i < N - 1) ? (&(e->rs[i + 1])) : (&(e->rs[0]));
 
-        ret->sges[i] = sge;
+        e->sges[i] = sge;
       }
     }
-    return ret;
+
+    auto alloc = alloc_p;
+    return Arc<RecvEntries<N>>(
+        e.release(), [alloc, num_bufs, alloc_lock](RecvEntries<N> *e) {
+          std::unique_lock<std::mutex> guard;
+          if (alloc_lock)
+            guard = std::unique_lock<std::mutex>(*alloc_lock);
+          for (uint i = 0; i < num_bufs; ++i)
+            alloc->dealloc_one(
+                reinterpret_cast<rmem::RMem::raw_ptr_t>(e->rs[i].wr_id));
+          delete e;
+        });
   }
 };
 
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "../nic.hh"
+#include "../rmem/mem_allocators.hh"
+#include "./abs_recv_allocator.hh"
+
+namespace rdmaio {
+
+namespace qp {
+
+/*!
+  A recv buffer allocator with power-of-two size classes.
+  Each class carves its buffers from chunks which are registered lazily, i.e.,
+  only when the class runs out of free buffers; freed buffers are kept in the
+  class's free list and reused.
+  Compared with a bump allocator over one large MR, the pinned memory follows
+  what the posted recv entries really need.
+
+  Example:
+  `
+  Arc<AbsRecvAllocator> alloc = SizeClassAllocator::create(nic).value();
+  auto entries = RecvEntriesFactoryv2<128>::create(alloc, 4096).value();
+  `
+ */
+class SizeClassAllocator : public AbsRecvAllocator {
+public:
+  static const usize kMinClassSz = 64;
+
+private:
+  struct Chunk {
+    Arc<rmem::RegHandler> mr;
+    rmem::RegAttr attr;
+    usize class_idx;
+  };
+
+  Arc<RNic> nic;
+  const usize max_class_sz;
+  const usize chunk_sz;
+  const rmem::MemOptions mem_opts;
+
+  // free buffers of each size class
+  std::vector<std::vector<rmem::RMem::raw_ptr_t>> free_lists;
+  // chunk start address -> chunk
+  std::map<uintptr_t, Chunk> chunks;
+
+  usize pinned = 0;
+  usize in_use = 0;
+
+  std::mutex lock;
+
+  SizeClassAllocator(Arc<RNic> nic, const usize &max_class_sz,
+                     const usize &chunk_sz, const rmem::MemOptions &mem_opts)
+      : nic(nic), max_class_sz(max_class_sz), chunk_sz(chunk_sz),
+        mem_opts(mem_opts), free_lists(class_of(max_class_sz) + 1) {}
+
+  static usize class_of(const usize &sz) {
+    usize idx = 0;
+    while ((kMinClassSz << idx) < sz)
+      idx += 1;
+    return idx;
+  }
+
+  static usize class_sz(const usize &idx) { return kMinClassSz << idx; }
+
+  // register one more chunk for the class, requires the lock
+  bool grow(const usize &idx) {
+    const usize sz = std::max(chunk_sz, class_sz(idx));
+    auto mem = rmem::alloc_rmem(sz, mem_opts);
+    if (!mem->valid())
+      return false;
+    auto mr = rmem::RegHandler::create(mem, nic);
+    if (!mr)
+      return false;
+    auto attr = mr.value()->get_reg_attr().value();
+
+    chunks.insert(std::make_pair(static_cast<uintptr_t>(attr.buf),
+                                 Chunk{mr.value(), attr, idx}));
+    // the chunk is rounded up to whole pages (e.g., 1GB ones), carve all of it
+    for (usize off = 0; off + class_sz(idx) <= mem->sz; off += class_sz(idx))
+      free_lists[idx].push_back(
+          reinterpret_cast<rmem::RMem::raw_ptr_t>(attr.buf + off));
+    pinned += mem->sz;
+    return true;
+  }
+
+  // the chunk containing buf, requires the lock
+  Option<Chunk> chunk_of(const uintptr_t &buf) {
+    auto it = chunks.upper_bound(buf);
+    if (it == chunks.begin())
+      return {};
+    it--;
+    if (buf >= it->second.attr.buf + it->second.attr.sz)
+      return {};
+    return it->second;
+  }
+
+  Option<std::pair<rmem::RMem::raw_ptr_t, Chunk>> alloc_buf(const usize &sz) {
+    if (sz > max_class_sz)
+      return {};
+    auto idx = class_of(sz);
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (free_lists[idx].empty() && !grow(idx))
+      return {};
+    auto buf = free_lists[idx].back();
+    free_lists[idx].pop_back();
+    in_use += class_sz(idx);
+    return std::make_pair(
+        buf, chunk_of(reinterpret_cast<uintptr_t>(buf)).value());
+  }
+
+public:
+  /*!
+    max_class_sz: the largest buffer which can be allocated
+    chunk_sz: the size registered at a time for classes smaller than it,
+              rounded up to the page size of mem_opts
+    mem_opts: the memory backing the chunks, e.g., huge pages
+   */
+  static Option<Arc<SizeClassAllocator>>
+  create(Arc<RNic> nic, const usize &max_class_sz = 4 * 1024 * 1024,
+         const usize &chunk_sz = 2 * 1024 * 1024,
+         const rmem::MemOptions &mem_opts = rmem::MemOptions()) {
+    if (max_class_sz < kMinClassSz || chunk_sz == 0)
+      return {};
+    return Arc<SizeClassAllocator>(
+        new SizeClassAllocator(nic, max_class_sz, chunk_sz, mem_opts));
+  }
+
+  Option<std::pair<rmem::RMem::raw_ptr_t, rmem::mr_key_t>>
+  alloc_one(const usize &sz) override {
+    auto res = alloc_buf(sz);
+    if (!res)
+      return {};
+    return std::make_pair(
+        std::get<0>(res.value()),
+        static_cast<rmem::mr_key_t>(std::get<1>(res.value()).attr.lkey));
+  }
+
+  Option<std::pair<rmem::RMem::raw_ptr_t, rmem::RegAttr>>
+  alloc_one_for_remote(const usize &sz) override {
+    auto res = alloc_buf(sz);
+    if (!res)
+      return {};
+    return std::make_pair(std::get<0>(res.value()),
+                          std::get<1>(res.value()).attr);
+  }
+
+  usize max_alloc_sz() const override { return max_class_sz; }
+
+  void dealloc_one(rmem::RMem::raw_ptr_t buf) override {
+    std::lock_guard<std::mutex> guard(lock);
+    auto chunk = chunk_of(reinterpret_cast<uintptr_t>(buf));
+    if (!chunk) {
+      RDMA_LOG(4) << "dealloc a buffer not from this allocator: " << buf;
+      return;
+    }
+    free_lists[chunk.value().class_idx].push_back(buf);
+    in_use -= class_sz(chunk.value().class_idx);
+  }
+
+  /*!
+    Bytes of memory registered to the NIC (chunks are never unregistered)
+   */
+  usize pinned_bytes() {
+    std::lock_guard<std::mutex> guard(lock);
+    return pinned;
+  }
+
+  /*!
+    Bytes of buffers currently handed out, rounded up to their classes
+   */
+  usize in_use_bytes() {
+    std::lock_guard<std::mutex> guard(lock);
+    return in_use;
+  }
+};
+
+} // namespace qp
+} // namespace rdmaio
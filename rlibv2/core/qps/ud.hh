@@ -1,6 +1,8 @@
 #pragma once
 
+#include <map>
 #include <memory>
+#include <tuple>
 
 #include "./config.hh"
 #include "./mod.hh"
@@ -52,7 +54,8 @@ public:
             .psn = static_cast<u64>(my_config.rq_psn),
             .port_id = static_cast<u64>(nic->id.port_id),
             .qpn = static_cast<u64>(qp->qp_num),
-            .qkey = static_cast<u64>(my_config.qkey)};
+            .qkey = static_cast<u64>(my_config.qkey),
+            .mtu = static_cast<u8>(nic->active_mtu ? nic->active_mtu.value() : 0)};
   }
 
   /*!
@@ -82,6 +85,34 @@ public:
     return ibv_create_ah(nic->get_pd(), &ah_attr);
   }
 
+  /*!
+    Send one message (with the GRH, it must fit in one packet) to the remote
+    UD QP *remote_qpn* reachable by the address handle *ah*.
+   */
+  Result<std::string> send_to(ibv_ah *ah, const u32 &remote_qpn,
+                              const ibv_sge &sge, const int &flags,
+                              const u64 &wr_id = 0,
+                              const u32 &remote_qkey = kDefaultQKey) {
+    ibv_sge sg = sge;
+    ibv_send_wr sr = {}, *bad_sr;
+    sr.wr_id = wr_id;
+    sr.opcode = IBV_WR_SEND;
+    sr.num_sge = 1;
+    sr.sg_list = &sg;
+    sr.send_flags = flags;
+    sr.wr.ud.ah = ah;
+    sr.wr.ud.remote_qpn = remote_qpn;
+    sr.wr.ud.remote_qkey = remote_qkey;
+
+    if (flags & IBV_SEND_SIGNALED)
+      out_signaled += 1;
+
+    auto rc = ibv_post_send(qp, &sr, &bad_sr);
+    if (0 == rc)
+      return ::rdmaio::Ok(std::string(""));
+    return ::rdmaio::Err(std::string(strerror(errno)));
+  }
+
 private:
   UD(Arc<RNic> nic, const QPConfig &config) : Dummy(nic), my_config(config) {
 
@@ -154,6 +185,80 @@ private:
     return rc == 0;
   }
 };
+/*!
+  Address handles of the peers of a UD QP, created on the first message to
+  (or from) a peer and kept until the cache is destroyed.
+  An address handle only depends on the remote port, so all the QPs of one
+  host share an entry.
+
+  Example:
+  `
+  UDAHCache ahs(ud);
+  // client: to a QP whose attr is fetched from its RCtrl
+  ud->send_to(ahs.query(server_attr), server_attr.qpn, sge, flags);
+  // server: reply to the sender of a received message
+  auto ah = ahs.query_from_wc(wc, recv_buf); // recv_buf starts with the GRH
+  ud->send_to(ah, wc.src_qp, sge, flags);
+  `
+ */
+class UDAHCache {
+  using key_t = std::tuple<u64, u64, u64>; // (subnet prefix, interface id, lid)
+
+  Arc<UD> ud;
+  std::map<key_t, ibv_ah *> ahs;
+
+public:
+  explicit UDAHCache(Arc<UD> ud) : ud(ud) {}
+
+  /*!
+    \ret the address handle of the port of attr, nullptr on failure
+   */
+  ibv_ah *query(const QPAttr &attr) {
+    key_t key = std::make_tuple(static_cast<u64>(attr.addr.subnet_prefix),
+                                static_cast<u64>(attr.addr.interface_id),
+                                static_cast<u64>(attr.lid));
+    auto it = ahs.find(key);
+    if (it != ahs.end())
+      return it->second;
+    auto ah = ud->create_ah(attr);
+    if (ah != nullptr)
+      ahs.insert(std::make_pair(key, ah));
+    return ah;
+  }
+
+  /*!
+    \ret the address handle of the sender of wc, nullptr on failure
+    \param grh: the start of the recv buffer, where the GRH (if any) is placed
+   */
+  ibv_ah *query_from_wc(const ibv_wc &wc, const void *grh) {
+    auto g = reinterpret_cast<const ibv_grh *>(grh);
+    key_t key = (wc.wc_flags & IBV_WC_GRH)
+                    ? std::make_tuple(
+                          static_cast<u64>(g->sgid.global.subnet_prefix),
+                          static_cast<u64>(g->sgid.global.interface_id),
+                          static_cast<u64>(wc.slid))
+                    : std::make_tuple(u64(0), u64(0), static_cast<u64>(wc.slid));
+    auto it = ahs.find(key);
+    if (it != ahs.end())
+      return it->second;
+    auto ah = ibv_create_ah_from_wc(ud->nic->get_pd(), const_cast<ibv_wc *>(&wc),
+                                    const_cast<ibv_grh *>(g),
+                                    ud->nic->id.port_id);
+    if (ah != nullptr)
+      ahs.insert(std::make_pair(key, ah));
+    return ah;
+  }
+
+  usize size() const { return ahs.size(); }
+
+  ~UDAHCache() {
+    for (auto &a : ahs)
+      ibv_destroy_ah(a.second);
+  }
+
+  DISABLE_COPY_AND_ASSIGN(UDAHCache);
+};
+
 } // namespace qp
 
 } // namespace rdmaio
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "../common.hh"
+
+namespace rdmaio {
+
+namespace qp {
+
+/*!
+  A pool of *target* items made ahead of time, e.g., RC QPs already created
+  and brought to INIT (with their recvs posted), so that the RCtrl handlers
+  take one instead of creating a QP (and its CQ) while serving a request.
+  A background thread calls *make* whenever the pool is below target, so the
+  pool refills itself after a burst of connections (e.g., a replica restart).
+  take() returns {} if the pool is empty, and the caller creates the item
+  itself.
+  make runs on the filler thread, so it reports a failure with {} and must
+  not throw.
+
+  Example:
+  `
+  WarmPool<Arc<RC>> pool([nic]() { return RC::create(nic, QPConfig()); }, 16);
+  auto rc = pool.take(); // an Option<Arc<RC>>
+  `
+ */
+template <typename T> class WarmPool {
+public:
+  using make_f = std::function<Option<T>()>;
+
+  // the filler waits this long before retrying a failed make
+  static constexpr usize kRetryMsec = 100;
+
+private:
+  make_f make;
+  const usize target;
+
+  std::deque<T> items;
+  std::mutex lock;
+  // signals the filler that items are taken (or the pool stops)
+  std::condition_variable taken;
+  // signals wait_full() that items are added
+  std::condition_variable added;
+  bool running = true;
+
+  u64 hit_cnt = 0;
+  u64 miss_cnt = 0;
+
+  std::thread filler;
+
+public:
+  WarmPool(make_f make, const usize &target)
+      : make(std::move(make)), target(target),
+        filler([this]() { this->fill(); }) {}
+
+  WarmPool(const WarmPool &) = delete;
+  WarmPool &operator=(const WarmPool &) = delete;
+
+  ~WarmPool() {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      running = false;
+    }
+    taken.notify_all();
+    filler.join();
+  }
+
+  /*!
+    Take an item, or {} if the pool is empty
+   */
+  Option<T> take() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (items.empty()) {
+      miss_cnt += 1;
+      taken.notify_one();
+      return {};
+    }
+    auto item = std::move(items.front());
+    items.pop_front();
+    hit_cnt += 1;
+    taken.notify_one();
+    return item;
+  }
+
+  /*!
+    Block until the pool holds *target* items, or timeout_usec passed
+    \ret whether the pool is full
+   */
+  bool wait_full(const double &timeout_usec = 1000000) {
+    std::unique_lock<std::mutex> guard(lock);
+    return added.wait_for(guard,
+                          std::chrono::microseconds(static_cast<i64>(
+                              std::min(timeout_usec, 3.15e13))),
+                          [this]() { return items.size() >= target; });
+  }
+
+  usize size() {
+    std::lock_guard<std::mutex> guard(lock);
+    return items.size();
+  }
+
+  // the takes served from the pool, and the ones that found it empty
+  u64 hits() {
+    std::lock_guard<std::mutex> guard(lock);
+    return hit_cnt;
+  }
+
+  u64 misses() {
+    std::lock_guard<std::mutex> guard(lock);
+    return miss_cnt;
+  }
+
+private:
+  void fill() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (running) {
+      if (items.size() >= target) {
+        taken.wait(guard);
+        continue;
+      }
+      // making an item is slow, the takers should not wait for it
+      guard.unlock();
+      auto item = make();
+      guard.lock();
+      if (!item) {
+        RDMA_LOG(4) << "warm pool failed to make an item, retry later";
+        taken.wait_for(guard, std::chrono::milliseconds(kRetryMsec));
+        continue;
+      }
+      items.push_back(std::move(item.value()));
+      added.notify_all();
+    }
+  }
+};
+
+} // namespace qp
+
+} // namespace rdmaio
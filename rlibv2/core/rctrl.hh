@@ -2,10 +2,13 @@
 
 #include "./rmem/handler.hh"
 #include "qps/mod.hh"
+#include "qps/warm_pool.hh"
 
 #include "./bootstrap/srpc.hh"
 
 #include <atomic>
+#include <functional>
+#include <vector>
 
 #include <pthread.h>
 
@@ -14,12 +17,23 @@ namespace rdmaio {
 /*!
   RCtrl is a control path daemon, that handles all RDMA bootstrap to this
   machine. RCtrl is **thread-safe**.
+
+  The requests are served by *workers* daemon threads, each receiving from
+  its own socket of the port (see SRpcHandler), so many clients connecting at
+  once (e.g., after a failover) have their QPs created in parallel.
+  With more than one worker, the handlers and hooks registered may run
+  concurrently.
  */
 class RCtrl {
 
   std::atomic<bool> running;
 
-  pthread_t handler_tid;
+  struct Worker {
+    RCtrl *ctrl;
+    usize id;
+    pthread_t tid;
+  };
+  std::vector<Worker> workers;
 
   /*!
     The two factory which allow user to **register** the QP, MR so that others
@@ -34,9 +48,27 @@ public:
 
   bootstrap::SRpcHandler rpc;
 
+  /*!
+    Called with the QP's name after a QP is deleted by a remote DeleteRC,
+    e.g., to release resources (like recv entries) bound to that QP.
+    \note: hooks run in the daemon threads, add them before start_daemon()
+   */
+  std::vector<std::function<void(const std::string &)>> qp_delete_hooks;
+
+  using rc_pool_t = qp::WarmPool<Arc<qp::RC>>;
+
+private:
+  struct RCPool {
+    nic_id_t nic_id;
+    qp::QPConfig config;
+    Arc<rc_pool_t> pool;
+  };
+  std::vector<RCPool> rc_pools;
+
 public:
-  explicit RCtrl(const usize &port, const std::string &h = "localhost")
-      : running(false), rpc(port, h) {
+  explicit RCtrl(const usize &port, const std::string &h = "localhost",
+                 const usize &workers = 1)
+      : running(false), rpc(port, h, workers) {
     RDMA_ASSERT(rpc.register_handler(
         proto::FetchMr,
         std::bind(&RCtrl::fetch_mr_handler, this, std::placeholders::_1)));
@@ -56,6 +88,13 @@ public:
     RDMA_ASSERT(rpc.register_handler(
         proto::FetchDCAttr,
         std::bind(&RCtrl::fetch_dc_attr_wrapper, this, std::placeholders::_1)));
+
+    RDMA_ASSERT(rpc.register_handler(
+        proto::CreateRCBulk, [this](const ByteBuffer &b) {
+          return rc_bulk_handler(b, [this](const proto::RCReq &req) {
+            return create_rc(req);
+          });
+        }));
   }
 
   ~RCtrl() {
@@ -63,7 +102,7 @@ public:
   }
 
   /*!
-    Start the daemon thread for handling RDMA connection requests
+    Start the daemon threads for handling RDMA connection requests
    */
   bool start_daemon() {
     running = true;
@@ -71,32 +110,67 @@ public:
 
     pthread_attr_t attr;
     pthread_attr_init(&attr);
-    return (pthread_create(&handler_tid, &attr, &RCtrl::daemon, this) == 0);
+    // reserved up front, the threads hold pointers to their Worker
+    workers.reserve(rpc.num_workers());
+    for (usize i = 0; i < rpc.num_workers(); ++i) {
+      workers.push_back({.ctrl = this, .id = i, .tid = {}});
+      if (pthread_create(&workers.back().tid, &attr, &RCtrl::daemon,
+                         &workers.back()) != 0) {
+        workers.pop_back();
+        stop_daemon();
+        return false;
+      }
+    }
+    return true;
   }
 
   /*!
-    Stop the daemon thread for handling RDMA connection requests
+    Stop the daemon threads for handling RDMA connection requests
    */
   void stop_daemon() {
     if (running) {
       running = false;
 
       asm volatile("" ::: "memory");
-      pthread_join(handler_tid, nullptr);
+      for (auto &w : workers)
+        pthread_join(w.tid, nullptr);
+      workers.clear();
     }
   }
 
   static void *daemon(void *ctx) {
-    RCtrl &ctrl = *((RCtrl *)ctx);
+    Worker &w = *((Worker *)ctx);
+    RCtrl &ctrl = *w.ctrl;
     u64 total_reqs = 0;
     while (ctrl.running) {
-      total_reqs += ctrl.rpc.run_one_event_loop();
+      total_reqs += ctrl.rpc.run_one_event_loop(w.id);
       continue;
     }
-    RDMA_LOG(INFO) << "stop with :" << total_reqs << " processed.";
+    RDMA_LOG(INFO) << "worker " << w.id << " stop with :" << total_reqs
+                   << " processed.";
     return nullptr; // nothing should return
   }
 
+  /*!
+    Keep *num* RC QPs of *config* on the NIC nic_id created and in INIT, so
+    that a CreateRC (or CreateRCBulk) with the same NIC and config takes one
+    instead of creating it. See qp::WarmPool.
+    \note: call it after the NIC is registered, and before start_daemon()
+    \ret the pool, e.g., for its hit counters
+   */
+  Option<Arc<rc_pool_t>> warm_rc_pool(const nic_id_t &nic_id,
+                                      const qp::QPConfig &config,
+                                      const usize &num) {
+    auto nic = opened_nics.query(nic_id);
+    if (!nic)
+      return {};
+    auto n = nic.value();
+    auto pool = std::make_shared<rc_pool_t>(
+        [n, config]() { return qp::RC::create(n, config); }, num);
+    rc_pools.push_back({.nic_id = nic_id, .config = config, .pool = pool});
+    return pool;
+  }
+
   // handlers of the dameon call
 private:
   ByteBuffer fetch_mr_handler(const ByteBuffer &b) {
@@ -131,6 +205,10 @@ private:
       if (del_res.value() == nullptr)
         return ::rdmaio::Marshal::dump<proto::RCReply>(
             {.status = proto::CallbackStatus::AuthErr});
+
+      // drop our reference before running the hooks
+      del_res = {};
+      run_delete_hooks(std::string(rc_req_o.value().name));
       return ::rdmaio::Marshal::dump<proto::RCReply>(
           {.status = proto::CallbackStatus::Ok});
     }
@@ -188,7 +266,131 @@ public:
         {.status = proto::CallbackStatus::NotFound});
   }
 
+  /*!
+    Deregister a QP created by this RCtrl, and run the delete hooks as if it
+    was deleted by a remote DeleteRC
+   */
+  void delete_created_rc(const std::string &name, const u64 &key) {
+    if (registered_qps.dereg(name, key).value_or(nullptr) != nullptr)
+      run_delete_hooks(name);
+  }
+
+  using create_rc_ret_t = std::pair<Arc<qp::RC>, u64>;
+  using create_rc_f =
+      std::function<Option<create_rc_ret_t>(const proto::RCReq &)>;
+
+  /*!
+    Serve a bulk request (RCBulkReq): QP i is created by *create* from the
+    RCReq that would create it alone. If one of them fails, the QPs created by
+    this call are deleted.
+    It is used for CreateRCBulk, and by the RecvManager for CreateRCMBulk.
+   */
+  ByteBuffer rc_bulk_handler(const ByteBuffer &b, const create_rc_f &create) {
+    auto req_o = ::rdmaio::Marshal::dedump<proto::RCBulkReq>(b);
+    if (!req_o)
+      return bulk_reply_err(proto::CallbackStatus::WrongArg);
+    auto &req = req_o.value();
+    if (req.num > proto::kMaxBulkRC ||
+        b.size() < sizeof(proto::RCBulkReq) + req.num * sizeof(qp::QPAttr))
+      return bulk_reply_err(proto::CallbackStatus::WrongArg);
+
+    ByteBuffer reply = ::rdmaio::Marshal::dump<proto::RCBulkReply>(
+        {.status = proto::CallbackStatus::Ok, .num = req.num});
+    std::vector<std::pair<std::string, u64>> created;
+
+    auto attrs = b.data() + sizeof(proto::RCBulkReq);
+    for (u16 i = 0; i < req.num; ++i) {
+      proto::RCReq rc_req = {};
+      auto name = std::string(req.prefix) + std::to_string(req.base + i);
+      if (name.size() > qp::kMaxQPNameLen)
+        goto Rollback;
+      memcpy(rc_req.name, name.data(), name.size());
+      memcpy(rc_req.name_recv, req.name_recv, qp::kMaxQPNameLen + 1);
+      rc_req.whether_create = 1;
+      rc_req.whether_recv = req.name_recv[0] != '\0' ? 1 : 0;
+      rc_req.nic_id = req.nic_id;
+      rc_req.config = req.config;
+      memcpy(&rc_req.attr, attrs + i * sizeof(qp::QPAttr), sizeof(qp::QPAttr));
+      rc_req.max_recv_sz = req.max_recv_sz;
+      rc_req.recv_entries = req.recv_entries;
+
+      {
+        auto res = create(rc_req);
+        if (!res)
+          goto Rollback;
+        auto &rc = std::get<0>(res.value());
+        auto key = std::get<1>(res.value());
+        created.push_back(std::make_pair(name, key));
+        reply.append(::rdmaio::Marshal::dump<proto::RCBulkEntry>(
+            {.attr = rc->my_attr(), .key = key}));
+      }
+    }
+    return reply;
+
+  Rollback:
+    for (auto &c : created)
+      delete_created_rc(c.first, c.second);
+    return bulk_reply_err(proto::CallbackStatus::WrongArg);
+  }
+
 private:
+  void run_delete_hooks(const std::string &name) {
+    for (auto &hook : qp_delete_hooks)
+      hook(name);
+  }
+
+  static ByteBuffer bulk_reply_err(const proto::CallbackStatus &status) {
+    return ::rdmaio::Marshal::dump<proto::RCBulkReply>(
+        {.status = status, .num = 0});
+  }
+
+  /*!
+    Create, register and connect the QP of a CreateRC request
+    \ret the QP and its key
+   */
+  Option<create_rc_ret_t> create_rc(const proto::RCReq &rc_req) {
+    // 1.0 find the Nic to create this QP
+    auto nic = opened_nics.query(rc_req.nic_id);
+    if (!nic)
+      return {}; // failed to find Nic
+
+    // 1.0 check whether we are able to use the registered recv_cq
+    ibv_cq *recv_cq = nullptr;
+#if 0 // we move this to a separte class
+    if (rc_req.whether_recv == 1) {
+      recv_cq = rc_recv_cqs.query_or_default(rc_req.name_recv,nullptr).get();
+    }
+#endif
+
+    // 1.1 take a pre-created QP, or try to create one, and register it
+    Option<Arc<qp::RC>> rc_o = {};
+    for (auto &p : rc_pools) {
+      if (p.nic_id == rc_req.nic_id && p.config == rc_req.config) {
+        rc_o = p.pool->take();
+        break;
+      }
+    }
+    if (!rc_o)
+      rc_o = qp::RC::create(nic.value(), rc_req.config, recv_cq);
+    if (!rc_o)
+      return {};
+    auto rc = rc_o.value();
+    auto rc_status = registered_qps.reg(rc_req.name, rc);
+
+    if (!rc_status) {
+      // clean up
+      return {};
+    }
+
+    // 1.2 finally we connect the QP
+    if (rc->connect(rc_req.attr) != IOCode::Ok) {
+      // in connect error
+      registered_qps.dereg(rc_req.name, rc_status.value());
+      return {};
+    }
+    return std::make_pair(rc, rc_status.value());
+  }
+
   /*!
     Handling the RC request
     The process has two steps:
@@ -212,35 +414,10 @@ private:
       // 1. check whether we need to create the QP
       u64 key = 0;
       if (rc_req.whether_create == 1) {
-        // 1.0 find the Nic to create this QP
-        auto nic = opened_nics.query(rc_req.nic_id);
-        if (!nic)
-          goto WA; // failed to find Nic
-
-        // 1.0 check whether we are able to use the registered recv_cq
-        ibv_cq *recv_cq = nullptr;
-#if 0 // we move this to a separte class
-        if (rc_req.whether_recv == 1) {
-          recv_cq = rc_recv_cqs.query_or_default(rc_req.name_recv,nullptr).get();
-        }
-#endif
-
-        // 1.1 try to create and register this QP
-        auto rc = qp::RC::create(nic.value(), rc_req.config, recv_cq).value();
-        auto rc_status = registered_qps.reg(rc_req.name, rc);
-
-        if (!rc_status) {
-          // clean up
+        auto res = create_rc(rc_req);
+        if (!res)
           goto WA;
-        }
-
-        // 1.2 finally we connect the QP
-        if (rc->connect(rc_req.attr) != IOCode::Ok) {
-          // in connect error
-          registered_qps.dereg(rc_req.name, rc_status.value());
-          goto WA;
-        }
-        key = rc_status.value();
+        key = std::get<1>(res.value());
       }
 
       // 2. fetch the QP result
@@ -250,9 +427,6 @@ private:
   WA: // wrong arg
     return ::rdmaio::Marshal::dump<proto::RCReply>(
         {.status = proto::CallbackStatus::WrongArg});
-  Err:
-    return ::rdmaio::Marshal::dump<proto::RCReply>(
-        {.status = proto::CallbackStatus::ConnectErr});
   }
 };
 
@@ -18,7 +18,7 @@ struct __attribute__((packed)) IOCode {
 
   explicit IOCode(const Code &c) : c(c) {}
 
-  std::string name() {
+  std::string name() const {
     switch (c) {
     case Ok:
       return "Ok";
@@ -36,9 +36,9 @@ struct __attribute__((packed)) IOCode {
     return "";
   }
 
-  inline bool operator==(const Code &code) { return c == code; }
+  inline bool operator==(const Code &code) const { return c == code; }
 
-  inline bool operator!=(const Code &code) { return c != code; }
+  inline bool operator!=(const Code &code) const { return c != code; }
 };
 
 struct __attribute__((packed)) DummyDesc {
@@ -53,9 +53,9 @@ template <typename Desc = DummyDesc> struct Result {
   IOCode code;
   Desc desc;
 
-  inline bool operator==(const IOCode::Code &c) { return code.c == c; }
+  inline bool operator==(const IOCode::Code &c) const { return code.c == c; }
 
-  inline bool operator!=(const IOCode::Code &c) { return code.c != c; }
+  inline bool operator!=(const IOCode::Code &c) const { return code.c != c; }
 };
 
 /*!
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "./mem.hh"
+
+namespace rdmaio {
+
+namespace rmem {
+
+/*!
+  Where the memory of an RMem comes from.
+  - Malloc: the default RMem allocation (4KB pages)
+  - THP: 2MB aligned memory advised to use transparent huge pages
+  - Huge2M/Huge1G: MAP_HUGETLB memory from the hugetlbfs pool of that page
+    size, which must be reserved beforehand (e.g.,
+    /sys/kernel/mm/hugepages/hugepages-2048kB/nr_hugepages)
+
+  Huge pages shrink both the time ibv_reg_mr spends pinning and translating
+  the memory and the translation entries the NIC has to cache.
+ */
+enum class MemType { Malloc, THP, Huge2M, Huge1G };
+
+struct MemOptions {
+  MemType type = MemType::Malloc;
+  // the NUMA node to bind the memory to, -1 leaves it to the kernel
+  int numa_node = -1;
+
+  /*!
+    Parse a memory type from its name: malloc, thp, huge2m or huge1g
+   */
+  static Option<MemType> parse_type(const std::string &name) {
+    if (name == "malloc")
+      return MemType::Malloc;
+    if (name == "thp")
+      return MemType::THP;
+    if (name == "huge2m")
+      return MemType::Huge2M;
+    if (name == "huge1g")
+      return MemType::Huge1G;
+    return {};
+  }
+
+  usize page_sz() const {
+    switch (type) {
+    case MemType::THP:
+    case MemType::Huge2M:
+      return 2 * 1024 * 1024;
+    case MemType::Huge1G:
+      return 1024 * 1024 * 1024;
+    default:
+      return 4096;
+    }
+  }
+};
+
+/*!
+  Allocate an RMem of (at least) sz bytes with the given memory type, bound to
+  a NUMA node if requested.
+  The size is rounded up to the page size of the type.
+  \ret an invalid RMem if the memory cannot be allocated (e.g., no huge pages
+  are reserved)
+
+  Example:
+  `
+  auto mem = alloc_rmem(1024 * 1024 * 1024, {.type = MemType::Huge2M,
+                                             .numa_node = 0});
+  RDMA_ASSERT(mem->valid());
+  auto mr = RegHandler::create(mem, nic).value();
+  `
+ */
+inline Arc<RMem> alloc_rmem(const u64 &sz, const MemOptions &opts = MemOptions()) {
+  if (opts.type == MemType::Malloc && opts.numa_node < 0)
+    return Arc<RMem>(new RMem(sz));
+
+  const u64 page = opts.page_sz();
+  const u64 map_sz = (sz + page - 1) / page * page;
+
+  auto bind = [opts](RMem::raw_ptr_t p, u64 len) {
+    if (opts.numa_node < 0)
+      return true;
+    // MPOL_BIND, called through syscall so that libnuma is not needed
+    const int kMpolBind = 2;
+    unsigned long mask = 1UL << opts.numa_node;
+    return syscall(SYS_mbind, p, len, kMpolBind, &mask, sizeof(mask) * 8, 0) ==
+           0;
+  };
+
+  auto alloc = [opts, page, map_sz, bind](u64) -> RMem::raw_ptr_t {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (opts.type == MemType::Huge2M)
+      flags |= MAP_HUGETLB | (21 << MAP_HUGE_SHIFT);
+    if (opts.type == MemType::Huge1G)
+      flags |= MAP_HUGETLB | (30 << MAP_HUGE_SHIFT);
+
+    // THP only backs 2MB aligned ranges, so map one more page and trim it
+    const u64 extra = opts.type == MemType::THP ? page : 0;
+    auto p = mmap(nullptr, map_sz + extra, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (p == MAP_FAILED) {
+      RDMA_LOG(4) << "mmap " << map_sz << " bytes error: " << strerror(errno);
+      return nullptr;
+    }
+    if (extra != 0) {
+      auto start = reinterpret_cast<uintptr_t>(p);
+      auto aligned = (start + page - 1) / page * page;
+      if (aligned != start)
+        munmap(p, aligned - start);
+      if (aligned - start != extra)
+        munmap(reinterpret_cast<RMem::raw_ptr_t>(aligned + map_sz),
+               extra - (aligned - start));
+      p = reinterpret_cast<RMem::raw_ptr_t>(aligned);
+    }
+    if (opts.type == MemType::THP && madvise(p, map_sz, MADV_HUGEPAGE) != 0)
+      RDMA_LOG(4) << "madvise huge page error: " << strerror(errno);
+    if (!bind(p, map_sz))
+      RDMA_LOG(4) << "bind memory to node " << opts.numa_node
+                  << " error: " << strerror(errno);
+    return p;
+  };
+
+  auto dealloc = [map_sz](RMem::raw_ptr_t p) {
+    if (p != nullptr)
+      munmap(p, map_sz);
+  };
+
+  return Arc<RMem>(new RMem(map_sz, alloc, dealloc));
+}
+
+} // namespace rmem
+
+} // namespace rdmaio
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <mutex>
+
+#include "./handler.hh"
+
+namespace rdmaio {
+
+namespace rmem {
+
+/*!
+  A pin-down cache of memory registrations, so that application buffers can be
+  used in requests without copying them into a pre-registered buffer.
+  The first pin() of a range registers it (rounded to pages), the following
+  pins of any range inside it only look the registration up.
+  Unpinned registrations are kept in LRU order, and deregistered once the
+  pinned bytes exceed max_pinned_bytes.
+
+  \note: the cache cannot know when the application frees a buffer. Call
+  invalidate() before freeing (or unmapping) a buffer which has been pinned,
+  otherwise a later buffer at the same address would use a stale registration.
+
+  Example:
+  `
+  auto cache = MRCache::create(nic).value();
+  char *buf = new char[4096]; // not registered
+  auto pin = cache->pin(buf, 4096).value();
+  qp->send_normal({...}, {.local_addr = buf, ...}, pin);
+  // wait for the completion, then the pin can be dropped
+  `
+ */
+class MRCache {
+  struct Entry {
+    Arc<RegHandler> mr;
+    RegAttr attr;
+    usize refs = 0;
+    std::list<uintptr_t>::iterator lru_pos;
+  };
+
+  Arc<RNic> nic;
+  const usize max_pinned_bytes;
+  const MemoryFlags flags;
+
+  // range start -> registration
+  std::map<uintptr_t, Entry> entries;
+  // unpinned and pinned registrations, most recently used at the front
+  std::list<uintptr_t> lru;
+
+  usize pinned = 0;
+
+  std::mutex lock;
+
+  MRCache(Arc<RNic> nic, const usize &max_pinned_bytes,
+          const MemoryFlags &flags)
+      : nic(nic), max_pinned_bytes(max_pinned_bytes), flags(flags) {}
+
+  static const uintptr_t kPageSz = 4096;
+
+  static Arc<RegHandler> reg_range(const Arc<RNic> &nic, const uintptr_t &start,
+                                   const u64 &sz, const MemoryFlags &flags) {
+    // the memory belongs to the application, so RMem must not free it
+    auto mem = Arc<RMem>(new RMem(
+        sz, [start](u64) { return reinterpret_cast<RMem::raw_ptr_t>(start); },
+        [](RMem::raw_ptr_t) {}));
+    auto mr = RegHandler::create(mem, nic, flags);
+    if (mr)
+      return mr.value();
+    return nullptr;
+  }
+
+  // the registration covering [addr, addr + sz), requires the lock
+  std::map<uintptr_t, Entry>::iterator find(const uintptr_t &addr,
+                                            const u64 &sz) {
+    auto it = entries.upper_bound(addr);
+    if (it == entries.begin())
+      return entries.end();
+    it--;
+    if (addr + sz > it->second.attr.buf + it->second.attr.sz)
+      return entries.end();
+    return it;
+  }
+
+  // deregister unpinned ranges, least recently used first, requires the lock
+  void evict_for(const u64 &sz) {
+    for (auto pos = lru.end(); pos != lru.begin() && pinned + sz > max_pinned_bytes;) {
+      pos--;
+      auto it = entries.find(*pos);
+      if (it->second.refs != 0)
+        continue;
+      pinned -= it->second.attr.sz;
+      evictions += 1;
+      pos = lru.erase(pos);
+      entries.erase(it);
+    }
+  }
+
+  void unpin(const uintptr_t &start) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = entries.find(start);
+    if (it != entries.end())
+      it->second.refs -= 1;
+  }
+
+public:
+  /*!
+    A registration pinned for one use.
+    While a pin is alive its range is never deregistered, so it should be kept
+    until the requests using it complete.
+    \note: a pin should not outlive its cache.
+   */
+  class Pin {
+    friend class MRCache;
+
+    MRCache *cache = nullptr;
+    uintptr_t start = 0;
+    RegAttr pinned_attr;
+    // set if the range could not be cached, and is registered just for this pin
+    Arc<RegHandler> uncached;
+
+    Pin(MRCache *cache, const RegAttr &attr, Arc<RegHandler> uncached = nullptr)
+        : cache(cache), start(attr.buf), pinned_attr(attr),
+          uncached(uncached) {}
+
+  public:
+    Pin(Pin &&o) noexcept
+        : cache(o.cache), start(o.start), pinned_attr(o.pinned_attr),
+          uncached(std::move(o.uncached)) {
+      o.cache = nullptr;
+    }
+
+    Pin &operator=(Pin &&o) noexcept {
+      if (this != &o) {
+        this->release();
+        cache = o.cache;
+        start = o.start;
+        pinned_attr = o.pinned_attr;
+        uncached = std::move(o.uncached);
+        o.cache = nullptr;
+      }
+      return *this;
+    }
+
+    Pin(const Pin &) = delete;
+    Pin &operator=(const Pin &) = delete;
+
+    const RegAttr &attr() const { return pinned_attr; }
+
+    mr_key_t lkey() const { return pinned_attr.lkey; }
+
+    mr_key_t rkey() const { return pinned_attr.key; }
+
+    void release() {
+      if (cache != nullptr && uncached == nullptr)
+        cache->unpin(start);
+      cache = nullptr;
+      uncached = nullptr;
+    }
+
+    ~Pin() { this->release(); }
+  };
+
+  // statistics
+  u64 hits = 0;
+  u64 misses = 0;
+  u64 evictions = 0;
+
+  /*!
+    max_pinned_bytes: unpinned registrations are evicted above it; pinned ones
+    are never evicted, so it may be exceeded while they are in use
+   */
+  static Option<Arc<MRCache>>
+  create(Arc<RNic> nic, const usize &max_pinned_bytes = 1024 * 1024 * 1024,
+         const MemoryFlags &flags = MemoryFlags()) {
+    if (!nic->valid())
+      return {};
+    return Arc<MRCache>(new MRCache(nic, max_pinned_bytes, flags));
+  }
+
+  /*!
+    Pin the registration covering [addr, addr + sz), registering it on a miss.
+    \ret the pin, or {} if the range cannot be registered
+   */
+  Option<Pin> pin(const void *addr, const u64 &sz) {
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(addr);
+    const uintptr_t start = begin & ~(kPageSz - 1);
+    const uintptr_t end = (begin + sz + kPageSz - 1) & ~(kPageSz - 1);
+
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = find(begin, sz);
+    if (it != entries.end()) {
+      hits += 1;
+      it->second.refs += 1;
+      lru.splice(lru.begin(), lru, it->second.lru_pos);
+      return Pin(this, it->second.attr);
+    }
+
+    misses += 1;
+    auto old = entries.find(start);
+    if (old != entries.end() && old->second.refs != 0) {
+      // a smaller range with the same start is in use, register this one on
+      // the side
+      auto mr = reg_range(nic, start, end - start, flags);
+      if (mr == nullptr)
+        return {};
+      return Pin(this, mr->get_reg_attr().value(), mr);
+    }
+    if (old != entries.end()) {
+      // grow the unpinned range with the same start
+      pinned -= old->second.attr.sz;
+      lru.erase(old->second.lru_pos);
+      entries.erase(old);
+    }
+
+    evict_for(end - start);
+    auto mr = reg_range(nic, start, end - start, flags);
+    if (mr == nullptr)
+      return {};
+
+    lru.push_front(start);
+    auto &e = entries[start];
+    e.mr = mr;
+    e.attr = mr->get_reg_attr().value();
+    e.refs = 1;
+    e.lru_pos = lru.begin();
+    pinned += end - start;
+    return Pin(this, e.attr);
+  }
+
+  /*!
+    Drop the unpinned registrations overlapping [addr, addr + sz), e.g., before
+    the application frees the buffer.
+    \ret false if one of them is still pinned (it is kept)
+   */
+  bool invalidate(const void *addr, const u64 &sz) {
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(addr);
+    bool ret = true;
+
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = entries.upper_bound(begin);
+    if (it != entries.begin())
+      it--;
+    while (it != entries.end() && it->first < begin + sz) {
+      if (it->second.attr.buf + it->second.attr.sz <= begin) {
+        it++;
+        continue;
+      }
+      if (it->second.refs != 0) {
+        ret = false;
+        it++;
+        continue;
+      }
+      pinned -= it->second.attr.sz;
+      lru.erase(it->second.lru_pos);
+      it = entries.erase(it);
+    }
+    return ret;
+  }
+
+  /*!
+    Bytes currently registered by the cache
+   */
+  usize pinned_bytes() {
+    std::lock_guard<std::mutex> guard(lock);
+    return pinned;
+  }
+
+  usize num_entries() {
+    std::lock_guard<std::mutex> guard(lock);
+    return entries.size();
+  }
+
+  DISABLE_COPY_AND_ASSIGN(MRCache);
+};
+
+} // namespace rmem
+
+} // namespace rdmaio
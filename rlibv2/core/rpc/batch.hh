@@ -0,0 +1,157 @@
+#pragma once
+
+#include "../qps/rc.hh"
+#include "../rmem/handler.hh"
+
+#include "./proto.hh"
+
+namespace rdmaio {
+
+namespace rpc {
+
+using namespace qp;
+using namespace rmem;
+
+/*!
+  FrameBatcher packs frames into the send buffers of one RC QP, and sends a
+  batch of them with one SEND_WITH_IMM (imm_data = #frames) when flushed or
+  when the next frame does not fit.
+  Frames are built in place: reserve() returns the header of a frame, whose
+  payload follows it, and commit() adds it to the batch.
+
+  Example:
+  `
+  auto batcher = FrameBatcher::create(qp, nic, RpcConfig()).value();
+  auto h = batcher->reserve(sizeof(u64));
+  *reinterpret_cast<u64 *>(h + 1) = 73;
+  h->len = sizeof(u64); // also fill in req_id, rpc_id, status
+  batcher->commit(h);
+  batcher->flush();
+  `
+ */
+class FrameBatcher {
+  Arc<RC> qp;
+  Arc<RegHandler> mr;
+  RegAttr attr;
+  const RpcConfig config;
+
+  // the buffer of the current batch, and its content
+  usize cur = 0;
+  usize off = 0;
+  u32 frames = 0;
+
+  u64 sends = 0;
+
+  FrameBatcher(Arc<RC> qp, Arc<RNic> nic, const RpcConfig &config)
+      : qp(qp), config(config) {
+    auto mr_o = RegHandler::create(
+        Arc<RMem>(new RMem(config.send_ring * config.max_msg_sz)), nic);
+    if (mr_o) {
+      mr = mr_o.value();
+      attr = mr->get_reg_attr().value();
+    }
+  }
+
+  char *buf_of(const usize &idx) const {
+    return reinterpret_cast<char *>(attr.buf) + idx * config.max_msg_sz;
+  }
+
+public:
+  static Option<Arc<FrameBatcher>> create(Arc<RC> qp, Arc<RNic> nic,
+                                          const RpcConfig &config) {
+    if (config.send_ring < 2 || config.max_msg_sz <= sizeof(FrameHeader))
+      return {};
+    auto res = Arc<FrameBatcher>(new FrameBatcher(qp, nic, config));
+    if (res->mr == nullptr)
+      return {};
+    return res;
+  }
+
+  /*!
+    Reserve a frame with up to *cap* bytes of payload, the current batch is
+    sent first if the frame does not fit in it.
+    \ret the frame's header, or nullptr if the frame can never fit in a batch
+   */
+  FrameHeader *reserve(const usize &cap) {
+    if (unlikely(sizeof(FrameHeader) + cap > config.max_msg_sz))
+      return nullptr;
+    if (off + sizeof(FrameHeader) + cap > config.max_msg_sz) {
+      auto res = flush();
+      if (unlikely(res != IOCode::Ok)) {
+        RDMA_LOG(4) << "flush a batch error: " << res.desc;
+        return nullptr;
+      }
+    }
+    return reinterpret_cast<FrameHeader *>(buf_of(cur) + off);
+  }
+
+  /*!
+    Append the frame returned by the last reserve(), with h->len bytes of
+    payload, to the batch
+   */
+  void commit(FrameHeader *h) {
+    off += sizeof(FrameHeader) + h->len;
+    frames += 1;
+  }
+
+  bool empty() const { return frames == 0; }
+
+  /*!
+    Send the current batch, if any
+   */
+  Result<std::string> flush() {
+    if (frames == 0)
+      return ::rdmaio::Ok(std::string(""));
+
+    sends += 1;
+    const bool signaled = sends % config.signal_batch() == 0;
+    auto res = qp->send_normal(
+        {.op = IBV_WR_SEND_WITH_IMM,
+         .flags = signaled ? IBV_SEND_SIGNALED : 0,
+         .len = static_cast<u32>(off),
+         .wr_id = 0},
+        {.local_addr = reinterpret_cast<RMem::raw_ptr_t>(buf_of(cur)),
+         .remote_addr = 0,
+         .imm_data = frames},
+        attr, attr);
+    if (unlikely(res != IOCode::Ok))
+      return res;
+    if (signaled) {
+      // the buffers of this half of the ring can be reused from now on
+      auto res_p = qp->wait_rc_comp();
+      if (unlikely(res_p != IOCode::Ok))
+        return ::rdmaio::Err(Dummy::wc_status(std::get<1>(res_p.desc)));
+    }
+
+    cur = (cur + 1) % config.send_ring;
+    off = 0;
+    frames = 0;
+    return ::rdmaio::Ok(std::string(""));
+  }
+};
+
+/*!
+  Call f(const FrameHeader &, const char *payload) on each of the *frames*
+  frames in a received batch of *sz* bytes.
+  \ret false if the batch is malformed (the valid frames before are visited)
+ */
+template <typename F>
+inline bool for_each_frame(const char *buf, const usize &sz, const u32 &frames,
+                           F &&f) {
+  usize off = 0;
+  for (u32 i = 0; i < frames; ++i) {
+    if (unlikely(off + sizeof(FrameHeader) > sz))
+      return false;
+    auto h = reinterpret_cast<const FrameHeader *>(buf + off);
+    off += sizeof(FrameHeader);
+    if (unlikely(off + h->len > sz))
+      return false;
+    f(*h, buf + off);
+    off += h->len;
+  }
+  return true;
+}
+
+} // namespace rpc
+
+} // namespace rdmaio
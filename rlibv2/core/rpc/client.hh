@@ -0,0 +1,206 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "../lib.hh"
+#include "../qps/recv_cursor.hh"
+#include "../qps/size_class_allocator.hh"
+
+#include "./batch.hh"
+
+namespace rdmaio {
+
+namespace rpc {
+
+/*!
+  The client end of the RPC layer: one RC QP to a RpcServer, with up to
+  RpcConfig::max_outstanding calls in flight.
+  A call is appended to the current batch, which is sent by flush() (or
+  poll(), or once the batch is full). Replies are matched to their calls by
+  the req_id, i.e., the call's slot in the response table, and handed to the
+  call's callback from poll().
+
+  R: the recv entries of the QP, at least RpcConfig::max_outstanding.
+
+  Example:
+  `
+  auto client = RpcClient<>::create(nic, RpcConfig()).value();
+  auto res = client->connect(cm, "rpc_qp_0", "rpc_channel", nic_id);
+
+  client->call(kLookup, &key, sizeof(key),
+               [](RpcStatus s, const char *reply, u32 len) { ... });
+  while (client->outstanding() > 0)
+    client->poll();
+  client->disconnect(cm);
+  `
+ */
+template <usize R = 128> class RpcClient {
+public:
+  // (status, reply payload, payload len), the payload is only valid in the call
+  using reply_f = std::function<void(RpcStatus, const char *, u32)>;
+
+private:
+  struct Pending {
+    reply_f cb;
+    bool used = false;
+  };
+
+  const RpcConfig config;
+  Arc<RC> qp;
+  Arc<RecvEntries<R>> entries;
+  Arc<FrameBatcher> batcher;
+  std::unique_ptr<RecvCursor<RC, R>> cursor;
+
+  std::vector<Pending> table;
+  std::vector<u32> free_slots;
+
+  // the remote QP name and key, for disconnect()
+  std::string remote_name;
+  u64 remote_key = 0;
+
+  RpcClient(const RpcConfig &config) : config(config) {}
+
+public:
+  static Option<Arc<RpcClient>> create(Arc<RNic> nic,
+                                       const RpcConfig &config = RpcConfig(),
+                                       const QPConfig &qp_config = QPConfig()) {
+    if (config.max_outstanding == 0 || config.max_outstanding > R)
+      return {};
+
+    auto recv_cq_res = Impl::create_cq(nic, R);
+    if (recv_cq_res != IOCode::Ok) {
+      RDMA_LOG(4) << "create recv cq error: " << std::get<1>(recv_cq_res.desc);
+      return {};
+    }
+    auto qp = RC::create(nic, qp_config, std::get<0>(recv_cq_res.desc));
+    if (!qp)
+      return {};
+
+    Arc<RpcClient> ret(new RpcClient(config));
+    ret->qp = qp.value();
+    auto batcher = FrameBatcher::create(ret->qp, nic, config);
+    auto alloc = SizeClassAllocator::create(nic, config.max_msg_sz);
+    if (!batcher || !alloc)
+      return {};
+    ret->batcher = batcher.value();
+
+    Arc<AbsRecvAllocator> recv_alloc = alloc.value();
+    auto entries = RecvEntriesFactoryv2<R>::create(recv_alloc, config.max_msg_sz);
+    if (!entries)
+      return {};
+    ret->entries = entries.value();
+    if (ret->qp->post_recvs(*ret->entries, R) != IOCode::Ok)
+      return {};
+    ret->cursor.reset(new RecvCursor<RC, R>(ret->qp, ret->entries));
+
+    ret->table.resize(config.max_outstanding);
+    for (u32 i = 0; i < config.max_outstanding; ++i)
+      ret->free_slots.push_back(config.max_outstanding - 1 - i);
+    return ret;
+  }
+
+  /*!
+    Create and connect the server's QP *name* on its RPC channel
+   */
+  Result<std::string> connect(ConnectManager &cm, const std::string &name,
+                              const std::string &channel,
+                              const nic_id_t &nic_id,
+                              const QPConfig &qp_config = QPConfig()) {
+    auto res = cm.cc_rc_msg(name, channel, config.max_msg_sz, qp, nic_id,
+                            qp_config);
+    if (res != IOCode::Ok)
+      return ::rdmaio::transfer(res, std::get<0>(res.desc));
+    remote_name = name;
+    remote_key = std::get<1>(res.desc);
+    return ::rdmaio::Ok(std::string(""));
+  }
+
+  /*!
+    Release the server's QP, so that the name can be reused
+   */
+  Result<std::string> disconnect(ConnectManager &cm) {
+    return cm.delete_remote_rc(remote_name, remote_key);
+  }
+
+  /*!
+    Issue a call to the handler *rpc_id* of the server, the callback is called
+    from poll() with the reply.
+    \ret
+    - Ok: the req_id of the call
+    - NotReady: max_outstanding calls are in flight, poll() and retry
+    - Err: the request does not fit in a batch, or the send failed
+   */
+  Result<u32> call(const u16 &rpc_id, const void *req, const u32 &len,
+                   reply_f cb) {
+    if (free_slots.empty())
+      return NotReady(0u);
+    auto h = batcher->reserve(len);
+    if (unlikely(h == nullptr))
+      return ::rdmaio::Err(0u);
+
+    u32 slot = free_slots.back();
+    free_slots.pop_back();
+    table[slot].cb = std::move(cb);
+    table[slot].used = true;
+
+    *h = {.req_id = slot,
+          .rpc_id = rpc_id,
+          .status = static_cast<u8>(RpcStatus::Ok),
+          .len = len};
+    memcpy(h + 1, req, len);
+    batcher->commit(h);
+    return ::rdmaio::Ok(slot);
+  }
+
+  /*!
+    Send the calls batched so far
+   */
+  Result<std::string> flush() { return batcher->flush(); }
+
+  /*!
+    Flush the batched calls, then handle the received replies.
+    \ret the number of calls completed
+   */
+  usize poll() {
+    auto res = flush();
+    if (unlikely(res != IOCode::Ok))
+      RDMA_LOG(4) << "send calls error: " << res.desc;
+
+    usize done = 0;
+    for (cursor->poll(); cursor->has_msgs(); cursor->next()) {
+      auto &wc = cursor->cur_wc();
+      if (unlikely(wc.status != IBV_WC_SUCCESS)) {
+        RDMA_LOG(4) << "recv reply error: " << Dummy::wc_status(wc);
+        continue;
+      }
+      auto buf = reinterpret_cast<const char *>(wc.wr_id);
+      auto ok = for_each_frame(
+          buf, wc.byte_len, wc.imm_data,
+          [this, &done](const FrameHeader &h, const char *payload) {
+            if (unlikely(h.req_id >= table.size() || !table[h.req_id].used)) {
+              RDMA_LOG(4) << "reply to an unknown call: " << h.req_id;
+              return;
+            }
+            auto &p = table[h.req_id];
+            // free the slot first, so the callback can issue another call
+            auto cb = std::move(p.cb);
+            p.used = false;
+            free_slots.push_back(h.req_id);
+            cb(static_cast<RpcStatus>(h.status), payload, h.len);
+            done += 1;
+          });
+      if (unlikely(!ok))
+        RDMA_LOG(4) << "malformed reply batch of " << wc.byte_len << " bytes";
+    }
+    return done;
+  }
+
+  usize outstanding() const { return table.size() - free_slots.size(); }
+
+  Arc<RC> &get_qp() { return qp; }
+};
+
+} // namespace rpc
+
+} // namespace rdmaio
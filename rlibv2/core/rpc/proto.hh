@@ -0,0 +1,57 @@
+#pragma once
+
+#include "../common.hh"
+
+namespace rdmaio {
+
+namespace rpc {
+
+/*!
+  Wire format of the RPC layer over RC two-sided verbs.
+
+  Each SEND carries a batch of frames packed back to back, and its imm_data is
+  the number of frames in it. A frame is a FrameHeader followed by *len* bytes
+  of payload. A request frame names the handler (rpc_id) and the caller's slot
+  in its response table (req_id); the reply frame echoes both, with a status.
+ */
+struct __attribute__((packed)) FrameHeader {
+  u32 req_id;
+  u16 rpc_id;
+  u8 status;
+  u8 reserved = 0;
+  u32 len;
+};
+
+enum class RpcStatus : u8 {
+  Ok = 0,
+  // no handler is registered for the rpc_id
+  NoHandler,
+  // the handler's reply exceeds RpcConfig::max_reply_sz
+  ReplyTooLarge,
+};
+
+// handlers are stored in an array indexed by rpc_id
+const usize kMaxRpcs = 256;
+
+struct RpcConfig {
+  // largest SEND (i.e., one batch of frames) in either direction, also the
+  // size of each recv buffer
+  usize max_msg_sz = 4096;
+
+  // reply payload space a server handler is given for one call
+  usize max_reply_sz = 1024;
+
+  // calls awaiting their reply at a client, it should not exceed the recv
+  // entries at either end, since every SEND in flight holds one of them
+  usize max_outstanding = 64;
+
+  // send buffers of each QP, reused round-robin. sends are unsignaled except
+  // one per half ring, so a buffer is never reused before its send is done
+  usize send_ring = 16;
+
+  usize signal_batch() const { return send_ring / 2; }
+};
+
+} // namespace rpc
+
+} // namespace rdmaio
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "../qps/rc_recv_manager.hh"
+#include "../qps/size_class_allocator.hh"
+
+#include "./batch.hh"
+
+namespace rdmaio {
+
+namespace rpc {
+
+/*!
+  The server end of the RPC layer: a recv channel of a RecvManager, whose QPs
+  (created by clients with RpcClient::connect) are served by the thread
+  calling poll().
+  The replies to the requests of one poll are batched per QP, so a client
+  issuing many calls at a time gets them back in few SENDs.
+
+  New and deleted QPs are reported by the RecvManager and RCtrl hooks, so the
+  server should outlive the RCtrl daemon, and be created before
+  start_daemon().
+
+  Example:
+  `
+  RCtrl ctrl(8888);
+  RecvManager<128> manager(ctrl);
+  auto server = RpcServer<128>::create(ctrl, manager, nic, "rpc_channel").value();
+  server->register_handler(kLookup, [](const char *req, u32 len, char *reply,
+                                       u32 max_reply) -> u32 { ... });
+  ctrl.start_daemon();
+  while (running)
+    server->poll();
+  `
+ */
+template <usize R = 128> class RpcServer {
+public:
+  // (request payload, len, reply payload, max reply len) -> reply len
+  using handler_f = std::function<u32(const char *, u32, char *, u32)>;
+
+  static const usize kPollBatch = 64;
+
+private:
+  struct Conn {
+    std::string name;
+    Arc<RC> qp;
+    Arc<RecvEntries<R>> entries;
+    Arc<FrameBatcher> batcher;
+    // requests received in the current poll, whose recvs are to be re-posted
+    usize consumed = 0;
+  };
+
+  const RpcConfig config;
+  const std::string channel;
+  Arc<RNic> nic;
+  ibv_cq *cq = nullptr;
+
+  std::vector<handler_f> handlers;
+
+  // only used by the polling thread
+  std::unordered_map<u32, Conn> conns;
+  std::unordered_map<std::string, u32> qpn_of;
+  // QPs with requests in the current poll
+  std::vector<u32> active;
+  ibv_wc wcs[kPollBatch];
+
+  // QPs joined (qp != nullptr) or left the channel, handed over from the
+  // RCtrl daemon
+  std::mutex lock;
+  std::vector<Conn> events;
+  std::atomic<bool> has_events{false};
+
+  RpcServer(Arc<RNic> nic, const std::string &channel, const RpcConfig &config)
+      : config(config), channel(channel), nic(nic), handlers(kMaxRpcs) {}
+
+  void on_join(const std::string &name, const std::string &ch, Arc<RC> qp,
+               Arc<RecvEntries<R>> entries) {
+    if (ch != channel)
+      return;
+    auto batcher = FrameBatcher::create(qp, nic, config);
+    if (!batcher) {
+      RDMA_LOG(4) << "failed to create the reply buffers of " << name;
+      return;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    events.push_back(Conn{name, qp, entries, batcher.value()});
+    has_events.store(true, std::memory_order_release);
+  }
+
+  void on_leave(const std::string &name) {
+    std::lock_guard<std::mutex> guard(lock);
+    events.push_back(Conn{name, nullptr, nullptr, nullptr});
+    has_events.store(true, std::memory_order_release);
+  }
+
+  void apply_events() {
+    std::vector<Conn> evs;
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      evs.swap(events);
+      has_events.store(false, std::memory_order_relaxed);
+    }
+    for (auto &e : evs) {
+      auto it = qpn_of.find(e.name);
+      if (e.qp == nullptr) {
+        if (it != qpn_of.end()) {
+          conns.erase(it->second);
+          qpn_of.erase(it);
+        }
+        continue;
+      }
+      auto qpn = e.qp->qp->qp_num;
+      qpn_of[e.name] = qpn;
+      conns[qpn] = std::move(e);
+    }
+  }
+
+  void serve(Conn &conn, const FrameHeader &h, const char *payload) {
+    auto rh = conn.batcher->reserve(config.max_reply_sz);
+    if (unlikely(rh == nullptr)) {
+      RDMA_LOG(4) << "no reply buffer for " << conn.name;
+      return;
+    }
+    auto status = RpcStatus::Ok;
+    u32 len = 0;
+    if (likely(h.rpc_id < kMaxRpcs && handlers[h.rpc_id])) {
+      len = handlers[h.rpc_id](payload, h.len, reinterpret_cast<char *>(rh + 1),
+                               config.max_reply_sz);
+      if (unlikely(len > config.max_reply_sz)) {
+        status = RpcStatus::ReplyTooLarge;
+        len = 0;
+      }
+    } else
+      status = RpcStatus::NoHandler;
+
+    *rh = {.req_id = h.req_id,
+           .rpc_id = h.rpc_id,
+           .status = static_cast<u8>(status),
+           .len = len};
+    conn.batcher->commit(rh);
+    served += 1;
+  }
+
+public:
+  // calls served so far
+  u64 served = 0;
+
+  /*!
+    Register the recv channel *channel* at the manager, with a recv cq of
+    cq_depth entries. Clients connect to it with max_msg_sz equal to
+    config.max_msg_sz.
+   */
+  static Option<Arc<RpcServer>> create(RCtrl &ctrl, RecvManager<R> &manager,
+                                       Arc<RNic> nic, const std::string &channel,
+                                       const RpcConfig &config = RpcConfig(),
+                                       const usize &cq_depth = 8192) {
+    if (config.max_reply_sz + sizeof(FrameHeader) > config.max_msg_sz)
+      return {};
+    auto cq_res = Impl::create_cq(nic, cq_depth);
+    if (cq_res != IOCode::Ok) {
+      RDMA_LOG(4) << "create recv cq error: " << std::get<1>(cq_res.desc);
+      return {};
+    }
+    auto alloc = SizeClassAllocator::create(nic, config.max_msg_sz);
+    if (!alloc)
+      return {};
+
+    Arc<RpcServer> ret(new RpcServer(nic, channel, config));
+    ret->cq = std::get<0>(cq_res.desc);
+    if (!manager.reg_recv_cqs.create_then_reg(channel, ret->cq, alloc.value()))
+      return {};
+
+    auto server = ret.get();
+    manager.msg_qp_hooks.push_back(
+        [server](const std::string &name, const std::string &ch, Arc<RC> qp,
+                 Arc<RecvEntries<R>> entries) {
+          server->on_join(name, ch, qp, entries);
+        });
+    ctrl.qp_delete_hooks.push_back(
+        [server](const std::string &name) { server->on_leave(name); });
+    return ret;
+  }
+
+  /*!
+    Register the handler of *rpc_id*, before the server is polled
+    \ret false if the id is out of range or already registered
+   */
+  bool register_handler(const u16 &rpc_id, handler_f h) {
+    if (rpc_id >= kMaxRpcs || handlers[rpc_id])
+      return false;
+    handlers[rpc_id] = std::move(h);
+    return true;
+  }
+
+  /*!
+    Serve one batch of requests: call their handlers, send the replies of
+    each QP in one batch and re-post the consumed recvs.
+    \ret the number of requests (SENDs) received
+   */
+  usize poll() {
+    if (unlikely(has_events.load(std::memory_order_acquire)))
+      apply_events();
+
+    int n = ibv_poll_cq(cq, kPollBatch, wcs);
+    if (unlikely(n < 0)) {
+      RDMA_LOG(4) << "poll recv cq error";
+      return 0;
+    }
+
+    for (int i = 0; i < n; ++i) {
+      auto it = conns.find(wcs[i].qp_num);
+      if (unlikely(it == conns.end())) {
+        // the QP may have joined after the events were applied
+        apply_events();
+        it = conns.find(wcs[i].qp_num);
+      }
+      if (unlikely(wcs[i].status != IBV_WC_SUCCESS || it == conns.end())) {
+        RDMA_LOG(4) << "drop a request of qp " << wcs[i].qp_num << ": "
+                    << Dummy::wc_status(wcs[i]);
+        continue;
+      }
+
+      auto &conn = it->second;
+      if (conn.consumed == 0)
+        active.push_back(wcs[i].qp_num);
+      conn.consumed += 1;
+
+      auto ok = for_each_frame(
+          reinterpret_cast<const char *>(wcs[i].wr_id), wcs[i].byte_len,
+          wcs[i].imm_data, [this, &conn](const FrameHeader &h, const char *p) {
+            serve(conn, h, p);
+          });
+      if (unlikely(!ok))
+        RDMA_LOG(4) << "malformed request batch from " << conn.name;
+    }
+
+    for (auto qpn : active) {
+      // the QP may have left while its requests were served
+      auto it = conns.find(qpn);
+      if (unlikely(it == conns.end()))
+        continue;
+      auto conn = &it->second;
+      auto res = conn->batcher->flush();
+      if (unlikely(res != IOCode::Ok))
+        RDMA_LOG(4) << "send replies to " << conn->name << " error: " << res.desc;
+      // recvs of one QP complete in order, so re-post the consumed entries
+      auto res_r = conn->qp->post_recvs(*conn->entries, conn->consumed);
+      if (unlikely(res_r != IOCode::Ok))
+        RDMA_LOG(4) << "post recvs error: " << strerror(res_r.desc);
+      conn->consumed = 0;
+    }
+    active.clear();
+    return n;
+  }
+
+  usize num_conns() const { return conns.size(); }
+};
+
+} // namespace rpc
+
+} // namespace rdmaio
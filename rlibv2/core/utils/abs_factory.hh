@@ -1,11 +1,15 @@
 #pragma once
 
-#include <map>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
 #include <mutex>
 
 #include "../common.hh"
 
+#include "./rcu_map.hh"
+
 namespace rdmaio {
 
 /*!
@@ -28,61 +32,94 @@ namespace rdmaio {
   opened_nics.dereg(73,key); // delete the nic from the registration
   `
 
+  Queries take no lock (the entries are kept in an RCUMap), so many threads
+  (e.g., pollers resolving a QP or MR per request) can query at once, while
+  reg and dereg copy the registry and are serialized.
+
  */
 template <typename K, typename V> class Factory {
-  std::map<K,std::pair<Arc<V>,u64>> store;
-  std::mutex lock;
+  // name -> (entry, authentication key); lookups take no lock, see RCUMap
+  RCUMap<K, std::pair<Arc<V>, u64>> store;
+
+  // notified on every reg, for wait_for
+  std::mutex wait_lock;
+  std::condition_variable registered;
 
 public:
   static Arc<V> wrapper_raw_ptr(V *v) {
     return Arc<V>(v, [](auto p) {});
   }
 
-  usize reg_entries() const { return store.size(); }
+  usize reg_entries() { return store.size(); }
   /*!
     Register a v to the factory,
     if successful, return an authentication key so that user can delete it.
    */
   Option<u64> reg(const K &k, Arc<V> v) {
-    std::lock_guard<std::mutex> guard(lock);
-    if (store.find(k) != store.end())
-      return {};
-    auto key = generate_key();
-    store.insert(std::make_pair(k,std::make_pair(v,key)));
-
+    Option<u64> key = {};
+    store.update([&](auto &next) {
+      if (next.find(k) != next.end())
+        return false;
+      key = generate_key();
+      next.insert(std::make_pair(k, std::make_pair(v, key.value())));
+      return true;
+    });
+    if (key) {
+      // a waiter checks the store while holding wait_lock
+      std::lock_guard<std::mutex> guard(wait_lock);
+      registered.notify_all();
+    }
     return key;
   }
 
+  /*!
+    Block until an entry is registered under k (e.g., a QP created by a
+    remote peer through RCtrl), instead of polling query().
+    \note: timeout is measured in microseconds
+    \ret the entry, or {} on timeout
+   */
+  Option<Arc<V>> wait_for(const K &k, const double &timeout_usec = 1000000) {
+    std::unique_lock<std::mutex> guard(wait_lock);
+    // no_timeout() does not fit in a chrono duration, a year is long enough
+    auto to = std::chrono::microseconds(
+        static_cast<i64>(std::min(timeout_usec, 3.15e13)));
+    Option<Arc<V>> res = {};
+    registered.wait_for(guard, to, [&] { return (res = query(k)).has_value(); });
+    return res;
+  }
+
   /*!
     Qeury a registered entry, without authentication.
+    It takes no lock, so it is cheap to call per request from many threads.
    */
   Option<Arc<V>> query(const K &k) {
-    std::lock_guard<std::mutex> guard(lock);
-    if (store.find(k) != store.end())
-      return std::get<0>(store[k]);
-    return {};
+    return store.read([&k](const auto &m) -> Option<Arc<V>> {
+      auto it = m.find(k);
+      if (it == m.end())
+        return {};
+      return std::get<0>(it->second);
+    });
   }
 
   Arc<V> query_or_default(const K &k, V *def) {
     auto res = query(k);
-    if (res);
+    if (res)
       return res.value();
     return wrapper_raw_ptr(def);
   }
 
   Option<Arc<V>> dereg(const K &id, const u64 &k) {
-    std::lock_guard<std::mutex> guard(lock);
-    auto it = store.find(id);
-    if (it != store.end()) {
+    Option<Arc<V>> res = {};
+    store.update([&](auto &next) {
+      auto it = next.find(id);
       // further check the authentication key
-      if (std::get<1>(it->second) == k) {
-        auto res = std::get<0>(it->second);
-        store.erase(it);
-
-        return res;
-      }
-    }
-    return {};
+      if (it == next.end() || std::get<1>(it->second) != k)
+        return false;
+      res = std::get<0>(it->second);
+      next.erase(it);
+      return true;
+    });
+    return res;
   }
 
   /*!
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "../common.hh"
+
+namespace rdmaio {
+
+/*!
+  A read-mostly hash map with RCU-style updates: a reader looks up the
+  current snapshot of the map without any lock, and an update copies the
+  snapshot, modifies the copy and publishes it, then frees the old snapshot
+  once no reader may use it anymore.
+  A lookup takes two atomic adds on a counter of its own cache line (which
+  the readers of other threads rarely share), so lookups from many threads
+  proceed in parallel and never wait for an update. Updates are serialized
+  and take O(size) each, which suits registries updated only when a resource
+  is (de)registered.
+
+  A reader announces itself on the counters of the current epoch parity,
+  then loads the snapshot. An update publishes its snapshot, then flips the
+  epoch twice, each time waiting for the readers of the parity left
+  (as the memb flavor of userspace RCU does), so that all the readers that
+  may have loaded the old snapshot are done before it is freed.
+
+  Example:
+  `
+  RCUMap<std::string, u64> m;
+  m.update([](auto &next) { next["a"] = 1; return true; });
+  auto v = m.find("a"); // an Option<u64>
+  `
+ */
+template <typename K, typename T> class RCUMap {
+public:
+  using map_t = std::unordered_map<K, T>;
+
+  // reader counters of each parity, one cache line each
+  static constexpr usize kStripes = 16;
+
+private:
+  struct alignas(64) Counter {
+    std::atomic<u64> n{0};
+  };
+
+  std::atomic<map_t *> cur;
+  std::atomic<u64> epoch{0};
+  Counter readers[2][kStripes];
+  std::mutex writer;
+
+  static usize my_stripe() {
+    static std::atomic<usize> next_stripe{0};
+    static thread_local usize stripe = next_stripe.fetch_add(1) % kStripes;
+    return stripe;
+  }
+
+  /*!
+    Wait until no reader may hold a snapshot published before this call
+   */
+  void synchronize() {
+    for (int phase = 0; phase < 2; ++phase) {
+      auto parity = epoch.fetch_add(1) & 1;
+      for (usize i = 0; i < kStripes; ++i) {
+        while (readers[parity][i].n.load() != 0)
+          std::this_thread::yield();
+      }
+    }
+  }
+
+public:
+  RCUMap() : cur(new map_t()) {}
+
+  RCUMap(const RCUMap &) = delete;
+  RCUMap &operator=(const RCUMap &) = delete;
+
+  ~RCUMap() { delete cur.load(); }
+
+  /*!
+    Call f with the current snapshot, and return its result.
+    \note: f must not keep references into the snapshot, nor update this map
+   */
+  template <typename F>
+  auto read(F &&f) -> decltype(f(std::declval<const map_t &>())) {
+    auto &c = readers[epoch.load() & 1][my_stripe()].n;
+    c.fetch_add(1);
+    struct Exit {
+      std::atomic<u64> &c;
+      ~Exit() { c.fetch_sub(1, std::memory_order_release); }
+    } exit{c};
+    return f(*cur.load());
+  }
+
+  Option<T> find(const K &k) {
+    return read([&k](const map_t &m) -> Option<T> {
+      auto it = m.find(k);
+      if (it == m.end())
+        return {};
+      return it->second;
+    });
+  }
+
+  usize size() {
+    return read([](const map_t &m) { return m.size(); });
+  }
+
+  /*!
+    Call f with a copy of the map; if it returns true, publish the copy as
+    the current snapshot.
+    Updates are serialized, so f may decide on the copy (e.g., whether a key
+    exists) without racing with other updates.
+    \ret what f returns
+   */
+  template <typename F> bool update(F &&f) {
+    std::lock_guard<std::mutex> guard(writer);
+    auto old = cur.load();
+    std::unique_ptr<map_t> next(new map_t(*old));
+    if (!f(*next))
+      return false;
+    cur.store(next.release());
+    synchronize();
+    delete old;
+    return true;
+  }
+};
+
+} // namespace rdmaio
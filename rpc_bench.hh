@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+
+#include "rlibv2/core/common.hh"
+
+/*!
+  Handlers and names shared by rpc_server and rpc_client.
+ */
+
+enum RpcBenchId : rdmaio::u16 {
+	// replies with as many bytes as the u32 at the head of the request asks for
+	kRpcEcho = 0,
+	// replies nothing, the cost of the framework alone
+	kRpcNull = 1,
+};
+
+// recv entries of each RC QP (on both sides), which bounds the calls in flight per QP
+constexpr rdmaio::usize rpc_entry_num = 128;
+
+inline std::string rpc_qp_name(int client_id) {
+	return "rpc_qp_" + std::to_string(client_id);
+}
@@ -0,0 +1,119 @@
+#include <gflags/gflags.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "rlibv2/core/lib.hh"
+#include "rlibv2/core/rpc/client.hh"
+
+#include "bench_utils.hh"
+#include "rpc_bench.hh"
+
+DEFINE_string(addr, "192.168.252.212:8888", "RPC server address");
+DEFINE_int64(use_nic_idx, 0, "Which NIC to create QP");
+DEFINE_int32(gid_idx, 0, "GID index of the NIC (RoCE v2 GIDs are often 1 or 3)");
+DEFINE_int64(reg_mem_name, 73, "The name of the NIC registered at the server");
+DEFINE_string(channel, "rpc_channel", "The recv channel the server registered");
+DEFINE_string(rpc, "echo", "Handler to call: echo or null");
+DEFINE_int32(threads, 1, "Number of client threads in this process, each owning one QP");
+DEFINE_int32(client_offset, 0, "Index of the first QP name, for running several client processes against one server");
+DEFINE_int32(depth, 16, "Calls each thread keeps in flight (at most 128)");
+DEFINE_int32(req_size, 64, "Payload size of each request");
+DEFINE_int32(resp_size, 64, "Payload size of each reply (echo only)");
+DEFINE_int64(max_msg_size, 4096, "Largest batch of frames in either direction (must match the server)");
+DEFINE_int32(calls_per_thread, 1000000, "Number of calls each thread issues");
+
+using namespace rdmaio;
+using namespace rdmaio::qp;
+using namespace rdmaio::rpc;
+using namespace std;
+
+/**
+ * Keeps --depth calls in flight until --calls_per_thread are done, new calls issued
+ * in one round are sent in one batch
+ */
+void run_thread(Arc<RNic> nic, int idx, vector<long> &latencies, std::atomic<int> &ready,
+	std::atomic<bool> &start) {
+	RpcConfig config;
+	config.max_msg_sz = FLAGS_max_msg_size;
+	config.max_outstanding = FLAGS_depth;
+	auto client = RpcClient<rpc_entry_num>::create(nic, config).value();
+
+	ConnectManager cm(FLAGS_addr);
+	if (cm.wait_ready(1000000, 4) == IOCode::Timeout) {
+		RDMA_LOG(WARNING) << "connect to the " << FLAGS_addr << " timeout!";
+	}
+	auto res = client->connect(cm, rpc_qp_name(idx), FLAGS_channel, FLAGS_reg_mem_name);
+	RDMA_ASSERT(res == IOCode::Ok) << res.desc;
+
+	vector<char> req(std::max<usize>(FLAGS_req_size, sizeof(u32)), 'x');
+	*reinterpret_cast<u32 *>(req.data()) = FLAGS_resp_size;
+	u16 rpc_id = FLAGS_rpc == "null" ? kRpcNull : kRpcEcho;
+	latencies.reserve(FLAGS_calls_per_thread);
+
+	ready.fetch_add(1);
+	while (!start.load()) {
+	}
+
+	int issued = 0;
+	while (static_cast<int>(latencies.size()) < FLAGS_calls_per_thread) {
+		while (issued < FLAGS_calls_per_thread && client->outstanding() < static_cast<usize>(FLAGS_depth)) {
+			long begin = now_nsec();
+			auto res_c = client->call(rpc_id, req.data(), FLAGS_req_size,
+				[&latencies, begin](RpcStatus status, const char *, u32) {
+					RDMA_ASSERT(status == RpcStatus::Ok) << "rpc error " << static_cast<int>(status);
+					latencies.push_back(now_nsec() - begin);
+				});
+			RDMA_ASSERT(res_c == IOCode::Ok) << "call error " << res_c.code.name();
+			issued += 1;
+		}
+		client->poll();
+	}
+
+	client->disconnect(cm);
+}
+
+int main(int argc, char **argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+	RDMA_ASSERT(FLAGS_depth > 0 && FLAGS_depth <= static_cast<int>(rpc_entry_num))
+		<< "depth should be in [1, " << rpc_entry_num << "]";
+	RDMA_ASSERT(FLAGS_rpc == "echo" || FLAGS_rpc == "null") << "unknown rpc: " << FLAGS_rpc;
+
+	auto nic =
+	  RNic::create(RNicInfo::query_dev_names().at(FLAGS_use_nic_idx), FLAGS_gid_idx).value();
+
+	vector<vector<long>> latencies(FLAGS_threads);
+	std::atomic<int> ready(0);
+	std::atomic<bool> start(false);
+	vector<std::thread> workers;
+	for (int t = 0; t < FLAGS_threads; ++t) {
+		workers.emplace_back(run_thread, nic, FLAGS_client_offset + t, std::ref(latencies[t]), std::ref(ready),
+			std::ref(start));
+	}
+
+	while (ready.load() != FLAGS_threads) {
+	}
+	long begin = now_nsec();
+	start.store(true);
+	for (auto &w : workers) {
+		w.join();
+	}
+	long elapsed = now_nsec() - begin;
+
+	vector<long> all;
+	for (auto &l : latencies) {
+		all.insert(all.end(), l.begin(), l.end());
+	}
+	double rpcs_per_sec = static_cast<double>(all.size()) / elapsed * 1e9;
+	auto summary = LatencySummary::from(all);
+	RDMA_LOG(INFO) << FLAGS_rpc << ", " << FLAGS_threads << " threads x depth " << FLAGS_depth << ": "
+		<< rpcs_per_sec << " rpcs/s, p50 " << summary.p50 << " ns, p99 " << summary.p99 << " ns, p999 "
+		<< summary.p999 << " ns";
+
+	appendResultRow(std::string(kResultsDir) + "rpc.txt",
+		"rpc\tthreads\tdepth\treq_size\tresp_size\trpcs_per_sec\t" + LatencySummary::header(),
+		FLAGS_rpc + "\t" + std::to_string(FLAGS_threads) + "\t" + std::to_string(FLAGS_depth) + "\t" +
+		std::to_string(FLAGS_req_size) + "\t" + std::to_string(FLAGS_resp_size) + "\t" +
+		std::to_string(rpcs_per_sec) + "\t" + summary.row());
+	return 0;
+}
@@ -0,0 +1,61 @@
+#include <gflags/gflags.h>
+
+#include "rlibv2/core/lib.hh"
+#include "rlibv2/core/rpc/server.hh"
+
+#include "bench_utils.hh"
+#include "rpc_bench.hh"
+
+DEFINE_int64(port, 8888, "Server listener (UDP) port.");
+DEFINE_int64(use_nic_idx, 0, "Which NIC to create QP");
+DEFINE_int32(gid_idx, 0, "GID index of the NIC (RoCE v2 GIDs are often 1 or 3)");
+DEFINE_int64(reg_mem_name, 73, "The name to register the NIC at rctrl");
+DEFINE_string(channel, "rpc_channel", "The recv channel the clients connect to");
+DEFINE_int64(max_msg_size, 4096, "Largest batch of frames in either direction (must match the clients)");
+DEFINE_int64(max_reply_size, 1024, "Reply space of one call");
+
+using namespace rdmaio;
+using namespace rdmaio::qp;
+using namespace rdmaio::rpc;
+using namespace std;
+
+int main(int argc, char **argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+	RCtrl ctrl(FLAGS_port);
+	RecvManager<rpc_entry_num> manager(ctrl);
+	auto nic =
+	  RNic::create(RNicInfo::query_dev_names().at(FLAGS_use_nic_idx), FLAGS_gid_idx).value();
+	RDMA_ASSERT(ctrl.opened_nics.reg(FLAGS_reg_mem_name, nic));
+
+	RpcConfig config;
+	config.max_msg_sz = FLAGS_max_msg_size;
+	config.max_reply_sz = FLAGS_max_reply_size;
+	auto server = RpcServer<rpc_entry_num>::create(ctrl, manager, nic, FLAGS_channel, config).value();
+
+	RDMA_ASSERT(server->register_handler(kRpcEcho, [](const char *req, u32 len, char *reply, u32 max_reply) -> u32 {
+		if (len < sizeof(u32)) {
+			return 0;
+		}
+		u32 want = *reinterpret_cast<const u32 *>(req);
+		u32 n = std::min(want, max_reply);
+		memcpy(reply, req, std::min(n, len));
+		return n;
+	}));
+	RDMA_ASSERT(server->register_handler(kRpcNull, [](const char *, u32, char *, u32) -> u32 { return 0; }));
+
+	ctrl.start_daemon();
+	RDMA_LOG(INFO) << "rpc server ready on channel " << FLAGS_channel;
+
+	Timer report_timer;
+	u64 last = 0;
+	while (true) {
+		server->poll();
+		if (report_timer.passed_sec() >= 1) {
+			RDMA_LOG(INFO) << server->served - last << " rpcs/s from " << server->num_conns() << " QPs";
+			last = server->served;
+			report_timer.reset();
+		}
+	}
+	return 0;
+}
@@ -13,40 +13,157 @@ server_pid_file="$remote_log_path/rdma_server_$msg_size.pid" # For more robust k
 # Ensure the results directory exists
 mkdir -p results logs files
 msg_count=1000
+verbs=(send write)
+
+# Blocks until the remote server (from its PID file) exits, for at most 5 seconds, instead of a fixed sleep
+wait_server_exit() {
+    ssh -n $remote_user@$remote_host "pid=\$(cat $server_pid_file 2>/dev/null); for i in \$(seq 50); do kill -0 \$pid 2>/dev/null || exit 0; sleep 0.1; done"
+}
 
 echo "Starting RDMA tests..."
-# Loop through each message size for RDMA tests
+# Loop through each data path verb (SEND_WITH_IMM / WRITE_WITH_IMM) and message size for RDMA tests
+for verb in "${verbs[@]}"; do
 for msg_size in "${msg_sizes[@]}"; do
-    echo "Running RDMA experiment with message size: $msg_size bytes"
+    echo "Running RDMA experiment ($verb) with message size: $msg_size bytes"
 
     # Start the server on the remote machine
     echo "Starting server on $remote_host..."
-    ssh -n $remote_user@$remote_host "nohup $remote_server_path --msg_size=$msg_size > $remote_log_path/rdma_send_recv_server_$msg_size.txt 2>&1 & echo \$! > $server_pid_file" &
+    ssh -n $remote_user@$remote_host "nohup $remote_server_path --verb=$verb --msg_size=$msg_size > $remote_log_path/rdma_send_recv_server_${verb}_$msg_size.txt 2>&1 & echo \$! > $server_pid_file" &
     echo "Server started on $remote_host"
-    sleep 2 # Give the server a moment to start
+    # no need to wait here, the client retries until the server's RCtrl answers
 
     # Run the client locally and redirect output to /dev/null
-    echo "Running RDMA test for $msg_size"
-    ./client --msg_size=$msg_size --msg_count=$msg_count > /dev/null 2>&1
-    echo "Client finished for message size: $msg_size bytes. Results saved to logs/rdma_send_recv_client_$msg_size.txt"
+    echo "Running RDMA test ($verb) for $msg_size"
+    ./client --verb=$verb --msg_size=$msg_size --msg_count=$msg_count > /dev/null 2>&1
+    echo "Client finished for message size: $msg_size bytes."
 
     # Wait for a bit to allow the server to receive the termination message and shut down
-    echo "Sleeping for a bit to allow server shutdown..."
-    sleep 5 # You might need to adjust this value
+    echo "Waiting for the server to shut down..."
+    wait_server_exit
 
     # Kill the remote server (using PID file if implemented in server)
     if [ -f "$server_pid_file" ]; then
         ssh -n $remote_user@$remote_host "kill $(cat "$server_pid_file")" &
         echo "Sent kill signal to server (PID from $server_pid_file) after message size: $msg_size bytes."
     else
-        ssh -n $remote_user@$remote_host "pkill -f '$remote_server_path --msg_size=$msg_size'" &
+        ssh -n $remote_user@$remote_host "pkill -f '$remote_server_path --verb=$verb --msg_size=$msg_size'" &
         echo "Ensured server is stopped (using pkill) after message size: $msg_size bytes."
     fi
     sleep 1
 
+done
 done
 echo "All RDMA experiments completed."
 
+echo ""
+echo "Starting path MTU tests..."
+# Large messages with the path MTU capped at 1 KiB (the former hard-coded value) vs the negotiated
+# one (the verb loops above): on a 4 KiB-MTU fabric the cap quadruples the packets per message
+mtu_msg_sizes=(4096 8192 16384 32768 65536 131072 262144 524288 1048576)
+for msg_size in "${mtu_msg_sizes[@]}"; do
+    echo "Running RDMA experiment (path mtu 1024) with message size: $msg_size bytes"
+
+    ssh -n $remote_user@$remote_host "nohup $remote_server_path --msg_size=$msg_size > $remote_log_path/rdma_send_recv_server_mtu1024_$msg_size.txt 2>&1 & echo \$! > $server_pid_file" &
+
+    ./client --path_mtu=1024 --msg_size=$msg_size --msg_count=$msg_count > /dev/null 2>&1
+    echo "Client finished for message size: $msg_size bytes."
+
+    wait_server_exit
+    ssh -n $remote_user@$remote_host "pkill -f '$remote_server_path --msg_size=$msg_size'" &
+    sleep 1
+done
+echo "All path MTU experiments completed."
+
+echo ""
+echo "Starting framed record send path tests..."
+# Framed records sent with a staging copy vs scatter-gather (header pool sge + in-place payload sge)
+send_paths=(copy sge)
+for send_path in "${send_paths[@]}"; do
+for msg_size in "${msg_sizes[@]}"; do
+    echo "Running RDMA experiment (send path $send_path) with message size: $msg_size bytes"
+
+    ssh -n $remote_user@$remote_host "nohup $remote_server_path --framed --msg_size=$msg_size > $remote_log_path/rdma_send_recv_server_${send_path}_$msg_size.txt 2>&1 & echo \$! > $server_pid_file" &
+
+    ./client --send_path=$send_path --msg_size=$msg_size --msg_count=$msg_count > /dev/null 2>&1
+    echo "Client finished for message size: $msg_size bytes."
+
+    wait_server_exit
+    ssh -n $remote_user@$remote_host "pkill -f '$remote_server_path --framed --msg_size=$msg_size'" &
+    sleep 1
+done
+done
+echo "All framed record send path experiments completed."
+
+echo ""
+echo "Starting UD vs RC small-message RPC tests..."
+# Request/response over the server's one UD QP vs one RC QP per client, for messages that fit in a UD packet
+remote_ud_rpc_server_path="$(dirname $remote_server_path)/ud_rpc_server"
+rpc_msg_sizes=(8 16 32 64 128 256 512 1024 2048 4000)
+rpc_clients=(1 4 16)
+ssh -n $remote_user@$remote_host "nohup $remote_ud_rpc_server_path > $remote_log_path/ud_rpc_server.txt 2>&1 &" &
+for transport in ud rc; do
+for clients in "${rpc_clients[@]}"; do
+for msg_size in "${rpc_msg_sizes[@]}"; do
+    echo "Running RPC experiment ($transport, $clients clients) with message size: $msg_size bytes"
+    ./ud_rpc_client --transport=$transport --clients=$clients --msg_size=$msg_size > /dev/null 2>&1
+done
+done
+done
+ssh -n $remote_user@$remote_host "pkill -f '$remote_ud_rpc_server_path'" &
+sleep 1
+echo "All UD vs RC RPC experiments completed."
+
+echo ""
+echo "Starting RPC framework tests..."
+# Throughput and tail latency of the RC RPC layer against the calls in flight per QP
+remote_rpc_server_path="$(dirname $remote_server_path)/rpc_server"
+rpc_depths=(1 4 16 64)
+ssh -n $remote_user@$remote_host "nohup $remote_rpc_server_path > $remote_log_path/rpc_server.txt 2>&1 &" &
+for threads in "${rpc_clients[@]}"; do
+for depth in "${rpc_depths[@]}"; do
+    echo "Running RPC framework experiment ($threads threads, depth $depth)"
+    ./rpc_client --threads=$threads --depth=$depth > /dev/null 2>&1
+done
+done
+ssh -n $remote_user@$remote_host "pkill -f '$remote_rpc_server_path'" &
+sleep 1
+echo "All RPC framework experiments completed."
+
+# Coroutine ping-pong vs the hand-written loop (only if built with -DRLIB_ENABLE_CORO=ON)
+if [ -x ./coro_client ]; then
+    echo ""
+    echo "Starting coroutine ping-pong tests..."
+    remote_coro_server_path="$(dirname $remote_server_path)/coro_server"
+    coro_streams=(1 4 16 64)
+    for mode in coro loop; do
+        ssh -n $remote_user@$remote_host "nohup $remote_coro_server_path --mode=$mode > $remote_log_path/coro_server_$mode.txt 2>&1 &" &
+        for streams in "${coro_streams[@]}"; do
+        for msg_size in 64 1024 16384; do
+            echo "Running coroutine ping-pong experiment ($mode, $streams streams) with message size: $msg_size bytes"
+            ./coro_client --mode=$mode --streams=$streams --msg_size=$msg_size > /dev/null 2>&1
+        done
+        done
+        ssh -n $remote_user@$remote_host "pkill -f '$remote_coro_server_path'" &
+        sleep 1
+    done
+    echo "All coroutine ping-pong experiments completed."
+fi
+
+echo ""
+echo "Starting chunked transfer tests..."
+# A 256 MiB snapshot written over loopback as one WR vs pipelined chunks, by chunk size and chunks in flight
+snapshot_size=268435456
+./chunk_bench --msg_size=$snapshot_size --chunk_size=$snapshot_size --depth=1 > /dev/null 2>&1
+chunk_sizes=(65536 262144 1048576 4194304 16777216)
+chunk_depths=(1 2 4 8 16)
+for chunk_size in "${chunk_sizes[@]}"; do
+for depth in "${chunk_depths[@]}"; do
+    echo "Running chunked transfer with $chunk_size byte chunks, $depth in flight"
+    ./chunk_bench --msg_size=$snapshot_size --chunk_size=$chunk_size --depth=$depth > /dev/null 2>&1
+done
+done
+echo "All chunked transfer experiments completed."
+
 echo ""
 echo "Starting Disk I/O tests..."
 # Loop through each message size for Disk I/O tests
@@ -0,0 +1,204 @@
+#include <gflags/gflags.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "rlibv2/core/lib.hh"
+#include "rlibv2/core/qps/op.hh"
+#include "rlibv2/core/qps/recv_iter.hh"
+
+#include "bench_utils.hh"
+
+DEFINE_string(addr, "192.168.252.212:8888", "Sequencer server address");
+DEFINE_int64(use_nic_idx, 0, "Which NIC to create QP");
+DEFINE_int64(reg_mem_name, 73, "The name of the counter MR (and the NIC) registered at the server");
+DEFINE_string(cq_name, "seq_channel", "The receive cq the server registered for sequence number RPCs");
+DEFINE_string(mode, "faa", "How to obtain a sequence number: faa (one-sided FETCH_AND_ADD) or rpc (two-sided request)");
+DEFINE_int32(threads, 1, "Number of client threads, each owning one QP");
+DEFINE_int32(thread_offset, 0, "Index of the first QP name, for running several client processes against one server");
+DEFINE_int32(ops_per_thread, 100000, "Number of sequence numbers each thread obtains");
+DEFINE_int32(warmup_ops, 1000, "Number of sequence numbers each thread obtains before measuring");
+DEFINE_bool(verify_unique, true, "Check that no sequence number was handed out twice");
+
+using namespace rdmaio;
+using namespace rdmaio::rmem;
+using namespace rdmaio::qp;
+using namespace std;
+
+constexpr usize entry_num = 16;
+constexpr usize seq_msg_sz = 64;
+
+struct ThreadResult {
+	vector<long> latencies;
+	vector<u64> seqs;
+};
+
+class SeqClient {
+	Arc<RC> qp;
+	Arc<RegHandler> local_mr;
+	Arc<RegHandler> recv_mr;
+	Arc<RecvEntries<entry_num>> entries;
+	RegAttr counter_attr;
+	u64 *faa_buf = nullptr;
+	u32 req_id = 0;
+
+	public:
+	SeqClient(Arc<RNic> &nic, int idx) {
+		// 1. a dedicated recv cq so that rpc replies do not mix with send completions
+		auto recv_cq_res = ::rdmaio::qp::Impl::create_cq(nic, entry_num);
+		RDMA_ASSERT(recv_cq_res == IOCode::Ok);
+		qp = RC::create(nic, QPConfig(), std::get<0>(recv_cq_res.desc)).value();
+
+		ConnectManager cm(FLAGS_addr);
+		if (cm.wait_ready(1000000, 4) == IOCode::Timeout) {
+			RDMA_LOG(WARNING) << "connect to the " << FLAGS_addr << " timeout!";
+		}
+
+		// 2. create the remote QP and connect
+		auto qp_res = cm.cc_rc_msg("seq_qp_" + std::to_string(idx), FLAGS_cq_name,
+			seq_msg_sz, qp, FLAGS_reg_mem_name, QPConfig());
+		RDMA_ASSERT(qp_res == IOCode::Ok) << std::get<0>(qp_res.desc);
+
+		// 3. fetch the counter MR
+		auto fetch_res = cm.fetch_remote_mr(FLAGS_reg_mem_name);
+		RDMA_ASSERT(fetch_res == IOCode::Ok) << std::get<0>(fetch_res.desc);
+		counter_attr = std::get<1>(fetch_res.desc);
+
+		// 4. local memory for the FAA result and the recv buffers of rpc replies
+		auto mem = Arc<RMem>(new RMem(seq_msg_sz));
+		local_mr = RegHandler::create(mem, nic).value();
+		auto local_attr = local_mr->get_reg_attr().value();
+		faa_buf = reinterpret_cast<u64 *>(local_attr.buf);
+		qp->bind_remote_mr(counter_attr);
+		qp->bind_local_mr(local_attr);
+
+		auto recv_mem = Arc<RMem>(new RMem(seq_msg_sz * entry_num));
+		recv_mr = RegHandler::create(recv_mem, nic).value();
+		Arc<AbsRecvAllocator> alloc =
+			std::make_shared<SimpleAllocator>(recv_mem, recv_mr->get_reg_attr().value().key);
+		entries = RecvEntriesFactoryv2<entry_num>::create(alloc, seq_msg_sz).value();
+		auto res = qp->post_recvs(*entries, entry_num);
+		RDMA_ASSERT(res == IOCode::Ok);
+	}
+
+	/**
+	 * One-sided: FETCH_AND_ADD on the server counter, no server CPU involved
+	 */
+	u64 next_faa() {
+		Op<> op;
+		op.set_atomic_rbuf(reinterpret_cast<u64 *>(counter_attr.buf), counter_attr.key).set_fetch_add(1);
+		op.set_payload(faa_buf, sizeof(u64), local_mr->get_reg_attr().value().lkey);
+		auto res_s = op.execute(qp, IBV_SEND_SIGNALED);
+		RDMA_ASSERT(res_s == IOCode::Ok) << res_s.desc;
+		auto res_p = qp->wait_rc_comp();
+		RDMA_ASSERT(res_p == IOCode::Ok);
+		return *faa_buf;
+	}
+
+	/**
+	 * Two-sided: ask the server thread for the next sequence number
+	 */
+	u64 next_rpc() {
+		// 0 is never used as request id
+		req_id = req_id + 1 == 0 ? 1 : req_id + 1;
+		auto res_s = qp->send_normal(
+			{.op = IBV_WR_SEND_WITH_IMM,
+			 .flags = IBV_SEND_SIGNALED,
+			 .len = 0,
+			 .wr_id = 0},
+			{.local_addr = reinterpret_cast<RMem::raw_ptr_t>(faa_buf),
+			 .remote_addr = 0,
+			 .imm_data = req_id});
+		RDMA_ASSERT(res_s == IOCode::Ok) << res_s.desc;
+
+		Option<u64> seq;
+		while (!seq) {
+			for (RecvIter<RC, entry_num> iter(qp, entries); iter.has_msgs(); iter.next()) {
+				auto imm_msg = iter.cur_msg().value();
+				RDMA_ASSERT(std::get<0>(imm_msg) == req_id) << "unexpected reply " << std::get<0>(imm_msg);
+				seq = *static_cast<u64 *>(std::get<1>(imm_msg));
+			}
+		}
+		auto res_p = qp->wait_rc_comp();
+		RDMA_ASSERT(res_p == IOCode::Ok);
+		return seq.value();
+	}
+
+	u64 next() {
+		return FLAGS_mode == "faa" ? next_faa() : next_rpc();
+	}
+};
+
+int main(int argc, char **argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+	RDMA_ASSERT(FLAGS_mode == "faa" || FLAGS_mode == "rpc") << "unknown mode: " << FLAGS_mode;
+
+	auto nic =
+	  RNic::create(RNicInfo::query_dev_names().at(FLAGS_use_nic_idx)).value();
+
+	vector<ThreadResult> results(FLAGS_threads);
+	std::atomic<int> ready(0);
+	std::atomic<bool> start(false);
+	vector<std::thread> workers;
+
+	for (int t = 0; t < FLAGS_threads; ++t) {
+		workers.emplace_back([&, t]() {
+			SeqClient client(nic, FLAGS_thread_offset + t);
+			for (int i = 0; i < FLAGS_warmup_ops; ++i) {
+				client.next();
+			}
+
+			auto &res = results[t];
+			res.latencies.reserve(FLAGS_ops_per_thread);
+			if (FLAGS_verify_unique) {
+				res.seqs.reserve(FLAGS_ops_per_thread);
+			}
+
+			ready.fetch_add(1);
+			while (!start.load()) {
+			}
+
+			for (int i = 0; i < FLAGS_ops_per_thread; ++i) {
+				long before = now_nsec();
+				u64 seq = client.next();
+				res.latencies.push_back(now_nsec() - before);
+				if (FLAGS_verify_unique) {
+					res.seqs.push_back(seq);
+				}
+			}
+		});
+	}
+
+	while (ready.load() != FLAGS_threads) {
+	}
+	long begin = now_nsec();
+	start.store(true);
+	for (auto &w : workers) {
+		w.join();
+	}
+	long elapsed = now_nsec() - begin;
+
+	vector<long> latencies;
+	vector<u64> seqs;
+	for (auto &r : results) {
+		latencies.insert(latencies.end(), r.latencies.begin(), r.latencies.end());
+		seqs.insert(seqs.end(), r.seqs.begin(), r.seqs.end());
+	}
+
+	if (FLAGS_verify_unique) {
+		std::sort(seqs.begin(), seqs.end());
+		RDMA_ASSERT(std::adjacent_find(seqs.begin(), seqs.end()) == seqs.end())
+			<< "a sequence number was handed out twice";
+	}
+
+	double ops_per_sec = static_cast<double>(latencies.size()) / elapsed * 1e9;
+	auto summary = LatencySummary::from(latencies);
+	RDMA_LOG(INFO) << FLAGS_mode << " sequencer, " << FLAGS_threads << " threads: "
+		<< ops_per_sec << " ops/s, p50 " << summary.p50 << " ns, p99 " << summary.p99 << " ns";
+
+	appendResultRow(std::string(kResultsDir) + "sequencer_" + FLAGS_mode + ".txt",
+		"threads\tops_per_sec\t" + LatencySummary::header(),
+		std::to_string(FLAGS_threads) + "\t" + std::to_string(ops_per_sec) + "\t" + summary.row());
+
+	return 0;
+}
@@ -0,0 +1,112 @@
+#include <gflags/gflags.h>
+
+#include "rlibv2/core/lib.hh"
+#include "rlibv2/core/qps/rc_recv_manager.hh"
+
+#include "bench_utils.hh"
+
+DEFINE_int64(port, 8888, "Server listener (UDP) port.");
+DEFINE_int64(use_nic_idx, 0, "Which NIC to create QP");
+DEFINE_int64(reg_mem_name, 73, "The name to register the counter MR (and the NIC) at rctrl.");
+DEFINE_string(cq_name, "seq_channel", "The name to register the receive cq for sequence number RPCs");
+DEFINE_int32(max_clients, 256, "Maximum number of client QPs (seq_qp_0 .. seq_qp_{max_clients-1})");
+
+using namespace rdmaio;
+using namespace rdmaio::rmem;
+using namespace rdmaio::qp;
+using namespace std;
+
+constexpr usize entry_num = 64;
+// requests only carry an immediate, replies carry the u64 sequence number
+constexpr usize seq_msg_sz = 64;
+constexpr usize recv_cq_depth = 4096;
+
+struct ClientQP {
+	Arc<RC> qp;
+	Arc<RecvEntries<entry_num>> entries;
+	u64 *reply_slot;
+	u64 replies = 0;
+};
+
+int main(int argc, char **argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+	RCtrl ctrl(FLAGS_port);
+	RecvManager<entry_num> manager(ctrl);
+	auto nic =
+	  RNic::create(RNicInfo::query_dev_names().at(FLAGS_use_nic_idx)).value();
+	RDMA_ASSERT(ctrl.opened_nics.reg(FLAGS_reg_mem_name, nic));
+
+	// 1. the counter used by the one-sided FETCH_AND_ADD path, on its own cache line
+	auto counter_mem = Arc<RMem>(new RMem(seq_msg_sz));
+	memset(counter_mem->raw_ptr, 0, seq_msg_sz);
+	auto counter_mr = RegHandler::create(counter_mem, nic).value();
+	ctrl.registered_mrs.reg(FLAGS_reg_mem_name, counter_mr);
+
+	// 2. the recv channel and reply buffers used by the two-sided RPC path
+	auto recv_cq_res = ::rdmaio::qp::Impl::create_cq(nic, recv_cq_depth);
+	RDMA_ASSERT(recv_cq_res == IOCode::Ok);
+	auto recv_cq = std::get<0>(recv_cq_res.desc);
+
+	auto recv_mem = Arc<RMem>(new RMem(FLAGS_max_clients * entry_num * seq_msg_sz));
+	auto recv_mr = RegHandler::create(recv_mem, nic).value();
+	auto alloc = std::make_shared<SimpleAllocator>(recv_mem, recv_mr->get_reg_attr().value().key);
+	manager.reg_recv_cqs.create_then_reg(FLAGS_cq_name, recv_cq, alloc);
+
+	auto reply_mem = Arc<RMem>(new RMem(FLAGS_max_clients * seq_msg_sz));
+	auto reply_mr = RegHandler::create(reply_mem, nic).value();
+	auto reply_attr = reply_mr->get_reg_attr().value();
+
+	auto reply_base = reinterpret_cast<u64 *>(reply_attr.buf);
+	ClientTable<ClientQP, entry_num> clients(ctrl, manager, "seq_qp_", FLAGS_cq_name,
+		[reply_base](int id, Arc<RC> qp, Arc<RecvEntries<entry_num>> entries) -> Option<ClientQP> {
+			if (id >= FLAGS_max_clients) {
+				return {};
+			}
+			RDMA_LOG(INFO) << "sequencer serves seq_qp_" << id << " (qpn " << qp->qp->qp_num << ")";
+			// every client owns one cache line of the reply buffer
+			return ClientQP{qp, entries, reply_base + id * (seq_msg_sz / sizeof(u64))};
+		});
+
+	ctrl.start_daemon();
+	RDMA_LOG(INFO) << "sequencer ready: counter MR " << FLAGS_reg_mem_name << ", rpc channel " << FLAGS_cq_name;
+
+	u64 next_seq = 0;
+	ibv_wc wcs[entry_num];
+
+	while (true) {
+		int n = ibv_poll_cq(recv_cq, entry_num, wcs);
+		RDMA_ASSERT(n >= 0) << "poll recv cq error";
+
+		for (int i = 0; i < n; ++i) {
+			RDMA_ASSERT(wcs[i].status == IBV_WC_SUCCESS) << Dummy::wc_status(wcs[i]);
+
+			auto client_p = clients.find(wcs[i].qp_num);
+			RDMA_ASSERT(client_p != nullptr) << "unknown qp: " << wcs[i].qp_num;
+			auto &client = *client_p;
+
+			// hand out the next sequence number, echoing the request id in the immediate
+			*client.reply_slot = next_seq++;
+			client.replies += 1;
+			bool signaled = client.replies % kReplySignalBatch == 0;
+			auto res_s = client.qp->send_normal(
+				{.op = IBV_WR_SEND_WITH_IMM,
+				 .flags = signaled ? IBV_SEND_SIGNALED : 0,
+				 .len = sizeof(u64),
+				 .wr_id = 0},
+				{.local_addr = reinterpret_cast<RMem::raw_ptr_t>(client.reply_slot),
+				 .remote_addr = 0,
+				 .imm_data = wcs[i].imm_data},
+				reply_attr, reply_attr);
+			RDMA_ASSERT(res_s == IOCode::Ok) << res_s.desc;
+			if (signaled) {
+				auto res_p = client.qp->wait_rc_comp();
+				RDMA_ASSERT(res_p == IOCode::Ok);
+			}
+
+			repost_consumed(*client.qp, *client.entries);
+		}
+	}
+
+	return 0;
+}
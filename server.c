@@ -10,7 +10,7 @@
 #include "rlibv2/c_wrappers/rdmaio_lib_c.h"
 #include "rlibv2/c_wrappers/rdmaio_rc_c.h"
 #include "rlibv2/c_wrappers/rdmaio_rctrl_c.h"
-#include "rlibv2/c_wrappers/rdmaio_recv_iter_c.h"
+#include "rlibv2/c_wrappers/rdmaio_recv_cursor_c.h"
 #include "rlibv2/c_wrappers/rdmaio_regattr_c.h"
 #include "rlibv2/c_wrappers/rdmaio_result_c.h"
 #include "rlibv2/c_wrappers/rdmaio_rc_recv_manager_c.h"
@@ -30,11 +30,53 @@ char* FLAGS_ack_cq_name = "ack_channel";
 int FLAGS_buffer_size = 1024 * 1024 * 1024;
 int FLAGS_ack_buffer_size = 1024;
 int FLAGS_msg_size = 1024;
+char* FLAGS_verb = "send";
+long FLAGS_reg_write_mem_name = 74;
 
 // Constant for entry_num
 const int entry_num = 256;
+// with WRITE_WITH_IMM the payload lands in the write region, the recv buffer only carries the immediate
+const int write_imm_recv_sz = 64;
 
-void init_recv_queue(rdmaio_rctrl_t* ctrl, rdmaio_nic_t* nic, rdmaio_recv_manager_t* manager, rdmaio_qp_t** recv_qp, recv_entries_handle_t** recv_rs) {
+bool use_write_verb() {
+	return strcmp(FLAGS_verb, "write") == 0;
+}
+
+// The memory and cq behind the recv channel (and the write region). The RCtrl and the RecvManager
+// only hold non-owning references to them, so they live until the server shuts down.
+typedef struct recv_queue_res_t {
+	struct ibv_cq* recv_cq;
+	rdmaio_rmem_t* mem;
+	rdmaio_reg_handler_t* handler;
+	simple_allocator_t* allocator;
+	rdmaio_rmem_t* write_mem;
+	rdmaio_reg_handler_t* write_handler;
+} recv_queue_res_t;
+
+void release_recv_queue(recv_queue_res_t* res) {
+	if (res->write_handler) {
+		rdmaio_reg_handler_destroy(res->write_handler);
+	}
+	if (res->write_mem) {
+		rmem_destroy(res->write_mem);
+	}
+	if (res->allocator) {
+		simple_allocator_destroy(res->allocator);
+	}
+	if (res->handler) {
+		rdmaio_reg_handler_destroy(res->handler);
+	}
+	if (res->mem) {
+		rmem_destroy(res->mem);
+	}
+	if (res->recv_cq) {
+		rdmaio_destroy_cq(res->recv_cq);
+	}
+	memset(res, 0, sizeof(*res));
+}
+
+void init_recv_queue(rdmaio_rctrl_t* ctrl, rdmaio_nic_t* nic, rdmaio_recv_manager_t* manager, recv_queue_res_t* res,
+	rdmaio_qp_t** recv_qp, recv_entries_handle_t** recv_rs) {
 	if (!ctrl || !nic || !manager) {
 		fprintf(stderr, "Null arguments passed to init_recv_queue.\n");
 		if (recv_qp) {
@@ -59,7 +101,8 @@ void init_recv_queue(rdmaio_rctrl_t* ctrl, rdmaio_nic_t* nic, rdmaio_recv_manage
 		return;
 	}
 
-	rdmaio_rmem_t* mem = rmem_create(FLAGS_buffer_size);
+	// with the write verb the recv buffers only hold immediates, payloads go to a separate write region
+	rdmaio_rmem_t* mem = rmem_create(use_write_verb() ? entry_num * write_imm_recv_sz : FLAGS_buffer_size);
 	rdmaio_reg_handler_t* handler = rdmaio_reg_handler_create(mem, nic);
 	rdmaio_regattr_t reg_attr = rdmaio_reg_handler_get_attr(handler);
 
@@ -108,6 +151,33 @@ void init_recv_queue(rdmaio_rctrl_t* ctrl, rdmaio_nic_t* nic, rdmaio_recv_manage
 		return;
 	}
 
+	rdmaio_rmem_t* write_mem = NULL;
+	rdmaio_reg_handler_t* write_handler = NULL;
+	if (use_write_verb()) {
+		write_mem = rmem_create(FLAGS_buffer_size);
+		write_handler = write_mem ? rdmaio_reg_handler_create(write_mem, nic) : NULL;
+		if (!write_handler || !rdmaio_rctrl_register_mr(ctrl, FLAGS_reg_write_mem_name, write_handler)) {
+			fprintf(stderr, "Failed to register the write region with RCtrl.\n");
+			if (write_handler) {
+				rdmaio_reg_handler_destroy(write_handler);
+			}
+			if (write_mem) {
+				rmem_destroy(write_mem);
+			}
+			simple_allocator_destroy(allocator);
+			rdmaio_reg_handler_destroy(handler);
+			rmem_destroy(mem);
+			rdmaio_destroy_cq(recv_cq);
+			if (recv_qp) {
+				*recv_qp = NULL;
+			}
+			if (recv_rs) {
+				*recv_rs = NULL;
+			}
+			return;
+		}
+	}
+
 	if (!rctrl_start_daemon(ctrl)) {
 		fprintf(stderr, "Failed to start RCtrl daemon.\n");
 		simple_allocator_destroy(allocator);
@@ -144,10 +214,13 @@ void init_recv_queue(rdmaio_rctrl_t* ctrl, rdmaio_nic_t* nic, rdmaio_recv_manage
 		*recv_rs = client_recv_rs;
 	}
 
-	simple_allocator_destroy(allocator);
-	rdmaio_reg_handler_destroy(handler);
-	rmem_destroy(mem);
-	rdmaio_destroy_cq(recv_cq);
+	// clients keep receiving into (and writing to) these, they are released at shutdown
+	res->recv_cq = recv_cq;
+	res->mem = mem;
+	res->handler = handler;
+	res->allocator = allocator;
+	res->write_mem = write_mem;
+	res->write_handler = write_handler;
 
 	fprintf(stderr, "Receive queue initialized (client QP and recv entries obtained).\n");
 }
@@ -218,6 +291,8 @@ void print_usage(const char *program_name) {
 	fprintf(stderr, "  --buffer_size <int>   Total buffer size (default: %d)\n", FLAGS_buffer_size);
 	fprintf(stderr, "  --ack_buffer_size <int> Buffer for ack messages (default: %d)\n", FLAGS_ack_buffer_size);
 	fprintf(stderr, "  --msg_size <int>      Size of each message to send (default: %d)\n", FLAGS_msg_size);
+	fprintf(stderr, "  --verb <send|write>   Data path verb: SEND_WITH_IMM or WRITE_WITH_IMM (default: %s)\n", FLAGS_verb);
+	fprintf(stderr, "  --reg_write_mem_name <int> The name to register the WRITE_WITH_IMM target MR at rctrl (default: %ld)\n", FLAGS_reg_write_mem_name);
 	fprintf(stderr, "  --help                Print this usage information\n");
 }
 
@@ -235,11 +310,13 @@ int main(int argc, char **argv) {
 		{"buffer_size", required_argument, 0, 'b'},
 		{"ack_buffer_size", required_argument, 0, 'e'},
 		{"msg_size", required_argument, 0, 's'},
+		{"verb", required_argument, 0, 'v'},
+		{"reg_write_mem_name", required_argument, 0, 'w'},
 		{"help", no_argument, 0, 'h'},
 		{NULL, 0, NULL, 0}
 	};
 
-	while ((option = getopt_long(argc, argv, "a:p:n:m:k:c:d:b:e:s:h", long_options, &long_index)) != -1) {
+	while ((option = getopt_long(argc, argv, "a:p:n:m:k:c:d:b:e:s:v:w:h", long_options, &long_index)) != -1) {
 		long temp_long; // Temporary variable to hold the long value from strtol
 		switch (option) {
 			case 'a':
@@ -287,6 +364,16 @@ int main(int argc, char **argv) {
 			   }
 			   FLAGS_msg_size = (int)temp_long;
 			   break;
+			case 'v':
+				if (strcmp(optarg, "send") != 0 && strcmp(optarg, "write") != 0) {
+					fprintf(stderr, "Error: --verb must be either send or write.\n");
+					return 1;
+				}
+				FLAGS_verb = optarg;
+				break;
+			case 'w':
+				FLAGS_reg_write_mem_name = strtol(optarg, NULL, 10);
+				break;
 			case 'h':
 				print_usage(argv[0]);
 				return 0;
@@ -361,7 +448,8 @@ int main(int argc, char **argv) {
 
 	rdmaio_qp_t* recv_qp = NULL;
 	recv_entries_handle_t* recv_rs = NULL;
-	init_recv_queue(ctrl, nic, manager, &recv_qp, &recv_rs);
+	recv_queue_res_t recv_res = {0};
+	init_recv_queue(ctrl, nic, manager, &recv_res, &recv_qp, &recv_rs);
 	fprintf(stderr, "Client Recv entries registered. Ready to receive messages!\n");
 
 	sleep(3); // Ensure client has setup ready
@@ -377,13 +465,15 @@ int main(int argc, char **argv) {
 	bool first_recv = true;
 	bool terminate = false;
 
+	// one cursor for the whole run: consumed recvs are re-posted in batches
+	rdmaio_recv_cursor_t* recv_cursor = rdmaio_recv_cursor_create(recv_qp, recv_rs, 0);
 	while (!terminate) {
-		rdmaio_recv_iter_t* iter = rdmaio_recv_iter_create(recv_qp, recv_rs);
-		if (iter) {
-			while (rdmaio_recv_iter_has_msgs(iter)) {
+		if (recv_cursor) {
+			rdmaio_recv_cursor_poll(recv_cursor);
+			while (rdmaio_recv_cursor_has_msgs(recv_cursor)) {
 				uint32_t imm_msg;
 				uintptr_t buf_addr;
-				if (rdmaio_recv_iter_cur_msg(iter, &imm_msg, &buf_addr)) {
+				if (rdmaio_recv_cursor_cur_msg(recv_cursor, &imm_msg, &buf_addr)) {
 					int received_cnt = (int) imm_msg;
 					if (received_cnt == 0) {
 						terminate = true;
@@ -394,7 +484,7 @@ int main(int argc, char **argv) {
 						send_cnt = 0;
 						last_recvd_cnt = 0;
 						first_recv = true;
-						rdmaio_recv_iter_next(iter);
+						rdmaio_recv_cursor_next(recv_cursor);
 						continue;
 					}
 					recv_cnt++;
@@ -445,11 +535,10 @@ int main(int argc, char **argv) {
 				} else {
 					fprintf(stderr, "Error getting current message.\n");
 				}
-				rdmaio_recv_iter_next(iter);
+				rdmaio_recv_cursor_next(recv_cursor);
 			}
-			rdmaio_recv_iter_destroy(iter);
 		} else {
-			fprintf(stderr, "Error creating recv iterator in main loop.\n");
+			fprintf(stderr, "Error creating recv cursor.\n");
 			break;
 		}
 		fprintf(stderr, "Received count: %lu, Sent count: %lu\n", recv_cnt, send_cnt);
@@ -459,6 +548,7 @@ int main(int argc, char **argv) {
 	}
 
 	fprintf(stderr, "Server shutting down\n");
+	rdmaio_recv_cursor_destroy(recv_cursor);
 
 	rnic_info_free_dev_names(dev_idx_array);
 	rnic_destroy(nic);
@@ -467,6 +557,7 @@ int main(int argc, char **argv) {
 	// rdmaio_destroy_qp(recv_qp); // Receive QP obtained from RCtrl, do not destroy
 	recv_manager_destroy(manager);
 	rctrl_destroy(ctrl);
+	release_recv_queue(&recv_res);
 
 	return 0;
 }
\ No newline at end of file
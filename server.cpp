@@ -1,10 +1,17 @@
 #include <gflags/gflags.h>
+#include <sys/resource.h>
 #include <cstddef>
 #include <thread>
+#include <vector>
 
 #include "rlibv2/core/lib.hh"
 #include "rlibv2/core/qps/rc_recv_manager.hh"
-#include "rlibv2/core/qps/recv_iter.hh"
+#include "rlibv2/core/qps/recv_cursor.hh"
+#include "rlibv2/core/qps/comp_channel.hh"
+#include "rlibv2/core/qps/size_class_allocator.hh"
+#include "rlibv2/core/rmem/mem_allocators.hh"
+
+#include "bench_utils.hh"
 
 DEFINE_string(addr, "192.168.252.212:8888", "Client IP address");
 DEFINE_int64(port, 8888, "Server listener (UDP) port.");
@@ -16,6 +23,15 @@ DEFINE_string(ack_cq_name, "ack_channel", "The name to register an acknowledgeme
 DEFINE_int32(buffer_size, 1024*1024*1024, "Total buffer size");
 DEFINE_int32(ack_buffer_size, 1024, "Buffer for ack messages");
 DEFINE_int32(msg_size, 1024, "Size of each message to send");
+DEFINE_string(verb, "send", "Data path verb: send (SEND_WITH_IMM into posted recv buffers) or write (WRITE_WITH_IMM into a remote-offset slot)");
+DEFINE_int64(reg_write_mem_name, 74, "The name to register the WRITE_WITH_IMM target MR at rctrl");
+DEFINE_string(wait_mode, "poll", "How to wait for completions: poll (busy polling), event (sleep on a completion channel) or adaptive (spin for spin_usec, then sleep)");
+DEFINE_double(spin_usec, 20, "Spin budget of the adaptive wait mode, in microseconds");
+DEFINE_int64(max_slot_size, 4*1024*1024, "Largest recv payload the allocator hands out, must cover the client's max_msg_size (framed records add their header)");
+DEFINE_bool(split_slots, false, "Also serve the client's large-message QP on channel <cq_name>_large (must match the client)");
+DEFINE_bool(framed, false, "Messages are framed records (the client's copy and sge send paths): a record header, then the payload");
+DEFINE_string(mem_type, "malloc", "Memory backing the recv slot chunks and the write buffer: malloc, thp (transparent huge pages), huge2m or huge1g (hugetlbfs)");
+DEFINE_int32(numa_node, -1, "NUMA node to bind the recv slots and the write buffer to, -1 for no binding");
 
 using namespace rdmaio;
 using namespace rdmaio::rmem;
@@ -23,47 +39,53 @@ using namespace rdmaio::qp;
 using namespace std;
 
 constexpr usize entry_num = 256;
+// with WRITE_WITH_IMM the payload lands in the write region, the recv buffer only carries the immediate
+constexpr usize write_imm_recv_sz = 64;
 
-class SimpleAllocator : public AbsRecvAllocator {
-	RMem::raw_ptr_t buf = nullptr;
-	usize total_mem = 0;
-	mr_key_t key;
+bool use_write_verb() {
+	return FLAGS_verb == "write";
+}
 
-	public:
-	virtual ~SimpleAllocator() = default;
-	SimpleAllocator(const Arc<RMem>& mem, mr_key_t key)
-	  : buf(mem->raw_ptr), total_mem(mem->sz), key(key) {
-		RDMA_LOG(4) << "simple allocator use key: " << key;
-	}
+/**
+ * Offset of the slot that message number `counter` was written to in the write region.
+ * Must match the client's layout.
+ */
+u64 write_slot_offset(u32 counter) {
+	const u64 slot_sz = FLAGS_msg_size + 1;
+	const u64 num_slots = FLAGS_buffer_size / slot_sz;
+	return ((counter - 1) % num_slots) * slot_sz;
+}
 
-	Option<std::pair<rmem::RMem::raw_ptr_t, rmem::mr_key_t>> alloc_one(
-	  const usize &sz) override {
-		if (total_mem < sz) {
-			return {};
-		}
-		auto ret = buf;
-		buf = static_cast<char *>(buf) + sz;
-		total_mem -= sz;
-		return std::make_pair(ret, key);
+/**
+ * How long an idle recv cq is polled before sleeping on the completion channel
+ */
+double spin_budget_usec() {
+	if (FLAGS_wait_mode == "poll") {
+		return Timer::no_timeout();
 	}
+	return FLAGS_wait_mode == "event" ? 0 : FLAGS_spin_usec;
+}
 
-	Option<std::pair<rmem::RMem::raw_ptr_t, rmem::RegAttr>> alloc_one_for_remote(
-		const usize &sz) override {
-		return {};
-	}
-};
+/**
+ * User plus system CPU time of this process, in seconds
+ */
+double cpu_seconds() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+		(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
 
 pair<Arc<RC>, Arc<RegHandler>> init_send_queue(Arc<RNic> &nic) {
 	// 1. create the local QP to send
 	auto qp = RC::create(nic, QPConfig()).value();
 
 	ConnectManager cm(FLAGS_addr);
-	if (cm.wait_ready(100000, 4) ==
-		IOCode::Timeout) {  // wait 1 second for server to ready, retry 2 times
+	// the client starts its RCtrl before creating its QP, so it normally answers at once
+	if (cm.wait_ready(100000, 50) == IOCode::Timeout) {
 		RDMA_LOG(WARNING) << "connect to the " << FLAGS_addr << " timeout!";
-		}
+	}
 
-	sleep(1);
 	// 2. create the remote QP and connect (max msg size is 1 byte as we only care about imm_data)
 	auto qp_res = cm.cc_rc_msg("server_qp", FLAGS_ack_cq_name,
 		1, qp, FLAGS_reg_ack_mem_name, QPConfig());
@@ -83,54 +105,68 @@ pair<Arc<RC>, Arc<RegHandler>> init_send_queue(Arc<RNic> &nic) {
 	return make_pair(qp, local_mr);
 }
 
-pair<shared_ptr<Dummy>, shared_ptr<RecvEntries<entry_num>>> init_recv_queue(RCtrl &ctrl, Arc<RNic> &nic, RecvManager<entry_num> &manager) {
-	// 1. create receive cq
-	auto recv_cq_res = ::rdmaio::qp::Impl::create_cq(nic, entry_num);
+/**
+ * Creates a recv cq (reporting to the completion channel, if any) and registers it as a channel
+ */
+void reg_recv_channel(RecvManager<entry_num> &manager, Arc<RNic> &nic, const Arc<CompChannel> &channel,
+	const Arc<AbsRecvAllocator> &alloc, const std::string &name) {
+	auto recv_cq_res = channel ? channel->create_cq(nic, entry_num) : ::rdmaio::qp::Impl::create_cq(nic, entry_num);
 	RDMA_ASSERT(recv_cq_res == IOCode::Ok);
-	auto recv_cq = std::get<0>(recv_cq_res.desc);
-
-	// 2. prepare the message buffer with allocator
-	auto mem =
-	  Arc<RMem>(new RMem(static_cast<const rdmaio::u64>(FLAGS_buffer_size)));
-	auto handler = RegHandler::create(mem, nic).value();
-	auto alloc = std::make_shared<SimpleAllocator>(
-	  mem, handler->get_reg_attr().value().key);
-
-	// 3. register receive cq
-	manager.reg_recv_cqs.create_then_reg(FLAGS_cq_name, recv_cq, alloc);
-	RDMA_LOG(EMPH) << "Register test_channel";
+	manager.reg_recv_cqs.create_then_reg(name, std::get<0>(recv_cq_res.desc), alloc);
+	RDMA_LOG(EMPH) << "Register " << name;
+}
+
+void init_recv_queue(RCtrl &ctrl, Arc<RNic> &nic, RecvManager<entry_num> &manager,
+	const Arc<CompChannel> &channel, const Arc<AbsRecvAllocator> &alloc) {
+	// 1. register the receive channels, the recv slots are carved from the size-classed allocator
+	// on demand, sized by what the client asks for
+	reg_recv_channel(manager, nic, channel, alloc, FLAGS_cq_name);
+	if (FLAGS_split_slots) {
+		reg_recv_channel(manager, nic, channel, alloc, FLAGS_cq_name + "_large");
+	}
+
+	// 2. the recv slots are not remotely accessible, but the client still fetches an MR under this name
+	auto handler = RegHandler::create(Arc<RMem>(new RMem(4096)), nic).value();
 	ctrl.registered_mrs.reg(FLAGS_reg_mem_name, handler);
 
+	if (use_write_verb()) {
+		auto write_handler = timed_reg(alloc_rmem(FLAGS_buffer_size, mem_options(FLAGS_mem_type, FLAGS_numa_node)), nic,
+			FLAGS_mem_type);
+		ctrl.registered_mrs.reg(FLAGS_reg_write_mem_name, write_handler);
+		RDMA_LOG(EMPH) << "Register write region " << FLAGS_reg_write_mem_name;
+	}
+
 	ctrl.start_daemon();
-	Option<Arc<Dummy>> recv_qp_opt;
-	Option<Arc<RecvEntries<entry_num>>> recv_rs_opt;
-	int ctx = 0;
+}
 
-	do {
-		recv_qp_opt = ctrl.registered_qps.query("client_qp");
-		if (!recv_qp_opt.has_value()) {
-			RDMA_LOG(INFO) << "Client QP not yet registered. Retrying count " << ++ctx;
-			sleep(1);
-		}
-	} while (!recv_qp_opt.has_value());
-
-	ctx = 0;
-	do {
-		recv_rs_opt = manager.reg_recv_entries.query("client_qp");
-		if (!recv_rs_opt.has_value()) {
-			RDMA_LOG(INFO) << "Client Recv entries not yet registered. Retrying count " << ++ctx;
-			sleep(1);
-		}
-	} while (!recv_rs_opt.has_value());
+/**
+ * Waits until the client has created the QP `qp_name` and its recv entries are posted.
+ * It wakes up as soon as the RCtrl registers them, instead of re-checking every second.
+ */
+pair<Arc<Dummy>, Arc<RecvEntries<entry_num>>> wait_recv_qp(RCtrl &ctrl, RecvManager<entry_num> &manager,
+	const std::string &qp_name) {
+	Option<Arc<Dummy>> recv_qp_opt;
+	for (int ctx = 1; !(recv_qp_opt = ctrl.registered_qps.wait_for(qp_name, 1000000)); ++ctx) {
+		RDMA_LOG(INFO) << "Client QP " << qp_name << " not yet registered. Waiting count " << ctx;
+	}
 
-	auto recv_qp = ctrl.registered_qps.query("client_qp").value();
-	auto recv_rs = manager.reg_recv_entries.query("client_qp").value();
+	// the entries are registered once the QP is connected
+	Option<Arc<RecvEntries<entry_num>>> recv_rs_opt;
+	for (int ctx = 1; !(recv_rs_opt = manager.reg_recv_entries.wait_for(qp_name, 1000000)); ++ctx) {
+		RDMA_LOG(INFO) << "Client Recv entries not yet registered. Waiting count " << ctx;
+	}
 
-	return make_pair(recv_qp, recv_rs);
+	return make_pair(recv_qp_opt.value(), recv_rs_opt.value());
 }
 
 int main(int argc, char **argv) {
 	gflags::ParseCommandLineFlags(&argc, &argv, true);
+	RDMA_ASSERT(FLAGS_verb == "send" || FLAGS_verb == "write") << "unknown verb: " << FLAGS_verb;
+	RDMA_ASSERT(FLAGS_wait_mode == "poll" || FLAGS_wait_mode == "event" || FLAGS_wait_mode == "adaptive")
+		<< "unknown wait mode: " << FLAGS_wait_mode;
+	RDMA_ASSERT(MemOptions::parse_type(FLAGS_mem_type)) << "unknown mem type: " << FLAGS_mem_type;
+	RDMA_ASSERT(!FLAGS_split_slots || !use_write_verb()) << "split slots only apply to the send verb";
+	RDMA_ASSERT(!FLAGS_framed || !use_write_verb()) << "framed records only apply to the send verb";
 
 	RCtrl ctrl(FLAGS_port);
 	RecvManager<entry_num> manager(ctrl);
@@ -139,72 +175,129 @@ int main(int argc, char **argv) {
 	RDMA_ASSERT(ctrl.opened_nics.reg(FLAGS_reg_mem_name, nic));
 	RDMA_ASSERT(ctrl.opened_nics.reg(FLAGS_reg_ack_mem_name, nic));
 
-	auto [recv_qp, recv_rs] = init_recv_queue(ctrl, nic, manager);
-	RDMA_LOG(INFO) << "Client Recv entries registered. Ready to receive messages!";
-
-	// Ensure client has setup ready for server to connect
-	sleep(3);
+	Arc<CompChannel> channel;
+	if (FLAGS_wait_mode != "poll") {
+		channel = CompChannel::create(nic).value();
+	}
+	// a framed record carries its header in front of the payload
+	usize max_slot_sz = FLAGS_max_slot_size + (FLAGS_framed ? sizeof(RecordHeader) : 0);
+	auto recv_alloc = SizeClassAllocator::create(nic, max_slot_sz, 2 * 1024 * 1024,
+		mem_options(FLAGS_mem_type, FLAGS_numa_node)).value();
+	init_recv_queue(ctrl, nic, manager, channel, recv_alloc);
+
+	auto [recv_qp, recv_rs] = wait_recv_qp(ctrl, manager, "client_qp");
+	vector<ibv_cq *> recv_cqs = {recv_qp->recv_cq};
+	// one cursor for the whole run: consumed recvs are re-posted in batches
+	RecvCursor<Dummy, entry_num> recv_cursor(recv_qp, recv_rs);
+
+	// with split slots, large messages arrive on a second QP with only a few big slots posted,
+	// so its cursor re-posts every consumed slot right away
+	unique_ptr<RecvCursor<Dummy, entry_num>> large_cursor;
+	if (FLAGS_split_slots) {
+		auto [large_qp, large_rs] = wait_recv_qp(ctrl, manager, "client_qp_large");
+		recv_cqs.push_back(large_qp->recv_cq);
+		large_cursor.reset(new RecvCursor<Dummy, entry_num>(large_qp, large_rs, 1));
+	}
+	AdaptiveWait recv_waiter(channel, recv_cqs, spin_budget_usec());
+	RDMA_LOG(INFO) << "Client Recv entries registered, " << recv_alloc->pinned_bytes()
+		<< " bytes of recv slots pinned. Ready to receive messages!";
 
 	auto [send_qp, local_mr] = init_send_queue(nic);
 	RDMA_LOG(INFO) << "rc server ready to send acknowledgements to the client!";
 
+	char *write_base = nullptr;
+	if (use_write_verb()) {
+		write_base = reinterpret_cast<char *>(
+		  ctrl.registered_mrs.query(FLAGS_reg_write_mem_name).value()->get_reg_attr().value().buf);
+	}
+
 	u64 recv_cnt = 0;
 	u64 send_cnt = 0;
 	u16 last_recvd_cnt = 0;
 	bool first_recv = true;
+	double cpu_begin = cpu_seconds();
+
+	// handles one message, returns false on the termination signal
+	auto handle_msg = [&](const pair<u32, RMem::raw_ptr_t> &imm_msg) -> bool {
+		int received_cnt = static_cast<int>(std::get<0>(imm_msg));
+		if (unlikely(received_cnt == 0)) {
+			// termination signal received
+			return false;
+		}
+		if (unlikely(received_cnt == -1)) {
+			// reset message
+			recv_cnt = 0;
+			send_cnt = 0;
+			last_recvd_cnt = 0;
+			first_recv = true;
+			cpu_begin = cpu_seconds();
+			return true;
+		}
+		auto buf = static_cast<char *>(std::get<1>(imm_msg));
+		// with the write verb the payload was placed in the slot picked by the counter
+		const char *payload = use_write_verb() ? write_base + write_slot_offset(received_cnt) : buf;
+		if (FLAGS_framed) {
+			auto header = reinterpret_cast<const RecordHeader *>(buf);
+			RDMA_ASSERT(header->seq == static_cast<u32>(received_cnt) && header->len == static_cast<u32>(FLAGS_msg_size + 1))
+				<< "bad record header: seq " << header->seq << ", len " << header->len;
+			payload = buf + sizeof(RecordHeader);
+		}
+		const std::string msg(payload, FLAGS_msg_size);  // wrap the received msg
+		recv_cnt++;
+
+		if (first_recv) {
+			RDMA_ASSERT(received_cnt == 1);
+			last_recvd_cnt = received_cnt;
+			send_cnt = received_cnt;
+			first_recv = false;
+		} else {
+			RDMA_ASSERT(received_cnt == last_recvd_cnt + 1);
+			send_cnt++;
+			last_recvd_cnt = received_cnt;
+		}
+
+		RDMA_ASSERT(recv_cnt == send_cnt);
+
+		// send acknowledgement
+		auto res_s = send_qp->send_normal(
+			{.op = IBV_WR_SEND_WITH_IMM,
+			 .flags = IBV_SEND_SIGNALED,
+			 .len = 0,
+			 .wr_id = 0},
+			{.local_addr = reinterpret_cast<RMem::raw_ptr_t>(buf),
+			 .remote_addr = 0,
+			 .imm_data = recv_cnt}); // message size 0, counter 0 => terminate
+		RDMA_ASSERT(res_s == IOCode::Ok);
+		auto res_p = send_qp->wait_rc_comp(); // confirming that message was sent successfully
+		RDMA_ASSERT(res_p == IOCode::Ok);
+		return true;
+	};
 
 	// receive all msgs.
 	bool terminate = false;
 	while (!terminate) {
-		for (RecvIter<Dummy, entry_num> iter(recv_qp, recv_rs); iter.has_msgs(); iter.next()) {
-			auto imm_msg = iter.cur_msg().value();
-			int received_cnt = static_cast<int>(std::get<0>(imm_msg));
-			if (unlikely(received_cnt == 0)) {
-				// termination signal received
-				terminate = true;
-				break;
-			}
-			if (unlikely(received_cnt == -1)) {
-				// reset message
-				recv_cnt = 0;
-				send_cnt = 0;
-				last_recvd_cnt = 0;
-				first_recv = true;
-				continue;
-			}
-			auto buf = static_cast<char *>(std::get<1>(imm_msg));
-			const std::string msg(buf, FLAGS_msg_size);  // wrap the received msg
-			recv_cnt++;
-
-			if (first_recv) {
-				RDMA_ASSERT(received_cnt == 1);
-				last_recvd_cnt = received_cnt;
-				send_cnt = received_cnt;
-				first_recv = false;
-			} else {
-				RDMA_ASSERT(received_cnt == last_recvd_cnt + 1);
-				send_cnt++;
-				last_recvd_cnt = received_cnt;
-			}
-
-			RDMA_ASSERT(recv_cnt == send_cnt);
-
-			// send acknowledgement
-			char* ack_buf = (char *) local_mr->get_reg_attr().value().buf;
-			auto res_s = send_qp->send_normal(
-				{.op = IBV_WR_SEND_WITH_IMM,
-				 .flags = IBV_SEND_SIGNALED,
-				 .len = 0,
-				 .wr_id = 0},
-				{.local_addr = reinterpret_cast<RMem::raw_ptr_t>(buf),
-				 .remote_addr = 0,
-				 .imm_data = recv_cnt}); // message size 0, counter 0 => terminate
-			RDMA_ASSERT(res_s == IOCode::Ok);
-			auto res_p = send_qp->wait_rc_comp(); // confirming that message was sent successfully
-			RDMA_ASSERT(res_p == IOCode::Ok);
+		int polled = recv_cursor.poll();
+		if (large_cursor) {
+			polled += large_cursor->poll();
+		}
+		if (polled == 0) {
+			recv_waiter.idle();
+			continue;
+		}
+		recv_waiter.reset();
+		// control messages (reset, terminate) always use the small QP, so draining it first keeps them in order
+		for (; !terminate && recv_cursor.has_msgs(); recv_cursor.next()) {
+			terminate = !handle_msg(recv_cursor.cur_msg().value());
+		}
+		for (; !terminate && large_cursor && large_cursor->has_msgs(); large_cursor->next()) {
+			terminate = !handle_msg(large_cursor->cur_msg().value());
 		}
 		RDMA_LOG(INFO) << recv_cnt <<", " <<  send_cnt;
 	}
+	if (recv_cnt > 0) {
+		RDMA_LOG(INFO) << "wait mode " << FLAGS_wait_mode << ": " << (cpu_seconds() - cpu_begin) / recv_cnt
+			<< " CPU-seconds/msg, slept " << recv_waiter.blocks << " times";
+	}
 	RDMA_LOG(INFO) << "Server shutting down";
 
 	return 0;
@@ -0,0 +1,128 @@
+#include <gflags/gflags.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "rlibv2/core/lib.hh"
+
+#include "bench_utils.hh"
+
+DEFINE_string(addr, "192.168.252.212:8888", "SRQ server address");
+DEFINE_int64(use_nic_idx, 0, "Which NIC to create QP");
+DEFINE_int64(reg_mem_name, 73, "The name of the NIC registered at the server");
+DEFINE_string(cq_name, "srq_channel", "The receive channel the server registered");
+DEFINE_int32(threads, 4, "Number of client threads");
+DEFINE_int32(qps_per_thread, 64, "Number of QPs (simulated clients) each thread drives");
+DEFINE_int32(qp_offset, 0, "Index of the first QP name, for running several client processes against one server");
+DEFINE_int64(msg_size, 64, "Size of every message, at most the server's max_recv_sz");
+DEFINE_int32(msgs_per_qp, 10000, "Number of messages sent on every QP");
+DEFINE_int32(batch, 8, "Messages posted on a QP before waiting for its signaled completion");
+
+using namespace rdmaio;
+using namespace rdmaio::rmem;
+using namespace rdmaio::qp;
+using namespace std;
+
+// the recv entries of srq_server's SRQ, and of each QP without it (enough for the largest batch)
+constexpr int srq_entries = 2048;
+constexpr usize qp_recv_entries = 64;
+
+struct ClientQP {
+	Arc<RC> qp;
+	std::string name;
+	u64 key = 0;
+};
+
+int main(int argc, char **argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+	RDMA_ASSERT(FLAGS_batch > 0 && FLAGS_batch <= static_cast<int>(qp_recv_entries)) << "batch must be in [1,64]";
+	// the messages beyond the SRQ's entries wait for RNR retries, which skews the comparison
+	RDMA_VERIFY(WARNING, FLAGS_threads * FLAGS_qps_per_thread * FLAGS_batch <= srq_entries)
+		<< FLAGS_threads * FLAGS_qps_per_thread * FLAGS_batch << " messages in flight, the server's SRQ holds "
+		<< srq_entries;
+
+	auto nic =
+	  RNic::create(RNicInfo::query_dev_names().at(FLAGS_use_nic_idx)).value();
+
+	std::atomic<int> ready(0);
+	std::atomic<bool> start(false);
+	std::atomic<u64> total_msgs(0);
+	vector<std::thread> workers;
+
+	for (int t = 0; t < FLAGS_threads; ++t) {
+		workers.emplace_back([&, t]() {
+			ConnectManager cm(FLAGS_addr);
+			if (cm.wait_ready(1000000, 4) == IOCode::Timeout) {
+				RDMA_LOG(WARNING) << "connect to the " << FLAGS_addr << " timeout!";
+			}
+
+			// one payload buffer serves all the QPs of this thread, the content is not checked
+			auto mem = Arc<RMem>(new RMem(FLAGS_msg_size));
+			auto mr = RegHandler::create(mem, nic).value();
+			auto attr = mr->get_reg_attr().value();
+
+			vector<ClientQP> qps;
+			for (int i = 0; i < FLAGS_qps_per_thread; ++i) {
+				int idx = FLAGS_qp_offset + t * FLAGS_qps_per_thread + i;
+				ClientQP c{RC::create(nic, QPConfig()).value(), "srq_qp_" + std::to_string(idx)};
+				auto qp_res = cm.cc_rc_msg(c.name, FLAGS_cq_name, FLAGS_msg_size, c.qp, FLAGS_reg_mem_name, QPConfig(),
+					1000000, qp_recv_entries);
+				RDMA_ASSERT(qp_res == IOCode::Ok) << std::get<0>(qp_res.desc);
+				c.key = std::get<1>(qp_res.desc);
+				qps.push_back(c);
+			}
+
+			ready.fetch_add(1);
+			while (!start.load()) {
+			}
+
+			// post a batch on every QP, then drain them, so all QPs of a thread are in flight together
+			u64 sent = 0;
+			for (int round = 0; round * FLAGS_batch < FLAGS_msgs_per_qp; ++round) {
+				int num = std::min(FLAGS_batch, FLAGS_msgs_per_qp - round * FLAGS_batch);
+				for (auto &c : qps) {
+					for (int i = 0; i < num; ++i) {
+						auto res_s = c.qp->send_normal(
+							{.op = IBV_WR_SEND_WITH_IMM,
+							 .flags = i == num - 1 ? IBV_SEND_SIGNALED : 0,
+							 .len = static_cast<u32>(FLAGS_msg_size),
+							 .wr_id = 0},
+							{.local_addr = mem->raw_ptr, .remote_addr = 0, .imm_data = 1},
+							attr, attr);
+						RDMA_ASSERT(res_s == IOCode::Ok) << res_s.desc;
+					}
+				}
+				for (auto &c : qps) {
+					auto res_p = c.qp->wait_rc_comp();
+					RDMA_ASSERT(res_p == IOCode::Ok);
+				}
+				sent += num * qps.size();
+			}
+			total_msgs.fetch_add(sent);
+
+			for (auto &c : qps) {
+				release_remote_qp(cm, c.name, c.key);
+			}
+		});
+	}
+
+	while (ready.load() != FLAGS_threads) {
+	}
+	long begin = now_nsec();
+	start.store(true);
+	for (auto &w : workers) {
+		w.join();
+	}
+	long elapsed = now_nsec() - begin;
+
+	int clients = FLAGS_threads * FLAGS_qps_per_thread;
+	double msgs_per_sec = static_cast<double>(total_msgs.load()) / elapsed * 1e9;
+	RDMA_LOG(INFO) << clients << " clients, " << FLAGS_msg_size << " B messages: " << msgs_per_sec << " msgs/s, "
+		<< msgs_per_sec * FLAGS_msg_size / (1024 * 1024) << " MiB/s";
+
+	appendResultRow(std::string(kResultsDir) + "srq_client.txt",
+		"clients\tmsg_size\tmsgs_per_sec",
+		std::to_string(clients) + "\t" + std::to_string(FLAGS_msg_size) + "\t" + std::to_string(msgs_per_sec));
+
+	return 0;
+}
@@ -0,0 +1,126 @@
+#include <gflags/gflags.h>
+#include <unordered_map>
+
+#include "rlibv2/core/lib.hh"
+#include "rlibv2/core/qps/rc_recv_manager.hh"
+
+#include "bench_utils.hh"
+
+DEFINE_int64(port, 8888, "Server listener (UDP) port.");
+DEFINE_int64(use_nic_idx, 0, "Which NIC to create QP");
+DEFINE_int64(reg_mem_name, 73, "The name to register the NIC at rctrl.");
+DEFINE_string(cq_name, "srq_channel", "The name to register the receive channel");
+DEFINE_bool(use_srq, true, "Share one SRQ among all client QPs; otherwise every QP gets its own recv entries");
+DEFINE_int32(max_clients, 256, "Maximum number of client QPs (srq_qp_0 .. srq_qp_{max_clients-1})");
+DEFINE_int64(max_recv_sz, 1024, "Size of every recv buffer, clients must not send larger messages");
+
+using namespace rdmaio;
+using namespace rdmaio::rmem;
+using namespace rdmaio::qp;
+using namespace std;
+
+// recv entries of the SRQ, the most a RecvManager allows. Every message the clients keep in flight
+// holds one, srq_client defaults to 4 threads x 64 QPs x batch 8 = 2048
+constexpr usize entry_num = 2048;
+// without the SRQ, recv buffers of every QP: srq_client asks for this many (its largest batch)
+constexpr usize qp_recv_bufs = 64;
+constexpr usize recv_cq_depth = 8192;
+constexpr usize poll_batch = 64;
+
+struct ClientQP {
+	Arc<RC> qp;
+	Arc<RecvEntries<entry_num>> entries;
+};
+
+int main(int argc, char **argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+	RCtrl ctrl(FLAGS_port);
+	RecvManager<entry_num> manager(ctrl);
+	auto nic =
+	  RNic::create(RNicInfo::query_dev_names().at(FLAGS_use_nic_idx)).value();
+	RDMA_ASSERT(ctrl.opened_nics.reg(FLAGS_reg_mem_name, nic));
+
+	auto recv_cq_res = ::rdmaio::qp::Impl::create_cq(nic, recv_cq_depth);
+	RDMA_ASSERT(recv_cq_res == IOCode::Ok);
+	auto recv_cq = std::get<0>(recv_cq_res.desc);
+
+	// the SRQ pins one pool of recv buffers, otherwise each client QP pins its own
+	u64 pinned = FLAGS_max_recv_sz * (FLAGS_use_srq ? entry_num : qp_recv_bufs * FLAGS_max_clients);
+	auto recv_mem = Arc<RMem>(new RMem(pinned));
+	auto recv_mr = RegHandler::create(recv_mem, nic).value();
+	Arc<AbsRecvAllocator> alloc = std::make_shared<SimpleAllocator>(recv_mem, recv_mr->get_reg_attr().value().key);
+
+	Arc<RecvSRQ<entry_num>> srq;
+	if (FLAGS_use_srq) {
+		srq = RecvSRQ<entry_num>::create(nic, recv_cq, alloc, FLAGS_max_recv_sz).value();
+		RDMA_ASSERT(manager.reg_recv_srqs.reg(FLAGS_cq_name, srq));
+	} else {
+		manager.reg_recv_cqs.create_then_reg(FLAGS_cq_name, recv_cq, alloc);
+	}
+
+	ClientTable<ClientQP, entry_num> clients(ctrl, manager, "srq_qp_", FLAGS_cq_name,
+		[](int id, Arc<RC> qp, Arc<RecvEntries<entry_num>> entries) -> Option<ClientQP> {
+			if (id >= FLAGS_max_clients) {
+				return {};
+			}
+			return ClientQP{qp, entries};
+		});
+
+	ctrl.start_daemon();
+	RDMA_LOG(INFO) << "srq server ready: channel " << FLAGS_cq_name << (FLAGS_use_srq ? " (srq)" : " (per-QP recvs)")
+		<< ", " << pinned / (1024 * 1024) << " MiB of recv buffers pinned";
+
+	unordered_map<u32, u64> active;
+	ibv_wc wcs[poll_batch];
+
+	// a run lasts from the first message until the channel has been idle for a second
+	u64 msgs = 0, bytes = 0;
+	long first = 0, last = 0;
+
+	while (true) {
+		int n = ibv_poll_cq(recv_cq, poll_batch, wcs);
+		RDMA_ASSERT(n >= 0) << "poll recv cq error";
+
+		if (n == 0) {
+			if (msgs > 0 && now_nsec() - last > 1000000000L) {
+				double elapsed = static_cast<double>(std::max(last - first, 1L));
+				double msgs_per_sec = msgs / elapsed * 1e9;
+				double mb_per_sec = bytes / elapsed * 1e9 / (1024 * 1024);
+				long rss = vm_rss_kb();
+				RDMA_LOG(INFO) << active.size() << " clients: " << msgs_per_sec << " msgs/s, " << mb_per_sec
+					<< " MiB/s, pinned " << pinned / 1024 << " KiB, VmRSS " << rss << " KiB";
+				appendResultRow(std::string(kResultsDir) + "srq_" + (FLAGS_use_srq ? "shared" : "per_qp") + ".txt",
+					"clients\tmax_recv_sz\tmsgs_per_sec\tmb_per_sec\tpinned_kb\tvm_rss_kb",
+					std::to_string(active.size()) + "\t" + std::to_string(FLAGS_max_recv_sz) + "\t" +
+					std::to_string(msgs_per_sec) + "\t" + std::to_string(mb_per_sec) + "\t" +
+					std::to_string(pinned / 1024) + "\t" + std::to_string(rss));
+				msgs = bytes = 0;
+				active.clear();
+			}
+			continue;
+		}
+
+		last = now_nsec();
+		first = msgs == 0 ? last : first;
+		for (int i = 0; i < n; ++i) {
+			RDMA_ASSERT(wcs[i].status == IBV_WC_SUCCESS) << Dummy::wc_status(wcs[i]);
+			msgs += 1;
+			bytes += wcs[i].byte_len;
+			active[wcs[i].qp_num] += 1;
+
+			if (!FLAGS_use_srq) {
+				auto client = clients.find(wcs[i].qp_num);
+				RDMA_ASSERT(client != nullptr) << "unknown qp: " << wcs[i].qp_num;
+				repost_consumed(*client->qp, *client->entries);
+			}
+		}
+
+		if (FLAGS_use_srq) {
+			auto res_r = srq->repost(wcs, n);
+			RDMA_ASSERT(res_r == IOCode::Ok);
+		}
+	}
+
+	return 0;
+}
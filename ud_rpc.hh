@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+
+#include "rlibv2/core/common.hh"
+
+/*!
+  Wire format and names shared by ud_rpc_server and ud_rpc_client.
+  Every request starts with an RpcHeader and is answered by a response that
+  echoes it, over either one UD QP shared by all clients or one RC QP per
+  client.
+ */
+
+struct __attribute__((packed)) RpcHeader {
+	rdmaio::u32 client_id;
+	// a retried request keeps its id: a late response to an earlier try is accepted as its answer,
+	// only responses to earlier (given up) requests are dropped
+	rdmaio::u32 req_id;
+};
+
+// the server's UD QP, registered at its RCtrl so that clients can fetch its attr
+constexpr const char *kUdRpcServerQP = "ud_rpc_server";
+
+// requests and responses fit in one UD packet (UD::kMaxMsgSz), so both transports carry the same sizes
+constexpr rdmaio::usize ud_rpc_max_msg_sz = 4000;
+
+// recv entries of each RC QP (on both sides)
+constexpr rdmaio::usize ud_rpc_rc_entry_num = 64;
+
+// the server QP of RC client i is named <kUdRpcRCPrefix><i>
+constexpr const char *kUdRpcRCPrefix = "ud_rpc_rc_";
+
+inline std::string ud_rpc_rc_name(int client_id) {
+	return kUdRpcRCPrefix + std::to_string(client_id);
+}
@@ -0,0 +1,257 @@
+#include <gflags/gflags.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "rlibv2/core/lib.hh"
+#include "rlibv2/core/qps/recv_cursor.hh"
+#include "rlibv2/core/qps/size_class_allocator.hh"
+#include "rlibv2/core/qps/ud.hh"
+
+#include "bench_utils.hh"
+#include "ud_rpc.hh"
+
+DEFINE_string(addr, "192.168.252.212:8888", "UD rpc server address");
+DEFINE_int64(use_nic_idx, 0, "Which NIC to create QP");
+DEFINE_int32(gid_idx, 0, "GID index of the NIC (RoCE v2 GIDs are often 1 or 3)");
+DEFINE_int64(reg_mem_name, 73, "The name of the NIC registered at the server");
+DEFINE_string(cq_name, "ud_rpc_channel", "The receive channel the server registered for RC clients");
+DEFINE_string(transport, "ud", "ud (datagrams to the server's one UD QP) or rc (one connected QP per client)");
+DEFINE_int32(clients, 1, "Number of client threads in this process, each owning one QP");
+DEFINE_int32(client_offset, 0, "Id of the first client, for running several client processes against one server");
+DEFINE_int32(msg_size, 64, "Size of each request, including the rpc header (at most 4000, one UD packet)");
+DEFINE_int32(reqs_per_client, 100000, "Number of requests each client issues");
+DEFINE_int64(timeout_usec, 1000, "UD only: a request without response after this long is sent again");
+DEFINE_int32(max_retries, 10, "UD only: a request is given up (counted as lost) after this many retries");
+
+using namespace rdmaio;
+using namespace rdmaio::rmem;
+using namespace rdmaio::qp;
+using namespace std;
+
+constexpr usize entry_num = ud_rpc_rc_entry_num;
+// sends are signaled once per batch so the send queue is drained without waiting on every request
+constexpr u64 signal_batch = 16;
+
+/**
+ * One closed-loop rpc client: one request in flight, over either transport
+ */
+class RpcClient {
+	const u32 id;
+	Arc<RegHandler> req_mr;
+	RegAttr req_attr;
+	u32 next_req = 0;
+	u64 sends = 0;
+
+	// ud
+	Arc<UD> ud;
+	unique_ptr<UDAHCache> ahs;
+	QPAttr server_attr;
+	ibv_ah *server_ah = nullptr;
+	Arc<RecvEntries<entry_num>> ud_entries;
+	unique_ptr<RecvCursor<UD, entry_num>> ud_cursor;
+
+	// rc
+	Arc<RC> rc;
+	u64 rc_key = 0;
+	Arc<RecvEntries<entry_num>> rc_entries;
+	unique_ptr<RecvCursor<RC, entry_num>> rc_cursor;
+
+	void send_req() {
+		sends += 1;
+		bool signaled = sends % signal_batch == 0;
+		int flags = signaled ? IBV_SEND_SIGNALED : 0;
+		if (ud) {
+			auto res_s = ud->send_to(server_ah, server_attr.qpn,
+				{.addr = req_attr.buf, .length = static_cast<u32>(FLAGS_msg_size), .lkey = req_attr.lkey}, flags);
+			RDMA_ASSERT(res_s == IOCode::Ok) << res_s.desc;
+			if (signaled) {
+				auto res_p = ud->wait_one_comp();
+				RDMA_ASSERT(res_p == IOCode::Ok) << Dummy::wc_status(res_p.desc);
+			}
+			return;
+		}
+		auto res_s = rc->send_normal(
+			{.op = IBV_WR_SEND,
+			 .flags = flags,
+			 .len = static_cast<u32>(FLAGS_msg_size),
+			 .wr_id = 0},
+			{.local_addr = reinterpret_cast<RMem::raw_ptr_t>(req_attr.buf),
+			 .remote_addr = 0,
+			 .imm_data = 0},
+			req_attr, req_attr);
+		RDMA_ASSERT(res_s == IOCode::Ok) << res_s.desc;
+		if (signaled) {
+			auto res_p = rc->wait_rc_comp();
+			RDMA_ASSERT(res_p == IOCode::Ok);
+		}
+	}
+
+	/**
+	 * Consumes the received responses, returns whether the one of `req_id` is among them
+	 */
+	template <typename QP>
+	bool poll_resp(RecvCursor<QP, entry_num> &cursor, usize hdr_off, u32 req_id) {
+		bool found = false;
+		for (cursor.poll(); cursor.has_msgs(); cursor.next()) {
+			RDMA_ASSERT(cursor.cur_wc().status == IBV_WC_SUCCESS) << Dummy::wc_status(cursor.cur_wc());
+			auto resp = reinterpret_cast<const RpcHeader *>(
+				static_cast<char *>(std::get<1>(cursor.cur_msg().value())) + hdr_off);
+			// responses to requests given up earlier are dropped
+			found = found || (resp->client_id == id && resp->req_id == req_id);
+		}
+		return found;
+	}
+
+	public:
+	u64 retries = 0;
+	u64 lost = 0;
+
+	RpcClient(Arc<RNic> &nic, u32 id) : id(id) {
+		req_mr = RegHandler::create(Arc<RMem>(new RMem(FLAGS_msg_size)), nic).value();
+		req_attr = req_mr->get_reg_attr().value();
+		memset(reinterpret_cast<char *>(req_attr.buf), 'x', FLAGS_msg_size);
+
+		ConnectManager cm(FLAGS_addr);
+		if (cm.wait_ready(1000000, 4) == IOCode::Timeout) {
+			RDMA_LOG(WARNING) << "connect to the " << FLAGS_addr << " timeout!";
+		}
+		Arc<AbsRecvAllocator> alloc = SizeClassAllocator::create(nic).value();
+
+		if (FLAGS_transport == "ud") {
+			ud = UD::create(nic, QPConfig()).value();
+			auto fetch_res = cm.fetch_qp_attr(kUdRpcServerQP);
+			RDMA_ASSERT(fetch_res == IOCode::Ok) << std::get<0>(fetch_res.desc);
+			server_attr = std::get<1>(fetch_res.desc);
+			ahs.reset(new UDAHCache(ud));
+			server_ah = ahs->query(server_attr);
+			RDMA_ASSERT(server_ah != nullptr) << "failed to create the ah of the server";
+
+			// a response lands after the GRH
+			ud_entries = RecvEntriesFactoryv2<entry_num>::create(alloc, kGRHSz + ud->kMaxMsgSz).value();
+			auto res = ud->post_recvs(*ud_entries, entry_num);
+			RDMA_ASSERT(res == IOCode::Ok);
+			ud_cursor.reset(new RecvCursor<UD, entry_num>(ud, ud_entries));
+			return;
+		}
+
+		auto recv_cq_res = ::rdmaio::qp::Impl::create_cq(nic, entry_num);
+		RDMA_ASSERT(recv_cq_res == IOCode::Ok);
+		rc = RC::create(nic, QPConfig(), std::get<0>(recv_cq_res.desc)).value();
+		auto qp_res = cm.cc_rc_msg(ud_rpc_rc_name(id), FLAGS_cq_name, FLAGS_msg_size, rc, FLAGS_reg_mem_name,
+			QPConfig());
+		RDMA_ASSERT(qp_res == IOCode::Ok) << std::get<0>(qp_res.desc);
+		rc_key = std::get<1>(qp_res.desc);
+
+		rc_entries = RecvEntriesFactoryv2<entry_num>::create(alloc, ud_rpc_max_msg_sz).value();
+		auto res = rc->post_recvs(*rc_entries, entry_num);
+		RDMA_ASSERT(res == IOCode::Ok);
+		rc_cursor.reset(new RecvCursor<RC, entry_num>(rc, rc_entries));
+	}
+
+	~RpcClient() {
+		// flush the cursors before the QPs and entries they point to go away
+		ud_cursor.reset();
+		rc_cursor.reset();
+		if (rc) {
+			release_remote_qp(FLAGS_addr, ud_rpc_rc_name(id), rc_key);
+		}
+	}
+
+	/**
+	 * Issues one request and waits for its response, retrying (UD) on timeout
+	 * \ret false if the request was lost
+	 */
+	bool call() {
+		auto req = reinterpret_cast<RpcHeader *>(req_attr.buf);
+		req->client_id = id;
+		req->req_id = ++next_req;
+		send_req();
+
+		Timer t;
+		int tries = 0;
+		while (true) {
+			if (ud ? poll_resp(*ud_cursor, kGRHSz, req->req_id) : poll_resp(*rc_cursor, 0, req->req_id)) {
+				return true;
+			}
+			// passed_msec() is measured in microseconds
+			if (ud && t.passed_msec() > FLAGS_timeout_usec) {
+				if (tries == FLAGS_max_retries) {
+					lost += 1;
+					return false;
+				}
+				tries += 1;
+				retries += 1;
+				send_req();
+				t.reset();
+			}
+		}
+	}
+};
+
+int main(int argc, char **argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+	RDMA_ASSERT(FLAGS_transport == "ud" || FLAGS_transport == "rc") << "unknown transport: " << FLAGS_transport;
+	RDMA_ASSERT(FLAGS_msg_size >= static_cast<int>(sizeof(RpcHeader)) &&
+		FLAGS_msg_size <= static_cast<int>(ud_rpc_max_msg_sz))
+		<< "a request must hold the rpc header and fit in one UD packet";
+
+	auto nic =
+	  RNic::create(RNicInfo::query_dev_names().at(FLAGS_use_nic_idx), FLAGS_gid_idx).value();
+
+	vector<vector<long>> latencies(FLAGS_clients);
+	vector<u64> retries(FLAGS_clients, 0), lost(FLAGS_clients, 0);
+	std::atomic<int> ready(0);
+	std::atomic<bool> start(false);
+	vector<std::thread> workers;
+
+	for (int t = 0; t < FLAGS_clients; ++t) {
+		workers.emplace_back([&, t]() {
+			RpcClient client(nic, FLAGS_client_offset + t);
+			latencies[t].reserve(FLAGS_reqs_per_client);
+
+			ready.fetch_add(1);
+			while (!start.load()) {
+			}
+			for (int i = 0; i < FLAGS_reqs_per_client; ++i) {
+				long begin = now_nsec();
+				if (client.call()) {
+					latencies[t].push_back(now_nsec() - begin);
+				}
+			}
+			retries[t] = client.retries;
+			lost[t] = client.lost;
+		});
+	}
+
+	while (ready.load() != FLAGS_clients) {
+	}
+	long begin = now_nsec();
+	start.store(true);
+	for (auto &w : workers) {
+		w.join();
+	}
+	long elapsed = now_nsec() - begin;
+
+	vector<long> all;
+	u64 total_retries = 0, total_lost = 0;
+	for (int t = 0; t < FLAGS_clients; ++t) {
+		all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+		total_retries += retries[t];
+		total_lost += lost[t];
+	}
+	double reqs_per_sec = static_cast<double>(all.size()) / elapsed * 1e9;
+	auto summary = LatencySummary::from(all);
+	RDMA_LOG(INFO) << FLAGS_transport << ", " << FLAGS_clients << " clients, " << FLAGS_msg_size << " B: "
+		<< reqs_per_sec << " reqs/s, p50 " << summary.p50 << " ns, p99 " << summary.p99 << " ns, "
+		<< total_retries << " retries, " << total_lost << " lost";
+
+	appendResultRow(std::string(kResultsDir) + "ud_rpc.txt",
+		"transport\tclients\tmsg_size\treqs_per_sec\tretries\tlost\t" + LatencySummary::header(),
+		FLAGS_transport + "\t" + std::to_string(FLAGS_clients) + "\t" + std::to_string(FLAGS_msg_size) + "\t" +
+		std::to_string(reqs_per_sec) + "\t" + std::to_string(total_retries) + "\t" + std::to_string(total_lost) +
+		"\t" + summary.row());
+
+	return 0;
+}
@@ -0,0 +1,209 @@
+#include <gflags/gflags.h>
+#include <vector>
+
+#include "rlibv2/core/lib.hh"
+#include "rlibv2/core/qps/rc_recv_manager.hh"
+#include "rlibv2/core/qps/recv_cursor.hh"
+#include "rlibv2/core/qps/size_class_allocator.hh"
+#include "rlibv2/core/qps/ud.hh"
+
+#include "bench_utils.hh"
+#include "ud_rpc.hh"
+
+DEFINE_int64(port, 8888, "Server listener (UDP) port.");
+DEFINE_int64(use_nic_idx, 0, "Which NIC to create QP");
+DEFINE_int32(gid_idx, 0, "GID index of the NIC (RoCE v2 GIDs are often 1 or 3)");
+DEFINE_int64(reg_mem_name, 73, "The name to register the NIC at rctrl");
+DEFINE_string(cq_name, "ud_rpc_channel", "The receive channel of the RC clients");
+DEFINE_int32(max_clients, 4096, "Maximum number of RC clients (ud_rpc_rc_0 .. ud_rpc_rc_{max_clients-1})");
+DEFINE_int32(resp_size, 32, "Size of each response, including the rpc header");
+
+using namespace rdmaio;
+using namespace rdmaio::rmem;
+using namespace rdmaio::qp;
+using namespace std;
+
+constexpr usize ud_entry_num = 1024;
+constexpr usize rc_cq_depth = 8192;
+constexpr usize poll_batch = 64;
+// each QP takes its responses from a ring of this many slots, so that a slot is not reused
+// before the (unsignaled) send from it is done
+constexpr u64 resp_ring_sz = 2 * kReplySignalBatch;
+
+struct RCClient {
+	Arc<RC> qp;
+	Arc<RecvEntries<ud_rpc_rc_entry_num>> entries;
+	// index of the client's response ring
+	u32 ring = 0;
+	u64 replies = 0;
+};
+
+/**
+ * Serves the requests of both transports from one thread: the UD QP shared by all
+ * UD clients, and one RC QP per RC client on a shared recv cq
+ */
+class RpcServer {
+	Arc<UD> ud;
+	Arc<RecvEntries<ud_entry_num>> ud_entries;
+	UDAHCache ahs;
+	u64 ud_replies = 0;
+
+	ibv_cq *rc_cq = nullptr;
+	// clients deleted with delete_remote_rc are dropped
+	ClientTable<RCClient, ud_rpc_rc_entry_num> rc_clients;
+
+	Arc<RegHandler> resp_mr;
+	RegAttr resp_attr;
+
+	/**
+	 * Fills the response to `req` in the next slot of a response ring and returns its sge
+	 */
+	ibv_sge make_resp(const RpcHeader *req, u32 ring, u64 seq) {
+		u64 addr = resp_attr.buf + (ring * resp_ring_sz + seq % resp_ring_sz) * FLAGS_resp_size;
+		*reinterpret_cast<RpcHeader *>(addr) = *req;
+		return {.addr = addr, .length = static_cast<u32>(FLAGS_resp_size), .lkey = resp_attr.lkey};
+	}
+
+	public:
+	u64 msgs = 0;
+
+	RpcServer(RCtrl &ctrl, RecvManager<ud_rpc_rc_entry_num> &manager, Arc<RNic> &nic)
+		: ud(UD::create(nic, QPConfig()).value()), ahs(ud),
+		  rc_clients(ctrl, manager, kUdRpcRCPrefix, FLAGS_cq_name,
+			  [](int id, Arc<RC> qp, Arc<RecvEntries<ud_rpc_rc_entry_num>> entries) -> Option<RCClient> {
+				  if (id >= FLAGS_max_clients) {
+					  return {};
+				  }
+				  // ring 0 is used by the UD QP
+				  return RCClient{qp, entries, static_cast<u32>(id + 1)};
+			  }) {
+		RDMA_ASSERT(ctrl.registered_qps.reg(kUdRpcServerQP, ud));
+
+		// every UD recv buffer holds the GRH followed by at most one packet of payload
+		Arc<AbsRecvAllocator> alloc = SizeClassAllocator::create(nic).value();
+		ud_entries = RecvEntriesFactoryv2<ud_entry_num>::create(alloc, kGRHSz + ud->kMaxMsgSz).value();
+		auto res = ud->post_recvs(*ud_entries, ud_entry_num);
+		RDMA_ASSERT(res == IOCode::Ok);
+
+		auto rc_cq_res = ::rdmaio::qp::Impl::create_cq(nic, rc_cq_depth);
+		RDMA_ASSERT(rc_cq_res == IOCode::Ok);
+		rc_cq = std::get<0>(rc_cq_res.desc);
+		manager.reg_recv_cqs.create_then_reg(FLAGS_cq_name, rc_cq, alloc);
+
+		resp_mr = RegHandler::create(
+			Arc<RMem>(new RMem((FLAGS_max_clients + 1) * resp_ring_sz * FLAGS_resp_size)), nic).value();
+		resp_attr = resp_mr->get_reg_attr().value();
+	}
+
+	usize num_rc_clients() {
+		return rc_clients.size();
+	}
+
+	usize num_ahs() const {
+		return ahs.size();
+	}
+
+	/**
+	 * Serves one batch of UD requests, the recvs are replenished by the cursor
+	 */
+	void poll_ud(RecvCursor<UD, ud_entry_num> &cursor) {
+		for (cursor.poll(); cursor.has_msgs(); cursor.next()) {
+			auto &wc = cursor.cur_wc();
+			RDMA_ASSERT(wc.status == IBV_WC_SUCCESS) << Dummy::wc_status(wc);
+			auto buf = static_cast<char *>(std::get<1>(cursor.cur_msg().value()));
+			auto req = reinterpret_cast<const RpcHeader *>(buf + kGRHSz);
+
+			auto ah = ahs.query_from_wc(wc, buf);
+			RDMA_ASSERT(ah != nullptr) << "failed to create the ah of qp " << wc.src_qp;
+			ud_replies += 1;
+			bool signaled = ud_replies % kReplySignalBatch == 0;
+			auto res_s = ud->send_to(ah, wc.src_qp, make_resp(req, 0, ud_replies), signaled ? IBV_SEND_SIGNALED : 0);
+			RDMA_ASSERT(res_s == IOCode::Ok) << res_s.desc;
+			if (signaled) {
+				auto res_p = ud->wait_one_comp();
+				RDMA_ASSERT(res_p == IOCode::Ok) << Dummy::wc_status(res_p.desc);
+			}
+			msgs += 1;
+		}
+	}
+
+	/**
+	 * Serves one batch of RC requests, replying on the QP they came from
+	 */
+	void poll_rc() {
+		ibv_wc wcs[poll_batch];
+		int n = ibv_poll_cq(rc_cq, poll_batch, wcs);
+		RDMA_ASSERT(n >= 0) << "poll rc cq error";
+		for (int i = 0; i < n; ++i) {
+			RDMA_ASSERT(wcs[i].status == IBV_WC_SUCCESS) << Dummy::wc_status(wcs[i]);
+			auto client_p = rc_clients.find(wcs[i].qp_num);
+			RDMA_ASSERT(client_p != nullptr) << "unknown qp: " << wcs[i].qp_num;
+			auto &client = *client_p;
+			auto req = reinterpret_cast<const RpcHeader *>(wcs[i].wr_id);
+
+			client.replies += 1;
+			bool signaled = client.replies % kReplySignalBatch == 0;
+			auto sge = make_resp(req, client.ring, client.replies);
+			auto res_s = client.qp->send_normal(
+				{.op = IBV_WR_SEND,
+				 .flags = signaled ? IBV_SEND_SIGNALED : 0,
+				 .len = sge.length,
+				 .wr_id = 0},
+				{.local_addr = reinterpret_cast<RMem::raw_ptr_t>(sge.addr),
+				 .remote_addr = 0,
+				 .imm_data = 0},
+				resp_attr, resp_attr);
+			RDMA_ASSERT(res_s == IOCode::Ok) << res_s.desc;
+			if (signaled) {
+				auto res_p = client.qp->wait_rc_comp();
+				RDMA_ASSERT(res_p == IOCode::Ok);
+			}
+
+			repost_consumed(*client.qp, *client.entries);
+			msgs += 1;
+		}
+	}
+
+	Arc<UD> &ud_qp() {
+		return ud;
+	}
+
+	Arc<RecvEntries<ud_entry_num>> &ud_recv_entries() {
+		return ud_entries;
+	}
+};
+
+int main(int argc, char **argv) {
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+	RDMA_ASSERT(FLAGS_resp_size >= static_cast<int>(sizeof(RpcHeader)) &&
+		FLAGS_resp_size <= static_cast<int>(ud_rpc_max_msg_sz))
+		<< "a response must hold the rpc header and fit in one UD packet";
+
+	RCtrl ctrl(FLAGS_port);
+	RecvManager<ud_rpc_rc_entry_num> manager(ctrl);
+	auto nic =
+	  RNic::create(RNicInfo::query_dev_names().at(FLAGS_use_nic_idx), FLAGS_gid_idx).value();
+	RDMA_ASSERT(ctrl.opened_nics.reg(FLAGS_reg_mem_name, nic));
+
+	RpcServer server(ctrl, manager, nic);
+	RecvCursor<UD, ud_entry_num> ud_cursor(server.ud_qp(), server.ud_recv_entries());
+	ctrl.start_daemon();
+	RDMA_LOG(INFO) << "ud rpc server ready";
+
+	// per-second rate and the connection state held for the clients
+	Timer report_timer;
+	u64 last = 0;
+	while (true) {
+		server.poll_ud(ud_cursor);
+		server.poll_rc();
+
+		if (report_timer.passed_sec() >= 1) {
+			RDMA_LOG(INFO) << server.msgs - last << " reqs/s, QPs: 1 UD + " << server.num_rc_clients()
+				<< " RC, " << server.num_ahs() << " AHs, RSS " << vm_rss_kb() << " KiB";
+			last = server.msgs;
+			report_timer.reset();
+		}
+	}
+
+	return 0;
+}